@@ -0,0 +1,721 @@
+//文件名: client/app_bench_client.c
+//
+//描述: 这是基准测试版本的客户端程序代码. 客户端首先连接到本地SIP进程, 然后它调用stcp_client_init()初始化STCP客户端.
+//它根据命令行参数选择测试模式:
+//  conns: 客户端调用stcp_client_setmaxconn()放开连接数上限, 然后由BENCH_THREADS个线程并发地创建n个套接字,
+//         第i个套接字使用客户端端口号CLIENTPORTBASE+i, 连接到服务器端口号SERVERPORTBASE+i, 并发送它的序号i.
+//         所有连接同时保持打开, 经过一段时间后, 客户端断开所有连接并关闭套接字.
+//  fanin: n个线程从客户端端口号CLIENTPORTBASE+i同时连接到同一个服务器端口号SERVERPORTBASE, 各自用stcp_client_sendv()上传
+//         自己的序号和FANIN_BYTES字节, 模拟多个节点向一个收集者上传数据. 经过一段时间后, 客户端报告各连接的平均SRTT, 最小往返时间, 两者之差即排队延迟,
+//         以及重传的DATA段的比例, 然后断开所有连接并关闭套接字. 第四个参数为nopace时, 所有连接关闭步调发送, 用于对比.
+//  epoll: 与fanin相同, 但所有套接字都使用非阻塞模式, 由主线程通过epoll等待套接字的eventfd来连接, 发送和断开.
+//  streams: 与fanin相同的n次上传, 但它们在同一个连接内的n个流上进行, 每个流用stcp_client_stream_open()打开, 不需要握手.
+//         服务器收到所有上传后在流0上回送一个字节, 客户端然后关闭流并断开连接.
+//  pingpong: 客户端在一个连接上发送n个PINGPONG_BYTES字节的请求, 每次都用stcp_client_recv()等待服务器回送的响应,
+//         然后报告每秒往返次数, 以及两个方向上的DATA段, 单独的DATAACK和捎带在DATA中的确认的数量.
+//  msgpong: 与pingpong相同, 但第r个请求是长度在1到MSGPONG_BYTES之间变化的消息, 由stcp_client_send_msg()发出,
+//         响应由stcp_client_recv_msg()读入它分配的缓冲区, 双方都不需要发送和读出消息长度.
+//  oneshot: 客户端依次建立n个短连接, 第i个连接使用客户端端口号CLIENTPORTBASE+i. 每个连接发送一个ONESHOT_BYTES字节的请求,
+//         等待服务器回送的响应后断开. 报告从开始连接到收到响应的平均延迟和延迟分布.
+//  fastopen: 与oneshot相同, 但请求由stcp_client_connect_data()随SYN发出. 第一个连接只得到cookie, 此后的连接节省一次往返.
+//  soak: 客户端在一个连接上上传n MB(默认DEFAULT_SOAK_MB, 即20GB)数据, 先发送8字节的长度, 然后使用非阻塞模式, 在发送缓冲区满时等待
+//         套接字的eventfd, 所以内存占用不随上传长度增长. 数据的每个64位字由它的字节偏移生成, 服务器据此校验并报告吞吐量.
+//         上传超过4GB时序号回绕, 客户端最后报告吞吐量和服务器回送的校验结果.
+//  fec: 与pingpong相同, 但请求是FEC_BYTES字节, 连接用STCP_OPT_FEC请求前向纠错. 报告两个方向合计的有效吞吐量,
+//         往返时间的中位数, p99和最大值, 以及双方发出的校验段和恢复的段数. 第四个参数为nofec时不请求前向纠错, 只靠超时重传恢复丢包,
+//         用于在有丢包的路径上对比.
+//  bulk: 与soak相同, 但默认上传DEFAULT_BULK_MB, 连接用STCP_OPT_RATE请求速率模式, 并且不由seglost()注入丢包, 丢包和延迟由
+//         路径模拟器pathemu产生. 结束时还报告SRTT, 最小往返时间, 重传的段的比例和最终的发送速率. 第四个参数为norate时使用拥塞窗口,
+//         用于对比. pathemu/sweep.sh用它在不同的丢包率和跳数下比较两种模式.
+//  tclass: 客户端用流量类别TC_BULK, 使用速率模式的连接向服务器端口SERVERPORTBASE持续上传, 等待TCLASS_WARMUP_MS毫秒让它占满路径后,
+//         在类别为TC_INTERACTIVE的另一个连接上向服务器端口SERVERPORTBASE+1依次发送n个PINGPONG_BYTES字节的请求并等待回送.
+//         报告请求往返时间的中位数, p99和最大值, 以及同一时间内批量上传的吞吐量. 第四个参数为noclass时两个连接都使用TC_DEFAULT,
+//         用于对比. 丢包和延迟由路径模拟器pathemu产生, pathemu/tcbench.sh用它比较先进先出和按类别调度的瓶颈.
+//最后, 客户端断开到本地SIP进程的连接.
+
+//输入: 服务器名 测试模式 [连接数, 往返次数或MB数 [nopace|nofec|norate|noclass]]
+
+//输出: STCP客户端状态和测试结果
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include "../common/constants.h"
+#include "../common/seg.h"
+#include "../topology/topology.h"
+#include "stcp_client.h"
+
+//第i个连接使用客户端端口号CLIENTPORTBASE+i和服务器端口号SERVERPORTBASE+i.
+#define CLIENTPORTBASE 20000
+#define SERVERPORTBASE 1000
+//conns模式的默认连接数.
+#define DEFAULT_CONNS 10000
+//fanin模式的默认客户端数和每个客户端上传的字节数.
+#define DEFAULT_FANIN 16
+#define FANIN_BYTES 65536
+//pingpong模式的默认往返次数和请求的字节数.
+#define DEFAULT_PINGPONG 1000
+#define PINGPONG_BYTES 64
+//msgpong模式中消息的最大长度.
+#define MSGPONG_BYTES 4096
+//oneshot和fastopen模式的默认连接数和请求的字节数.
+#define DEFAULT_ONESHOT 200
+#define ONESHOT_BYTES 512
+//fec模式的默认往返次数和请求的字节数.
+#define DEFAULT_FEC_ROUNDS 200
+#define FEC_BYTES (8 * MAX_SEG_LEN)
+//tclass模式的默认请求数, 以及批量上传开始后等待它占满路径的毫秒数.
+#define DEFAULT_TCLASS_ROUNDS 200
+#define TCLASS_WARMUP_MS 2000
+//同时建立和断开连接的线程数.
+#define BENCH_THREADS 64
+//每个连接调用stcp_client_connect()的最多次数.
+#define CONNECT_TRIES 3
+
+//soak模式默认上传的MB数, 20GB.
+#define DEFAULT_SOAK_MB 20480
+//bulk模式默认上传的MB数.
+#define DEFAULT_BULK_MB 8
+//soak模式每次调用stcp_client_send()发送的字节数, 是64位字的整数倍, 且不超过SEND_BUF_SEGS个段.
+#define SOAK_CHUNK (16 * MAX_SEG_LEN)
+//在连接到SIP进程后, 等待1秒, 让服务器启动.
+#define STARTDELAY 1
+//在发送数据后, 等待10秒, 然后关闭连接.
+#define WAITTIME 10
+
+int server_nodeID;
+int conns;
+int *socks;
+int *phases;    //epoll模式中每个连接所处的阶段
+int *tries;     //epoll模式中每个连接调用stcp_client_connect()的次数
+int finished;   //epoll模式中完成当前阶段的连接数
+int pacing = 1; //连接是否步调发送
+int fec;        //连接是否请求前向纠错
+int rate;       //连接是否请求速率模式
+int bulk;       //soak模式是否作为bulk模式运行
+int tclass = TC_DEFAULT;    //连接的流量类别
+int bulkStop;   //tclass模式的请求都已完成, 批量上传应停止
+unsigned long bulkSent;     //tclass模式中批量上传已交给STCP的字节数
+
+//epoll模式中连接的阶段
+#define EP_CONNECTING 0
+#define EP_SENT 1
+#define EP_CLOSING 2
+#define EP_CLOSED 3
+
+//这个函数连接到本地SIP进程的端口SIP_PORT. 如果TCP连接失败, 返回-1. 连接成功, 返回TCP套接字描述符, STCP将使用该描述符发送段.
+int connectToSIP(void) {
+    struct sockaddr_in servAddr;
+    bzero(&servAddr, sizeof servAddr);
+    servAddr.sin_family = AF_INET;
+    servAddr.sin_port = htons(SIP_PORT);
+    inet_pton(AF_INET, "127.0.0.1", &servAddr.sin_addr);
+    int sock_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock_fd == -1) {
+        printf("[SIP]<connectToSIP> tcp socket error\n");
+        return -1;
+    }
+    if (connect(sock_fd, (struct sockaddr *) &servAddr, sizeof servAddr) < 0) {
+        printf("[SIP]<connectToSIP> connection failed\n");
+        return -3;
+    }
+    return sock_fd;
+}
+
+//这个函数断开到本地SIP进程的TCP连接.
+void disconnectToSIP(int sip_conn) {
+    close(sip_conn);
+    printf("[SIP]<disconnectToSIP> connection to SON is closed\n");
+}
+
+// open connection i from port CLIENTPORTBASE + i to server_port
+void open_conn(int i, unsigned int server_port) {
+    socks[i] = stcp_client_sock(CLIENTPORTBASE + i);
+    if (socks[i] < 0) {
+        printf("fail to create stcp client sock %d\n", i);
+        exit(1);
+    }
+    stcp_client_setopt(socks[i], STCP_OPT_PACING, pacing);
+    stcp_client_setopt(socks[i], STCP_OPT_FEC, fec);
+    stcp_client_setopt(socks[i], STCP_OPT_RATE, rate);
+    stcp_client_setopt(socks[i], STCP_OPT_CLASS, tclass);
+    // SYN_MAX_RETRY losses in a row do happen once in a few thousand connections, just try again
+    int tries = 0;
+    while (stcp_client_connect(socks[i], server_nodeID, server_port) < 0) {
+        if (++tries == CONNECT_TRIES) {
+            printf("fail to connect to stcp server port %u\n", server_port);
+            exit(1);
+        }
+    }
+}
+
+// the transport statistics of connection i, all zero if it is gone
+stcp_stats_t conn_stats(int i) {
+    stcp_stats_t s;
+    if (stcp_client_getstats(socks[i], &s) < 0) memset(&s, 0, sizeof s);
+    return s;
+}
+
+// disconnect and close the first n connections, then free the socket array
+void finish(int n) {
+    for (int i = 0; i < n; ++i) {
+        if (stcp_client_disconnect(socks[i]) < 0) printf("fail to disconnect %d\n", i);
+        stcp_client_close(socks[i]);
+    }
+    free(socks);
+}
+
+// thread t opens the connections t, t + BENCH_THREADS, ... in order, the server accepts them in the same order,
+// then every connection sends its index
+void *conns_open(void *arg) {
+    for (int i = (int) (long) arg; i < conns; i += BENCH_THREADS)
+        open_conn(i, SERVERPORTBASE + i);
+    for (int i = (int) (long) arg; i < conns; i += BENCH_THREADS)
+        stcp_client_send(socks[i], &i, sizeof(int));
+    return NULL;
+}
+
+void *conns_close(void *arg) {
+    for (int i = (int) (long) arg; i < conns; i += BENCH_THREADS) {
+        if (stcp_client_disconnect(socks[i]) < 0)
+            printf("fail to disconnect connection %d\n", i);
+        stcp_client_close(socks[i]);
+    }
+    return NULL;
+}
+
+// client i uploads its index and FANIN_BYTES bytes to the single server port
+void *fanin_send(void *arg) {
+    int i = (int) (long) arg;
+    open_conn(i, SERVERPORTBASE);
+    char *buf = (char *) malloc(FANIN_BYTES);
+    for (int k = 0; k < FANIN_BYTES; ++k) buf[k] = (char) (k + i);
+    // the index rides in the first segment of the upload
+    struct iovec iov[2] = {{.iov_base = &i, .iov_len = sizeof(int)}, {.iov_base = buf, .iov_len = FANIN_BYTES}};
+    stcp_client_sendv(socks[i], iov, 2);
+    free(buf);
+    return NULL;
+}
+
+// run one step of the benchmark on BENCH_THREADS threads, returns the elapsed nanoseconds
+long run_threads(void *(*step)(void *)) {
+    pthread_t tids[BENCH_THREADS];
+    long start = now_nano();
+    for (long t = 0; t < BENCH_THREADS; ++t)
+        pthread_create(&tids[t], NULL, step, (void *) t);
+    for (int t = 0; t < BENCH_THREADS; ++t)
+        pthread_join(tids[t], NULL);
+    return now_nano() - start;
+}
+
+void bench_conns(void) {
+    socks = (int *) malloc(conns * sizeof(int));
+    stcp_client_setmaxconn(conns);
+    long nano = run_threads(conns_open);
+    printf("%d connections are open in %.3f s, %.3f ms per connection\n",
+           conns, (double) nano / 1000000000, (double) nano / 1000000 / conns);
+
+    sleep(WAITTIME);
+
+    nano = run_threads(conns_close);
+    printf("%d connections are closed in %.3f s\n", conns, (double) nano / 1000000000);
+    free(socks);
+}
+
+void bench_fanin(void) {
+    socks = (int *) malloc(conns * sizeof(int));
+    stcp_client_setmaxconn(conns);
+    pthread_t *tids = (pthread_t *) malloc(conns * sizeof(pthread_t));
+    for (long i = 0; i < conns; ++i)
+        pthread_create(&tids[i], NULL, fanin_send, (void *) i);
+    for (int i = 0; i < conns; ++i)
+        pthread_join(tids[i], NULL);
+    free(tids);
+    printf("%d clients are uploading %d bytes each\n", conns, FANIN_BYTES);
+
+    sleep(WAITTIME);
+
+    //SRTT超出最小往返时间的部分是段在SIP, SON和对端的队列中等待的时间
+    double srtt = 0, min_rtt = 0;
+    unsigned long sent = 0, resent = 0;
+    for (int i = 0; i < conns; ++i) {
+        stcp_stats_t s = conn_stats(i);
+        srtt += (double) s.srtt / 1000000 / conns;
+        min_rtt += (double) s.minRtt / 1000000 / conns;
+        sent += s.segsSent;
+        resent += s.segsResent;
+    }
+    printf("pacing %s: mean srtt %.3f ms, mean min rtt %.3f ms, queueing delay %.3f ms, "
+           "%lu DATA sent, %.1f%% of them resent\n", pacing ? "on" : "off", srtt, min_rtt, srtt - min_rtt,
+           sent, sent ? 100.0 * (double) resent / (double) sent : 0);
+
+    run_threads(conns_close);
+    free(socks);
+}
+
+// move connection i forward after its eventfd fired, the calls never block
+void epoll_step(int ep, int i) {
+    int ret;
+    switch (phases[i]) {
+        case EP_CONNECTING:
+            ret = stcp_client_connect(socks[i], server_nodeID, SERVERPORTBASE);
+            if (ret == STCP_EAGAIN) return;
+            if (ret < 0) {
+                if (++tries[i] == CONNECT_TRIES) {
+                    printf("fail to connect to stcp server port %u\n", SERVERPORTBASE);
+                    exit(1);
+                }
+                stcp_client_connect(socks[i], server_nodeID, SERVERPORTBASE);
+                return;
+            }
+            // the index of the client and its upload in one call, it fits the empty send buffer
+            char *buf = (char *) malloc(FANIN_BYTES);
+            for (int k = 0; k < FANIN_BYTES; ++k) buf[k] = (char) (k + i);
+            struct iovec iov[2] = {{.iov_base = &i, .iov_len = sizeof(int)}, {.iov_base = buf, .iov_len = FANIN_BYTES}};
+            ret = stcp_client_sendv(socks[i], iov, 2);
+            free(buf);
+            if (ret < 0) {
+                printf("fail to send on connection %d\n", i);
+                exit(1);
+            }
+            phases[i] = EP_SENT;
+            ++finished;
+            return;
+        case EP_CLOSING:
+            ret = stcp_client_disconnect(socks[i]);
+            if (ret == STCP_EAGAIN) return;
+            if (ret < 0) printf("fail to disconnect connection %d\n", i);
+            epoll_ctl(ep, EPOLL_CTL_DEL, stcp_client_eventfd(socks[i]), NULL);
+            stcp_client_close(socks[i]);
+            phases[i] = EP_CLOSED;
+            ++finished;
+            return;
+        default:
+            // acknowledgements of the upload
+            return;
+    }
+}
+
+// wait on the eventfds until every connection finished its current phase, returns the epoll wakeups
+int epoll_run(int ep) {
+    struct epoll_event evs[64];
+    int wakeups = 0;
+    while (finished < conns) {
+        int n = epoll_wait(ep, evs, 64, -1);
+        ++wakeups;
+        for (int e = 0; e < n; ++e) {
+            int i = (int) evs[e].data.u32;
+            eventfd_t cnt;
+            eventfd_read(stcp_client_eventfd(socks[i]), &cnt);
+            epoll_step(ep, i);
+        }
+    }
+    return wakeups;
+}
+
+void bench_epoll(void) {
+    //每个连接占用一个eventfd
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    socks = (int *) malloc(conns * sizeof(int));
+    phases = (int *) calloc(conns, sizeof(int));
+    tries = (int *) calloc(conns, sizeof(int));
+    stcp_client_setmaxconn(conns);
+    int ep = epoll_create1(0);
+    finished = 0;
+    long start = now_nano();
+    for (int i = 0; i < conns; ++i) {
+        socks[i] = stcp_client_sock(CLIENTPORTBASE + i);
+        if (socks[i] < 0 || stcp_client_setopt(socks[i], STCP_OPT_NONBLOCK, 1) < 0) {
+            printf("fail to create stcp client sock %d\n", i);
+            exit(1);
+        }
+        //epoll事件的数据是连接的序号, 新的eventfd立即可读, 第一次epoll_step会发出连接请求
+        struct epoll_event ev = {.events = EPOLLIN, .data.u32 = i};
+        epoll_ctl(ep, EPOLL_CTL_ADD, stcp_client_eventfd(socks[i]), &ev);
+    }
+    int wakeups = epoll_run(ep);
+    printf("%d clients connected and queued %d bytes each in %.3f s, one thread, %d epoll wakeups\n",
+           conns, FANIN_BYTES, (double) (now_nano() - start) / 1000000000, wakeups);
+
+    sleep(WAITTIME);
+
+    for (int i = 0; i < conns; ++i) phases[i] = EP_CLOSING;
+    finished = 0;
+    start = now_nano();
+    //eventfd在上一阶段被读空, 这里先发出所有FIN
+    for (int i = 0; i < conns; ++i) epoll_step(ep, i);
+    wakeups = epoll_run(ep);
+    printf("%d connections are closed in %.3f s, %d epoll wakeups\n", conns,
+           (double) (now_nano() - start) / 1000000000, wakeups);
+    close(ep);
+    free(socks);
+    free(phases);
+    free(tries);
+}
+
+void bench_streams(void) {
+    int transfers = conns;
+    conns = 1;
+    socks = (int *) malloc(sizeof(int));
+    open_conn(0, SERVERPORTBASE);
+    int *ids = (int *) malloc(transfers * sizeof(int));
+    char *buf = (char *) malloc(FANIN_BYTES);
+    long start = now_nano();
+    for (int i = 0; i < transfers; ++i) {
+        ids[i] = stcp_client_stream_open(socks[0]);
+        for (int k = 0; k < FANIN_BYTES; ++k) buf[k] = (char) (k + i);
+        if (ids[i] < 0 || stcp_client_stream_send(socks[0], ids[i], &i, sizeof(int)) < 0 ||
+            stcp_client_stream_send(socks[0], ids[i], buf, FANIN_BYTES) < 0) {
+            printf("fail to upload on stream %d\n", i);
+            exit(1);
+        }
+    }
+    printf("%d streams are opened and uploading %d bytes each in %.3f ms\n", transfers, FANIN_BYTES,
+           (double) (now_nano() - start) / 1000000);
+    free(buf);
+
+    char done;
+    if (stcp_client_recv(socks[0], &done, 1) < 0) printf("fail to hear from the server\n");
+    for (int i = 0; i < transfers; ++i) stcp_client_stream_close(socks[0], ids[i]);
+    free(ids);
+    finish(1);
+}
+
+void bench_pingpong(void) {
+    int rounds = conns;
+    conns = 1;
+    socks = (int *) malloc(sizeof(int));
+    open_conn(0, SERVERPORTBASE);
+    char req[PINGPONG_BYTES], resp[PINGPONG_BYTES];
+    long start = now_nano();
+    for (int r = 0; r < rounds; ++r) {
+        for (int k = 0; k < PINGPONG_BYTES; ++k) req[k] = (char) (k + r);
+        if (stcp_client_send(socks[0], req, PINGPONG_BYTES) < 0 ||
+            stcp_client_recv(socks[0], resp, PINGPONG_BYTES) < 0) {
+            printf("round %d failed\n", r);
+            exit(1);
+        }
+        if (memcmp(req, resp, PINGPONG_BYTES) != 0) printf("round %d: response is corrupted\n", r);
+    }
+    long nano = now_nano() - start;
+    stcp_stats_t s = conn_stats(0);
+    printf("%d round trips of %d bytes in %.3f s, %.1f round trips/s\n", rounds, PINGPONG_BYTES,
+           (double) nano / 1000000000, rounds / ((double) nano / 1000000000));
+    printf("client sent %lu DATA, %lu DATAACK, %lu ACKs piggybacked on DATA\n",
+           s.segsSent, s.acksSent, s.acksPiggybacked);
+
+    finish(1);
+}
+
+void bench_msgpong(void) {
+    int rounds = conns;
+    conns = 1;
+    socks = (int *) malloc(sizeof(int));
+    open_conn(0, SERVERPORTBASE);
+    char req[MSGPONG_BYTES];
+    long start = now_nano();
+    for (int r = 0; r < rounds; ++r) {
+        unsigned int len = 1 + (unsigned int) r * 997 % MSGPONG_BYTES;
+        for (unsigned int k = 0; k < len; ++k) req[k] = (char) (k + r);
+        void *resp = NULL;
+        int got;
+        if (stcp_client_send_msg(socks[0], req, len) < 0 || (got = stcp_client_recv_msg(socks[0], &resp, 0)) < 0) {
+            printf("round %d failed\n", r);
+            exit(1);
+        }
+        if ((unsigned int) got != len || memcmp(req, resp, len) != 0) printf("round %d: response is corrupted\n", r);
+        free(resp);
+    }
+    long nano = now_nano() - start;
+    stcp_stats_t s = conn_stats(0);
+    printf("%d round trips of messages of 1 to %d bytes in %.3f s, %.1f round trips/s\n", rounds, MSGPONG_BYTES,
+           (double) nano / 1000000000, rounds / ((double) nano / 1000000000));
+    printf("client sent %lu DATA, %lu DATAACK, %lu ACKs piggybacked on DATA\n",
+           s.segsSent, s.acksSent, s.acksPiggybacked);
+
+    finish(1);
+}
+
+int latency_cmp(const void *a, const void *b) {
+    long x = *(const long *) a, y = *(const long *) b;
+    return x < y ? -1 : x > y;
+}
+
+void bench_oneshot(int fastopen) {
+    long *latency = (long *) malloc(conns * sizeof(long));
+    char req[ONESHOT_BYTES], resp[ONESHOT_BYTES];
+    for (int i = 0; i < conns; ++i) {
+        int sock = stcp_client_sock(CLIENTPORTBASE + i);
+        if (sock < 0) {
+            printf("fail to create stcp client sock %d\n", i);
+            exit(1);
+        }
+        for (int k = 0; k < ONESHOT_BYTES; ++k) req[k] = (char) (k + i);
+        long start = now_nano();
+        int ret = fastopen ? stcp_client_connect_data(sock, server_nodeID, SERVERPORTBASE, req, ONESHOT_BYTES)
+                           : stcp_client_connect(sock, server_nodeID, SERVERPORTBASE);
+        if (ret < 0 || (!fastopen && stcp_client_send(sock, req, ONESHOT_BYTES) < 0) ||
+            stcp_client_recv(sock, resp, ONESHOT_BYTES) < 0) {
+            printf("connection %d failed\n", i);
+            exit(1);
+        }
+        latency[i] = now_nano() - start;
+        if (memcmp(req, resp, ONESHOT_BYTES) != 0) printf("connection %d: response is corrupted\n", i);
+        if (stcp_client_disconnect(sock) < 0) printf("fail to disconnect %d\n", i);
+        stcp_client_close(sock);
+    }
+    //第一个连接的延迟单独报告, fastopen模式中它只取得cookie
+    double first = (double) latency[0] / 1000000, total = 0;
+    for (int i = 1; i < conns; ++i) total += (double) latency[i] / 1000000;
+    qsort(latency + 1, conns - 1, sizeof(long), latency_cmp);
+    printf("%s: %d one-request connections of %d bytes, first %.3f ms, then mean %.3f ms, median %.3f ms, p99 %.3f ms\n",
+           fastopen ? "fastopen" : "oneshot", conns, ONESHOT_BYTES, first, conns > 1 ? total / (conns - 1) : 0,
+           conns > 1 ? (double) latency[1 + (conns - 1) / 2] / 1000000 : 0,
+           conns > 1 ? (double) latency[1 + (conns - 1) * 99 / 100] / 1000000 : 0);
+    free(latency);
+}
+
+// the word at byte offset off of the soak upload, the server generates the same sequence to check it
+static uint64_t soak_word(uint64_t off) {
+    return off * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+void bench_soak(long mb) {
+    conns = 1;
+    socks = (int *) malloc(sizeof(int));
+    open_conn(0, SERVERPORTBASE);
+    uint64_t total = (uint64_t) mb << 20, sent = 0;
+    uint64_t *buf = (uint64_t *) malloc(SOAK_CHUNK);
+    if (stcp_client_send(socks[0], &total, sizeof(uint64_t)) < 0) {
+        printf("fail to send the length\n");
+        exit(1);
+    }
+    // a blocking send queues everything it gets, the whole upload would end up in the send buffer
+    stcp_client_setopt(socks[0], STCP_OPT_NONBLOCK, 1);
+    struct pollfd pfd = {.fd = stcp_client_eventfd(socks[0]), .events = POLLIN};
+    long start = now_nano();
+    while (sent < total) {
+        unsigned int len = total - sent < SOAK_CHUNK ? (unsigned int) (total - sent) : SOAK_CHUNK;
+        for (unsigned int k = 0; k < len / sizeof(uint64_t); ++k) buf[k] = soak_word(sent + k * sizeof(uint64_t));
+        int ret;
+        while ((ret = stcp_client_send(socks[0], buf, len)) == STCP_EAGAIN) {
+            eventfd_t cnt;
+            if (poll(&pfd, 1, -1) > 0) eventfd_read(pfd.fd, &cnt);
+        }
+        if (ret < 0) {
+            printf("connection lost after %lu bytes\n", (unsigned long) sent);
+            exit(1);
+        }
+        sent += len;
+    }
+    stcp_client_setopt(socks[0], STCP_OPT_NONBLOCK, 0);
+    char ok = 0;
+    if (stcp_client_recv(socks[0], &ok, 1) < 0) printf("fail to hear from the server\n");
+    double sec = (double) (now_nano() - start) / 1000000000;
+    stcp_stats_t s = conn_stats(0);
+    printf("soak: %lu bytes in %.3f s, %.1f MB/s, %.2f times the sequence space, %lu DATA sent, %.3f s blocked on send, "
+           "data %s\n", (unsigned long) total, sec, (double) total / (1 << 20) / sec, (double) total / 4294967296.0,
+           s.segsSent, (double) s.sendBlocked / 1000000000, ok ? "intact" : "corrupted");
+    if (bulk) {
+        printf("bulk: %s, srtt %.3f ms, min rtt %.3f ms, %.2f%% of the DATA resent, final rate %lu segments/s, path capacity %lu segments/s\n",
+               s.rate ? "rate mode" : "congestion window", (double) s.srtt / 1000000, (double) s.minRtt / 1000000,
+               s.segsSent ? 100.0 * (double) s.segsResent / (double) s.segsSent : 0, s.rate, s.peerCapacity);
+    }
+    free(buf);
+
+    finish(1);
+}
+
+void bench_fec(void) {
+    int rounds = conns;
+    conns = 1;
+    socks = (int *) malloc(sizeof(int));
+    open_conn(0, SERVERPORTBASE);
+    char *req = (char *) malloc(FEC_BYTES), *resp = (char *) malloc(FEC_BYTES);
+    long *latency = (long *) malloc(rounds * sizeof(long));
+    long start = now_nano();
+    for (int r = 0; r < rounds; ++r) {
+        for (int k = 0; k < FEC_BYTES; ++k) req[k] = (char) (k * 7 + r);
+        long sent = now_nano();
+        if (stcp_client_send(socks[0], req, FEC_BYTES) < 0 || stcp_client_recv(socks[0], resp, FEC_BYTES) < 0) {
+            printf("round %d failed\n", r);
+            exit(1);
+        }
+        latency[r] = now_nano() - sent;
+        if (memcmp(req, resp, FEC_BYTES) != 0) printf("round %d: response is corrupted\n", r);
+    }
+    double sec = (double) (now_nano() - start) / 1000000000;
+    qsort(latency, rounds, sizeof(long), latency_cmp);
+    stcp_stats_t s = conn_stats(0);
+    printf("%s: %d round trips of %d bytes in %.3f s, goodput %.1f KB/s, median %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           s.fec ? "fec" : "retransmit only", rounds, FEC_BYTES, sec, 2.0 * FEC_BYTES * rounds / 1024 / sec,
+           (double) latency[rounds / 2] / 1000000, (double) latency[rounds * 99 / 100] / 1000000,
+           (double) latency[rounds - 1] / 1000000);
+    printf("client sent %lu DATA and %lu parity segments, %lu segments of the server were rebuilt from parity\n",
+           s.segsSent, s.paritySent, s.parityRecovered);
+    free(latency);
+    free(req);
+    free(resp);
+
+    finish(1);
+}
+
+// the bulk connection of the tclass mode keeps the path full until the requests are done
+void *tclass_bulk(void *arg) {
+    (void) arg;
+    char *buf = (char *) malloc(SOAK_CHUNK);
+    memset(buf, 0x5a, SOAK_CHUNK);
+    stcp_client_setopt(socks[0], STCP_OPT_NONBLOCK, 1);
+    struct pollfd pfd = {.fd = stcp_client_eventfd(socks[0]), .events = POLLIN};
+    while (!__atomic_load_n(&bulkStop, __ATOMIC_ACQUIRE)) {
+        int ret = stcp_client_send(socks[0], buf, SOAK_CHUNK);
+        if (ret == STCP_EAGAIN) {
+            // wake up now and then to see whether the requests are done
+            eventfd_t cnt;
+            if (poll(&pfd, 1, 100) > 0) eventfd_read(pfd.fd, &cnt);
+        } else if (ret < 0) {
+            printf("bulk connection lost after %lu bytes\n", bulkSent);
+            exit(1);
+        } else {
+            __atomic_fetch_add(&bulkSent, SOAK_CHUNK, __ATOMIC_RELAXED);
+        }
+    }
+    stcp_client_setopt(socks[0], STCP_OPT_NONBLOCK, 0);
+    free(buf);
+    return NULL;
+}
+
+void bench_tclass(int classes) {
+    int rounds = conns;
+    conns = 2;
+    socks = (int *) malloc(2 * sizeof(int));
+    // the server answers each connection in the class its SYN carried. the window of one stream
+    // can't fill the path, the bulk upload uses the rate mode
+    tclass = classes ? TC_BULK : TC_DEFAULT;
+    rate = 1;
+    open_conn(0, SERVERPORTBASE);
+    tclass = classes ? TC_INTERACTIVE : TC_DEFAULT;
+    rate = 0;
+    open_conn(1, SERVERPORTBASE + 1);
+    pthread_t tid;
+    pthread_create(&tid, NULL, tclass_bulk, NULL);
+    usleep(TCLASS_WARMUP_MS * 1000);
+
+    char req[PINGPONG_BYTES], resp[PINGPONG_BYTES];
+    long *latency = (long *) malloc(rounds * sizeof(long));
+    unsigned long bulkStart = __atomic_load_n(&bulkSent, __ATOMIC_RELAXED);
+    long start = now_nano();
+    for (int r = 0; r < rounds; ++r) {
+        for (int k = 0; k < PINGPONG_BYTES; ++k) req[k] = (char) (k * 3 + r);
+        long sent = now_nano();
+        if (stcp_client_send(socks[1], req, PINGPONG_BYTES) < 0 ||
+            stcp_client_recv(socks[1], resp, PINGPONG_BYTES) < 0) {
+            printf("request %d failed\n", r);
+            exit(1);
+        }
+        latency[r] = now_nano() - sent;
+        if (memcmp(req, resp, PINGPONG_BYTES) != 0) printf("request %d: response is corrupted\n", r);
+    }
+    double sec = (double) (now_nano() - start) / 1000000000;
+    unsigned long bulkBytes = __atomic_load_n(&bulkSent, __ATOMIC_RELAXED) - bulkStart;
+    __atomic_store_n(&bulkStop, 1, __ATOMIC_RELEASE);
+    pthread_join(tid, NULL);
+
+    qsort(latency, rounds, sizeof(long), latency_cmp);
+    printf("tclass: %s, %d requests of %d bytes in %.3f s beside a bulk upload, median %.3f ms, p99 %.3f ms, max %.3f ms, "
+           "bulk %.1f KB/s meanwhile\n", classes ? "interactive and bulk classes" : "one class", rounds, PINGPONG_BYTES,
+           sec, (double) latency[rounds / 2] / 1000000, (double) latency[rounds * 99 / 100] / 1000000,
+           (double) latency[rounds - 1] / 1000000, (double) bulkBytes / 1024 / sec);
+    free(latency);
+
+    finish(2);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("usage: %s server_name conns|fanin|epoll|streams|pingpong|msgpong|oneshot|fastopen|soak|fec|bulk|tclass [connections|rounds|MB [nopace|nofec|norate|noclass]]\n", argv[0]);
+        exit(1);
+    }
+    //用于丢包率的随机数种子
+    srand(time(NULL));
+
+    server_nodeID = topology_getNodeIDfromname(argv[1], NULL);
+    if (server_nodeID == -1) {
+        printf("host name error!\n");
+        exit(1);
+    }
+
+    //连接到SIP进程并获得TCP套接字描述符
+    int sip_conn = connectToSIP();
+    if (sip_conn < 0) {
+        printf("fail to connect to the local SIP process\n");
+        exit(1);
+    }
+
+    //初始化stcp客户端
+    stcp_client_init(sip_conn);
+    sleep(STARTDELAY);
+
+    if (strcmp(argv[2], "conns") == 0) {
+        conns = argc > 3 ? atoi(argv[3]) : DEFAULT_CONNS;
+        bench_conns();
+    } else if (strcmp(argv[2], "fanin") == 0) {
+        conns = argc > 3 ? atoi(argv[3]) : DEFAULT_FANIN;
+        pacing = !(argc > 4 && strcmp(argv[4], "nopace") == 0);
+        bench_fanin();
+    } else if (strcmp(argv[2], "epoll") == 0) {
+        conns = argc > 3 ? atoi(argv[3]) : DEFAULT_FANIN;
+        bench_epoll();
+    } else if (strcmp(argv[2], "streams") == 0) {
+        conns = argc > 3 ? atoi(argv[3]) : DEFAULT_FANIN;
+        bench_streams();
+    } else if (strcmp(argv[2], "pingpong") == 0) {
+        conns = argc > 3 ? atoi(argv[3]) : DEFAULT_PINGPONG;
+        bench_pingpong();
+    } else if (strcmp(argv[2], "msgpong") == 0) {
+        conns = argc > 3 ? atoi(argv[3]) : DEFAULT_PINGPONG;
+        bench_msgpong();
+    } else if (strcmp(argv[2], "oneshot") == 0 || strcmp(argv[2], "fastopen") == 0) {
+        conns = argc > 3 ? atoi(argv[3]) : DEFAULT_ONESHOT;
+        bench_oneshot(strcmp(argv[2], "fastopen") == 0);
+    } else if (strcmp(argv[2], "soak") == 0) {
+        bench_soak(argc > 3 ? atol(argv[3]) : DEFAULT_SOAK_MB);
+    } else if (strcmp(argv[2], "fec") == 0) {
+        conns = argc > 3 ? atoi(argv[3]) : DEFAULT_FEC_ROUNDS;
+        fec = !(argc > 4 && strcmp(argv[4], "nofec") == 0);
+        bench_fec();
+    } else if (strcmp(argv[2], "bulk") == 0) {
+        // the path emulator drops the segments, it gives the same loss to both modes
+        seg_setlossrate(0);
+        bulk = 1;
+        rate = !(argc > 4 && strcmp(argv[4], "norate") == 0);
+        bench_soak(argc > 3 ? atol(argv[3]) : DEFAULT_BULK_MB);
+    } else if (strcmp(argv[2], "tclass") == 0) {
+        // the path emulator drops the segments
+        seg_setlossrate(0);
+        conns = argc > 3 ? atoi(argv[3]) : DEFAULT_TCLASS_ROUNDS;
+        bench_tclass(!(argc > 4 && strcmp(argv[4], "noclass") == 0));
+    } else {
+        printf("unknown mode %s\n", argv[2]);
+        exit(1);
+    }
+
+    //断开与SIP进程之间的连接
+    disconnectToSIP(sip_conn);
+}
@@ -2,7 +2,8 @@
 //
 //描述: 这是压力测试版本的客户端程序代码. 客户端首先连接到本地SIP进程, 然后它调用stcp_client_init()初始化STCP客户端. 
 //它通过调用stcp_client_sock()和stcp_client_connect()创建套接字并连接到服务器.
-//然后它读取文件sendthis.txt中的文本数据, 将文件的长度和文件数据发送给服务器. 经过一段时候后, 客户端调用stcp_client_disconnect()断开到服务器的连接.
+//然后它将文件sendthis.txt的长度(8字节)和文件数据发送给服务器. 文件以STRESS_CHUNK字节为单位边读边发, 发送缓冲区满时等待套接字的eventfd,
+//所以文件可以大于4GB, 内存占用也不随文件长度增长. 经过一段时候后, 客户端打印连接的传输统计, 然后调用stcp_client_disconnect()断开到服务器的连接.
 //最后,客户端调用stcp_client_close()关闭套接字并断开到本地SIP进程的连接.
 
 //输入: 无
@@ -19,6 +20,9 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include "../common/constants.h"
 #include "../topology/topology.h"
 #include "stcp_client.h"
@@ -27,6 +31,9 @@
 #define CLIENTPORT1 87
 #define SERVERPORT1 88
 
+//每次从文件读出并发送的字节数, 不超过SEND_BUF_SEGS个段.
+#define STRESS_CHUNK (16 * MAX_SEG_LEN)
+
 //在连接到SIP进程后, 等待1秒, 让服务器启动.
 #define STARTDELAY 1
 //在发送文件后, 等待5秒, 然后关闭连接.
@@ -57,6 +64,18 @@ void disconnectToSIP(int sip_conn) {
     printf("[SIP]<disconnectToSIP> connection to SON is closed\n");
 }
 
+//这个函数打印连接的传输统计.
+void print_stats(int sockfd) {
+    stcp_stats_t s;
+    if (stcp_client_getstats(sockfd, &s) < 0) return;
+    printf("stats: %lu bytes in %lu DATA sent, %lu bytes in %lu DATA received, %lu DATA (%lu bytes) resent, %lu DATAACK sent\n",
+           s.bytesSent, s.segsSent, s.bytesRcvd, s.segsRcvd, s.segsResent, s.bytesResent, s.acksSent);
+    printf("stats: %lu timeouts, %lu duplicate ACKs, cwnd %u, %u in flight, peer window %u, srtt %.3f ms, min rtt %.3f ms, rto %.3f ms\n",
+           s.timeouts, s.dupAcks, s.cwnd, s.inFlight, s.peerWin, (double) s.srtt / 1000000, (double) s.minRtt / 1000000,
+           (double) s.rto / 1000000);
+    printf("stats: %u bytes unread, %u bytes out of order\n", s.recvBuffered, s.oooBytes);
+}
+
 int main(void) {
     //用于丢包率的随机数种子
     srand(time(NULL));
@@ -95,22 +114,36 @@ int main(void) {
     }
     printf("client connected to server, client port:%d, server port %d\n", CLIENTPORT1, SERVERPORT1);
 
-    //获取sendthis.txt文件长度, 创建缓冲区并读取文件中的数据
+    //获取sendthis.txt文件长度, 首先发送文件长度, 然后分块读取并发送整个文件.
     FILE *f;
     f = fopen("sendthis.txt", "r");
     assert(f != NULL);
     fseek(f, 0, SEEK_END);
-    int fileLen = ftell(f);
+    uint64_t fileLen = ftell(f);
     fseek(f, 0, SEEK_SET);
-    char *buffer = (char *) malloc(fileLen);
-    fread(buffer, fileLen, 1, f);
-    fclose(f);
-    //首先发送文件长度, 然后发送整个文件.
-    stcp_client_send(sockfd, &fileLen, sizeof(int));
-    stcp_client_send(sockfd, buffer, fileLen);
+    stcp_client_send(sockfd, &fileLen, sizeof(uint64_t));
+    // a blocking send would queue the whole file in the send buffer
+    stcp_client_setopt(sockfd, STCP_OPT_NONBLOCK, 1);
+    struct pollfd pfd = {.fd = stcp_client_eventfd(sockfd), .events = POLLIN};
+    char *buffer = (char *) malloc(STRESS_CHUNK);
+    size_t len;
+    while ((len = fread(buffer, 1, STRESS_CHUNK, f)) > 0) {
+        int ret;
+        while ((ret = stcp_client_send(sockfd, buffer, len)) == STCP_EAGAIN) {
+            eventfd_t cnt;
+            if (poll(&pfd, 1, -1) > 0) eventfd_read(pfd.fd, &cnt);
+        }
+        if (ret < 0) {
+            printf("fail to send the file\n");
+            exit(1);
+        }
+    }
+    stcp_client_setopt(sockfd, STCP_OPT_NONBLOCK, 0);
     free(buffer);
+    fclose(f);
     //等待一段时间, 然后关闭连接.
     sleep(WAITTIME);
+    print_stats(sockfd);
 
     if (stcp_client_disconnect(sockfd) < 0) {
         printf("fail to disconnect from stcp server\n");
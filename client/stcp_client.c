@@ -12,68 +12,93 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <time.h>
+#include <errno.h>
 #include <pthread.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include "../common/helper.h"
 #include "../topology/topology.h"
 #include "stcp_client.h"
 #include "../common/seg.h"
+#include "../common/tcbtable.h"
+#include "../common/stream.h"
 
-//声明tcbtable为全局变量
-client_tcb_t *TCB[MAX_TRANSPORT_CONNECTIONS];
-//声明到SIP进程的TCP连接为全局变量
-int sip_conn;
-
-//======================================================
-//          definition of buffer helpers
-//======================================================
-
-/**
- * deep copy from the seg to the send buffer, will help send segment
- */
-int add_seg(int sock, seg_t *seg) {
-    if (TCB[sock] == NULL || TCB[sock]->state != CONNECTED) {
-        printf("[Client] socket missing or state error, add segment to buffer failed");
-        return -1;
-    }
-    client_tcb_t *tcb = TCB[sock];
-    segBuf_t *buf = new(segBuf_t);
-    memcpy(&buf->seg, seg, sizeof(seg_t));
-    buf->next = NULL;
+//声明tcbtable为全局变量, 它与服务器的TCB表不同名, 所以两个库可以链接进同一个程序
+tcbtable_t *clientTcbTable;
+#define TCB(sock) ((client_tcb_t *) tcbtable_get(clientTcbTable, (sock)))
+//到SIP进程的TCP连接
+static int sip_conn;
+static void *seghandler(void *arg);
+//延迟确认队列, 只由seghandler访问
+static ackq_t ackQueue;
+//被应用程序关闭的TCB. seghandler可能正在处理它的段, 它也可能还在延迟确认队列中, 所以由seghandler释放. 由orphanMutex保护
+static client_tcb_t *orphanHead;
+static pthread_mutex_t orphanMutex = PTHREAD_MUTEX_INITIALIZER;
+//服务器节点发放的快速打开cookie, 由cookieMutex保护
+typedef struct fastOpenCookie {
+    int nodeID;
+    unsigned int cookie;
+} fastOpenCookie_t;
+static fastOpenCookie_t cookieCache[MAX_NODE_NUM];
+static unsigned int cookieNum;
+static pthread_mutex_t cookieMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// tell the application polling the eventfd of the tcb that something happened on it
+static void tcb_event(client_tcb_t *tcb) {
+    int fd = __atomic_load_n(&tcb->eventFd, __ATOMIC_ACQUIRE);
+    if (fd >= 0) eventfd_write(fd, 1);
+}
+
+// wake up the threads blocked on the tcb and the application polling its eventfd
+static void tcb_notify(client_tcb_t *tcb) {
     pthread_mutex_lock(tcb->bufMutex);
-    if (tcb->sendBufHead == tcb->sendBufTail) {   // start from an empty buffer
-        tcb->sendBufunSent = buf;
-        tcb->sendBufTail->next = buf;
-        tcb->sendBufTail = buf;
-        // create a new thread to traverse the buffer
-        printf("[Client] send_buf timer starts\n");
-        pthread_t tid;
-        pthread_attr_t attr;
-        pthread_attr_init(&attr);
-        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-        pthread_create(&tid, &attr, sendBuf_timer, tcb);
-    } else {
-        tcb->sendBufTail->next = buf;
-        tcb->sendBufTail = buf;
-        if (tcb->sendBufunSent == NULL) tcb->sendBufunSent = buf;
-    }
+    pthread_cond_broadcast(tcb->stateCond);
+    tcb_event(tcb);
     pthread_mutex_unlock(tcb->bufMutex);
-    return 0;
 }
 
-// pop segment from the head, atom operation, should be surrounded by lock and unlock
-void pop_seg(client_tcb_t *tcb) {
-    segBuf_t *first = tcb->sendBufHead->next;
-    if (first == tcb->sendBufTail) {
-        tcb->sendBufTail = tcb->sendBufHead;
-        tcb->sendBufunSent = tcb->sendBufHead;
+// the cached fast open cookie of the server node, returns 0 if there is none
+static int cookie_lookup(int nodeID, unsigned int *cookie) {
+    int found = 0;
+    pthread_mutex_lock(&cookieMutex);
+    for (unsigned int i = 0; i < cookieNum && !found; ++i) {
+        if (cookieCache[i].nodeID != nodeID) continue;
+        *cookie = cookieCache[i].cookie;
+        found = 1;
     }
-    tcb->sendBufHead->next = first->next;
-    free(first);
+    pthread_mutex_unlock(&cookieMutex);
+    return found;
+}
+
+// remember the cookie a SYNACK of the server node carried, replacing its old one
+static void cookie_store(int nodeID, unsigned int cookie) {
+    pthread_mutex_lock(&cookieMutex);
+    unsigned int i = 0;
+    while (i < cookieNum && cookieCache[i].nodeID != nodeID) ++i;
+    // a full cache gives up a slot that depends on the node
+    if (i == MAX_NODE_NUM) i = (unsigned int) nodeID % MAX_NODE_NUM;
+    else if (i == cookieNum) ++cookieNum;
+    cookieCache[i].nodeID = nodeID;
+    cookieCache[i].cookie = cookie;
+    pthread_mutex_unlock(&cookieMutex);
+}
+
+static void fastopen_drop(client_tcb_t *tcb) {
+    free(tcb->fastOpenData);
+    tcb->fastOpenData = NULL;
+    tcb->fastOpenLen = tcb->fastOpenSyn = 0;
 }
 
-//======================================================
-//          buffer helpers end
-//======================================================
+static void tcb_free(client_tcb_t *tcb) {
+    fastopen_drop(tcb);
+    stream_group_free(&tcb->sg);
+    pthread_mutex_destroy(tcb->bufMutex);
+    free(tcb->bufMutex);
+    pthread_cond_destroy(tcb->stateCond);
+    free(tcb->stateCond);
+    if (tcb->eventFd >= 0) close(tcb->eventFd);
+    free(tcb);
+}
 
 /*********************************************************************/
 //
@@ -81,12 +106,13 @@ void pop_seg(client_tcb_t *tcb) {
 //
 /*********************************************************************/
 
-// 这个函数初始化TCB表, 将所有条目标记为NULL.  
+// 这个函数创建一个空的TCB表, 最大连接数为MAX_TRANSPORT_CONNECTIONS.
 // 它还针对TCP套接字描述符conn初始化一个STCP层的全局变量, 该变量作为sip_sendseg和sip_recvseg的输入参数.
 // 最后, 这个函数启动seghandler线程来处理进入的STCP段. 客户端只有一个seghandler.
 void stcp_client_init(int conn) {
     sip_conn = conn;
-    bzero(TCB, sizeof(TCB));
+    stream_setconn(conn);
+    clientTcbTable = tcbtable_create(MAX_TRANSPORT_CONNECTIONS);
     pthread_t tid;
     pthread_attr_t attr;
     pthread_attr_init(&attr);
@@ -94,18 +120,17 @@ void stcp_client_init(int conn) {
     pthread_create(&tid, &attr, seghandler, NULL);
 }
 
-// 这个函数查找客户端TCB表以找到第一个NULL条目, 然后使用malloc()为该条目创建一个新的TCB条目.
+// 这个函数创建一个新的TCB条目, 并从TCB表中为它分配一个套接字ID, 被关闭的套接字ID会被优先回收使用.
 // 该TCB中的所有字段都被初始化. 例如, TCB state被设置为CLOSED，客户端端口被设置为函数调用参数client_port. 
-// TCB表中条目的索引号应作为客户端的新套接字ID被这个函数返回, 它用于标识客户端的连接. 
-// 如果TCB表中没有条目可用, 这个函数返回-1.
+// 分配的套接字ID被这个函数返回, 它用于标识客户端的连接. 
+// 如果连接数已达到上限, 这个函数返回-1.
 int stcp_client_sock(unsigned int client_port) {
-    int i_sock = 0;
-    for (; i_sock < MAX_TRANSPORT_CONNECTIONS && TCB[i_sock]; ++i_sock);
-    assert(i_sock <= MAX_TRANSPORT_CONNECTIONS);
-    if (i_sock == MAX_TRANSPORT_CONNECTIONS)return -1;
-
-    TCB[i_sock] = new(client_tcb_t);
-    client_tcb_t *entry = TCB[i_sock];
+    client_tcb_t *entry = tcbtable_newtcb(sizeof(client_tcb_t));
+    int i_sock = tcbtable_alloc(clientTcbTable, entry);
+    if (i_sock < 0) {
+        free(entry);
+        return -1;
+    }
     //  initialize server node ID & port
     entry->server_nodeID = 0;
     entry->server_portNum = 0;
@@ -114,250 +139,561 @@ int stcp_client_sock(unsigned int client_port) {
     entry->client_portNum = client_port;
     // stcp is not ready before stcp_client_connect
     entry->state = CLOSED;
-    // 0 is the start of SYN
-    entry->next_seqNum = 0;
     // send wants to add packets to the tail, and DATA_ACK wants to remove buffers
     entry->bufMutex = new(pthread_mutex_t);
     pthread_mutex_init(entry->bufMutex, NULL);
-    // buffer related pointers should all be set to null, lead by a dummy head
-    entry->sendBufHead = entry->sendBufTail = entry->sendBufunSent = new(segBuf_t);
-    // number of sent-but-not-acked segs
-    entry->unAck_segNum = 0;
+    // connect/disconnect sleep on it until seghandler moves the state
+    entry->stateCond = new(pthread_cond_t);
+    pthread_cond_init(entry->stateCond, NULL);
+    // both directions of the connection, 0 is the start of SYN. the client opens the odd streams
+    stream_group_init(&entry->sg, &entry->st, entry->bufMutex, entry->stateCond, 1);
+    entry->st.localPort = client_port;
+    entry->nonblock = 0;
+    entry->eventFd = -1;
+    entry->asyncOp = -1;
+    entry->asyncRet = 0;
+    entry->handshaking = 0;
     return i_sock;
 }
 
+// send seg until seghandler moves the state away from wait_state or max_retry tries time out, returns the tries,
+// should be surrounded by lock and unlock
+static int handshake(client_tcb_t *tcb, seg_t *seg, unsigned int wait_state, long timeout, int max_retry) {
+    int retry = 0;
+    while (tcb->state == wait_state && retry < max_retry) {
+        if (stream_sendseg((int) tcb->server_nodeID, tcb->sg.tclass, seg) < 0) exit(0);
+        ++retry;
+        printf("[Client] %s %d is sent\n", seg_type_str(seg->header.type), retry);
+        // sleep until seghandler reports the answer or the segment times out
+        struct timespec deadline = nano_timespec(now_nano() + timeout);
+        while (tcb->state == wait_state &&
+               pthread_cond_timedwait(tcb->stateCond, tcb->bufMutex, &deadline) != ETIMEDOUT);
+    }
+    return retry;
+}
+
+// the result of connect after the SYNs, should be surrounded by lock and unlock
+static int connect_done(client_tcb_t *tcb, int retry) {
+    if (tcb->state == CONNECTED) {
+        printf("[Client] connected to server port %d\n", tcb->server_portNum);
+        return 1;
+    }
+    // connection failed
+    printf("[Client] tried but fail to connect in %d times\n", retry);
+    fastopen_drop(tcb);
+    tcb->state = CLOSED;
+    return -1;
+}
+
+// the result of disconnect after the FINs, should be surrounded by lock and unlock
+static int disconnect_done(client_tcb_t *tcb) {
+    if (tcb->state == FINWAIT) {
+        tcb->state = CLOSED;
+        printf("[Client] tried but fail to disconnect in %d times\n", FIN_MAX_RETRY);
+        return -1;
+    }
+    printf("[Client] port %u disconnect successfully\n", tcb->client_portNum);
+    return 0;
+}
+
+typedef struct handshakeArg {
+    client_tcb_t *tcb;
+    seg_t *seg;                     //SYN或FIN, 由线程释放
+} handshakeArg_t;
+
+// a non-blocking connect or disconnect retransmits its SYN or FIN on this thread
+static void *handshake_timer(void *arg) {
+    client_tcb_t *tcb = ((handshakeArg_t *) arg)->tcb;
+    seg_t *seg = ((handshakeArg_t *) arg)->seg;
+    free(arg);
+    pthread_mutex_lock(tcb->bufMutex);
+    if (seg->header.type == SYN) {
+        int retry = handshake(tcb, seg, SYNSENT, SYN_TIMEOUT, SYN_MAX_RETRY);
+        tcb->asyncRet = connect_done(tcb, retry);
+    } else {
+        handshake(tcb, seg, FINWAIT, FIN_TIMEOUT, FIN_MAX_RETRY);
+        tcb->asyncRet = disconnect_done(tcb);
+    }
+    // close waits for this, the tcb is not touched after the unlock
+    tcb->handshaking = 0;
+    tcb_event(tcb);
+    pthread_mutex_unlock(tcb->bufMutex);
+    free(seg);
+    return NULL;
+}
+
+// start a non-blocking connect or disconnect, should be surrounded by lock and unlock
+static int handshake_async(client_tcb_t *tcb, seg_t *seg) {
+    handshakeArg_t *arg = new(handshakeArg_t);
+    arg->tcb = tcb;
+    arg->seg = seg;
+    tcb->asyncOp = seg->header.type;
+    tcb->handshaking = 1;
+    pthread_t tid;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&tid, &attr, handshake_timer, arg);
+    return STCP_EAGAIN;
+}
+
+// whether a non-blocking connect (op SYN) or disconnect (op FIN) is started and not reported yet,
+// its result or STCP_EAGAIN while it still runs goes to *ret. should be surrounded by lock and unlock
+static int handshake_pending(client_tcb_t *tcb, int op, int *ret) {
+    if (tcb->asyncOp != op) return 0;
+    if (tcb->handshaking) {
+        *ret = STCP_EAGAIN;
+    } else {
+        tcb->asyncOp = -1;
+        *ret = tcb->asyncRet;
+    }
+    return 1;
+}
+
 // 这个函数用于连接服务器. 它以套接字ID, 服务器节点ID和服务器的端口号作为输入参数. 套接字ID用于找到TCB条目.  
 // 这个函数设置TCB的服务器节点ID和服务器端口号,  然后使用sip_sendseg()发送一个SYN段给服务器.  
-// 在发送了SYN段之后, 一个定时器被启动. 如果在SYNSEG_TIMEOUT时间之内没有收到SYNACK, SYN 段将被重传. 
+// 在发送了SYN段之后, 这个函数在stateCond上限时等待SYN_TIMEOUT. 如果在SYN_TIMEOUT时间之内没有收到SYNACK, SYN 段将被重传. 
 // 如果收到了, 就返回1. 否则, 如果重传SYN的次数大于SYN_MAX_RETRY, 就将state转换到CLOSED, 并返回-1.
+// 非阻塞模式下重传由handshake_timer线程完成, 这个函数返回STCP_EAGAIN, 完成后再次调用返回结果.
 int stcp_client_connect(int sockfd, int nodeID, unsigned int server_port) {
-    client_tcb_t *entry = TCB[sockfd];
+    return stcp_client_connect_data(sockfd, nodeID, server_port, NULL, 0);
+}
+
+// 快速打开版本的stcp_client_connect(). 有服务器节点的cookie时数据的前MAX_SEG_LEN字节随SYN发出, 否则SYN请求cookie.
+// SYNACK没有确认的数据在连接建立时进入发送缓冲区. 返回值与stcp_client_connect()相同.
+int stcp_client_connect_data(int sockfd, int nodeID, unsigned int server_port, void *data, unsigned int length) {
+    client_tcb_t *entry = TCB(sockfd);
     if (entry == NULL) {
         perror("[Client] connect: socket invalid\n");
         return -2;
-    } else if (entry->state != CLOSED) {
+    }
+    pthread_mutex_lock(entry->bufMutex);
+    int ret;
+    if (handshake_pending(entry, SYN, &ret)) {
+        pthread_mutex_unlock(entry->bufMutex);
+        return ret;
+    }
+    if (entry->state != CLOSED) {
+        pthread_mutex_unlock(entry->bufMutex);
         perror("[Client] connect: connection is not closed\n");
         return -3;
     }
+    // a socket reconnecting to another server drops its old key first
+    if (entry->server_portNum != 0)
+        tcbtable_unbind(clientTcbTable, entry->server_nodeID, entry->server_portNum, entry->client_portNum);
     entry->server_portNum = server_port;
     entry->server_nodeID = nodeID;
-    // make a syn seg
+    entry->st.remotePort = server_port;
+    entry->st.remoteNodeID = nodeID;
+    tcbtable_bind(clientTcbTable, entry->server_nodeID, entry->server_portNum, entry->client_portNum, sockfd);
+    // make a syn seg, it carries the first data when the server gave us a cookie and asks for one otherwise
+    unsigned int cookie = 0;
+    int cached = length > 0 && cookie_lookup(nodeID, &cookie);
+    unsigned short syn_len = cached ? (unsigned short) min(length, MAX_SEG_LEN) : 0;
     seg_t *synseg = create_seg(entry->client_portNum, server_port,
-                               SYN, entry->next_seqNum, 0, 0, 0, NULL);
-    entry->next_seqNum += 1;
-    // entry state transfer
-    if (sip_sendseg(sip_conn, (int) entry->server_nodeID, synseg) < 0) exit(0);
-    entry->state = SYNSENT;
-    printf("[Client] SYN 1 is sent\n");
-    int retry = 1;
-    long int pre_nano = now_nano();
-    while (entry->state == SYNSENT && retry < SYN_MAX_RETRY) {
-        long int cur_nano = now_nano();
-        if (timeout_nano(cur_nano, pre_nano, SYN_TIMEOUT)) {
-            pre_nano = cur_nano;
-            if (sip_sendseg(sip_conn, (int) entry->server_nodeID, synseg) < 0)exit(0);
-            ++retry;
-            printf("[Client] time over, retry to send SYN %d\n", retry);
-
-        }
-        // necessary: switch the thread to receive
-        usleep(1);
+                               SYN, entry->st.next_seqNum, cookie, 0, syn_len, data);
+    if (entry->fec) synseg->header.flags |= SEG_FLAG_FEC;
+    if (entry->rate) synseg->header.flags |= SEG_FLAG_RATE;
+    if (length > 0) {
+        synseg->header.flags |= cached ? SEG_FLAG_FASTOPEN : SEG_FLAG_COOKIE;
+        entry->fastOpenData = (char *) malloc(length);
+        memcpy(entry->fastOpenData, data, length);
+        entry->fastOpenLen = length;
+        entry->fastOpenSyn = syn_len;
     }
-
-    free(synseg);
-    if (entry->state == CONNECTED) {
-        printf("[Client] connected to server port %d\n", server_port);
-        return 1;
+    entry->st.next_seqNum += 1;
+    // state is switched before the first SYN leaves, so that seghandler never sees a SYNACK in CLOSED
+    entry->state = SYNSENT;
+    if (entry->nonblock) {
+        ret = handshake_async(entry, synseg);
+    } else {
+        ret = connect_done(entry, handshake(entry, synseg, SYNSENT, SYN_TIMEOUT, SYN_MAX_RETRY));
+        free(synseg);
     }
-    // connection failed
-    printf("[Client] tried but fail to connect in %d times\n", SYN_MAX_RETRY);
-    assert(retry == SYN_MAX_RETRY);
-    entry->state = CLOSED;
-    return -1;
+    pthread_mutex_unlock(entry->bufMutex);
+    return ret;
 }
 
 // 发送数据给STCP服务器. 这个函数使用套接字ID找到TCB表中的条目.
-// 然后它使用提供的数据创建segBuf, 将它附加到发送缓冲区链表中.
-// 如果发送缓冲区在插入数据之前为空, 一个名为sendbuf_timer的线程就会启动.
+// 然后它使用提供的数据创建segBuf, 将它附加到发送缓冲区链表中. 每个DATA段都捎带客户端当前的累计确认.
+// 如果stream_timer线程没有在运行, 它就会被启动.
 // 每隔SENDBUF_ROLLING_INTERVAL时间查询发送缓冲区以检查是否有超时事件发生. 
 // 这个函数在成功时返回1，否则返回-1. 
 // stcp_client_send是一个非阻塞函数调用.
 // 因为用户数据被分片为固定大小的STCP段, 所以一次stcp_client_send调用可能会产生多个segBuf
 // 被添加到发送缓冲区链表中. 如果调用成功, 数据就被放入TCB发送缓冲区链表中, 根据滑动窗口的情况,
-// 数据可能被传输到网络中, 或在队列中等待传输.
+// 数据可能被传输到网络中, 或在队列中等待传输. 非阻塞模式下发送缓冲区超过SEND_BUF_SEGS个段时返回STCP_EAGAIN.
 int stcp_client_send(int sockfd, void *data, unsigned int length) {
-    if (TCB[sockfd] == NULL || TCB[sockfd]->state != CONNECTED) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) {
         printf("[Client] send error: tcb missing or not connected\n");
         return -1;
     }
-    client_tcb_t *tcb = TCB[sockfd];
-    char *buf = data;
-    while (length > 0) {
-        unsigned short cur_len = length < MAX_SEG_LEN ? length : MAX_SEG_LEN;
-        seg_t *seg = create_seg(tcb->client_portNum, tcb->server_portNum, DATA,
-                                tcb->next_seqNum, 0, 0, cur_len, buf);
-        tcb->next_seqNum += cur_len;
-        buf += cur_len, length -= cur_len;
-        int err = add_seg(sockfd, seg);
-        free(seg);
-        if (err) return -1;
+    return stream_send(&tcb->st, data, length, tcb->nonblock, 0);
+}
+
+// stcp_client_send()的聚集版本, 段直接从iovcnt个缓冲区构造. 返回值与stcp_client_send()相同.
+int stcp_client_sendv(int sockfd, const struct iovec *iov, int iovcnt) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) {
+        printf("[Client] sendv error: tcb missing or not connected\n");
+        return -1;
+    }
+    return stream_sendv(&tcb->st, iov, iovcnt, tcb->nonblock, 0);
+}
+
+// stcp_client_recv()的分散版本, 数据到齐后直接从接收缓冲区分散到iovcnt个缓冲区中. 返回值与stcp_client_recv()相同.
+int stcp_client_recvv(int sockfd, const struct iovec *iov, int iovcnt) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) {
+        printf("[Client] missing socket or socket is not connected\n");
+        return -1;
+    }
+    return stream_recvv(&tcb->st, iov, iovcnt, tcb->nonblock);
+}
+
+// 把数据作为一个消息发送给STCP服务器, 最后一个段带SEG_FLAG_EOM. 返回值与stcp_client_send()相同, length为0或超过RECEIVE_BUF_SIZE时返回-1.
+int stcp_client_send_msg(int sockfd, void *data, unsigned int length) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED || length == 0 || length > RECEIVE_BUF_SIZE) {
+        printf("[Client] send_msg error: tcb missing, not connected or bad length\n");
+        return -1;
+    }
+    return stream_send(&tcb->st, data, length, tcb->nonblock, 1);
+}
+
+// 接收一个完整的消息, 返回消息长度. *buf为NULL时消息被读入新分配的缓冲区, 否则读入长度为length的*buf,
+// 消息更长时返回STCP_EMSGSIZE. 连接在消息到达前断开时返回-1, 非阻塞模式下没有完整的消息时返回STCP_EAGAIN.
+int stcp_client_recv_msg(int sockfd, void **buf, unsigned int length) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) {
+        printf("[Client] recv_msg: missing socket\n");
+        return -1;
+    }
+    return stream_recv_msg(&tcb->st, buf, length, tcb->nonblock);
+}
+
+// 接收来自STCP服务器的数据. 这个函数阻塞在TCB的stateCond上, seghandler每次向接收缓冲区追加数据时都会唤醒它,
+// 直到等待的数据到达, 它然后存储数据并返回0. 如果这个函数失败, 则返回-1.
+// 非阻塞模式下数据不足时不等待, 返回STCP_EAGAIN.
+int stcp_client_recv(int sockfd, void *buf, unsigned int length) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) {
+        printf("[Client] missing socket or socket is not connected\n");
+        return -1;
     }
     pthread_mutex_lock(tcb->bufMutex);
-    while (tcb->sendBufunSent && tcb->unAck_segNum < GBN_WINDOW) {
-        tcb->sendBufunSent->sentTime = now_nano();
-        if (sip_sendseg(sip_conn, (int) tcb->server_nodeID, &tcb->sendBufunSent->seg) < 0)exit(0);
-        ++tcb->unAck_segNum;
-        tcb->sendBufunSent = tcb->sendBufunSent->next;
+    if (!tcb->nonblock) stream_wait(&tcb->st, length, -1);
+    else stream_want(&tcb->st, length);
+    unsigned int state = tcb->state;
+    pthread_mutex_unlock(tcb->bufMutex);
+    if (ringbuf_used(tcb->st.recvBuf) < length) {
+        // not there yet, or the connection is gone before the whole response arrived
+        return tcb->nonblock && state == CONNECTED ? STCP_EAGAIN : -1;
     }
+    // data is ready, seghandler only appends so the bytes stay there without the lock
+    stream_read(&tcb->st, buf, length);
+    return 0;
+}
+
+// stcp_client_recv的部分读取版本. 这个函数等待直到接收缓冲区中至少有min_bytes字节(不超过length), 或等待了timeout纳秒,
+// 然后将缓冲区中已有的数据(最多length字节)拷贝到buf中. 返回拷贝的字节数, 超时且没有数据时返回0.
+// 如果套接字不存在, 或连接已不处于CONNECTED状态且缓冲区为空, 返回-1. 非阻塞模式下从不等待, 没有数据时返回STCP_EAGAIN.
+int stcp_client_recv_some(int sockfd, void *buf, unsigned int length, unsigned int min_bytes, long timeout) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) {
+        printf("[Client] recv_some: missing socket\n");
+        return -1;
+    }
+    pthread_mutex_lock(tcb->bufMutex);
+    if (!tcb->nonblock) stream_wait(&tcb->st, min(min_bytes, length), timeout < 0 ? -1 : now_nano() + timeout);
+    unsigned int state = tcb->state;
     pthread_mutex_unlock(tcb->bufMutex);
-    return 1;
+    unsigned int got = stream_read(&tcb->st, buf, length);
+    if (got == 0 && state != CONNECTED) return -1;
+    if (got == 0 && tcb->nonblock) return STCP_EAGAIN;
+    return (int) got;
 }
 
 // 这个函数用于断开到服务器的连接. 它以套接字ID作为输入参数. 套接字ID用于找到TCB表中的条目.  
-// 这个函数发送FIN段给服务器. 在发送FIN之后, state将转换到FINWAIT, 并启动一个定时器.
+// 这个函数发送FIN段给服务器. 在发送FIN之后, state将转换到FINWAIT, 并在stateCond上限时等待FIN_TIMEOUT.
 // 如果在最终超时之前state转换到CLOSED, 则表明FINACK已被成功接收. 否则, 如果在经过FIN_MAX_RETRY次尝试之后,
 // state仍然为FINWAIT, state将转换到CLOSED, 并返回-1.
+// 非阻塞模式下重传由handshake_timer线程完成, 这个函数返回STCP_EAGAIN, 完成后再次调用返回结果.
 int stcp_client_disconnect(int sockfd) {
-    client_tcb_t *tcb = TCB[sockfd];
+    client_tcb_t *tcb = TCB(sockfd);
     if (tcb == NULL) {
         printf("[Client] current socket %u has no connection\n", sockfd);
         return -1;
     }
+    pthread_mutex_lock(tcb->bufMutex);
+    int ret;
+    if (handshake_pending(tcb, FIN, &ret)) {
+        pthread_mutex_unlock(tcb->bufMutex);
+        return ret;
+    }
     if (tcb->state != CONNECTED) {
+        pthread_mutex_unlock(tcb->bufMutex);
         perror("[Client] client is not connected\n");
         return -1;
     }
     seg_t *finseg = create_seg(tcb->client_portNum, tcb->server_portNum,
-                               FIN, tcb->next_seqNum, 0, 0, 0, NULL);
-    tcb->next_seqNum += 1;
-    if (sip_sendseg(sip_conn, (int) tcb->server_nodeID, finseg) < 0)return -1;
+                               FIN, tcb->st.next_seqNum, 0, 0, 0, NULL);
+    tcb->st.next_seqNum += 1;
+    // the send buffer and anything the server still sends are dropped from now on
+    stream_group_shutdown(&tcb->sg);
     tcb->state = FINWAIT;
-    printf("[Client] FIN 1 is sent\n");
-    int retry = 1;
-    long int pre_nano = now_nano();
-    while (tcb->state == FINWAIT && retry < FIN_MAX_RETRY) {
-        long int cur_nano = now_nano();
-        if (timeout_nano(cur_nano, pre_nano, FIN_TIMEOUT)) {
-            if (sip_sendseg(sip_conn, (int) tcb->server_nodeID, finseg) < 0)exit(0);
-            ++retry;
-            printf("[Client] time over, retry to send FIN %d\n", retry);
-        }
-        // necessary: should switch to receive-thread or FINACK may not be received.
-        usleep(1);
-    }
-    if (tcb->state == FINWAIT) {
-        tcb->state = CLOSED;
-        printf("[Client] tried but fail to disconnect in %d times\n", FIN_MAX_RETRY);
-        return -1;
+    if (tcb->nonblock) {
+        ret = handshake_async(tcb, finseg);
+    } else {
+        handshake(tcb, finseg, FINWAIT, FIN_TIMEOUT, FIN_MAX_RETRY);
+        ret = disconnect_done(tcb);
+        free(finseg);
     }
-
-    printf("[Client] port %u disconnect successfully\n", tcb->client_portNum);
-    return 0;
+    pthread_mutex_unlock(tcb->bufMutex);
+    return ret;
 }
 
-// 这个函数调用free()释放TCB条目. 它将该条目标记为NULL, 成功时(即位于正确的状态)返回1,
-// 失败时(即位于错误的状态)返回-1.
+// 这个函数调用free()释放TCB条目. 它从TCB表中删除该条目并回收套接字ID, 成功时(即位于正确的状态)返回1,
+// 失败时(即位于错误的状态, 或非阻塞的connect/disconnect仍在进行)返回-1.
 int stcp_client_close(int sockfd) {
-    if (TCB[sockfd] == NULL) return 1;
-    if (TCB[sockfd] && TCB[sockfd]->state == CLOSED) {
-        pthread_mutex_destroy(TCB[sockfd]->bufMutex);
-        free(TCB[sockfd]->bufMutex);
-        free(TCB[sockfd]);
-        TCB[sockfd] = NULL;
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return 1;
+    if (tcb->state == CLOSED && !__atomic_load_n(&tcb->handshaking, __ATOMIC_ACQUIRE)) {
+        if (tcb->server_portNum != 0)
+            tcbtable_unbind(clientTcbTable, tcb->server_nodeID, tcb->server_portNum, tcb->client_portNum);
+        tcbtable_release(clientTcbTable, sockfd);
+        // seghandler may have found the tcb before it was unbound, or still hold a delayed ACK of it, so it frees it
+        pthread_mutex_lock(&orphanMutex);
+        tcb->orphanNext = orphanHead;
+        __atomic_store_n(&orphanHead, tcb, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&orphanMutex);
         return 1;
     }
     return -1;
 }
 
-// 这是由stcp_client_init()启动的线程. 它处理所有来自服务器的进入段. 
-// seghandler被设计为一个调用sip_recvseg()的无穷循环. 如果sip_recvseg()失败, 则说明到SIP进程的连接已关闭,
-// 线程将终止. 根据STCP段到达时连接所处的状态, 可以采取不同的动作. 请查看客户端FSM以了解更多细节.
+// 这个函数在连接sockfd内不经过握手打开一个新的流, 返回流ID. 连接不处于CONNECTED状态或流ID已用完时返回-1.
+int stcp_client_stream_open(int sockfd) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) return -1;
+    return stream_open(&tcb->sg);
+}
+
+// 这个函数返回服务器在连接sockfd内打开的下一个新流的ID, 没有新流时它阻塞在stateCond上.
+// 非阻塞模式下没有新流时返回STCP_EAGAIN. 连接断开时返回-1.
+int stcp_client_stream_accept(int sockfd) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    return stream_accept(&tcb->sg, tcb->nonblock);
+}
+
+// 这个函数在连接sockfd的流stream_id上发送数据, 与stcp_client_send()相同. 流不存在时返回-1.
+int stcp_client_stream_send(int sockfd, int stream_id, void *data, unsigned int length) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) return -1;
+    stream_t *st = stream_find(&tcb->sg, stream_id);
+    if (st == NULL) return -1;
+    return stream_send(st, data, length, tcb->nonblock, 0);
+}
 
-static inline int get_sip_sock(unsigned int src_port, unsigned int dst_port) {
-    int j = 0;
-    for (; j < MAX_TRANSPORT_CONNECTIONS; ++j) {
-        if (TCB[j] && TCB[j]->client_portNum == dst_port && TCB[j]->server_portNum == src_port)
+// 这个函数从连接sockfd的流stream_id接收恰好length字节, 与stcp_client_recv()相同. 流不存在时返回-1.
+int stcp_client_stream_recv(int sockfd, int stream_id, void *buf, unsigned int length) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    stream_t *st = stream_find(&tcb->sg, stream_id);
+    if (st == NULL) return -1;
+    return stream_recv(st, buf, length, tcb->nonblock);
+}
+
+// 这个函数关闭连接sockfd的流stream_id. 成功时返回1, 流不存在或stream_id为0时返回-1.
+int stcp_client_stream_close(int sockfd, int stream_id) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    return stream_close(&tcb->sg, stream_id);
+}
+
+// 这个函数设置套接字选项opt的值为value. 成功时返回1, 套接字不存在或选项未知时返回-1.
+int stcp_client_setopt(int sockfd, int opt, int value) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    if (opt == STCP_OPT_CLASS && (value < 0 || value >= TC_NUM)) return -1;
+    // the segment threads and the timer read the options, every option is written under the lock
+    int ret = 1;
+    pthread_mutex_lock(tcb->bufMutex);
+    switch (opt) {
+        case STCP_OPT_DELAYACK:
+            tcb->st.delayAck = value != 0;
+            break;
+        case STCP_OPT_NONBLOCK:
+            tcb->nonblock = value != 0;
+            break;
+        case STCP_OPT_PACING:
+            tcb->sg.pacing = value != 0;
+            break;
+        case STCP_OPT_FEC:
+            tcb->fec = value != 0;
+            break;
+        case STCP_OPT_RATE:
+            tcb->rate = value != 0;
+            break;
+        case STCP_OPT_CLASS:
+            tcb->sg.tclass = (unsigned int) value;
             break;
+        default:
+            ret = -1;
     }
-    if (j == MAX_TRANSPORT_CONNECTIONS)return -1;
-    return j;
+    pthread_mutex_unlock(tcb->bufMutex);
+    return ret;
+}
+
+// 这个函数返回套接字的eventfd, 第一次调用时创建它. 新创建的eventfd立即可读, 以免错过在它创建之前发生的事件. 失败时返回-1.
+int stcp_client_eventfd(int sockfd) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    pthread_mutex_lock(tcb->bufMutex);
+    if (tcb->eventFd < 0) {
+        int fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+        __atomic_store_n(&tcb->eventFd, fd, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(tcb->bufMutex);
+    return tcb->eventFd;
+}
+
+// 这个函数把连接的传输统计填入stats. 成功时返回1, 套接字不存在时返回-1.
+int stcp_client_getstats(int sockfd, stcp_stats_t *stats) {
+    client_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    stream_group_stats(&tcb->sg, stats);
+    return 1;
+}
+
+// 这个函数修改客户端的最大连接数. 已经存在的连接不受影响.
+void stcp_client_setmaxconn(unsigned int max_conn) {
+    tcbtable_setlimit(clientTcbTable, max_conn);
 }
 
-void *seghandler(void *arg) {
+// free the tcbs closed by the application, seghandler holds none of them between segments
+static void orphan_reap(void) {
+    if (__atomic_load_n(&orphanHead, __ATOMIC_ACQUIRE) == NULL) return;
+    pthread_mutex_lock(&orphanMutex);
+    client_tcb_t *tcb = orphanHead;
+    orphanHead = NULL;
+    pthread_mutex_unlock(&orphanMutex);
+    while (tcb) {
+        client_tcb_t *next = tcb->orphanNext;
+        stream_group_ack_cancel(&ackQueue, &tcb->sg);
+        tcb_free(tcb);
+        tcb = next;
+    }
+}
+
+// 这是由stcp_client_init()启动的线程. 它处理所有来自服务器的进入段. 
+// seghandler被设计为一个调用sip_recvseg()的无穷循环, 它以(源节点ID, 源端口号, 目的端口号)在TCB表的哈希表中查找段所属的连接. 如果sip_recvseg()失败, 则说明到SIP进程的连接已关闭,
+// 线程将终止. 根据STCP段到达时连接所处的状态, 可以采取不同的动作. 请查看客户端FSM以了解更多细节.
+// 每次state转换都在bufMutex保护下进行, 并广播stateCond以唤醒阻塞在connect/disconnect中的线程, 同时通知套接字的eventfd.
+// 它处理服务器的DATA段和其中捎带的确认, 并像服务器一样发送到期的延迟确认: 在等待下一个段时, 它最多等待到第一个延迟确认的截止时间.
+// 它是库的内部线程, 不对应用程序导出, 所以客户端和服务器的库可以链接进同一个程序(见stcpd).
+
+static void *seghandler(void *arg) {
     seg_t rcv_seg;
     int srcNodeID;
     bzero(&rcv_seg, sizeof(seg_t));
     while (1) {
+        orphan_reap();
+        // no longer than the first delayed ACK may wait
+        int wait_ms = ackq_flush(&ackQueue);
+        if (wait_ms >= 0) {
+            struct pollfd pfd = {.fd = sip_conn, .events = POLLIN};
+            if (poll(&pfd, 1, wait_ms) == 0) continue;
+        }
         int ret = sip_recvseg(sip_conn, &srcNodeID, &rcv_seg);
         if (ret < 0)break;
         if (ret > 0)continue;
-        int sock = get_sip_sock(rcv_seg.header.src_port, rcv_seg.header.dst_port);
+        int sock = tcbtable_lookup(clientTcbTable, srcNodeID, rcv_seg.header.src_port, rcv_seg.header.dst_port);
         if (sock < 0)continue;
-        client_tcb_t *tcb = TCB[sock];
+        client_tcb_t *tcb = TCB(sock);
+        if (tcb == NULL)continue;
         if (tcb->state == CLOSED) continue;
         switch (rcv_seg.header.type) {
             case SYNACK: {
-                if (tcb->state == CONNECTED)continue;
-                assert(tcb->state == SYNSENT);
-                tcb->state = CONNECTED;
+                pthread_mutex_lock(tcb->bufMutex);
+                // a late SYNACK after connect gave up finds the tcb CLOSED again
+                if (tcb->state == SYNSENT) {
+                    // streams of an earlier connection of the socket go away
+                    stream_group_reset(&ackQueue, &tcb->sg);
+                    tcb->st.peer_win = rcv_seg.header.rcv_win;
+                    // the data of the server starts right after the sequence number of its SYNACK
+                    tcb->st.expect_seqNum = tcb->st.ackSentNum = rcv_seg.header.seq_num + 1;
+                    tcb->st.established = 1;
+                    tcb->sg.fec = tcb->fec && (rcv_seg.header.flags & SEG_FLAG_FEC);
+                    tcb->sg.rateMode = tcb->rate && (rcv_seg.header.flags & SEG_FLAG_RATE);
+                    if (rcv_seg.header.flags & SEG_FLAG_COOKIE && rcv_seg.header.length == sizeof(unsigned int)) {
+                        unsigned int cookie;
+                        memcpy(&cookie, rcv_seg.data, sizeof(cookie));
+                        cookie_store(srcNodeID, cookie);
+                    }
+                    if (tcb->fastOpenData) {
+                        // the SYNACK acknowledges the data of the SYN only if the server took it, the rest is sent as usual
+                        unsigned int taken = rcv_seg.header.ack_num - tcb->st.next_seqNum == tcb->fastOpenSyn ?
+                                             tcb->fastOpenSyn : 0;
+                        tcb->st.next_seqNum += taken;
+                        if (taken < tcb->fastOpenLen)
+                            stream_push(&tcb->st, tcb->fastOpenData + taken, tcb->fastOpenLen - taken, 0);
+                        fastopen_drop(tcb);
+                    }
+                    tcb->state = CONNECTED;
+                    pthread_cond_broadcast(tcb->stateCond);
+                    tcb_event(tcb);
+                }
+                pthread_mutex_unlock(tcb->bufMutex);
                 break;
             }
             case FINACK: {
-                if (tcb->state == CLOSED)continue;
-                assert(tcb->state == FINWAIT);
-                tcb->state = CLOSED;
+                stream_group_ack_cancel(&ackQueue, &tcb->sg);
+                pthread_mutex_lock(tcb->bufMutex);
+                if (tcb->state == FINWAIT) {
+                    tcb->state = CLOSED;
+                    pthread_cond_broadcast(tcb->stateCond);
+                    tcb_event(tcb);
+                }
+                pthread_mutex_unlock(tcb->bufMutex);
+                break;
+            }
+            case DATA: {
+                if (tcb->state != CONNECTED)continue;
+                stream_t *st = stream_demux(&ackQueue, &tcb->sg, &rcv_seg);
+                if (st == NULL)continue;
+                // the ACK carried by the data first, it may open the window for our own data.
+                // a parity carries the bounds of its block where the ACK would be
+                int parity = (rcv_seg.header.flags & SEG_FLAG_FEC) != 0;
+                unsigned int popped = parity ? 0 : stream_ack(st, rcv_seg.header.ack_num, rcv_seg.header.rcv_win);
+                int fresh = parity ? stream_parity(&ackQueue, st, &rcv_seg) : stream_data(&ackQueue, st, &rcv_seg);
+                if (fresh || popped) tcb_notify(tcb);
                 break;
             }
             case DATAACK: {
                 if (tcb->state != CONNECTED)continue;
-                unsigned int ack_num = rcv_seg.header.ack_num;
-                pthread_mutex_lock(tcb->bufMutex);
-                while (tcb->sendBufHead->next && tcb->sendBufHead->next->seg.header.seq_num < ack_num) {
-                    pop_seg(tcb);
-                    --tcb->unAck_segNum;
-                }
-                while (tcb->sendBufunSent && tcb->unAck_segNum < GBN_WINDOW) {
-                    tcb->sendBufunSent->sentTime = now_nano();
-                    if (sip_sendseg(sip_conn, (int) tcb->server_nodeID, &tcb->sendBufunSent->seg) < 0)exit(0);
-                    ++tcb->unAck_segNum;
-                    tcb->sendBufunSent = tcb->sendBufunSent->next;
-                }
-                pthread_mutex_unlock(tcb->bufMutex);
+                stream_t *st = stream_demux(&ackQueue, &tcb->sg, &rcv_seg);
+                // the segments a receive report names lost go out again with the ones the ACK lets go
+                if (st && (rcv_seg.header.flags & SEG_FLAG_RATE)) stream_report(st, &rcv_seg);
+                // room in the send buffer for a non-blocking sender
+                if (st && stream_ack(st, rcv_seg.header.ack_num, rcv_seg.header.rcv_win)) tcb_event(tcb);
                 break;
             }
             default:
                 assert(0);
         }
     }
-    // son connection is closed, should clear TCB
-    for (int i = 0; i < MAX_TRANSPORT_CONNECTIONS; ++i) {
-        if (TCB[i]) TCB[i]->state = CLOSED;
-    }
-    return 0;
-}
-
-
-//这个线程持续轮询发送缓冲区以触发超时事件. 如果发送缓冲区非空, 它应一直运行.
-//如果(当前时间 - 第一个已发送但未被确认段的发送时间) > DATA_TIMEOUT, 就发生一次超时事件.
-//当超时事件发生时, 重新发送所有已发送但未被确认段. 当发送缓冲区为空时, 这个线程将终止.
-void *sendBuf_timer(void *clienttcb) {
-    client_tcb_t *tcb = clienttcb;
-    while (1) {
-        usleep(nstoms(SENDBUF_POLLING_INTERVAL));
+    // son connection is closed, should clear TCB and wake up everyone waiting for a transition
+    for (int i = 0; i < tcbtable_span(clientTcbTable); ++i) {
+        client_tcb_t *tcb = TCB(i);
+        if (tcb == NULL) continue;
         pthread_mutex_lock(tcb->bufMutex);
-        // loop condition after '!', connected and not empty
-        if (!(tcb->state == CONNECTED && tcb->sendBufHead != tcb->sendBufTail)) {
-            pthread_mutex_unlock(tcb->bufMutex);
-            break;
-        }
-        long cur_nano = now_nano();
-        if (timeout_nano(cur_nano, tcb->sendBufHead->next->sentTime, DATA_TIMEOUT)) {
-            printf("[Client] \x1B[34mdata timeout, begin to resend\x1B[0m\n");
-            for (segBuf_t *sb = tcb->sendBufHead->next; sb != tcb->sendBufunSent; sb = sb->next) {
-                sb->sentTime = now_nano();
-                if (sip_sendseg(sip_conn, (int) tcb->server_nodeID, &sb->seg) < 0)exit(0);
-            }
-        }
+        tcb->state = CLOSED;
+        stream_group_shutdown(&tcb->sg);
+        pthread_cond_broadcast(tcb->stateCond);
+        tcb_event(tcb);
         pthread_mutex_unlock(tcb->bufMutex);
     }
     return 0;
@@ -7,6 +7,7 @@
 #define STCPCLIENT_H
 #include <pthread.h>
 #include "../common/seg.h"
+#include "../common/stream.h"
 
 //FSM中使用的客户端状态
 #define	CLOSED 1
@@ -14,12 +15,13 @@
 #define	CONNECTED 3
 #define	FINWAIT 4
 
-//在发送缓冲区链表中存储段的单元.
-typedef struct segBuf {
-        seg_t seg;
-        unsigned int sentTime;
-        struct segBuf* next;
-} segBuf_t;
+//stcp_client_setopt()支持的套接字选项
+#define STCP_OPT_DELAYACK 1         //是否启用延迟确认, 默认启用
+#define STCP_OPT_NONBLOCK 2         //是否使用非阻塞模式, 默认不使用
+#define STCP_OPT_PACING 4           //是否步调发送, 默认启用
+#define STCP_OPT_FEC 5              //是否请求启用前向纠错, 默认不请求
+#define STCP_OPT_RATE 6             //是否请求使用速率模式, 默认不请求
+#define STCP_OPT_CLASS 7            //连接的流量类别(TC_*), 默认为TC_DEFAULT
 
 //客户端传输控制块. 一个STCP连接的客户端使用这个数据结构记录连接信息.   
 typedef struct client_tcb {
@@ -28,12 +30,21 @@ typedef struct client_tcb {
 	unsigned int client_nodeID;     //客户端节点ID, 类似IP地址
 	unsigned int client_portNum;    //客户端端口号
 	unsigned int state;     	//客户端状态
-	unsigned int next_seqNum;       //新段准备使用的下一个序号 
 	pthread_mutex_t* bufMutex;      //发送缓冲区互斥量
-	segBuf_t* sendBufHead;          //发送缓冲区头
-	segBuf_t* sendBufunSent;        //发送缓冲区中的第一个未发送段
-	segBuf_t* sendBufTail;          //发送缓冲区尾
-	unsigned int unAck_segNum;      //已发送但未收到确认段的数量
+	pthread_cond_t* stateCond;      //state变化或有新数据进入接收缓冲区时被广播的条件变量, 与bufMutex配合使用
+	stream_t st;                    //双向的数据传输状态, stcp_client_send()的数据进入它的发送缓冲区, 从服务器到客户端的数据进入它的接收缓冲区
+	streamGroup_t sg;               //连接内多路复用的流, st是其中的流0
+	int nonblock;                   //是否使用非阻塞模式
+	int eventFd;                    //stcp_client_eventfd()创建的eventfd, 没有时为-1
+	int asyncOp;                    //非阻塞模式下尚未报告结果的连接(SYN)或断开(FIN)操作, 没有时为-1
+	int asyncRet;                   //asyncOp的结果, 即阻塞模式下connect/disconnect的返回值
+	int handshaking;                //是否有线程正在为asyncOp重传SYN或FIN
+	struct client_tcb* orphanNext;  //被应用程序关闭的TCB链表, 由seghandler释放
+	char* fastOpenData;             //stcp_client_connect_data()的数据副本, 连接建立时未被SYNACK确认的部分进入发送缓冲区, 没有时为NULL
+	unsigned int fastOpenLen;       //fastOpenData的长度
+	unsigned int fastOpenSyn;       //SYN中携带的fastOpenData的字节数, 没有cookie时为0
+	int fec;                        //是否在SYN中请求启用前向纠错, 服务器同意时sg.fec在连接建立时被设置
+	int rate;                       //是否在SYN中请求使用速率模式, 服务器同意时sg.rateMode在连接建立时被设置
 } client_tcb_t;
 
 //
@@ -49,7 +60,7 @@ typedef struct client_tcb {
 
 void stcp_client_init(int conn);
 
-// 这个函数初始化TCB表, 将所有条目标记为NULL.  
+// 这个函数创建一个空的TCB表, 最大连接数为MAX_TRANSPORT_CONNECTIONS.
 // 它还针对TCP套接字描述符conn初始化一个STCP层的全局变量, 该变量作为sip_sendseg和sip_recvseg的输入参数.
 // 最后, 这个函数启动seghandler线程来处理进入的STCP段. 客户端只有一个seghandler.
 //
@@ -58,10 +69,10 @@ void stcp_client_init(int conn);
 
 int stcp_client_sock(unsigned int client_port);
 
-// 这个函数查找客户端TCB表以找到第一个NULL条目, 然后使用malloc()为该条目创建一个新的TCB条目.
+// 这个函数创建一个新的TCB条目, 并从TCB表中为它分配一个套接字ID, 被关闭的套接字ID会被优先回收使用.
 // 该TCB中的所有字段都被初始化. 例如, TCB state被设置为CLOSED，客户端端口被设置为函数调用参数client_port. 
-// TCB表中条目的索引号应作为客户端的新套接字ID被这个函数返回, 它用于标识客户端的连接. 
-// 如果TCB表中没有条目可用, 这个函数返回-1.
+// 分配的套接字ID被这个函数返回, 它用于标识客户端的连接. 
+// 如果连接数已达到上限, 这个函数返回-1.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
@@ -69,9 +80,23 @@ int stcp_client_sock(unsigned int client_port);
 int stcp_client_connect(int socked, int nodeID, unsigned int server_port);
 
 // 这个函数用于连接服务器. 它以套接字ID, 服务器节点ID和服务器的端口号作为输入参数. 套接字ID用于找到TCB条目.  
-// 这个函数设置TCB的服务器节点ID和服务器端口号,  然后使用sip_sendseg()发送一个SYN段给服务器.  
-// 在发送了SYN段之后, 一个定时器被启动. 如果在SYNSEG_TIMEOUT时间之内没有收到SYNACK, SYN 段将被重传. 
+// 这个函数设置TCB的服务器节点ID和服务器端口号, 并将(服务器节点ID, 服务器端口号, 客户端端口号)登记到TCB表的哈希表中,
+// 然后使用sip_sendseg()发送一个SYN段给服务器.  
+// 在发送了SYN段之后, 这个函数在stateCond上限时等待SYN_TIMEOUT. 如果在SYN_TIMEOUT时间之内没有收到SYNACK, SYN 段将被重传. 
 // 如果收到了, 就返回1. 否则, 如果重传SYN的次数大于SYN_MAX_RETRY, 就将state转换到CLOSED, 并返回-1. 
+// 非阻塞模式下, 重传由一个后台线程完成, 这个函数立即返回STCP_EAGAIN. 连接建立或失败时套接字的eventfd变为可读,
+// 此后再次以相同参数调用这个函数返回上面的结果(1或-1), 在此之前调用返回STCP_EAGAIN.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_client_connect_data(int sockfd, int nodeID, unsigned int server_port, void* data, unsigned int length);
+
+// 快速打开版本的stcp_client_connect(). 如果缓存中有服务器节点nodeID发放的cookie, 数据的前MAX_SEG_LEN字节随SYN一起发出,
+// 服务器在接受连接前就把它们交给应用程序, 一个请求因此节省一次往返. 否则SYN向服务器请求cookie, 以备下一个连接使用.
+// 连接建立时, SYNACK没有确认的数据(没有cookie, cookie已失效或服务器没有启用STCP_OPT_FASTOPEN时是全部数据)像stcp_client_send()
+// 一样进入发送缓冲区, 所以无论服务器是否接受快速打开, 对端都按序收到全部数据. cookie按服务器节点缓存, 由进程内的所有套接字共享.
+// length为0时与stcp_client_connect()相同. 返回值与stcp_client_connect()相同, 连接失败时数据被丢弃.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
@@ -79,14 +104,53 @@ int stcp_client_connect(int socked, int nodeID, unsigned int server_port);
 int stcp_client_send(int sockfd, void* data, unsigned int length);
 
 // 发送数据给STCP服务器. 这个函数使用套接字ID找到TCB表中的条目.
-// 然后它使用提供的数据创建segBuf, 将它附加到发送缓冲区链表中.
-// 如果发送缓冲区在插入数据之前为空, 一个名为sendbuf_timer的线程就会启动.
+// 然后它使用提供的数据创建segBuf, 将它附加到发送缓冲区链表中. 每个DATA段都捎带客户端当前的累计确认.
+// 如果stream_timer线程没有在运行, 它就会被启动.
 // 每隔SENDBUF_ROLLING_INTERVAL时间查询发送缓冲区以检查是否有超时事件发生. 
 // 这个函数在成功时返回1，否则返回-1. 
 // stcp_client_send是一个非阻塞函数调用.
 // 因为用户数据被分片为固定大小的STCP段, 所以一次stcp_client_send调用可能会产生多个segBuf
 // 被添加到发送缓冲区链表中. 如果调用成功, 数据就被放入TCB发送缓冲区链表中, 根据滑动窗口的情况,
 // 数据可能被传输到网络中, 或在队列中等待传输.
+// 非阻塞模式下, 如果发送缓冲区非空且放入数据后将超过SEND_BUF_SEGS个段, 这个函数不放入任何数据并返回STCP_EAGAIN,
+// 发送缓冲区中的段被确认时套接字的eventfd变为可读.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_client_recv(int sockfd, void* buf, unsigned int length);
+
+// 接收来自STCP服务器的数据. 这个函数与stcp_server_recv()相同: 它阻塞在TCB的stateCond上, seghandler每次向接收缓冲区
+// 追加数据时都会唤醒它, 直到length字节的数据到达, 它然后存储数据并返回0. 如果连接在此之前断开, 返回-1.
+// 客户端收到的数据被延迟确认, 客户端的下一个DATA段会捎带这个确认. 非阻塞模式下数据不足时返回STCP_EAGAIN.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_client_recv_some(int sockfd, void* buf, unsigned int length, unsigned int min_bytes, long timeout);
+
+// stcp_client_recv的部分读取版本, 与stcp_server_recv_some()相同. 这个函数等待直到接收缓冲区中至少有min_bytes字节(不超过length),
+// 或等待了timeout纳秒, 然后拷贝缓冲区中已有的数据(最多length字节). timeout为负数时一直等待, 为0时不等待.
+// 返回拷贝的字节数, 超时且没有数据时返回0. 如果套接字不存在, 或连接已不处于CONNECTED状态且缓冲区为空, 返回-1.
+// 非阻塞模式下这个函数从不等待, 没有数据时返回STCP_EAGAIN.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_client_sendv(int sockfd, const struct iovec* iov, int iovcnt);
+int stcp_client_recvv(int sockfd, const struct iovec* iov, int iovcnt);
+
+// stcp_client_send()和stcp_client_recv()的分散/聚集版本, 与stcp_server_sendv()和stcp_server_recvv()相同.
+// 段直接从iovcnt个缓冲区构造, 收到的数据直接分散到iovcnt个缓冲区中, 首部加负载的协议不需要中间拷贝.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_client_send_msg(int sockfd, void* data, unsigned int length);
+int stcp_client_recv_msg(int sockfd, void** buf, unsigned int length);
+
+// 发送或接收一个保留边界的消息, 与stcp_server_send_msg()和stcp_server_recv_msg()相同. stcp_client_recv_msg()在*buf为NULL时
+// 分配消息缓冲区, 由调用者释放. 小的请求/响应因此不需要先发送长度, 接收方也不需要分两次读出.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
@@ -94,34 +158,98 @@ int stcp_client_send(int sockfd, void* data, unsigned int length);
 int stcp_client_disconnect(int sockfd);
 
 // 这个函数用于断开到服务器的连接. 它以套接字ID作为输入参数. 套接字ID用于找到TCB表中的条目.  
-// 这个函数发送FIN段给服务器. 在发送FIN之后, state将转换到FINWAIT, 并启动一个定时器.
+// 这个函数发送FIN段给服务器. 在发送FIN之后, state将转换到FINWAIT, 并在stateCond上限时等待FIN_TIMEOUT.
 // 如果在最终超时之前state转换到CLOSED, 则表明FINACK已被成功接收. 否则, 如果在经过FIN_MAX_RETRY次尝试之后,
 // state仍然为FINWAIT, state将转换到CLOSED, 并返回-1. 
+// 非阻塞模式下, 这个函数发送FIN后立即返回STCP_EAGAIN, 断开完成或失败时套接字的eventfd变为可读,
+// 此后再次调用这个函数返回上面的结果(0或-1).
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
 
 int stcp_client_close(int sockfd);
 
-// 这个函数调用free()释放TCB条目. 它将该条目标记为NULL, 成功时(即位于正确的状态)返回1,
-// 失败时(即位于错误的状态)返回-1.
+// 这个函数调用free()释放TCB条目. 它从TCB表中删除该条目并回收套接字ID, 成功时(即位于正确的状态)返回1,
+// 失败时(即位于错误的状态, 或非阻塞的connect/disconnect仍在进行)返回-1. 套接字的eventfd也被关闭.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_client_stream_open(int sockfd);
+
+// 在连接内打开一个新的流. 流0是连接本身, stcp_client_send()/stcp_client_recv()使用它. 其他流不需要握手: 这个函数只在本地分配一个
+// 奇数流ID, 流的第一个DATA段就在服务器打开它, 所以短传输不必为新连接付出SYN的往返. 每个流有独立的序号空间, 按序交付,
+// 接收窗口(STREAM_BUF_SIZE)和重传, 所以一个流的丢包不会阻塞其他流. 连接的所有流共享一个拥塞窗口和一个重传定时器线程.
+// 返回流ID. 连接不处于CONNECTED状态, 流ID已用完或连接中的流数已达到STREAM_MAX时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_client_stream_accept(int sockfd);
+
+// 返回服务器在连接内打开的下一个流的ID. 流按服务器打开的顺序被返回. 没有新流时这个函数阻塞在TCB的stateCond上,
+// 非阻塞模式下返回STCP_EAGAIN. 连接断开时返回-1.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
 
-void *seghandler(void* arg);
+int stcp_client_stream_send(int sockfd, int stream_id, void* data, unsigned int length);
+int stcp_client_stream_recv(int sockfd, int stream_id, void* buf, unsigned int length);
 
-// 这是由stcp_client_init()启动的线程. 它处理所有来自服务器的进入段. 
-// seghandler被设计为一个调用sip_recvseg()的无穷循环. 如果sip_recvseg()失败, 则说明到SIP进程的连接已关闭,
-// 线程将终止. 根据STCP段到达时连接所处的状态, 可以采取不同的动作. 请查看客户端FSM以了解更多细节.
+// 在流stream_id上发送或接收数据, 与stcp_client_send()和stcp_client_recv()相同. 流不存在或已被关闭时返回-1.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
 
-void* sendBuf_timer(void* clienttcb);
-//这个线程持续轮询发送缓冲区以触发超时事件. 如果发送缓冲区非空, 它应一直运行.
-//如果(当前时间 - 第一个已发送但未被确认段的发送时间) > DATA_TIMEOUT, 就发生一次超时事件.
-// 当超时事件发生时, 重新发送所有已发送但未被确认段. 当发送缓冲区为空时, 这个线程将终止.
+int stcp_client_stream_close(int sockfd, int stream_id);
+
+// 关闭一个流. 关闭后这个流不再接收数据, 对端在这个流上继续发送的数据被直接确认并丢弃. 发送缓冲区中的数据仍被发送,
+// 全部被确认后流被释放. 流ID在一个连接内不会被重用, 重新连接时上一个连接的流都被释放. 成功时返回1, 流不存在或stream_id为0时返回-1.
+//
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_client_setopt(int sockfd, int opt, int value);
+
+// 这个函数设置套接字选项opt的值为value. 当前支持的选项有:
+// STCP_OPT_NONBLOCK: 非0时使用非阻塞模式, stcp_client_connect(), stcp_client_send(), stcp_client_recv(),
+//                    stcp_client_recv_some()和stcp_client_disconnect()在操作无法立即完成时返回STCP_EAGAIN.
+// STCP_OPT_DELAYACK: 非0时启用延迟确认(默认启用), 与服务器的同名选项相同.
+// STCP_OPT_PACING: 非0时启用步调发送(默认启用), 与服务器的同名选项相同.
+// STCP_OPT_FEC: 非0时此后的连接在SYN中请求启用前向纠错, 服务器也启用了同名选项时两个方向都使用它, 见服务器的同名选项.
+// STCP_OPT_RATE: 非0时此后的连接在SYN中请求使用速率模式, 服务器也启用了同名选项时两个方向都使用它, 见服务器的同名选项.
+// STCP_OPT_CLASS: 连接的流量类别, TC_CONTROL到TC_BULK之一, 立即生效. SYN携带它, 服务器的连接默认在反方向上使用同一类别,
+//                    见服务器的同名选项.
+// 成功时返回1, 套接字不存在, 选项未知或流量类别不合法时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_client_eventfd(int sockfd);
+
+// 这个函数返回套接字的eventfd, 第一次调用时创建它, 它由stcp_client_close()关闭. 连接建立或失败, 发送缓冲区中的段被确认,
+// 数据进入接收缓冲区, 或连接断开时, eventfd的计数器增加, 从而变为可读, 应用程序可以把它加入自己的epoll/poll/select中, 读出计数器后重试非阻塞调用.
+// 新创建的eventfd立即可读, 以免错过在它创建之前发生的事件. 失败时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_client_getstats(int sockfd, stcp_stats_t* stats);
+
+// 这个函数把连接的传输统计填入stats: 收发和重传的字节数与段数, 单独的和捎带的确认数, 发出的校验段和由校验段恢复的段数,
+// 超时次数, 重复的DATAACK数, 拥塞窗口和在途段数, SRTT和重传超时, 速率模式的发送速率和对端报告的路径容量, 协商的前向纠错和流量类别,
+// 接收缓冲区中未读出的字节数, 乱序缓存的字节数, 以及非阻塞发送因发送缓冲区满而等待的时间, 即返回STCP_EAGAIN到确认腾出足够空间之间的时间.
+// 阻塞模式的发送总是立即放入发送缓冲区, 它的等待时间总是0. 计数器在收发段时用relaxed原子操作更新,
+// 所以可以在任何时候从任何线程调用这个函数, 不影响数据传输. 成功时返回1, 套接字不存在时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+void stcp_client_setmaxconn(unsigned int max_conn);
+
+// 这个函数修改客户端的最大连接数(默认为MAX_TRANSPORT_CONNECTIONS). 已经存在的连接不受影响.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
 
 #endif
@@ -9,12 +9,22 @@
 //传输层参数
 /*******************************************************************/
 
-//这是STCP可以支持的最大连接数. 你的TCB表应包含MAX_TRANSPORT_CONNECTIONS个条目.
+//这是STCP默认支持的最大连接数. TCB表按需增长, 最大连接数可以用stcp_client_setmaxconn()/stcp_server_setmaxconn()在运行时修改.
 #define MAX_TRANSPORT_CONNECTIONS 10
-//最大段长度
-//MAX_SEG_LEN = 1500 - sizeof(seg header) - sizeof(ip header)
-//#define MAX_SEG_LEN  1464
-#define MAX_SEG_LEN 1464
+//stcp_server_accept()在尚未监听的套接字上使用的默认接受队列长度.
+#define ACCEPT_BACKLOG 16
+//非阻塞模式下的STCP调用在操作无法立即完成时返回这个值, 类似于EAGAIN. 套接字的eventfd变为可读后应重试该调用
+#define STCP_EAGAIN (-11)
+//stcp_client_recv_msg()/stcp_server_recv_msg()的缓冲区小于消息时返回这个值, 类似于EMSGSIZE. 消息仍留在接收缓冲区中
+#define STCP_EMSGSIZE (-90)
+//非阻塞模式下发送缓冲区最多容纳的段数, 超过时stcp_client_send()返回STCP_EAGAIN
+#define SEND_BUF_SEGS 64
+//最大段长度, 一个段连同首部要装进一个SIP报文
+//MAX_SEG_LEN = MAX_PKT_LEN - sizeof(seg header) = 1484 - 28
+#define MAX_SEG_LEN 1456
+//STCP一次交给SIP的超级段最多包含的段数. 超级段的数据长度不能超过段首部中16位的length, 即64KB
+#define SUPERSEG_SEGS 44
+#define MAX_SUPERSEG_LEN (SUPERSEG_SEGS * MAX_SEG_LEN)
 //数据包丢失率为10%
 #define PKT_LOSS_RATE 0.1
 //SYN_TIMEOUT值, 单位为纳秒
@@ -27,18 +37,70 @@
 #define FIN_MAX_RETRY 5
 //服务器CLOSEWAIT超时值, 单位为秒
 #define CLOSEWAIT_TIMEOUT 5
-//sendBuf_timer线程的轮询间隔, 单位为纳秒
+//stream_timer线程的轮询间隔, 单位为纳秒
 #define SENDBUF_POLLING_INTERVAL 500000000
-//STCP客户端在stcp_server_recv()函数中使用这个时间间隔来轮询接收缓冲区, 以检查是否请求的数据已全部到达, 单位为秒.
-#define RECVBUF_POLLING_INTERVAL 1
-//stcp_server_accept()函数使用这个时间间隔来忙等待TCB状态转换, 单位为纳秒
-#define ACCEPT_POLLING_INTERVAL 500000000
 //接收缓冲区大小
 #define RECEIVE_BUF_SIZE 1000000
+//接收缓冲区的块大小. 接收缓冲区按块从共享的块池中分配, 只有存放着未读数据的块被占用
+#define RECV_CHUNK 16384
+//块池的默认内存预算, 单位为字节. 所有接收缓冲区占用的块超过它时, 通告的接收窗口只剩下各自已分配的块中的空闲空间
+#define RECV_POOL_BUDGET (256UL << 20)
+//块池中缓存以便重用的空闲块数, 更多的空闲块归还给系统
+#define RECV_POOL_CACHE 256
+//处理段的线程在连接的接收缓冲区空闲这么久之后归还它的所有块, 单位为秒
+#define RECV_IDLE_TRIM 1
 //数据段超时值, 单位为纳秒
 #define DATA_TIMEOUT 500000
 //GBN窗口大小
 #define GBN_WINDOW 10
+//一个连接内所有流共享的拥塞窗口的上限, 单位为段. 拥塞窗口从GBN_WINDOW开始慢启动, 重传过的段再次超时时减半, 但不小于GBN_WINDOW
+#define CWND_MAX 256
+//步调发送允许的突发段数. 启用步调发送时段以cwnd/SRTT的速率离开, 空闲后最多可以立即发出这么多段
+#define PACING_BURST 4
+//每个流的接收缓冲区中最多缓存的完整消息数, 消息边界队列满时接收窗口为0
+#define MSG_QUEUE_LEN 1024
+//多路复用的流(流ID不为0)的接收缓冲区大小
+#define STREAM_BUF_SIZE 65536
+//一个连接内最多同时存在的流数, 包括流0和已被关闭但尚未被释放的流. 超出它的对端流的DATA段被确认并丢弃
+#define STREAM_MAX 64
+//延迟确认的最长等待时间, 单位为纳秒. 按序到达的段最多等待这么久, 或等到第二个满长度段到达时才被确认
+#define DELAYED_ACK_TIMEOUT 20000000
+//前向纠错每组最多的DATA段数, 每组新发出的段之后跟一个校验段, 接收方用它恢复组内丢失的任意一个段
+#define FEC_MAX_K 16
+//前向纠错按对端报告的丢包率选择组大小, 使一组(包括校验段)中丢失的段数的期望值不超过这个百分比.
+//组越大校验段的开销越小, 但一组中丢失两个以上段而无法恢复的可能也越大
+#define FEC_LOSS_TARGET 60
+//接收方为恢复丢失的段而保留的最近收到的段数, 至少能容纳两组
+#define FEC_CACHE (2 * FEC_MAX_K)
+//速率模式(STCP_OPT_RATE)的初始, 最小和最大发送速率, 单位为段/秒
+#define RATE_INIT 1000
+#define RATE_MIN 100
+#define RATE_MAX 1000000
+//速率模式中增加发送速率的间隔, 单位为纳秒. 慢启动中速率每个SRTT(不少于这个间隔)翻倍
+#define RATE_INTERVAL 10000000
+//速率模式中所有流在途段数的上限, 它取代拥塞窗口, 每个流的在途段数还受对端接收窗口的限制
+#define RATE_WINDOW 1024
+//速率模式每发出这么多新段就背靠背发出一对段, 接收方由它们到达的间隔估计路径容量
+#define RATE_PROBE_SEGS 16
+//接收方保留的包对样本数, 它们的中位数作为路径容量报告给发送方
+#define RATE_PROBES 16
+//速率模式中, 排队延迟(SRTT - 最小往返时间)超过最小往返时间和这个值中较大的一个时, 丢包才被视为拥塞, 单位为纳秒
+#define RATE_QUEUE_SLACK 5000000
+//服务器seghandler到每个工作线程的段队列长度, 队列满时seghandler等待工作线程
+#define SEG_QUEUE_LEN 256
+//stcp_server_recv_file()的写线程每次写入磁盘的字节数, 是SINK_ALIGN的整数倍
+#define SINK_CHUNK (1 << 20)
+//stcp_server_recv_file()的暂存缓冲区数. 写线程写一个缓冲区时, 接收线程填充其他缓冲区
+#define SINK_BUFS 4
+//直接I/O(O_DIRECT)要求的缓冲区地址, 文件偏移和长度的对齐
+#define SINK_ALIGN 4096
+//流量类别, 用STCP_OPT_CLASS为每个套接字设置, 由段首部的flags带给SIP, 再由SIP报文首部的tclass带过整条路径.
+//SIP和SON对每个下一跳按类别排队: TC_CONTROL严格优先, 其他类别按权重轮转(DRR)分享链路. 连接默认使用TC_DEFAULT
+#define TC_CONTROL 0                //路由更新等控制报文, 也可用于极少量的关键消息
+#define TC_INTERACTIVE 1            //对延迟敏感的小请求
+#define TC_DEFAULT 2
+#define TC_BULK 3                   //批量传输
+#define TC_NUM 4
 
 /*******************************************************************/
 //SON参数
@@ -50,8 +112,11 @@
 //这个端口号由SON进程打开, 并由SIP进程连接
 #define SON_PORT 3522
 
-//最大SIP报文数据长度: 1500 - sizeof(sip header)
-#define MAX_PKT_LEN 1488 
+//最大SIP报文数据长度: 1500 - sizeof(sip header) = 1500 - 16
+#define MAX_PKT_LEN 1484
+
+//到邻居的TCP连接的内核发送缓冲区中最多保留这么多尚未发出的字节(TCP_NOTSENT_LOWAT), 更多的报文留在SON按流量类别调度的队列中
+#define SON_NOTSENT_LOWAT 16384
 
 /*******************************************************************/
 //SIP参数
@@ -73,4 +138,13 @@
 
 //路由更新广播间隔, 以秒为单位
 #define ROUTEUPDATE_INTERVAL 5
+
+//每个下一跳的报文队列中, 各类别每轮可以发出的字节数是权重乘以TC_QUANTUM, TC_CONTROL不受权重限制.
+//TC_QUANTUM不小于最长的报文(首部加MAX_PKT_LEN), 所以每个非空的类别每轮至少发出一个报文
+#define TC_WEIGHT_INTERACTIVE 8
+#define TC_WEIGHT_DEFAULT 4
+#define TC_WEIGHT_BULK 1
+#define TC_QUANTUM 1536
+//每个下一跳的每个类别最多排队的报文数, 队列满时新报文被丢弃, 由STCP重传
+#define TC_QUEUE_PKTS 256
 #endif
@@ -11,7 +11,10 @@
 #define new(struct_t) ((struct_t *) malloc(sizeof(struct_t)))
 #define new_n(struct_t, n) ((struct_t *) malloc((n) * sizeof(struct_t)))
 #define min(x,y) ((x) > (y) ? (y) : (x))
+#define max(x,y) ((x) > (y) ? (x) : (y))
 // limit should be transformed to second first
 #define timeout_nano(now, past, limit) (((now) - (past)) >= (limit))
+// absolute time in nanoseconds (the clock of now_nano) to a timespec for pthread_cond_timedwait
+#define nano_timespec(ns) ((struct timespec) {.tv_sec = (ns) / 1000000000, .tv_nsec = (ns) % 1000000000})
 
 #endif //LAB04_1_HELPER_H
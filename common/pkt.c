@@ -3,6 +3,7 @@
 #include <sys/socket.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/uio.h>
 
 #include "pkt.h"
 
@@ -56,6 +57,18 @@
     }                                             \
 }
 
+// write one '!& packet !#' frame with a single system call. separate small writes of one frame
+// wait for the ACK of the previous one on a TCP connection, which delays every control message
+static ssize_t send_pkt(int conn, sip_pkt_t *pkt) {
+    struct iovec iov[3] = {
+            {.iov_base = SIP_PREFIX, .iov_len = PREFIX_LEN},
+            {.iov_base = pkt, .iov_len = sizeof(sip_hdr_t) + pkt->header.length},
+            {.iov_base = SIP_SUFFIX, .iov_len = SUFFIX_LEN},
+    };
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 3};
+    return sendmsg(conn, &msg, MSG_NOSIGNAL);
+}
+
 // make connection fail packet
 void makeNodeFailSipPkt(sip_pkt_t *sipPkt, int loseID) {
     pkt_routeupdate_t nodeLoss;
@@ -63,6 +76,8 @@ void makeNodeFailSipPkt(sip_pkt_t *sipPkt, int loseID) {
     nodeLoss.entry[0].nodeID = UPDATE_HOP_FLOOR;
     nodeLoss.entry[0].cost = INFINITE_COST;
     sipPkt->header.type = ROUTE_UPDATE;
+    sipPkt->header.tclass = TC_CONTROL;
+    sipPkt->header.reserved = 0;
     sipPkt->header.src_nodeID = loseID;
     sipPkt->header.dst_nodeID = BROADCAST_NODEID;
     sipPkt->header.length = (unsigned short) (sizeof(nodeLoss.entryNum) +
@@ -77,21 +92,27 @@ void makeNodeFailSipPkt(sip_pkt_t *sipPkt, int loseID) {
 // 当通过SIP进程和SON进程之间的TCP连接发送数据结构sendpkt_arg_t时, 使用'!&'和'!#'作为分隔符, 按照'!& sendpkt_arg_t结构 !#'的顺序发送.
 // 如果发送成功, 返回1, 否则返回-1.
 int son_sendpkt(int nextNodeID, sip_pkt_t *pkt, int son_conn) {
-    if (send(son_conn, SIP_PREFIX, PREFIX_LEN, 0) < 0) {
-        printf("[Sip]<son_sendpkt> send prefix to SON error\n");
-        return -1;
-    }
-    if (send(son_conn, &nextNodeID, sizeof(int), 0) < 0) {
-        printf("[Sip]<son_sendpkt> send nextNodeID to SON error\n");
-        return -1;
-    }
-    if (send(son_conn, pkt, sizeof(sip_hdr_t) + pkt->header.length, 0) < 0) {
-        printf("[Sip]<son_sendpkt> send packet to SON error\n");
-        return -1;
-    }
-    if (send(son_conn, SIP_SUFFIX, SUFFIX_LEN, 0) < 0) {
-        printf("[Sip]<son_sendpkt> send suffix to SON error\n");
-        return -1;
+    return son_sendpkts(nextNodeID, pkt, 1, son_conn);
+}
+
+// son_sendpkts()与son_sendpkt()相同, 但把发往同一个下一跳的n个报文用一次系统调用交给SON进程, SIP用它发送从一个超级段切分出的报文.
+// 如果发送成功, 返回1, 否则返回-1.
+int son_sendpkts(int nextNodeID, sip_pkt_t *pkts, int n, int son_conn) {
+    // four pieces per frame, as son_sendpkt writes them
+    struct iovec iov[4 * SUPERSEG_SEGS];
+    while (n > 0) {
+        int batch = n < SUPERSEG_SEGS ? n : SUPERSEG_SEGS;
+        for (int i = 0; i < batch; ++i) {
+            iov[4 * i] = (struct iovec) {.iov_base = SIP_PREFIX, .iov_len = PREFIX_LEN};
+            iov[4 * i + 1] = (struct iovec) {.iov_base = &nextNodeID, .iov_len = sizeof(int)};
+            iov[4 * i + 2] = (struct iovec) {.iov_base = &pkts[i], .iov_len = sizeof(sip_hdr_t) + pkts[i].header.length};
+            iov[4 * i + 3] = (struct iovec) {.iov_base = SIP_SUFFIX, .iov_len = SUFFIX_LEN};
+        }
+        if (writev(son_conn, iov, 4 * batch) < 0) {
+            printf("[Sip]<son_sendpkts> send packets to SON error\n");
+            return -1;
+        }
+        pkts += batch, n -= batch;
     }
     return 1;
 }
@@ -148,18 +169,10 @@ int getpktToSend(sip_pkt_t *pkt, int *nextNode, int sip_conn) {
 // 报文通过SIP进程和SON进程之间的TCP连接发送, 使用分隔符!&和!#, 按照'!& 报文 !#'的顺序发送. 
 // 如果报文发送成功, 返回1, 否则返回-1.
 int forwardpktToSIP(sip_pkt_t *pkt, int sip_conn) {
-    if (send(sip_conn, SIP_PREFIX, PREFIX_LEN, MSG_NOSIGNAL) < 0) {
-        printf("[Son]<forwardpktToSIP> send prefix to SIP error\n");
-        return -1;
-    }
-    if (send(sip_conn, pkt, sizeof(sip_hdr_t) + pkt->header.length, MSG_NOSIGNAL) < 0) {
+    if (send_pkt(sip_conn, pkt) < 0) {
         printf("[Son]<forwardpktToSIP> send packet to SIP error\n");
         return -1;
     }
-    if (send(sip_conn, SIP_SUFFIX, SUFFIX_LEN, MSG_NOSIGNAL) < 0) {
-        printf("[Son]<forwardpktToSIP> send suffix to SIP error\n");
-        return -1;
-    }
     return 1;
 }
 
@@ -168,15 +181,7 @@ int forwardpktToSIP(sip_pkt_t *pkt, int sip_conn) {
 // 报文通过SON进程和其邻居节点之间的TCP连接发送, 使用分隔符!&和!#, 按照'!& 报文 !#'的顺序发送. 
 // 如果报文发送成功, 返回1, 否则返回-1.
 int sendpkt(sip_pkt_t *pkt, int conn) {
-    if (send(conn, SIP_PREFIX, PREFIX_LEN, MSG_NOSIGNAL) < 0) {
-        printf("[Son]<sendpkt> send packet to neighbor error, connection %d\n", conn);
-        return -1;
-    }
-    if (send(conn, pkt, sizeof(sip_hdr_t) + pkt->header.length, MSG_NOSIGNAL) < 0) {
-        printf("[Son]<sendpkt> send packet to neighbor error, connection %d\n", conn);
-        return -1;
-    }
-    if (send(conn, SIP_SUFFIX, SUFFIX_LEN, MSG_NOSIGNAL) < 0) {
+    if (send_pkt(conn, pkt) < 0) {
         printf("[Son]<sendpkt> send packet to neighbor error, connection %d\n", conn);
         return -1;
     }
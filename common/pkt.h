@@ -13,6 +13,8 @@ typedef struct sipheader {
   int dst_nodeID;		          //目标节点ID
   unsigned short int length;	  //报文中数据的长度
   unsigned short int type;	      //报文类型 
+  unsigned short int tclass;      //扩展首部: 流量类别(TC_*), SIP和SON按它为每个下一跳排队, 路由更新报文为TC_CONTROL
+  unsigned short int reserved;    //保留, 为0
 } sip_hdr_t;
 
 typedef struct packet {
@@ -57,6 +59,10 @@ void makeNodeFailSipPkt(sip_pkt_t *sipPkt, int loseID);
 // 如果发送成功, 返回1, 否则返回-1.
 int son_sendpkt(int nextNodeID, sip_pkt_t* pkt, int son_conn);
 
+// son_sendpkts()与son_sendpkt()相同, 但把发往同一个下一跳的n个报文用一次系统调用交给SON进程, SIP用它发送从一个超级段切分出的报文.
+// 如果发送成功, 返回1, 否则返回-1.
+int son_sendpkts(int nextNodeID, sip_pkt_t* pkts, int n, int son_conn);
+
 // son_recvpkt()函数由SIP进程调用, 其作用是接收来自SON进程的报文. 
 // 参数son_conn是SIP进程和SON进程之间TCP连接的套接字描述符. 报文通过SIP进程和SON进程之间的TCP连接发送, 使用分隔符!&和!#. 
 // 为了接收报文, 这个函数使用一个简单的有限状态机FSM
@@ -0,0 +1,226 @@
+//文件名: common/ringbuf.c
+//
+//描述: 这个文件实现单生产者/单消费者的无锁环形字节缓冲区, 以及它们共享的块池
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ringbuf.h"
+#include "helper.h"
+
+//块池. 所有环形缓冲区的块都来自这里, 归还的块缓存在空闲链表中以便重用, 超过RECV_POOL_CACHE个时归还给系统.
+static struct {
+    pthread_mutex_t lock;
+    char *freeHead;             //空闲块链表, 每个空闲块的开头存放下一个空闲块的指针
+    unsigned int freeNum;       //空闲块数
+    unsigned long used;         //被缓冲区占用的字节数
+    unsigned long budget;       //内存预算
+} pool = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, RECV_POOL_BUDGET};
+
+static char *chunk_get(void) {
+    pthread_mutex_lock(&pool.lock);
+    char *chunk = pool.freeHead;
+    if (chunk) {
+        pool.freeHead = *(char **) chunk;
+        --pool.freeNum;
+    }
+    __atomic_add_fetch(&pool.used, RECV_CHUNK, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&pool.lock);
+    return chunk ? chunk : (char *) malloc(RECV_CHUNK);
+}
+
+static void chunk_put(char *chunk) {
+    pthread_mutex_lock(&pool.lock);
+    __atomic_sub_fetch(&pool.used, RECV_CHUNK, __ATOMIC_RELAXED);
+    if (pool.freeNum < RECV_POOL_CACHE) {
+        *(char **) chunk = pool.freeHead;
+        pool.freeHead = chunk;
+        ++pool.freeNum;
+        chunk = NULL;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    free(chunk);
+}
+
+void ringbuf_pool_budget(unsigned long bytes) {
+    __atomic_store_n(&pool.budget, bytes, __ATOMIC_RELAXED);
+}
+
+unsigned long ringbuf_pool_used(void) {
+    return __atomic_load_n(&pool.used, __ATOMIC_RELAXED);
+}
+
+// the bytes of the data area chunk i covers, the last one may be short
+static unsigned int slot_size(ringbuf_t *rb, unsigned int i) {
+    return min(RECV_CHUNK, rb->size - i * RECV_CHUNK);
+}
+
+// whether chunk i holds bytes of [head, tail) that the consumer may still read
+static int slot_live(ringbuf_t *rb, unsigned int i, unsigned long head, unsigned long tail) {
+    unsigned long len = tail - head;
+    if (len == 0) return 0;
+    if (len >= rb->size) return 1;
+    unsigned long a = (unsigned long) i * RECV_CHUNK, b = a + slot_size(rb, i);
+    unsigned long from = head % rb->size, to = from + len;
+    if (to <= rb->size) return a < to && from < b;
+    // the live bytes wrap around the end of the data area
+    return from < b || a < to - rb->size;
+}
+
+// hand the chunks without live bytes back to the pool, the producer calls it
+static void reclaim(ringbuf_t *rb, unsigned long head, unsigned long tail) {
+    rb->reclaimed = head;
+    if (rb->chunks == NULL) return;
+    for (unsigned int i = 0; i < rb->slots; ++i) {
+        if (rb->chunks[i] == NULL || slot_live(rb, i, head, tail)) continue;
+        chunk_put(rb->chunks[i]);
+        rb->chunks[i] = NULL;
+        __atomic_store_n(&rb->allocated, rb->allocated - slot_size(rb, i), __ATOMIC_RELAXED);
+    }
+}
+
+// the address of byte pos and how many bytes follow it in the same chunk before the data area ends
+static char *rb_at(ringbuf_t *rb, unsigned long pos, unsigned int *span) {
+    unsigned int off = (unsigned int) (pos % rb->size);
+    *span = min(RECV_CHUNK - off % RECV_CHUNK, rb->size - off);
+    return rb->chunks[off / RECV_CHUNK] + off % RECV_CHUNK;
+}
+
+// copy len bytes between the ring at pos and a flat buffer, one chunk at a time
+static void rb_copy(ringbuf_t *rb, unsigned long pos, char *flat, unsigned int len, int to_ring) {
+    while (len > 0) {
+        unsigned int span;
+        char *p = rb_at(rb, pos, &span);
+        span = min(span, len);
+        if (to_ring) memcpy(p, flat, span);
+        else memcpy(flat, p, span);
+        pos += span;
+        flat += span;
+        len -= span;
+    }
+}
+
+ringbuf_t *ringbuf_create(unsigned int size) {
+    ringbuf_t *rb;
+    // keep the cache-line alignment of head and tail
+    if (posix_memalign((void **) &rb, 64, sizeof(ringbuf_t)) != 0) return NULL;
+    rb->chunks = NULL;
+    rb->size = size;
+    rb->slots = (size + RECV_CHUNK - 1) / RECV_CHUNK;
+    rb->allocated = rb->reclaimed = 0;
+    rb->want = 0;
+    rb->head = rb->tail = 0;
+    return rb;
+}
+
+void ringbuf_destroy(ringbuf_t *rb) {
+    if (rb->chunks) {
+        for (unsigned int i = 0; i < rb->slots; ++i)
+            if (rb->chunks[i]) chunk_put(rb->chunks[i]);
+        free(rb->chunks);
+    }
+    free(rb);
+}
+
+unsigned int ringbuf_used(ringbuf_t *rb) {
+    unsigned long tail = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+    unsigned long head = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+    return (unsigned int) (tail - head);
+}
+
+unsigned int ringbuf_free(ringbuf_t *rb) {
+    return rb->size - ringbuf_used(rb);
+}
+
+unsigned int ringbuf_room(ringbuf_t *rb) {
+    unsigned int used = ringbuf_used(rb);
+    unsigned long allocated = __atomic_load_n(&rb->allocated, __ATOMIC_RELAXED);
+    unsigned long pool_used = ringbuf_pool_used(), budget = __atomic_load_n(&pool.budget, __ATOMIC_RELAXED);
+    // the chunks this buffer holds can be reused, new ones only come out of what is left of the budget
+    unsigned long room = (allocated > used ? allocated - used : 0) + (budget > pool_used ? budget - pool_used : 0);
+    // a waiting consumer always gets what it waits for
+    unsigned int want = __atomic_load_n(&rb->want, __ATOMIC_RELAXED);
+    if (want > used) room = max(room, (unsigned long) (want - used));
+    return (unsigned int) min(room, (unsigned long) (rb->size - used));
+}
+
+void ringbuf_want(ringbuf_t *rb, unsigned int len) {
+    __atomic_store_n(&rb->want, min(len, rb->size), __ATOMIC_RELAXED);
+}
+
+unsigned int ringbuf_write(ringbuf_t *rb, const void *data, unsigned int len) {
+    // only the producer moves tail, a relaxed load of its own position is enough
+    unsigned long tail = __atomic_load_n(&rb->tail, __ATOMIC_RELAXED);
+    unsigned long head = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+    if (rb->size - (tail - head) < len || len == 0) return 0;
+    // the consumer left a chunk behind since the last look
+    if (head - rb->reclaimed >= RECV_CHUNK ||
+        (head % rb->size) / RECV_CHUNK != (rb->reclaimed % rb->size) / RECV_CHUNK)
+        reclaim(rb, head, tail);
+    if (rb->chunks == NULL) rb->chunks = (char **) calloc(rb->slots, sizeof(char *));
+    for (unsigned long pos = tail; pos < tail + len;) {
+        unsigned int off = (unsigned int) (pos % rb->size), i = off / RECV_CHUNK;
+        if (rb->chunks[i] == NULL) {
+            rb->chunks[i] = chunk_get();
+            __atomic_store_n(&rb->allocated, rb->allocated + slot_size(rb, i), __ATOMIC_RELAXED);
+        }
+        pos += slot_size(rb, i) - off % RECV_CHUNK;
+    }
+    rb_copy(rb, tail, (char *) data, len, 1);
+    // publish the bytes only after they are in place, the chunks they live in are published with them
+    __atomic_store_n(&rb->tail, tail + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+// copy up to len bytes from the head without consuming them, returns the head and the number copied
+static unsigned int ringbuf_copy(ringbuf_t *rb, void *dst, unsigned int len, unsigned long *head_out) {
+    unsigned long head = __atomic_load_n(&rb->head, __ATOMIC_RELAXED);
+    unsigned long tail = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+    len = min(len, (unsigned int) (tail - head));
+    if (len > 0) rb_copy(rb, head, (char *) dst, len, 0);
+    *head_out = head;
+    return len;
+}
+
+unsigned int ringbuf_read(ringbuf_t *rb, void *dst, unsigned int len) {
+    unsigned long head;
+    len = ringbuf_copy(rb, dst, len, &head);
+    // hand the space back to the producer only after the bytes are copied out
+    __atomic_store_n(&rb->head, head + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+unsigned int ringbuf_peek(ringbuf_t *rb, void *dst, unsigned int len) {
+    unsigned long head;
+    return ringbuf_copy(rb, dst, len, &head);
+}
+
+int ringbuf_views(ringbuf_t *rb, struct iovec *iov, int iovcnt) {
+    unsigned long head = __atomic_load_n(&rb->head, __ATOMIC_RELAXED);
+    unsigned long tail = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+    while (head < tail && n < iovcnt) {
+        unsigned int span;
+        iov[n].iov_base = rb_at(rb, head, &span);
+        iov[n].iov_len = min(span, (unsigned int) (tail - head));
+        head += iov[n++].iov_len;
+    }
+    return n;
+}
+
+void ringbuf_consume(ringbuf_t *rb, unsigned int len) {
+    unsigned long head = __atomic_load_n(&rb->head, __ATOMIC_RELAXED);
+    // the producer may reuse the space once the consumer is done with the views
+    __atomic_store_n(&rb->head, head + len, __ATOMIC_RELEASE);
+}
+
+void ringbuf_trim(ringbuf_t *rb) {
+    unsigned long tail = __atomic_load_n(&rb->tail, __ATOMIC_RELAXED);
+    unsigned long head = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+    reclaim(rb, head, tail);
+    // nothing to read, the consumer does not look at the chunks until the next write publishes new ones
+    if (head == tail && rb->chunks) {
+        free(rb->chunks);
+        rb->chunks = NULL;
+    }
+}
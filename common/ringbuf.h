@@ -0,0 +1,76 @@
+//文件名: common/ringbuf.h
+//
+//描述: 这个文件定义单生产者/单消费者的无锁环形字节缓冲区.
+//生产者(seghandler)只移动tail, 消费者(应用线程)只移动head, 两者都不需要加锁,
+//除了写入缓冲区和拷贝到用户缓冲区外不会再移动数据.
+//数据区被分为RECV_CHUNK字节的块, 块在第一次写入时才从所有缓冲区共享的块池中分配, 不再有数据的块由生产者归还给块池,
+//所以空闲的缓冲区只占用这个结构本身. 块池有一个全局的内存预算, 缓冲区的可写空间(ringbuf_room)受它限制, 它最终成为通告的接收窗口.
+
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+#include <sys/uio.h>
+#include "constants.h"
+
+typedef struct ringbuf {
+    char **chunks;              //数据区的块, 第i块是数据区的[i * RECV_CHUNK, (i + 1) * RECV_CHUNK), 未分配的块为NULL. 没有块时数组也不存在
+    unsigned int size;          //数据区大小
+    unsigned int slots;         //数据区的块数, 最后一块可能不满RECV_CHUNK字节
+    unsigned long allocated;    //已分配的块的总字节数, 只由生产者写
+    unsigned long reclaimed;    //生产者上一次归还块时的head, 只由生产者访问
+    unsigned int want;          //消费者正在等待的可读字节数, 缓冲区总可以容纳这么多数据而不受块池预算的限制, 只由消费者写
+    // head and tail count bytes ever read/written, they live on their own cache lines
+    // so that the producer and the consumer don't bounce a shared line
+    unsigned long head __attribute__((aligned(64)));    //消费者位置, 只由消费者写
+    unsigned long tail __attribute__((aligned(64)));    //生产者位置, 只由生产者写
+} ringbuf_t;
+
+//这个函数创建一个大小为size字节的空环形缓冲区. 数据区在写入时才分配.
+ringbuf_t *ringbuf_create(unsigned int size);
+
+//这个函数释放环形缓冲区, 把它的块归还给块池.
+void ringbuf_destroy(ringbuf_t *rb);
+
+//返回缓冲区中可读的字节数, 生产者和消费者都可以调用.
+unsigned int ringbuf_used(ringbuf_t *rb);
+
+//返回缓冲区中可写的字节数, 生产者和消费者都可以调用.
+unsigned int ringbuf_free(ringbuf_t *rb);
+
+//返回在块池的内存预算内缓冲区中可写的字节数, 即ringbuf_free()和已分配的块中的空闲空间加上预算中剩余的字节数两者中较小的一个.
+//消费者用ringbuf_want()声明正在等待的字节数时, 可写的字节数至少能使可读的数据达到它. 生产者和消费者都可以调用.
+unsigned int ringbuf_room(ringbuf_t *rb);
+
+//这个函数只能由消费者调用. 它声明消费者正在等待缓冲区中有len字节可读, 从而不会因为块池的预算而永远等不到它们. 0取消声明.
+void ringbuf_want(ringbuf_t *rb, unsigned int len);
+
+//这个函数只能由生产者调用. 它将len字节写入缓冲区, 空间不足时不写入任何数据. 写入需要的块从块池中分配,
+//即使超出预算也是如此, 预算只通过ringbuf_room()限制写入. 成功时返回len, 否则返回0.
+unsigned int ringbuf_write(ringbuf_t *rb, const void *data, unsigned int len);
+
+//这个函数只能由消费者调用. 它从缓冲区中读出最多len字节到dst, 返回读出的字节数.
+unsigned int ringbuf_read(ringbuf_t *rb, void *dst, unsigned int len);
+
+//这个函数只能由消费者调用. 它与ringbuf_read()相同, 但不移动head, 读出的数据仍留在缓冲区中.
+unsigned int ringbuf_peek(ringbuf_t *rb, void *dst, unsigned int len);
+
+//这个函数只能由消费者调用. 它把缓冲区头部可读的数据作为只读视图存入最多iovcnt个iov, 每个视图在块或数据区的末尾结束, 返回视图数,
+//缓冲区为空时返回0. RINGBUF_VIEWS(size)个视图总能容纳大小为size的缓冲区中的全部数据.
+//数据不被拷贝也不被读出, 消费者用ringbuf_consume()释放它们.
+int ringbuf_views(ringbuf_t *rb, struct iovec *iov, int iovcnt);
+#define RINGBUF_VIEWS(size) (((size) + RECV_CHUNK - 1) / RECV_CHUNK + 1)
+
+//这个函数只能由消费者调用. 它丢弃缓冲区头部的len字节, len不能超过可读的字节数.
+void ringbuf_consume(ringbuf_t *rb, unsigned int len);
+
+//这个函数只能由生产者调用. 它把所有不再有可读数据的块归还给块池, 缓冲区为空时连同块数组一起释放. 生产者在连接空闲时调用它,
+//写入时只会归还head已经越过的块.
+void ringbuf_trim(ringbuf_t *rb);
+
+//这个函数设置块池的内存预算, 单位为字节, 默认为RECV_POOL_BUDGET. 已分配的块不受影响.
+void ringbuf_pool_budget(unsigned long bytes);
+
+//返回所有缓冲区从块池中占用的字节数.
+unsigned long ringbuf_pool_used(void);
+
+#endif
@@ -6,6 +6,7 @@
 #include <time.h>
 #include <assert.h>
 #include <string.h>
+#include <sys/uio.h>
 
 #define SIP_PREFIX "!&"
 #define SIP_SUFFIX "!#"
@@ -48,7 +49,7 @@
 #define RCV_END(socket, noerr, print_error) { \
     char suf[SUFFIX_LEN + 1];\
     bzero(suf, sizeof(suf));\
-    rd = recv(socket, suf, SUFFIX_LEN, 0);\
+    rd = recv(socket, suf, SUFFIX_LEN, MSG_WAITALL);\
     checkrd(rd, noerr, print_error);\
     if (strcmp(suf, SIP_SUFFIX) != 0) {\
         printf("[WARN] the packet is invalid\n");\
@@ -101,33 +102,41 @@ create_seg(unsigned int src_port, unsigned int dst_port,
     return seg;
 }
 
+// write one '!& nodeID segment !#' frame with a single system call, returns the bytes of the segment or -1
+static int send_frame(int sip_conn, int dest_nodeID, void *seg, size_t seg_len) {
+    struct iovec iov[4] = {
+            {.iov_base = SIP_PREFIX, .iov_len = PREFIX_LEN},
+            {.iov_base = &dest_nodeID, .iov_len = sizeof(int)},
+            {.iov_base = seg, .iov_len = seg_len},
+            {.iov_base = SIP_SUFFIX, .iov_len = SUFFIX_LEN},
+    };
+    // SIP forwards to an STCP process that may be gone, the error is enough
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 4};
+    if (sendmsg(sip_conn, &msg, MSG_NOSIGNAL) <= 0) {
+        printf("[Son] sip_send error\n");
+        return -1;
+    }
+    return (int) seg_len;
+}
+
 //STCP进程使用这个函数发送sendseg_arg_t结构(包含段及其目的节点ID)给SIP进程.
 //参数sip_conn是在STCP进程和SIP进程之间连接的TCP描述符.
 //如果sendseg_arg_t发送成功,就返回1,否则返回-1.
 int sip_sendseg(int sip_conn, int dest_nodeID, seg_t *segPtr) {
-
     assert(segPtr);
-    if (send(sip_conn, SIP_PREFIX, PREFIX_LEN, 0) <= 0) {
-        printf("[Son] sip_send error\n");
-        return -1;
-    }
     unsigned short data_len = segPtr->header.length;
     unsigned long valid_seg_len = sizeof(stcp_hdr_t) + data_len;
     segPtr->header.checksum = 0;
     segPtr->header.checksum = checksum(segPtr, (int) valid_seg_len);
-    if (send(sip_conn, &dest_nodeID, sizeof(int), 0) <= 0) {
-        printf("[Son] sip_send error\n");
-        return -1;
-    }
-    if (send(sip_conn, segPtr, valid_seg_len, 0) <= 0) {
-        printf("[Son] sip_send error\n");
-        return -1;
-    }
-    if (send(sip_conn, SIP_SUFFIX, SUFFIX_LEN, 0) <= 0) {
-        printf("[Son] sip_send error\n");
-        return -1;
-    }
-    return (int) valid_seg_len;
+    return send_frame(sip_conn, dest_nodeID, segPtr, valid_seg_len);
+}
+
+//STCP进程使用这个函数发送一个超级段给SIP进程, 格式与sip_sendseg()相同. 校验和由SIP为切分出的每个段计算.
+//如果发送成功,就返回1,否则返回-1.
+int sip_sendsuperseg(int sip_conn, int dest_nodeID, superseg_t *segPtr) {
+    assert(segPtr && segPtr->header.length <= MAX_SUPERSEG_LEN);
+    segPtr->header.checksum = 0;
+    return send_frame(sip_conn, dest_nodeID, segPtr, sizeof(stcp_hdr_t) + segPtr->header.length);
 }
 
 //STCP进程使用这个函数来接收来自SIP进程的包含段及其源节点ID的sendseg_arg_t结构.
@@ -137,13 +146,13 @@ int sip_sendseg(int sip_conn, int dest_nodeID, seg_t *segPtr) {
 int sip_recvseg(int sip_conn, int *src_nodeID, seg_t *segPtr) {
     RCV_BEGIN(sip_conn, -1, printf("[SIP]<sip_recvseg> error receive prefix\n"))
     // the prefix is parsed, begin to read header and data
-    ssize_t rd = recv(sip_conn, src_nodeID, sizeof(int), 0);
+    ssize_t rd = recv(sip_conn, src_nodeID, sizeof(int), MSG_WAITALL);
     checkrd(rd, -1, printf("[SIP]<sip_recvseg> error receive src_nodeID\n"))
-    rd = recv(sip_conn, &segPtr->header, sizeof(stcp_hdr_t), 0);
+    rd = recv(sip_conn, &segPtr->header, sizeof(stcp_hdr_t), MSG_WAITALL);
     checkrd(rd, -1, printf("[SIP]<sip_recvseg> error receive header\n"))
     unsigned short data_len = segPtr->header.length;
     if (data_len > 0) {
-        rd = recv(sip_conn, &segPtr->data, data_len, 0);
+        rd = recv(sip_conn, &segPtr->data, data_len, MSG_WAITALL);
         checkrd(rd, -1, printf("[SIP]<sip_recvseg> error receive data\n"))
     }
     RCV_END(sip_conn, -1, printf("[SIP]<sip_recvseg> error receive suffix\n"))
@@ -168,51 +177,88 @@ int sip_recvseg(int sip_conn, int *src_nodeID, seg_t *segPtr) {
 //SIP进程使用这个函数接收来自STCP进程的包含段及其目的节点ID的sendseg_arg_t结构.
 //参数stcp_conn是在STCP进程和SIP进程之间连接的TCP描述符.
 //如果成功接收到sendseg_arg_t就返回1, 否则返回-1.
-int getsegToSend(int stcp_conn, int *dest_nodeID, seg_t *segPtr) {
+int getsegToSend(int stcp_conn, int *dest_nodeID, superseg_t *segPtr) {
     RCV_BEGIN(stcp_conn, -1, printf("[SIP]<getsegToSend> error receive prefix\n"))
-    ssize_t rd = recv(stcp_conn, dest_nodeID, sizeof(int), 0);
+    ssize_t rd = recv(stcp_conn, dest_nodeID, sizeof(int), MSG_WAITALL);
     checkrd(rd, -1, printf("[SIP]<getsegToSend> error receive dst_nodeID\n"))
-    rd = recv(stcp_conn, &segPtr->header, sizeof(stcp_hdr_t), 0);
+    rd = recv(stcp_conn, &segPtr->header, sizeof(stcp_hdr_t), MSG_WAITALL);
     checkrd(rd, -1, printf("[SIP]<getsegToSend> error receive header\n"))
     int data_len = segPtr->header.length;
+    if (data_len > MAX_SUPERSEG_LEN) {
+        printf("[SIP]<getsegToSend> segment of %d bytes is too long\n", data_len);
+        return -1;
+    }
     if (data_len > 0) {
-        rd = recv(stcp_conn, &segPtr->data, data_len, 0);
+        rd = recv(stcp_conn, &segPtr->data, data_len, MSG_WAITALL);
         checkrd(rd, -1, printf("[SIP]<getsegToSend> error receive data\n"))
     }
     RCV_END(stcp_conn, -1, printf("[SIP]<getsegToSend> error receive suffix\n"))
     return 1;
 }
 
+//SIP进程使用这个函数把getsegToSend()收到的段封装为发往dst_nodeID的SIP报文, 存放在pkts中. 普通段被封装进一个报文,
+//超级段被切分为最多SUPERSEG_SEGS个段, 每个段被封装进一个报文并计算自己的校验和. 报文的流量类别取自段首部的flags. 返回报文数.
+int sip_packsegs(superseg_t *segPtr, int src_nodeID, int dst_nodeID, sip_pkt_t *pkts) {
+    unsigned int total = segPtr->header.length;
+    if (total <= MAX_SEG_LEN) {
+        // a plain segment keeps the checksum STCP made
+        pkts[0].header.src_nodeID = src_nodeID;
+        pkts[0].header.dst_nodeID = dst_nodeID;
+        pkts[0].header.type = SIP;
+        pkts[0].header.tclass = (unsigned short) SEG_CLASS(segPtr->header.flags);
+        pkts[0].header.reserved = 0;
+        pkts[0].header.length = sizeof(stcp_hdr_t) + total;
+        memcpy(pkts[0].data, segPtr, pkts[0].header.length);
+        return 1;
+    }
+    int n = 0;
+    for (unsigned int off = 0; off < total; off += MAX_SEG_LEN, ++n) {
+        unsigned short len = (unsigned short) min(total - off, MAX_SEG_LEN);
+        seg_t *seg = (seg_t *) pkts[n].data;
+        seg->header = segPtr->header;
+        seg->header.seq_num = segPtr->header.seq_num + off;
+        seg->header.length = len;
+        // the end of a message is the end of the super-segment
+        if (off + len < total) seg->header.flags &= ~SEG_FLAG_EOM;
+        memcpy(seg->data, segPtr->data + off, len);
+        seg->header.checksum = 0;
+        seg->header.checksum = checksum(seg, (int) sizeof(stcp_hdr_t) + len);
+        pkts[n].header.src_nodeID = src_nodeID;
+        pkts[n].header.dst_nodeID = dst_nodeID;
+        pkts[n].header.type = SIP;
+        pkts[n].header.tclass = (unsigned short) SEG_CLASS(seg->header.flags);
+        pkts[n].header.reserved = 0;
+        pkts[n].header.length = sizeof(stcp_hdr_t) + len;
+    }
+    return n;
+}
+
 //SIP进程使用这个函数发送包含段及其源节点ID的sendseg_arg_t结构给STCP进程.
 //参数stcp_conn是STCP进程和SIP进程之间连接的TCP描述符.
 //如果sendseg_arg_t被成功发送就返回1, 否则返回-1.
 int forwardsegToSTCP(int stcp_conn, int src_nodeID, seg_t *segPtr) {
-    if (send(stcp_conn, SIP_PREFIX, PREFIX_LEN, MSG_NOSIGNAL) < 0) {
-        printf("[SIP]<forwardsegToSTCP> send prefix to STCP error\n");
-        return -1;
-    }
-    if (send(stcp_conn, &src_nodeID, sizeof(int), MSG_NOSIGNAL) < 0) {
-        printf("[SIP]<forwardsegToSTCP> send src_nodeID to STCP error\n");
-        return -1;
-    }
-    if (send(stcp_conn, segPtr, sizeof(segPtr->header) + segPtr->header.length, MSG_NOSIGNAL) < 0) {
-        printf("[SIP]<forwardsegToSTCP> send packet to STCP error\n");
-        return -1;
-    }
-    if (send(stcp_conn, SIP_SUFFIX, SUFFIX_LEN, MSG_NOSIGNAL) < 0) {
+    if (send_frame(stcp_conn, src_nodeID, segPtr, sizeof(segPtr->header) + segPtr->header.length) < 0) {
         printf("[SIP]<forwardsegToSTCP> send packet to STCP error\n");
         return -1;
     }
     return 1;
 }
 
+// the loss rate seglost() injects, PKT_LOSS_RATE until seg_setlossrate() changes it
+static double lossRate = PKT_LOSS_RATE;
+
+//这个函数设置seglost()使用的丢包率, 默认为PKT_LOSS_RATE.
+void seg_setlossrate(double rate) {
+    lossRate = rate;
+}
+
 // 一个段有PKT_LOST_RATE/2的可能性丢失, 或PKT_LOST_RATE/2的可能性有着错误的校验和.
 // 如果数据包丢失了, 就返回1, 否则返回0. 
 // 即使段没有丢失, 它也有PKT_LOST_RATE/2的可能性有着错误的校验和.
 // 我们在段中反转一个随机比特来创建错误的校验和.
 int seglost(seg_t *segPtr) {
     int random = rand() % 100;
-    if (random < PKT_LOSS_RATE * 100) {
+    if (random < lossRate * 100) {
         //50%可能性丢失段
         if (rand() % 2 == 0) {
             return 1;
@@ -7,6 +7,7 @@
 #define SEG_H
 
 #include "constants.h"
+#include "pkt.h"
 
 //段类型定义, 用于STCP.
 #define	SYN 0
@@ -16,7 +17,35 @@
 #define	DATA 4
 #define	DATAACK 5
 
-//段首部定义. 
+//段标志, 在段首部的flags中. 前两个用于快速打开.
+//SYN: 请求服务器发放快速打开的cookie. SYNACK: 段数据是服务器发放给客户端节点的cookie(4字节).
+#define SEG_FLAG_COOKIE 0x1
+//SYN: ack_num中是缓存的cookie, 段数据是连接的第一个DATA的数据. cookie有效时服务器接受数据, 并在SYNACK中确认它.
+#define SEG_FLAG_FASTOPEN 0x2
+//DATA: 这个段是一个消息的最后一个段, 见stcp_client_send_msg()/stcp_server_send_msg().
+#define SEG_FLAG_EOM 0x4
+//SYN: 客户端请求启用前向纠错. SYNACK: 服务器同意启用. DATA: 这是一个校验段, 段数据是一组新DATA段的数据的异或,
+//seq_num和ack_num是这组段的起始序号和结束序号, rcv_win是组内的段数, 它不捎带确认, 见stream.h.
+#define SEG_FLAG_FEC 0x8
+//SYN: 客户端请求使用速率模式. SYNACK: 服务器同意. DATA: 这是一个包对的第一个段, 下一个段紧随其后发出.
+//DATAACK: 段数据是速率模式的接收报告(rateReport_t), 包括路径容量的估计和丢失的序号区间, 见stream.h.
+#define SEG_FLAG_RATE 0x10
+//所有段在flags的第5, 6位中携带发送它的连接的流量类别(TC_*), SIP把它复制到报文首部的tclass中, 接收方不使用它
+#define SEG_CLASS_SHIFT 5
+#define SEG_CLASS_MASK (0x3 << SEG_CLASS_SHIFT)
+#define SEG_CLASS(flags) (((flags) & SEG_CLASS_MASK) >> SEG_CLASS_SHIFT)
+//启用前向纠错的连接上, 捎带确认的段(DATA和DATAACK)在flags的高8位中报告本端估计的对端发来的段的丢包率, 单位为1/256
+#define SEG_LOSS_SHIFT 8
+#define SEG_LOSS(flags) ((flags) >> SEG_LOSS_SHIFT)
+
+//序号比较. 序号是32位的字节计数, 一个连接传输超过4GB后会回绕, 所以不能直接用<比较. 这些宏按两者之差的符号比较,
+//只要比较的两个序号相距不到2GB(窗口和接收缓冲区都远小于它)结果就是正确的. 序号之差(如已确认的字节数)直接相减即可.
+#define SEQ_LT(a, b) ((int) ((unsigned int) (a) - (unsigned int) (b)) < 0)
+#define SEQ_LEQ(a, b) ((int) ((unsigned int) (a) - (unsigned int) (b)) <= 0)
+#define SEQ_GT(a, b) SEQ_LT(b, a)
+#define SEQ_GEQ(a, b) SEQ_LEQ(b, a)
+
+//段首部定义.
 
 typedef struct stcp_hdr {
 	unsigned int src_port;        //源端口号
@@ -25,8 +54,10 @@ typedef struct stcp_hdr {
 	unsigned int ack_num;         //确认号
 	unsigned short int length;    //段数据长度
 	unsigned short int  type;     //段类型
-	unsigned short int  rcv_win;  //当前未使用
+	unsigned short int  rcv_win;  //DATAACK/SYNACK中通告的接收窗口, 单位为段
 	unsigned short int checksum;  //这个段的校验和
+	unsigned short int stream_id; //扩展首部: DATA/DATAACK所属的流ID, 0是连接本身的流, 其他流在连接内多路复用
+	unsigned short int flags;     //扩展首部: 段标志, 见SEG_FLAG_*
 } stcp_hdr_t;
 
 
@@ -37,6 +68,15 @@ typedef struct segment {
 	char data[MAX_SEG_LEN];
 } seg_t;
 
+//超级段定义. STCP把一个流中连续的多个DATA段合并为一个超级段交给SIP, 由SIP切分回原来的段(分段卸载), 从而每批段只有一次
+//STCP到SIP的发送和一次路由查找. 首部是第一个段的首部, length是所有段的总长度, 大于MAX_SEG_LEN的段就是超级段.
+//除最后一个段外每个段都是MAX_SEG_LEN字节, 所以切分出的第i个段的序号是seq_num + i * MAX_SEG_LEN. 超级段不计算校验和.
+//首部的flags中的SEG_FLAG_EOM只属于最后一个段, 所以一个超级段最多包含一个消息的结束.
+typedef struct superSegment {
+	stcp_hdr_t header;
+	char data[MAX_SUPERSEG_LEN];
+} superseg_t;
+
 //这是在SIP进程和STCP进程之间交换的数据结构.
 //它包含一个节点ID和一个段. 
 //对sip_sendseg()来说, 节点ID是段的目标节点ID.
@@ -63,6 +103,10 @@ create_seg(unsigned int src_port, unsigned int dst_port,
 //如果sendseg_arg_t发送成功,就返回1,否则返回-1.
 int sip_sendseg(int sip_conn, int dest_nodeID, seg_t* segPtr);
 
+//STCP进程使用这个函数发送一个超级段给SIP进程, 格式与sip_sendseg()相同. 校验和由SIP为切分出的每个段计算.
+//如果发送成功,就返回1,否则返回-1.
+int sip_sendsuperseg(int sip_conn, int dest_nodeID, superseg_t* segPtr);
+
 //STCP进程使用这个函数来接收来自SIP进程的包含段及其源节点ID的sendseg_arg_t结构.
 //参数sip_conn是STCP进程和SIP进程之间连接的TCP描述符.
 //当接收到段时, 使用seglost()来判断该段是否应被丢弃并检查校验和.
@@ -70,9 +114,13 @@ int sip_sendseg(int sip_conn, int dest_nodeID, seg_t* segPtr);
 int sip_recvseg(int sip_conn, int* src_nodeID, seg_t* segPtr);
 
 //SIP进程使用这个函数接收来自STCP进程的包含段及其目的节点ID的sendseg_arg_t结构.
-//参数stcp_conn是在STCP进程和SIP进程之间连接的TCP描述符.
+//参数stcp_conn是在STCP进程和SIP进程之间连接的TCP描述符. 收到的可能是普通段或超级段, 所以segPtr指向一个超级段大小的缓冲区.
 //如果成功接收到sendseg_arg_t就返回1, 否则返回-1.
-int getsegToSend(int stcp_conn, int* dest_nodeID, seg_t* segPtr); 
+int getsegToSend(int stcp_conn, int* dest_nodeID, superseg_t* segPtr); 
+
+//SIP进程使用这个函数把getsegToSend()收到的段封装为发往dst_nodeID的SIP报文, 存放在pkts中. 普通段被封装进一个报文,
+//超级段被切分为最多SUPERSEG_SEGS个段, 每个段被封装进一个报文并计算自己的校验和. 返回报文数.
+int sip_packsegs(superseg_t* segPtr, int src_nodeID, int dst_nodeID, sip_pkt_t* pkts);
 
 //SIP进程使用这个函数发送包含段及其源节点ID的sendseg_arg_t结构给STCP进程.
 //参数stcp_conn是STCP进程和SIP进程之间连接的TCP描述符.
@@ -85,6 +133,9 @@ int forwardsegToSTCP(int stcp_conn, int src_nodeID, seg_t* segPtr);
 // 我们在段中反转一个随机比特来创建错误的校验和.
 int seglost(seg_t* segPtr); 
 
+//这个函数设置seglost()使用的丢包率, 默认为PKT_LOSS_RATE. 在路径模拟器中测试时设为0, 丢包只由模拟器产生.
+void seg_setlossrate(double rate);
+
 //这个函数计算指定段的校验和.
 //校验和计算覆盖段首部和段数据. 你应该首先将段首部中的校验和字段清零, 
 //如果数据长度为奇数, 添加一个全零的字节来计算校验和.
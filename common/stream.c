@@ -0,0 +1,1244 @@
+//文件名: common/stream.c
+//
+//描述: 这个文件包含客户端和服务器共用的双向数据传输实现.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include "stream.h"
+#include "helper.h"
+
+//到SIP进程的TCP连接
+static int sipConn = -1;
+//应用线程, 处理段的线程和定时器都会发送段, 这个互斥量保证发往SIP进程的段不会交织
+static pthread_mutex_t sendMutex = PTHREAD_MUTEX_INITIALIZER;
+//合并连续段的超级段缓冲区, 由sendMutex保护
+static superseg_t superSeg;
+
+// the statistics are read by stream_group_stats() without the threads that count them
+#define stat_add(var, n) __atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED)
+#define stat_get(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+
+// GBN window limited by the receive window of the peer, one segment is always allowed so that
+// a closed window is probed by the retransmission timer. the rate mode is held back by the receive window only
+#define send_window(st) max(1, min((st)->group->rateMode ? RATE_WINDOW : GBN_WINDOW, (st)->peer_win))
+
+// segments all streams may have in flight, the rate mode leaves the pace to its rate instead of the window
+#define flight_limit(g) ((g)->rateMode ? RATE_WINDOW : (g)->cwnd)
+
+void stream_setconn(int sip_conn) {
+    sipConn = sip_conn;
+}
+
+// the class rides in the flags to SIP, which queues the packets by it
+#define set_class(flags, tclass) \
+    ((flags) = (unsigned short) (((flags) & ~SEG_CLASS_MASK) | ((tclass) << SEG_CLASS_SHIFT & SEG_CLASS_MASK)))
+
+// one frame at a time goes to SIP
+int stream_sendseg(int dest_nodeID, unsigned int tclass, seg_t *seg) {
+    set_class(seg->header.flags, tclass);
+    pthread_mutex_lock(&sendMutex);
+    int ret = sip_sendseg(sipConn, dest_nodeID, seg);
+    pthread_mutex_unlock(&sendMutex);
+    return ret;
+}
+
+static void stream_init(stream_t *st, streamGroup_t *g, unsigned short id, unsigned int buf_size) {
+    memset(st, 0, sizeof(stream_t));
+    st->lock = g->lock;
+    st->cond = g->cond;
+    st->id = id;
+    st->group = g;
+    // buffer related pointers lead by a dummy head, the dummy head is never sent
+    st->sendBufHead = st->sendBufTail = new(segBuf_t);
+    st->sendBufHead->next = NULL;
+    st->sendBufunSent = NULL;
+    // updated by every SYNACK, DATA and DATAACK of the peer
+    st->peer_win = GBN_WINDOW;
+    st->recvBuf = ringbuf_create(buf_size);
+    st->msgEnds = ringbuf_create(MSG_QUEUE_LEN * sizeof(unsigned long));
+    st->delayAck = 1;
+}
+
+static void stream_free(stream_t *st) {
+    while (st->sendBufHead) {
+        segBuf_t *next = st->sendBufHead->next;
+        free(st->sendBufHead);
+        st->sendBufHead = next;
+    }
+    while (st->oooHead) {
+        oooSeg_t *next = st->oooHead->next;
+        free(st->oooHead);
+        st->oooHead = next;
+    }
+    ringbuf_destroy(st->recvBuf);
+    ringbuf_destroy(st->msgEnds);
+    free(st->fecParity);
+    free(st->fecCache);
+}
+
+// whether the boundary queue has a free record beyond those the held end-of-message segments will take
+#define msg_room(st) (ringbuf_free((st)->msgEnds) / sizeof(unsigned long) > (st)->oooMsgs)
+
+unsigned short stream_window(stream_t *st) {
+    // too many unread messages, the next one would have no record
+    if (!msg_room(st)) return 0;
+    // the memory budget of the chunk pool closes the window before the buffer itself is full
+    return (unsigned short) min(ringbuf_room(st->recvBuf) / MAX_SEG_LEN, 0xFFFF);
+}
+
+//======================================================
+//          definition of sending helpers
+//======================================================
+
+// the loss rate this end sees on the stream, reported in the flags of every segment carrying an ACK
+#define loss_report(st) \
+    ((st)->group->fec ? (unsigned short) (min((st)->fecLoss, 0xFF) << SEG_LOSS_SHIFT) : 0)
+
+// data segments per parity segment, as many as keep the segments expected lost in a block, the parity
+// included, within FEC_LOSS_TARGET percent. a peer seeing no loss gets the largest blocks
+static unsigned int fec_k(stream_t *st) {
+    int loss = __atomic_load_n(&st->fecPeerLoss, __ATOMIC_RELAXED);
+    if (loss == 0) return FEC_MAX_K;
+    return (unsigned int) max(1, min(FEC_MAX_K, FEC_LOSS_TARGET * 256 / (100 * loss) - 1));
+}
+
+// send the parity of the current block and start a new one. the parity has no ACK in it, ack_num is the end
+// of the block and rcv_win the number of segments. should be surrounded by lock and unlock
+static void fec_flush(stream_t *st, unsigned short eom) {
+    seg_t parity;
+    memset(&parity.header, 0, sizeof(stcp_hdr_t));
+    parity.header.src_port = st->localPort;
+    parity.header.dst_port = st->remotePort;
+    parity.header.type = DATA;
+    parity.header.seq_num = st->fecBase;
+    parity.header.ack_num = st->fecEnd;
+    parity.header.rcv_win = st->fecCount;
+    parity.header.length = st->fecMaxLen;
+    parity.header.stream_id = st->id;
+    parity.header.flags = SEG_FLAG_FEC | eom | loss_report(st);
+    memcpy(parity.data, st->fecParity, st->fecMaxLen);
+    if (stream_sendseg((int) st->remoteNodeID, st->group->tclass, &parity) < 0) exit(0);
+    memset(st->fecParity, 0, st->fecMaxLen);
+    stat_add(st->fecSent, 1);
+    st->fecBase = st->fecEnd;
+    st->fecCount = st->fecMaxLen = 0;
+}
+
+// fold a segment sent for the first time into the parity of its block, a block also ends with a message so
+// that the parity of a message is never held back by the next one. should be surrounded by lock and unlock
+static void fec_add(stream_t *st, seg_t *seg) {
+    unsigned int len = seg->header.length;
+    if (st->fecParity == NULL) st->fecParity = (char *) calloc(1, MAX_SEG_LEN);
+    if (st->fecCount == 0) st->fecBase = seg->header.seq_num;
+    for (unsigned int i = 0; i < len; ++i) st->fecParity[i] ^= seg->data[i];
+    st->fecEnd = seg->header.seq_num + len;
+    st->fecMaxLen = (unsigned short) max(st->fecMaxLen, len);
+    ++st->fecCount;
+    if (st->fecCount >= fec_k(st) || (seg->header.flags & SEG_FLAG_EOM))
+        fec_flush(st, seg->header.flags & SEG_FLAG_EOM);
+}
+
+// send up to k segments of the buffer from sb on, stopping before end, all carrying the latest ACK. full segments
+// in a row go to SIP as one super-segment that SIP cuts into the same segments again, so a window of data costs
+// one frame instead of one per segment. with FEC the segments sent for the first time are followed by the parity
+// of each block they complete. returns the number of segments sent, should be surrounded by lock and unlock
+static unsigned int transmit(stream_t *st, segBuf_t *sb, segBuf_t *end, unsigned int k) {
+    unsigned int ack_num = __atomic_load_n(&st->expect_seqNum, __ATOMIC_RELAXED);
+    if (ack_num != __atomic_load_n(&st->ackSentNum, __ATOMIC_RELAXED)) stat_add(st->ackPiggybacked, 1);
+    st->advWin = stream_window(st);
+    unsigned short report = loss_report(st);
+    unsigned int n = 1;
+    for (segBuf_t *last = sb; n < k && n < SUPERSEG_SEGS && last->seg.header.length == MAX_SEG_LEN &&
+                              !(last->seg.header.flags & SEG_FLAG_EOM) && last->next != end; last = last->next)
+        ++n;
+    long cur_nano = now_nano();
+    segBuf_t *cur = sb, *fresh = NULL;
+    unsigned int bytes = 0, resent = 0, resent_bytes = 0;
+    for (unsigned int i = 0; i < n; ++i, cur = cur->next) {
+        bytes += cur->seg.header.length;
+        cur->seg.header.ack_num = ack_num;
+        cur->seg.header.rcv_win = st->advWin;
+        cur->seg.header.flags = (unsigned short) ((cur->seg.header.flags & SEG_FLAG_EOM) | report);
+        // the receiver times the gap to the next one, which leaves in the same super-segment
+        if (i == 0 && n >= 2 && st->group->probeNow) cur->seg.header.flags |= SEG_FLAG_RATE;
+        // a segment sent before is a retransmission, its ACK says nothing about the round trip time.
+        // the segments going back N come first, the new ones after them
+        if (cur->sentTime != 0) {
+            cur->resent = 1;
+            ++resent;
+            resent_bytes += cur->seg.header.length;
+        } else if (fresh == NULL) fresh = cur;
+        cur->sentTime = cur_nano;
+    }
+    if (n == 1) {
+        if (stream_sendseg((int) st->remoteNodeID, st->group->tclass, &sb->seg) < 0) exit(0);
+    } else {
+        pthread_mutex_lock(&sendMutex);
+        superSeg.header = sb->seg.header;
+        unsigned int len = 0;
+        cur = sb;
+        for (unsigned int i = 0; i < n; ++i, cur = cur->next) {
+            memcpy(superSeg.data + len, cur->seg.data, cur->seg.header.length);
+            len += cur->seg.header.length;
+            // only the last one may end a message
+            superSeg.header.flags |= cur->seg.header.flags & SEG_FLAG_EOM;
+        }
+        superSeg.header.length = (unsigned short) len;
+        set_class(superSeg.header.flags, st->group->tclass);
+        int ret = sip_sendsuperseg(sipConn, (int) st->remoteNodeID, &superSeg);
+        pthread_mutex_unlock(&sendMutex);
+        if (ret < 0) exit(0);
+    }
+    __atomic_store_n(&st->ackSentNum, ack_num, __ATOMIC_RELAXED);
+    stat_add(st->dataSent, n);
+    stat_add(st->bytesSent, bytes);
+    if (resent) {
+        stat_add(st->dataResent, resent);
+        stat_add(st->bytesResent, resent_bytes);
+    }
+    if (st->group->fec && fresh) {
+        for (segBuf_t *sent = fresh; sent != cur; sent = sent->next) fec_add(st, &sent->seg);
+        // nothing more to send, the partial block is not held back
+        if (cur == NULL && st->fecCount > 0) fec_flush(st, 0);
+    }
+    return n;
+}
+
+// the gap between two paced segments, cwnd of them leave per SRTT, or the rate of the rate mode
+#define pace_interval(g) ((g)->rateMode ? 1000000000L / (long) (g)->rate : max(1, (g)->srtt / (g)->cwnd))
+
+// how many segments pacing lets leave now, 0 until paceNext. a connection that was idle may send PACING_BURST
+// segments at once. the rate mode is always paced. should be surrounded by lock and unlock
+static unsigned int pace_allow(streamGroup_t *g, long cur_nano) {
+    if (!g->rateMode && (!g->pacing || g->srtt == 0)) return UINT_MAX;
+    long interval = pace_interval(g);
+    // credit does not pile up beyond the burst while the connection is idle
+    if (g->paceNext < cur_nano - (PACING_BURST - 1) * interval) g->paceNext = cur_nano - (PACING_BURST - 1) * interval;
+    if (g->paceNext > cur_nano) return 0;
+    return (unsigned int) (1 + (cur_nano - g->paceNext) / interval);
+}
+
+// pacing holds the sending back, the timer thread goes on when the next segment may leave
+static void pace_wait(streamGroup_t *g) {
+    g->paceRelease = g->paceNext;
+    pthread_cond_signal(&g->timerCond);
+}
+
+// the rate mode resends the segments marked lost one by one ahead of new ones, at the same pace.
+// returns 0 if pacing stopped it. should be surrounded by lock and unlock
+static int rate_resend(streamGroup_t *g, long cur_nano) {
+    for (stream_t *st = g->head; st; st = st->groupNext) {
+        for (segBuf_t *sb = st->sendBufHead->next; st->nakPending > 0 && sb != st->sendBufunSent; sb = sb->next) {
+            if (!sb->nak) continue;
+            if (pace_allow(g, cur_nano) == 0) {
+                pace_wait(g);
+                return 0;
+            }
+            transmit(st, sb, sb->next, 1);
+            g->paceNext += pace_interval(g);
+            sb->nak = 0;
+            --st->nakPending;
+            stat_add(st->nakResent, 1);
+        }
+    }
+    return 1;
+}
+
+// send the unsent segments of all streams in turn, one run of segments per stream and round, as far as the window
+// of each stream, the congestion window and the pacing of the connection allow. the round goes on where the last one
+// stopped, so the streams at the head of the list don't starve the others. should be surrounded by lock and unlock
+static void group_transmit(streamGroup_t *g) {
+    stream_t *st = g->rrNext ? g->rrNext : g->head, *start = st;
+    int sent = 0;
+    long cur_nano = now_nano();
+    if (g->rateMode && !rate_resend(g, cur_nano)) return;
+    while (g->inFlight < flight_limit(g)) {
+        if (st->sendBufunSent && st->established && st->unAck_segNum < send_window(st)) {
+            unsigned int allow = pace_allow(g, cur_nano);
+            if (allow == 0) {
+                pace_wait(g);
+                break;
+            }
+            unsigned int k = min(flight_limit(g) - g->inFlight, send_window(st) - st->unAck_segNum);
+            segBuf_t *sb = st->sendBufunSent;
+            // every RATE_PROBE_SEGS new segments two full ones leave back to back as a packet pair
+            g->probeNow = g->rateMode && g->probeCount >= RATE_PROBE_SEGS && k >= 2 && sb->next &&
+                          sb->seg.header.length == MAX_SEG_LEN && !(sb->seg.header.flags & SEG_FLAG_EOM);
+            if (g->probeNow) allow = max(allow, 2);
+            unsigned int n = transmit(st, sb, NULL, min(k, allow));
+            if (g->probeNow) g->probeCount = g->probeNow = 0;
+            g->probeCount += n;
+            if (allow != UINT_MAX) g->paceNext += n * pace_interval(g);
+            st->unAck_segNum += n;
+            g->inFlight += n;
+            while (n-- > 0) st->sendBufunSent = st->sendBufunSent->next;
+            sent = 1;
+        }
+        st = st->groupNext ? st->groupNext : g->head;
+        // a whole round over the streams without sending anything ends it
+        if (st == start) {
+            if (!sent) break;
+            sent = 0;
+        }
+    }
+    g->rrNext = st;
+}
+
+// pop segment from the head, should be surrounded by lock and unlock
+static void pop_seg(stream_t *st) {
+    segBuf_t *first = st->sendBufHead->next;
+    if (first == st->sendBufTail) {
+        st->sendBufTail = st->sendBufHead;
+        // an empty buffer has nothing unsent
+        st->sendBufunSent = NULL;
+    }
+    st->sendBufHead->next = first->next;
+    --st->bufSegNum;
+    if (first->nak) --st->nakPending;
+    free(first);
+}
+
+// a standing queue on the path: the smoothed round trip time is well above the smallest one
+#define queued(g) ((g)->srtt - (g)->minRtt > max((g)->minRtt, RATE_QUEUE_SLACK))
+
+// the rate mode slows down by 1/8 for a loss that tells of congestion, once per round trip: segments sent before the
+// last decrease don't count. should be surrounded by lock and unlock
+static void rate_cut(streamGroup_t *g, long cur_nano) {
+    g->rate = max(RATE_MIN, g->rate * 7 / 8);
+    g->rateSlowStart = 0;
+    g->rateLastDec = cur_nano;
+}
+
+// the rate mode speeds up: doubling each SRTT in slow start until it reaches the capacity the peer measures, then
+// closing an eighth of the distance to it each RATE_INTERVAL, or probing beyond by 1/64 when it is reached. nothing
+// is gained while a queue builds up. should be surrounded by lock and unlock
+static void rate_raise(streamGroup_t *g, long cur_nano) {
+    if (cur_nano - g->rateLastInc < (g->rateSlowStart ? max(RATE_INTERVAL, g->srtt) : RATE_INTERVAL)) return;
+    g->rateLastInc = cur_nano;
+    if (queued(g)) {
+        g->rateSlowStart = 0;
+        return;
+    }
+    if (g->rateSlowStart) {
+        g->rate = min(RATE_MAX, g->rate * 2);
+        if (g->peerCapacity && g->rate >= g->peerCapacity) {
+            g->rate = g->peerCapacity;
+            g->rateSlowStart = 0;
+        }
+    } else if (g->peerCapacity > g->rate) {
+        g->rate += max(1, (g->peerCapacity - g->rate) / 8);
+    } else {
+        g->rate = min(RATE_MAX, g->rate + max(1, g->rate / 64));
+    }
+}
+
+// mark the segments in flight that went out before expire for a resend of their own, returns whether any of them was
+// resent already. should be surrounded by lock and unlock
+static int rate_expire(stream_t *st, long expire) {
+    int again = 0;
+    for (segBuf_t *sb = st->sendBufHead->next; sb != st->sendBufunSent; sb = sb->next) {
+        if (sb->nak || sb->sentTime > expire) continue;
+        again |= sb->resent;
+        sb->nak = 1;
+        ++st->nakPending;
+    }
+    return again;
+}
+
+//======================================================
+//          sending helpers end
+//======================================================
+
+// the total length of the user buffers
+static unsigned int iov_total(const struct iovec *iov, int iovcnt) {
+    unsigned int total = 0;
+    for (int i = 0; i < iovcnt; ++i) total += iov[i].iov_len;
+    return total;
+}
+
+void stream_push(stream_t *st, const void *data, unsigned int length, int msg) {
+    struct iovec iov = {.iov_base = (void *) data, .iov_len = length};
+    stream_pushv(st, &iov, 1, msg);
+}
+
+void stream_pushv(stream_t *st, const struct iovec *iov, int iovcnt, int msg) {
+    unsigned int length = iov_total(iov, iovcnt);
+    // the user buffer and the offset in it where the next segment starts
+    int v = 0;
+    size_t off = 0;
+    while (length > 0) {
+        unsigned short cur_len = length < MAX_SEG_LEN ? length : MAX_SEG_LEN;
+        segBuf_t *sb = new(segBuf_t);
+        memset(&sb->seg.header, 0, sizeof(stcp_hdr_t));
+        sb->resent = 0;
+        sb->seg.header.src_port = st->localPort;
+        sb->seg.header.dst_port = st->remotePort;
+        sb->seg.header.stream_id = st->id;
+        sb->seg.header.type = DATA;
+        sb->seg.header.seq_num = st->next_seqNum;
+        sb->seg.header.length = cur_len;
+        if (msg && cur_len == length) sb->seg.header.flags = SEG_FLAG_EOM;
+        // a segment is gathered straight from the user buffers, a small header and the start of the body share one
+        for (unsigned int got = 0; got < cur_len;) {
+            if (off == iov[v].iov_len) {
+                ++v, off = 0;
+                continue;
+            }
+            size_t n = min(cur_len - got, iov[v].iov_len - off);
+            memcpy(sb->seg.data + got, (const char *) iov[v].iov_base + off, n);
+            got += n, off += n;
+        }
+        sb->sentTime = 0;
+        sb->next = NULL;
+        st->sendBufTail->next = sb;
+        st->sendBufTail = sb;
+        if (st->sendBufunSent == NULL) st->sendBufunSent = sb;
+        ++st->bufSegNum;
+        st->next_seqNum += cur_len;
+        length -= cur_len;
+    }
+    streamGroup_t *g = st->group;
+    if (!g->timerRunning && st->sendBufHead != st->sendBufTail) {
+        // one thread traverses the buffers of all streams, a request/response exchange empties the buffer
+        // every round and must not leave one sleeping timer behind per round
+        g->timerRunning = 1;
+        pthread_t tid;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_create(&tid, &attr, stream_timer, g);
+    }
+    group_transmit(g);
+}
+
+int stream_send(stream_t *st, const void *data, unsigned int length, int nonblock, int msg) {
+    struct iovec iov = {.iov_base = (void *) data, .iov_len = length};
+    return stream_sendv(st, &iov, 1, nonblock, msg);
+}
+
+int stream_sendv(stream_t *st, const struct iovec *iov, int iovcnt, int nonblock, int msg) {
+    unsigned int length = iov_total(iov, iovcnt), segs = (length + MAX_SEG_LEN - 1) / MAX_SEG_LEN;
+    pthread_mutex_lock(st->lock);
+    // all or nothing, a message larger than the limit still goes into an empty buffer
+    if (nonblock && st->bufSegNum > 0 && st->bufSegNum + segs > SEND_BUF_SEGS) {
+        // the sender waits from now until ACKs make room for what it tried to send
+        if (st->blockedSince == 0) st->blockedSince = now_nano();
+        st->blockedSegs = segs;
+        pthread_mutex_unlock(st->lock);
+        return STCP_EAGAIN;
+    }
+    stream_pushv(st, iov, iovcnt, msg);
+    pthread_mutex_unlock(st->lock);
+    return 1;
+}
+
+void stream_report(stream_t *st, seg_t *seg) {
+    streamGroup_t *g = st->group;
+    rateReport_t *report = (rateReport_t *) seg->data;
+    if (seg->header.length < sizeof(rateReport_t)) return;
+    unsigned int ranges = (seg->header.length - sizeof(rateReport_t)) / (2 * sizeof(unsigned int));
+    pthread_mutex_lock(st->lock);
+    if (report->capacity) g->peerCapacity = report->capacity;
+    long cur_nano = now_nano();
+    int fresh_loss = 0;
+    // both the ranges and the segments in flight go up, one walk over the two does
+    segBuf_t *sb = st->sendBufHead->next;
+    for (unsigned int i = 0; i < ranges; ++i) {
+        unsigned int from = report->lost[2 * i], to = report->lost[2 * i + 1];
+        for (; sb != st->sendBufunSent && SEQ_LT(sb->seg.header.seq_num, to); sb = sb->next) {
+            // a resend that is still on its way was reported lost before it could arrive
+            if (SEQ_LT(sb->seg.header.seq_num, from) || sb->nak || cur_nano - sb->sentTime < g->srtt) continue;
+            sb->nak = 1;
+            ++st->nakPending;
+            if (sb->sentTime > g->rateLastDec) fresh_loss = 1;
+        }
+    }
+    // a random loss on a path without a queue leaves the rate alone
+    if (fresh_loss && (g->srtt == 0 || queued(g))) rate_cut(g, cur_nano);
+    else rate_raise(g, cur_nano);
+    pthread_mutex_unlock(st->lock);
+}
+
+unsigned int stream_ack(stream_t *st, unsigned int ack_num, unsigned short rcv_win) {
+    streamGroup_t *g = st->group;
+    unsigned int popped = 0;
+    pthread_mutex_lock(st->lock);
+    unsigned int old_win = st->peer_win;
+    st->peer_win = rcv_win;
+    long sample = 0;
+    segBuf_t *first;
+    while ((first = st->sendBufHead->next) && first->sentTime != 0 && SEQ_LT(first->seg.header.seq_num, ack_num)) {
+        if (!first->resent) sample = now_nano() - first->sentTime;
+        if (first == st->sendBufunSent) {
+            // sent before the timer took it back for a retransmission, it is not in flight anymore
+            st->sendBufunSent = first->next;
+        } else {
+            --st->unAck_segNum;
+            --g->inFlight;
+        }
+        pop_seg(st);
+        ++popped;
+    }
+    if (popped == 0) {
+        // nothing new is acknowledged while segments are in flight, and it is no window update either
+        if (st->unAck_segNum > 0 && rcv_win == old_win) stat_add(st->dupAcks, 1);
+    } else if (st->blockedSince && (st->bufSegNum == 0 || st->bufSegNum + st->blockedSegs <= SEND_BUF_SEGS)) {
+        // the send that failed would go through now, whenever the application retries it
+        stat_add(st->sendBlocked, now_nano() - st->blockedSince);
+        st->blockedSince = 0;
+    }
+    if (sample > 0) {
+        // the usual 1/8 gain, the latest acknowledged segment gives the freshest sample
+        g->srtt = g->srtt ? g->srtt + (sample - g->srtt) / 8 : sample;
+        if (g->minRtt == 0 || sample < g->minRtt) g->minRtt = sample;
+    }
+    if (g->cwnd < g->ssthresh) {
+        // slow start, one segment per acknowledged segment
+        g->cwnd = min(g->ssthresh, g->cwnd + popped);
+    } else {
+        // additive increase, one segment per window of acknowledged segments
+        g->cwndAcked += popped;
+        while (g->cwndAcked >= g->cwnd) {
+            g->cwndAcked -= g->cwnd;
+            if (g->cwnd < CWND_MAX) ++g->cwnd;
+        }
+    }
+    group_transmit(g);
+    pthread_mutex_unlock(st->lock);
+    return popped;
+}
+
+void *stream_timer(void *arg) {
+    streamGroup_t *g = arg;
+    pthread_mutex_lock(g->lock);
+    long next_poll = now_nano() + SENDBUF_POLLING_INTERVAL;
+    while (1) {
+        // sleep until the next poll, or until pacing lets the next segment leave
+        long deadline = g->paceRelease && g->paceRelease < next_poll ? g->paceRelease : next_poll;
+        struct timespec ts = nano_timespec(deadline);
+        if (!g->timerStop) pthread_cond_timedwait(&g->timerCond, g->lock, &ts);
+        if (g->timerStop) break;
+        long cur_nano = now_nano();
+        if (g->paceRelease && cur_nano >= g->paceRelease) {
+            g->paceRelease = 0;
+            group_transmit(g);
+        }
+        if (cur_nano < next_poll) continue;
+        next_poll = cur_nano + SENDBUF_POLLING_INTERVAL;
+        int busy = 0, congested = 0;
+        for (stream_t *st = g->head; st; st = st->groupNext) {
+            if (!st->established || st->sendBufHead == st->sendBufTail) continue;
+            busy = 1;
+            segBuf_t *first = st->sendBufHead->next;
+            if (first != st->sendBufunSent && timeout_nano(cur_nano, first->sentTime, DATA_TIMEOUT)) {
+                printf("[Stream] \x1B[34mdata timeout on stream %u, begin to resend\x1B[0m\n", st->id);
+                stat_add(st->timeouts, 1);
+                if (g->rateMode) {
+                    // receiver reports cover the holes, the segments no report could name are resent
+                    // one by one instead, the last ones sent above all
+                    if (rate_expire(st, cur_nano - max(DATA_TIMEOUT, 2 * g->srtt))) rate_cut(g, cur_nano);
+                    continue;
+                }
+                // anything in flight at a poll times out, only a segment lost again after it was
+                // resent tells of congestion
+                if (first->resent) congested = 1;
+                // go back N, the segments are sent again like new ones, so a resent window is paced too
+                g->inFlight -= st->unAck_segNum;
+                st->unAck_segNum = 0;
+                st->sendBufunSent = first;
+            }
+        }
+        if (congested) {
+            // multiplicative decrease, a loss on any stream slows down the whole connection, but never
+            // below the window a single stream had before the streams shared one
+            g->ssthresh = g->cwnd = max(GBN_WINDOW, g->cwnd / 2);
+            g->cwndAcked = 0;
+        }
+        group_transmit(g);
+        // loop condition after '!', some established stream has data in flight or waiting
+        if (!busy) break;
+    }
+    g->timerRunning = 0;
+    g->paceRelease = 0;
+    // stream_group_free may be waiting for the thread to leave
+    pthread_cond_broadcast(&g->timerCond);
+    pthread_mutex_unlock(g->lock);
+    return 0;
+}
+
+//======================================================
+//          definition of reassembly helpers
+//======================================================
+
+/**
+ * hold a segment that arrived ahead of expect_seqNum. Only segments ending inside the space left in the
+ * receive buffer are kept, so everything held can always be delivered. Duplicates and segments overlapping
+ * a held one are dropped, GBN resends the same segment boundaries anyway.
+ */
+static void ooo_insert(stream_t *st, seg_t *seg) {
+    unsigned int seq = seg->header.seq_num, len = seg->header.length;
+    int eom = (seg->header.flags & SEG_FLAG_EOM) != 0;
+    if (len == 0 || seq + len - st->expect_seqNum > ringbuf_free(st->recvBuf) || (eom && !msg_room(st))) return;
+    oooSeg_t **pos = &st->oooHead;
+    while (*pos && SEQ_LEQ((*pos)->seq_num + (*pos)->length, seq)) pos = &(*pos)->next;
+    if (*pos && SEQ_LT((*pos)->seq_num, seq + len)) return;
+    oooSeg_t *ooo = (oooSeg_t *) malloc(sizeof(oooSeg_t) + len);
+    ooo->seq_num = seq;
+    ooo->length = (unsigned short) len;
+    ooo->flags = seg->header.flags;
+    memcpy(ooo->data, seg->data, len);
+    ooo->next = *pos;
+    *pos = ooo;
+    stat_add(st->oooBytes, len);
+    st->oooMsgs += eom;
+}
+
+// note the end of a message that was just written into the receive buffer, only the segment thread calls it
+static void msg_end(stream_t *st) {
+    unsigned long end = __atomic_load_n(&st->recvBuf->tail, __ATOMIC_RELAXED);
+    ringbuf_write(st->msgEnds, &end, sizeof(unsigned long));
+}
+
+// move the held segments that the last in-order segment made contiguous into the receive buffer
+static void ooo_deliver(stream_t *st) {
+    while (st->oooHead && SEQ_LEQ(st->oooHead->seq_num, st->expect_seqNum)) {
+        oooSeg_t *head = st->oooHead;
+        unsigned int end = head->seq_num + head->length;
+        if (SEQ_GT(end, st->expect_seqNum)) {
+            unsigned int skip = st->expect_seqNum - head->seq_num;
+            ringbuf_write(st->recvBuf, head->data + skip, end - st->expect_seqNum);
+            stat_add(st->oooSavedBytes, end - st->expect_seqNum);
+            __atomic_store_n(&st->expect_seqNum, end, __ATOMIC_RELAXED);
+            if (head->flags & SEG_FLAG_EOM) msg_end(st);
+        }
+        if (head->flags & SEG_FLAG_EOM) --st->oooMsgs;
+        st->oooHead = head->next;
+        __atomic_fetch_sub(&st->oooBytes, head->length, __ATOMIC_RELAXED);
+        free(head);
+    }
+}
+
+//======================================================
+//          reassembly helpers end
+//======================================================
+
+//======================================================
+//          definition of ack helpers
+//======================================================
+
+// fill the receive report of the rate mode into a DATAACK: the capacity measured and the holes in front of the
+// held segments
+static void rate_report(stream_t *st, seg_t *ack) {
+    rateReport_t *report = (rateReport_t *) ack->data;
+    report->capacity = st->group->capacity;
+    unsigned int from = st->expect_seqNum, ranges = 0;
+    for (oooSeg_t *ooo = st->oooHead; ooo && ranges < RATE_NAK_MAX; ooo = ooo->next) {
+        if (SEQ_LT(from, ooo->seq_num)) {
+            report->lost[2 * ranges] = from;
+            report->lost[2 * ranges + 1] = ooo->seq_num;
+            ++ranges;
+        }
+        from = ooo->seq_num + ooo->length;
+    }
+    ack->header.length = (unsigned short) (sizeof(rateReport_t) + ranges * 2 * sizeof(unsigned int));
+    ack->header.flags |= SEG_FLAG_RATE;
+}
+
+// send a cumulative DATAACK carrying the current window, and the receive report in the rate mode
+static void send_dataack(stream_t *st) {
+    unsigned int ack_num = __atomic_load_n(&st->expect_seqNum, __ATOMIC_RELAXED);
+    st->advWin = stream_window(st);
+    seg_t *data_ack = create_seg(st->localPort, st->remotePort, DATAACK,
+                                 st->next_seqNum, ack_num, st->advWin, 0, NULL);
+    data_ack->header.stream_id = st->id;
+    data_ack->header.flags = loss_report(st);
+    if (st->group->rateMode) rate_report(st, data_ack);
+    if (stream_sendseg((int) st->remoteNodeID, st->group->tclass, data_ack) < 0) exit(1);
+    __atomic_store_n(&st->ackSentNum, ack_num, __ATOMIC_RELAXED);
+    stat_add(st->ackSent, 1);
+    free(data_ack);
+}
+
+static void ackq_append(ackq_t *q, stream_t *st) {
+    st->ackNext = NULL;
+    st->ackPrev = q->tail;
+    if (q->tail) q->tail->ackNext = st;
+    else q->head = st;
+    q->tail = st;
+    st->ackQueued = 1;
+}
+
+void stream_ack_cancel(ackq_t *q, stream_t *st) {
+    if (!st->ackQueued) return;
+    if (st->ackPrev) st->ackPrev->ackNext = st->ackNext;
+    else q->head = st->ackNext;
+    if (st->ackNext) st->ackNext->ackPrev = st->ackPrev;
+    else q->tail = st->ackPrev;
+    st->ackPrev = st->ackNext = NULL;
+    st->ackQueued = 0;
+}
+
+void stream_ack_now(ackq_t *q, stream_t *st) {
+    stream_ack_cancel(q, st);
+    send_dataack(st);
+}
+
+// the next DATAACK goes out within DELAYED_ACK_TIMEOUT
+static void ack_later(ackq_t *q, stream_t *st) {
+    if (!st->ackQueued) {
+        st->ackDeadline = now_nano() + DELAYED_ACK_TIMEOUT;
+        ackq_append(q, st);
+    }
+}
+
+// acknowledge an in-order segment: at least every second full segment is acknowledged at once,
+// anything less waits in the queue for DELAYED_ACK_TIMEOUT unless outgoing data carries it first
+static void ack_delayed(ackq_t *q, stream_t *st) {
+    unsigned int unacked = st->expect_seqNum - __atomic_load_n(&st->ackSentNum, __ATOMIC_RELAXED);
+    if (!st->delayAck || unacked >= 2 * MAX_SEG_LEN) {
+        stream_ack_now(q, st);
+        return;
+    }
+    ack_later(q, st);
+}
+
+// the rate mode reports the holes again every DELAYED_ACK_TIMEOUT until they are filled
+#define nak_again(st) ((st)->group->rateMode && (st)->oooHead)
+
+int ackq_flush(ackq_t *q) {
+    long cur_nano = now_nano();
+    while (q->head && q->head->ackDeadline <= cur_nano) {
+        stream_t *st = q->head;
+        stream_ack_cancel(q, st);
+        // a DATA segment sent in the meantime may have carried it already
+        if (st->expect_seqNum != __atomic_load_n(&st->ackSentNum, __ATOMIC_RELAXED) || nak_again(st))
+            send_dataack(st);
+        if (nak_again(st)) ack_later(q, st);
+    }
+    if (q->head == NULL) return -1;
+    // round up, the wait must not end before the deadline
+    return (int) ((q->head->ackDeadline - cur_nano + 999999) / 1000000);
+}
+
+//======================================================
+//          ack helpers end
+//======================================================
+
+//======================================================
+//          definition of FEC helpers
+//======================================================
+
+// keep a copy of a segment not delivered before, the parity of its block may need it to rebuild another one
+static void fec_keep(stream_t *st, seg_t *seg) {
+    unsigned int len = seg->header.length;
+    if (len == 0 || SEQ_LT(seg->header.seq_num, st->expect_seqNum)) return;
+    if (st->fecCache == NULL) st->fecCache = (fecSeg_t *) calloc(FEC_CACHE, sizeof(fecSeg_t));
+    // GBN resends the same segment boundaries
+    for (int i = 0; i < FEC_CACHE; ++i)
+        if (st->fecCache[i].length > 0 && st->fecCache[i].seq_num == seg->header.seq_num) return;
+    fecSeg_t *slot = &st->fecCache[st->fecCacheNext];
+    st->fecCacheNext = (st->fecCacheNext + 1) % FEC_CACHE;
+    slot->seq_num = seg->header.seq_num;
+    slot->length = (unsigned short) len;
+    memcpy(slot->data, seg->data, len);
+}
+
+// rebuild the only segment of the block [base, end) missing in [hole, hole + len) into rec from the parity
+// and the cached segments of the block. returns 0 if some other segment of the block is gone from the cache
+static int fec_rebuild(stream_t *st, seg_t *parity, unsigned int hole, unsigned int len, seg_t *rec) {
+    unsigned int base = parity->header.seq_num, end = parity->header.ack_num, known = 0, bytes = 0;
+    memcpy(rec->data, parity->data, parity->header.length);
+    for (int i = 0; i < FEC_CACHE && st->fecCache; ++i) {
+        fecSeg_t *c = &st->fecCache[i];
+        if (c->length == 0 || SEQ_LT(c->seq_num, base) || SEQ_GT(c->seq_num + c->length, end) ||
+            (SEQ_LT(c->seq_num, hole + len) && SEQ_GT(c->seq_num + c->length, hole)))
+            continue;
+        for (unsigned int k = 0; k < c->length; ++k) rec->data[k] ^= c->data[k];
+        ++known;
+        bytes += c->length;
+    }
+    if (known + 1 != parity->header.rcv_win || bytes + len != end - base) return 0;
+    rec->header = parity->header;
+    rec->header.seq_num = hole;
+    rec->header.length = (unsigned short) len;
+    // only the last segment of a block may end a message
+    rec->header.flags = hole + len == end ? parity->header.flags & SEG_FLAG_EOM : 0;
+    return 1;
+}
+
+// note the loss rate the peer reports for the segments of the stream
+static stream_t *loss_note(stream_t *st, seg_t *seg) {
+    if (st->group->fec) __atomic_store_n(&st->fecPeerLoss, SEG_LOSS(seg->header.flags), __ATOMIC_RELAXED);
+    return st;
+}
+
+//======================================================
+//          FEC helpers end
+//======================================================
+
+//======================================================
+//          definition of rate mode helpers
+//======================================================
+
+static int rate_cmp(const void *a, const void *b) {
+    unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+    return x < y ? -1 : x > y;
+}
+
+// time the packet pairs of the rate mode: the gap between the two segments of a pair is the time the narrowest
+// link of the path takes for the second one. the median of the last RATE_PROBES pairs is the capacity reported
+static void probe_sample(stream_t *st, seg_t *seg) {
+    streamGroup_t *g = st->group;
+    long cur_nano = now_nano();
+    if (seg->header.flags & SEG_FLAG_RATE) {
+        g->probeTime = cur_nano;
+        g->probeEnd = seg->header.seq_num + seg->header.length;
+        g->probeStream = st->id;
+        return;
+    }
+    // anything but the second segment of the pair coming next spoils it
+    if (g->probeTime == 0 || st->id != g->probeStream || seg->header.seq_num != g->probeEnd) {
+        g->probeTime = 0;
+        return;
+    }
+    long gap = max(1, cur_nano - g->probeTime);
+    g->probeTime = 0;
+    g->probeRates[g->probeNum++ % RATE_PROBES] =
+            (unsigned int) min(RATE_MAX, 1000000000L * seg->header.length / MAX_SEG_LEN / gap);
+    unsigned int n = min(g->probeNum, RATE_PROBES), sorted[RATE_PROBES];
+    memcpy(sorted, g->probeRates, n * sizeof(unsigned int));
+    qsort(sorted, n, sizeof(unsigned int), rate_cmp);
+    g->capacity = sorted[n / 2];
+}
+
+//======================================================
+//          rate mode helpers end
+//======================================================
+
+int stream_data(ackq_t *q, stream_t *st, seg_t *seg) {
+    stat_add(st->dataRcvd, 1);
+    stat_add(st->bytesRcvd, seg->header.length);
+    if (st->group->fec) fec_keep(st, seg);
+    if (st->group->rateMode) probe_sample(st, seg);
+    int eom = (seg->header.flags & SEG_FLAG_EOM) != 0;
+    if (st->expect_seqNum == seg->header.seq_num && (!eom || msg_room(st)) &&
+        seg->header.length <= ringbuf_room(st->recvBuf) && ringbuf_write(st->recvBuf, seg->data, seg->header.length) > 0) {
+        __atomic_store_n(&st->expect_seqNum, st->expect_seqNum + seg->header.length, __ATOMIC_RELAXED);
+        if (eom) msg_end(st);
+        oooSeg_t *oooHead = st->oooHead;
+        ooo_deliver(st);
+        // a filled hole moves the ACK by a whole run of segments, the peer should know at once
+        if (st->oooHead != oooHead) stream_ack_now(q, st);
+        else ack_delayed(q, st);
+        if (nak_again(st)) ack_later(q, st);
+        return 1;
+    }
+    // a hole in front of it, keep it until the hole is filled
+    if (SEQ_LT(st->expect_seqNum, seg->header.seq_num)) ooo_insert(st, seg);
+    // out of order, duplicated or no room for it: tell the peer where we are right away
+    stream_ack_now(q, st);
+    if (nak_again(st)) ack_later(q, st);
+    return 0;
+}
+
+int stream_parity(ackq_t *q, stream_t *st, seg_t *seg) {
+    unsigned int base = seg->header.seq_num, end = seg->header.ack_num, count = seg->header.rcv_win;
+    stat_add(st->fecRcvd, 1);
+    if (count == 0 || SEQ_LEQ(end, base)) return 0;
+    // the holes of the block are the parts neither delivered nor held out of order
+    unsigned int from = SEQ_LT(base, st->expect_seqNum) ? st->expect_seqNum : base;
+    unsigned int holes = 0, missing = 0, hole = 0, hole_len = 0;
+    for (oooSeg_t *ooo = st->oooHead; SEQ_LT(from, end); ooo = ooo->next) {
+        unsigned int upto = ooo && SEQ_LT(ooo->seq_num, end) ? ooo->seq_num : end;
+        if (SEQ_LT(from, upto)) {
+            if (holes++ == 0) {
+                hole = from;
+                hole_len = upto - from;
+            }
+            missing += upto - from;
+        }
+        if (ooo == NULL) break;
+        if (SEQ_GT(ooo->seq_num + ooo->length, from)) from = ooo->seq_num + ooo->length;
+    }
+    // the segments lost out of the block, the lengths of the missing ones are guessed as the mean
+    unsigned int lost = (unsigned int) (((unsigned long) missing * count + (end - base) - 1) / (end - base));
+    st->fecLoss += ((int) (min(lost, count) * 256 / count) - st->fecLoss) / 8;
+    seg_t rec;
+    if (holes != 1 || hole_len > seg->header.length || !fec_rebuild(st, seg, hole, hole_len, &rec)) return 0;
+    stat_add(st->fecRecovered, 1);
+    return stream_data(q, st, &rec);
+}
+
+void stream_want(stream_t *st, unsigned int need) {
+    if (ringbuf_used(st->recvBuf) >= need) return;
+    // a whole segment more, so that the window in segments covers the rest of the request
+    ringbuf_want(st->recvBuf, need + MAX_SEG_LEN - 1);
+    // the budget of the chunk pool may have closed the window below the request
+    if (st->established && st->advWin < GBN_WINDOW && stream_window(st) > st->advWin) send_dataack(st);
+}
+
+void stream_wait(stream_t *st, unsigned int need, long deadline) {
+    stream_want(st, need);
+    while (ringbuf_used(st->recvBuf) < need && st->established) {
+        if (deadline < 0) {
+            pthread_cond_wait(st->cond, st->lock);
+        } else {
+            struct timespec ts = nano_timespec(deadline);
+            if (pthread_cond_timedwait(st->cond, st->lock, &ts) == ETIMEDOUT) break;
+        }
+    }
+}
+
+// the reader reopened a window that was squeezed below GBN_WINDOW, advertise it without
+// waiting for the next segment of the peer
+static void window_reopen(stream_t *st, unsigned int got) {
+    if (got > 0 && st->established && st->advWin < GBN_WINDOW && stream_window(st) >= GBN_WINDOW) {
+        send_dataack(st);
+    }
+}
+
+unsigned int stream_read(stream_t *st, void *buf, unsigned int len) {
+    ringbuf_want(st->recvBuf, 0);
+    unsigned int got = ringbuf_read(st->recvBuf, buf, len);
+    window_reopen(st, got);
+    return got;
+}
+
+int stream_views(stream_t *st, struct iovec *iov, int iovcnt) {
+    return ringbuf_views(st->recvBuf, iov, iovcnt);
+}
+
+void stream_consume(stream_t *st, unsigned int len) {
+    ringbuf_want(st->recvBuf, 0);
+    ringbuf_consume(st->recvBuf, len);
+    window_reopen(st, len);
+}
+
+// the end of the first message that was not read yet, 0 if no whole message is there. boundaries that stream_recv()
+// read past are dropped. only the application thread calls it
+static unsigned long msg_first(stream_t *st) {
+    unsigned long end, head = __atomic_load_n(&st->recvBuf->head, __ATOMIC_RELAXED);
+    while (ringbuf_peek(st->msgEnds, &end, sizeof(unsigned long)) == sizeof(unsigned long)) {
+        if (end > head) return end;
+        ringbuf_read(st->msgEnds, &end, sizeof(unsigned long));
+    }
+    return 0;
+}
+
+int stream_recv_msg(stream_t *st, void **buf, unsigned int len, int nonblock) {
+    pthread_mutex_lock(st->lock);
+    unsigned long end;
+    // the length of the message is not known before its end arrives, the whole buffer may be needed
+    if ((end = msg_first(st)) == 0) stream_want(st, st->recvBuf->size);
+    while ((end = msg_first(st)) == 0 && st->established && !nonblock) pthread_cond_wait(st->cond, st->lock);
+    int established = st->established;
+    pthread_mutex_unlock(st->lock);
+    if (end == 0) return nonblock && established ? STCP_EAGAIN : -1;
+    unsigned int msg_len = (unsigned int) (end - __atomic_load_n(&st->recvBuf->head, __ATOMIC_RELAXED));
+    if (*buf != NULL && msg_len > len) return STCP_EMSGSIZE;
+    if (*buf == NULL) *buf = malloc(msg_len);
+    // the record goes first, so that the window update of stream_read() counts its slot
+    ringbuf_read(st->msgEnds, &end, sizeof(unsigned long));
+    stream_read(st, *buf, msg_len);
+    return (int) msg_len;
+}
+
+int stream_recv(stream_t *st, void *buf, unsigned int len, int nonblock) {
+    struct iovec iov = {.iov_base = buf, .iov_len = len};
+    return stream_recvv(st, &iov, 1, nonblock);
+}
+
+int stream_recvv(stream_t *st, const struct iovec *iov, int iovcnt, int nonblock) {
+    unsigned int len = iov_total(iov, iovcnt);
+    pthread_mutex_lock(st->lock);
+    if (!nonblock) stream_wait(st, len, -1);
+    else stream_want(st, len);
+    int established = st->established;
+    pthread_mutex_unlock(st->lock);
+    if (ringbuf_used(st->recvBuf) < len) {
+        // not there yet, or the connection is gone before all of it arrived
+        return nonblock && established ? STCP_EAGAIN : -1;
+    }
+    // data is ready, the segment thread only appends so the bytes stay there without the lock.
+    // it is scattered straight from the receive buffer into the user buffers
+    for (int i = 0; i < iovcnt; ++i) stream_read(st, iov[i].iov_base, iov[i].iov_len);
+    return 0;
+}
+
+//======================================================
+//          definition of stream group helpers
+//======================================================
+
+// create a stream copying the addressing of stream 0, should be surrounded by lock and unlock
+static stream_t *group_create(streamGroup_t *g, unsigned short id) {
+    stream_t *main = g->head, *st = new(stream_t);
+    stream_init(st, g, id, STREAM_BUF_SIZE);
+    st->localPort = main->localPort;
+    st->remotePort = main->remotePort;
+    st->remoteNodeID = main->remoteNodeID;
+    st->established = main->established;
+    st->delayAck = main->delayAck;
+    g->tail->groupNext = st;
+    g->tail = st;
+    ++g->streamNum;
+    return st;
+}
+
+// the stream with the id whether closed or not, a connection has at most STREAM_MAX streams so a list does.
+// should be surrounded by lock and unlock
+static stream_t *group_find(streamGroup_t *g, unsigned int id) {
+    stream_t *st = g->head;
+    while (st && st->id != id) st = st->groupNext;
+    return st;
+}
+
+// free the closed streams whose data is all acknowledged, should be surrounded by lock and unlock
+static void group_reap(ackq_t *q, streamGroup_t *g) {
+    // stream 0 is never closed
+    stream_t *prev = g->head;
+    while (prev->groupNext) {
+        stream_t *st = prev->groupNext;
+        if (st->closed && (st->sendBufHead == st->sendBufTail || !st->established)) {
+            prev->groupNext = st->groupNext;
+            if (g->tail == st) g->tail = prev;
+            --g->streamNum;
+            if (g->rrNext == st) g->rrNext = NULL;
+            stream_ack_cancel(q, st);
+            g->inFlight -= st->unAck_segNum;
+            --g->closedNum;
+            stream_free(st);
+            free(st);
+        } else prev = st;
+    }
+}
+
+// a DATA segment of a closed stream is acknowledged whole, so that the peer drains and frees its side too
+static void ack_closed(stream_t *main, seg_t *seg) {
+    seg_t *data_ack = create_seg(main->localPort, main->remotePort, DATAACK, 0,
+                                 seg->header.seq_num + seg->header.length, GBN_WINDOW, 0, NULL);
+    data_ack->header.stream_id = seg->header.stream_id;
+    if (stream_sendseg((int) main->remoteNodeID, main->group->tclass, data_ack) < 0) exit(1);
+    free(data_ack);
+}
+
+//======================================================
+//          stream group helpers end
+//======================================================
+
+void stream_group_init(streamGroup_t *g, stream_t *main, pthread_mutex_t *lock, pthread_cond_t *cond,
+                       unsigned short first_id) {
+    memset(g, 0, sizeof(streamGroup_t));
+    g->lock = lock;
+    g->cond = cond;
+    g->nextId = first_id;
+    // the peer opens the other parity, 2 or 1 is its first stream
+    g->peerMaxId = first_id & 1 ? 0 : -1;
+    g->cwnd = GBN_WINDOW;
+    g->ssthresh = CWND_MAX;
+    g->pacing = 1;
+    g->rate = RATE_INIT;
+    g->rateSlowStart = 1;
+    g->tclass = TC_DEFAULT;
+    pthread_cond_init(&g->timerCond, NULL);
+    stream_init(main, g, 0, RECEIVE_BUF_SIZE);
+    g->head = g->tail = main;
+    g->streamNum = 1;
+}
+
+void stream_group_free(streamGroup_t *g) {
+    // the timer thread sleeps on timerCond inside the tcb, it must be gone before the tcb is
+    pthread_mutex_lock(g->lock);
+    g->timerStop = 1;
+    pthread_cond_broadcast(&g->timerCond);
+    while (g->timerRunning) pthread_cond_wait(&g->timerCond, g->lock);
+    pthread_mutex_unlock(g->lock);
+    stream_t *st = g->head;
+    while (st) {
+        stream_t *next = st->groupNext;
+        stream_free(st);
+        if (st->id != 0) free(st);
+        st = next;
+    }
+    g->head = g->tail = NULL;
+    g->streamNum = 0;
+    pthread_cond_destroy(&g->timerCond);
+}
+
+void stream_group_shutdown(streamGroup_t *g) {
+    for (stream_t *st = g->head; st; st = st->groupNext) st->established = 0;
+    pthread_cond_broadcast(g->cond);
+}
+
+void stream_group_reset(ackq_t *q, streamGroup_t *g) {
+    stream_t *main = g->head;
+    while (main->groupNext) {
+        stream_t *st = main->groupNext;
+        main->groupNext = st->groupNext;
+        stream_ack_cancel(q, st);
+        stream_free(st);
+        free(st);
+    }
+    g->tail = main;
+    g->streamNum = 1;
+    g->nextId = (g->nextId & 1) ? 1 : 2;
+    g->peerMaxId = (g->nextId & 1) ? 0 : -1;
+    g->acceptHead = g->acceptTail = NULL;
+    g->rrNext = NULL;
+    g->closedNum = 0;
+    g->inFlight = main->unAck_segNum;
+    g->cwnd = GBN_WINDOW;
+    g->ssthresh = CWND_MAX;
+    g->cwndAcked = 0;
+    g->rate = RATE_INIT;
+    g->rateSlowStart = 1;
+    g->peerCapacity = g->capacity = g->probeNum = g->probeCount = 0;
+    g->rateLastInc = g->rateLastDec = g->probeTime = 0;
+    // segments cached from the last connection would rebuild garbage in the new sequence space
+    free(main->fecCache);
+    main->fecCache = NULL;
+    main->fecCount = main->fecMaxLen = 0;
+    if (main->fecParity) memset(main->fecParity, 0, MAX_SEG_LEN);
+    main->fecLoss = main->fecPeerLoss = 0;
+}
+
+void stream_group_ack_cancel(ackq_t *q, streamGroup_t *g) {
+    for (stream_t *st = g->head; st; st = st->groupNext) stream_ack_cancel(q, st);
+}
+
+int stream_group_trim(streamGroup_t *g) {
+    int holding = 0;
+    for (stream_t *st = g->head; st; st = st->groupNext) {
+        ringbuf_trim(st->recvBuf);
+        ringbuf_trim(st->msgEnds);
+        holding += st->recvBuf->chunks != NULL;
+    }
+    return holding;
+}
+
+void stream_group_stats(streamGroup_t *g, stcp_stats_t *stats) {
+    memset(stats, 0, sizeof(stcp_stats_t));
+    long cur_nano = now_nano();
+    pthread_mutex_lock(g->lock);
+    for (stream_t *st = g->head; st; st = st->groupNext) {
+        stats->bytesSent += stat_get(st->bytesSent);
+        stats->bytesRcvd += stat_get(st->bytesRcvd);
+        stats->segsSent += stat_get(st->dataSent);
+        stats->segsRcvd += stat_get(st->dataRcvd);
+        stats->segsResent += stat_get(st->dataResent);
+        stats->bytesResent += stat_get(st->bytesResent);
+        stats->acksSent += stat_get(st->ackSent);
+        stats->acksPiggybacked += stat_get(st->ackPiggybacked);
+        stats->paritySent += stat_get(st->fecSent);
+        stats->parityRecovered += stat_get(st->fecRecovered);
+        stats->timeouts += stat_get(st->timeouts);
+        stats->dupAcks += stat_get(st->dupAcks);
+        // a sender still waiting counts up to now
+        stats->sendBlocked += stat_get(st->sendBlocked) + (st->blockedSince ? cur_nano - st->blockedSince : 0);
+        stats->recvBuffered += ringbuf_used(st->recvBuf);
+        stats->oooBytes += stat_get(st->oooBytes);
+        stats->sendQueued += st->bufSegNum;
+        ++stats->streams;
+    }
+    stats->cwnd = g->cwnd;
+    stats->inFlight = g->inFlight;
+    stats->peerWin = g->head->peer_win;
+    stats->rate = g->rateMode ? g->rate : 0;
+    stats->peerCapacity = g->rateMode ? g->peerCapacity : 0;
+    stats->fec = g->fec;
+    stats->tclass = g->tclass;
+    stats->srtt = g->srtt;
+    stats->minRtt = g->minRtt;
+    // the timer finds segments older than DATA_TIMEOUT at its next poll, the rate mode gives the last ones
+    // sent two SRTTs
+    stats->rto = SENDBUF_POLLING_INTERVAL + (g->rateMode ? max(DATA_TIMEOUT, 2 * g->srtt) : DATA_TIMEOUT);
+    pthread_mutex_unlock(g->lock);
+}
+
+int stream_open(streamGroup_t *g) {
+    int id = -1;
+    pthread_mutex_lock(g->lock);
+    // ids go up and are never reused within a connection, so the peer tells a closed stream from a new one
+    if (g->head->established && g->nextId <= 0xFFFF && g->streamNum < STREAM_MAX) {
+        id = (int) g->nextId;
+        g->nextId += 2;
+        group_create(g, (unsigned short) id);
+    }
+    pthread_mutex_unlock(g->lock);
+    return id;
+}
+
+int stream_accept(streamGroup_t *g, int nonblock) {
+    pthread_mutex_lock(g->lock);
+    while (!nonblock && g->acceptHead == NULL && g->head->established) pthread_cond_wait(g->cond, g->lock);
+    int id;
+    if (g->acceptHead) {
+        stream_t *st = g->acceptHead;
+        g->acceptHead = st->acceptNext;
+        if (g->acceptHead == NULL) g->acceptTail = NULL;
+        id = st->id;
+    } else id = nonblock && g->head->established ? STCP_EAGAIN : -1;
+    pthread_mutex_unlock(g->lock);
+    return id;
+}
+
+int stream_close(streamGroup_t *g, unsigned int id) {
+    pthread_mutex_lock(g->lock);
+    stream_t *st = id == 0 ? NULL : group_find(g, id);
+    if (st == NULL || st->closed) {
+        pthread_mutex_unlock(g->lock);
+        return -1;
+    }
+    st->closed = 1;
+    ++g->closedNum;
+    // a stream closed before it was accepted is never returned by stream_accept
+    stream_t *prev = NULL;
+    for (stream_t *a = g->acceptHead; a; prev = a, a = a->acceptNext) {
+        if (a != st) continue;
+        if (prev) prev->acceptNext = a->acceptNext;
+        else g->acceptHead = a->acceptNext;
+        if (g->acceptTail == a) g->acceptTail = prev;
+        break;
+    }
+    pthread_mutex_unlock(g->lock);
+    return 1;
+}
+
+stream_t *stream_find(streamGroup_t *g, unsigned int id) {
+    pthread_mutex_lock(g->lock);
+    stream_t *st = group_find(g, id);
+    if (st && st->closed) st = NULL;
+    pthread_mutex_unlock(g->lock);
+    return st;
+}
+
+stream_t *stream_demux(ackq_t *q, streamGroup_t *g, seg_t *seg) {
+    unsigned int id = seg->header.stream_id;
+    if (id == 0 && __atomic_load_n(&g->closedNum, __ATOMIC_RELAXED) == 0) return loss_note(g->head, seg);
+    pthread_mutex_lock(g->lock);
+    if (g->closedNum > 0) group_reap(q, g);
+    stream_t *st = group_find(g, id);
+    // a peer opening more streams than a connection holds gets its data dropped as that of a closed stream,
+    // its segments would otherwise make the lookups of every other segment slow
+    if (st == NULL && seg->header.type == DATA && (id & 1) != (g->nextId & 1) && (int) id > g->peerMaxId &&
+        g->head->established && g->streamNum + ((int) id - g->peerMaxId) / 2 <= STREAM_MAX) {
+        // the peer opened it with no handshake, together with any stream of the peer below it
+        // whose first segment is still on the way
+        for (int next = g->peerMaxId + 2; next <= (int) id; next += 2) {
+            st = group_create(g, (unsigned short) next);
+            if (g->acceptTail) g->acceptTail->acceptNext = st;
+            else g->acceptHead = st;
+            g->acceptTail = st;
+        }
+        g->peerMaxId = (int) id;
+        pthread_cond_broadcast(g->cond);
+    }
+    pthread_mutex_unlock(g->lock);
+    if (st && !(st->closed && seg->header.type == DATA)) return loss_note(st, seg);
+    // a parity has no data to acknowledge
+    if (seg->header.type == DATA && !(seg->header.flags & SEG_FLAG_FEC)) ack_closed(g->head, seg);
+    return NULL;
+}
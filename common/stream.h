@@ -0,0 +1,341 @@
+//文件名: common/stream.h
+//
+//描述: 这个文件定义STCP连接一端在两个方向上的数据传输状态, 客户端和服务器的TCB都包含一个stream_t.
+//发送方向是GBN发送缓冲区: 数据被分片为段放入链表, 窗口内的段被发出, 超时未被确认的段由定时器线程重传.
+//接收方向是环形接收缓冲区, 乱序段链表和延迟确认.
+//每个发出的DATA段都在ack_num和rcv_win中捎带当前的累计确认和接收窗口, 只有没有数据可以捎带确认时才发送单独的DATAACK.
+//两个方向的序号空间相互独立: 客户端的数据从SYN的序号+1开始, 服务器的数据从SYNACK的序号+1开始.
+//一个连接内可以多路复用多个流, 它们组成一个streamGroup_t. 流0是连接本身的流, 其他流不需要握手, 第一个DATA段就打开它,
+//它们的序号从0开始. 每个流有自己的序号空间, 接收缓冲区, 乱序段链表和接收窗口, 所以一个流的丢包不会阻塞其他流的交付.
+//同一连接的所有流共享TCB的锁, 一个拥塞窗口和一个重传定时器线程.
+//连接在握手中协商启用前向纠错(FEC)时, 发送方把每组第一次发出的连续DATA段的数据按位异或, 在组满, 组以消息结束或没有更多数据可发时
+//发出一个校验段. 接收方缓存最近收到的段, 一组中只缺少一个段时用校验段和组内其他段把它恢复出来, 不必等待重传定时器回退N.
+//每组的段数随接收方在确认中报告的丢包率自适应变化, 丢包越多组越小.
+//连接也可以在握手中协商使用速率模式, 它用于高带宽时延积路径上的批量传输: 段不再受拥塞窗口限制, 而是以测量的速率步调发出.
+//接收方的每个DATAACK都是一个接收报告, 它列出当前的空洞(NAK), 空洞存在时周期性地重发. 发送方只重传报告丢失的段.
+//发送方定期背靠背发出包对, 接收方由到达间隔估计路径容量, 发送速率在慢启动后向它逼近. 随机丢包不降低速率,
+//只有伴随着排队延迟的丢包才被视为拥塞, 速率降低1/8.
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <pthread.h>
+#include <sys/uio.h>
+#include "seg.h"
+#include "ringbuf.h"
+
+//在发送缓冲区链表中存储段的单元.
+typedef struct segBuf {
+    seg_t seg;
+    long sentTime;                  //最近一次发送的时间, 单位为纳秒, 还没有发送过时为0
+    int resent;                     //是否被重传过, 重传过的段不用于估计往返时间
+    int nak;                        //速率模式中被报告丢失或超时, 等待单独重传
+    struct segBuf* next;
+} segBuf_t;
+
+//接收窗口中先于期待序号到达的段, 按序号升序链接成一个区间链表, 空洞被填上后按序交付.
+typedef struct oooSeg {
+    unsigned int seq_num;           //段的起始序号
+    unsigned short length;          //段数据长度
+    unsigned short flags;           //段标志, 交付时用到的只有SEG_FLAG_EOM
+    struct oooSeg* next;            //序号更大的下一个乱序段
+    char data[];                    //段数据
+} oooSeg_t;
+
+//接收方为前向纠错缓存的一个收到的段.
+typedef struct fecSeg {
+    unsigned int seq_num;           //段的起始序号
+    unsigned short length;          //段数据长度, 0表示空位
+    char data[MAX_SEG_LEN];         //段数据
+} fecSeg_t;
+
+//速率模式的接收报告, 它是DATAACK的段数据.
+typedef struct rateReport {
+    unsigned int capacity;          //接收方由包对估计的路径容量, 单位为段/秒, 没有样本时为0
+    unsigned int lost[];            //接收窗口中的空洞, 第i个是序号区间[lost[2i], lost[2i+1])
+} rateReport_t;
+//一个接收报告最多列出的空洞数
+#define RATE_NAK_MAX ((MAX_SEG_LEN - sizeof(rateReport_t)) / (2 * sizeof(unsigned int)))
+
+struct streamGroup;
+
+typedef struct stream {
+    //段的地址, 流0的地址在连接建立时由TCB的所有者设置, 其他流从流0复制
+    unsigned int localPort;         //本端端口号
+    unsigned int remotePort;        //对端端口号
+    unsigned int remoteNodeID;      //对端节点ID
+    int established;                //连接是否可以收发数据, 由TCB的所有者在state变化时设置
+    pthread_mutex_t* lock;          //TCB的bufMutex, 保护发送缓冲区
+    pthread_cond_t* cond;           //TCB的stateCond, 有新数据进入接收缓冲区时被广播
+    unsigned short id;              //流ID, 在段首部的stream_id中发送
+    struct streamGroup* group;      //所属连接的流组
+    struct stream* groupNext;       //流组中的下一个流
+    struct stream* acceptNext;      //对端打开但尚未被接受的下一个流
+    int closed;                     //本端应用程序是否已关闭这个流
+
+    //发送方向
+    unsigned int next_seqNum;       //新段准备使用的下一个序号
+    segBuf_t* sendBufHead;          //发送缓冲区头, 是一个哑元
+    segBuf_t* sendBufunSent;        //发送缓冲区中的第一个未发送段
+    segBuf_t* sendBufTail;          //发送缓冲区尾
+    unsigned int unAck_segNum;      //已发送但未收到确认段的数量
+    unsigned int bufSegNum;         //发送缓冲区中的段数
+    unsigned int peer_win;          //对端最近通告的接收窗口, 单位为段
+    unsigned int nakPending;        //速率模式中等待单独重传的段数
+
+    //接收方向
+    unsigned int expect_seqNum;     //期待的数据序号, 只由处理段的线程写
+    unsigned int ackSentNum;        //最近一次发出的确认号, 无论是单独的DATAACK还是捎带在DATA中
+    ringbuf_t* recvBuf;             //接收缓冲区, 处理段的线程写入, 应用程序读出, 两者都无需加锁
+    oooSeg_t* oooHead;              //乱序段链表头, 只由处理段的线程访问
+    unsigned int oooBytes;          //乱序段链表中缓存的字节数, 不超过接收缓冲区的剩余空间
+    ringbuf_t* msgEnds;             //消息边界队列, 每个消息一个unsigned long, 是它的最后一个字节之后在接收缓冲区中的位置(recvBuf->tail)
+    unsigned int oooMsgs;           //乱序段链表中带SEG_FLAG_EOM的段数, 消息边界队列为它们保留位置
+    int delayAck;                   //是否启用延迟确认
+    int ackQueued;                  //是否在延迟确认队列中
+    long ackDeadline;               //延迟确认的截止时间, 单位为纳秒
+    struct stream* ackPrev;         //延迟确认队列中的前一个stream
+    struct stream* ackNext;         //延迟确认队列中的后一个stream
+    unsigned short advWin;          //最近一次通告的接收窗口, 单位为段
+
+    //前向纠错, 只在流组启用时使用
+    unsigned int fecBase;           //发送方当前组的起始序号
+    unsigned int fecEnd;            //发送方当前组的结束序号, 即下一个加入组的段的序号
+    unsigned short fecCount;        //发送方当前组中的段数
+    unsigned short fecMaxLen;       //发送方当前组中最长的段数据长度, 即校验段的长度
+    char* fecParity;                //发送方当前组的段数据的异或, MAX_SEG_LEN字节, 第一次使用时分配
+    unsigned short fecPeerLoss;     //对端报告的本端到对端方向的丢包率, 单位为1/256, 决定发送方每组的段数
+    int fecLoss;                    //接收方由校验段估计的丢包率, 单位为1/256, 在确认中报告给对端
+    fecSeg_t* fecCache;             //接收方最近收到的FEC_CACHE个段, 第一次使用时分配
+    unsigned int fecCacheNext;      //fecCache中下一个被替换的位置
+
+    //统计
+    unsigned long dataSent;         //发出的DATA段数, 包括重传
+    unsigned long dataRcvd;         //收到的DATA段数
+    unsigned long ackSent;          //发出的单独的DATAACK段数
+    unsigned long ackPiggybacked;   //捎带在DATA段中发出的新确认数
+    unsigned long oooSavedBytes;    //从乱序段链表交付的字节数, 即免于重传的字节数
+    unsigned long fecSent;          //发出的校验段数
+    unsigned long fecRcvd;          //收到的校验段数
+    unsigned long fecRecovered;     //由校验段恢复的DATA段数
+    unsigned long nakResent;        //速率模式中被报告丢失或超时而重传的段数
+    unsigned long bytesSent;        //发出的DATA段的数据字节数, 包括重传
+    unsigned long bytesRcvd;        //收到的DATA段的数据字节数, 包括重复的段
+    unsigned long dataResent;       //重传的DATA段数
+    unsigned long bytesResent;      //重传的DATA段的数据字节数
+    unsigned long timeouts;         //stream_timer发现的超时次数
+    unsigned long dupAcks;          //段在途时收到的既没有确认新数据也没有改变窗口的DATAACK数
+    long sendBlocked;               //非阻塞的发送因发送缓冲区满而返回STCP_EAGAIN到确认腾出空间之间的总时间, 单位为纳秒
+    long blockedSince;              //发送缓冲区满而未能发送的开始时间, 没有时为0, 由lock保护
+    unsigned int blockedSegs;       //未能发送的数据需要的段数, 发送缓冲区能放下它们时等待结束, 由lock保护
+} stream_t;
+
+//一个连接的所有流. 所有字段都由lock保护.
+typedef struct streamGroup {
+    stream_t* head;                 //流链表, 第一个是流0
+    stream_t* tail;                 //流链表中的最后一个流
+    unsigned int streamNum;         //流链表中的流数, 不超过STREAM_MAX
+    pthread_mutex_t* lock;          //TCB的bufMutex
+    pthread_cond_t* cond;           //TCB的stateCond
+    unsigned int nextId;            //本端下一个打开的流ID, 客户端打开奇数ID的流, 服务器打开偶数ID的流
+    int peerMaxId;                  //对端打开过的最大流ID, 不大于它的对端流ID如果不存在, 就是已经被关闭的流
+    stream_t* acceptHead;           //对端打开但尚未被stream_accept()返回的流
+    stream_t* acceptTail;
+    unsigned int closedNum;         //已被关闭但尚未被释放的流的数量
+    unsigned int cwnd;              //共享的拥塞窗口, 单位为段
+    unsigned int ssthresh;          //慢启动阈值, cwnd小于它时每确认一个段cwnd加1
+    unsigned int cwndAcked;         //拥塞避免中cwnd增长前已累计确认的段数
+    unsigned int inFlight;          //所有流已发送但未被确认的段数, 不超过cwnd
+    stream_t* rrNext;               //轮流发送时下一个可以发送的流, NULL表示流0
+    int timerRunning;               //stream_timer线程是否在运行, 每个连接最多只有一个
+    int timerStop;                  //流组正在被释放, stream_timer线程应立即退出
+    pthread_cond_t timerCond;       //stream_timer线程在它上面等待下一次轮询或步调发送的时间, 与lock配合使用
+    long srtt;                      //平滑的往返时间, 单位为纳秒, 没有样本时为0
+    long minRtt;                    //最小的往返时间样本, srtt超出它的部分就是路径上的排队延迟
+    int pacing;                     //是否启用步调发送
+    long paceNext;                  //步调发送的下一个段的发送时间, 它最多可以提前PACING_BURST个间隔
+    long paceRelease;               //因步调而暂停的发送由stream_timer线程在这个时间恢复, 没有时为0
+    int fec;                        //握手是否协商启用了前向纠错, 由TCB的所有者在连接建立时设置
+    int rateMode;                   //握手是否协商使用速率模式, 由TCB的所有者在连接建立时设置
+    unsigned int tclass;            //连接的流量类别(TC_*), 它发出的所有段都携带它, 默认为TC_DEFAULT, 见STCP_OPT_CLASS
+    unsigned long rate;             //速率模式的发送速率, 单位为段/秒
+    unsigned long peerCapacity;     //对端报告的路径容量, 单位为段/秒, 没有时为0
+    int rateSlowStart;              //发送速率是否仍在慢启动中翻倍
+    long rateLastInc;               //上一次增加发送速率的时间
+    long rateLastDec;               //上一次降低发送速率的时间, 在它之前发出的段的丢失不再降低速率
+    unsigned int probeCount;        //上一个包对之后发出的新段数
+    int probeNow;                   //transmit()发出的前两个段是一个包对
+    long probeTime;                 //接收方: 包对的第一个段到达的时间, 没有时为0, 只由处理段的线程访问
+    unsigned int probeEnd;          //接收方: 包对的第一个段的结束序号
+    unsigned short probeStream;     //接收方: 包对所在的流ID
+    unsigned int probeRates[RATE_PROBES];   //接收方: 最近的包对样本, 单位为段/秒
+    unsigned int probeNum;          //接收方: 包对样本的总数
+    unsigned int capacity;          //接收方: 包对样本的中位数, 在接收报告中发给对端
+} streamGroup_t;
+
+//一个连接的传输统计, 由stcp_client_getstats()/stcp_server_getstats()返回. 计数器是套接字创建以来所有流的总和,
+//其余字段是调用时的值. 时间的单位都是纳秒.
+typedef struct stcp_stats {
+    unsigned long bytesSent;        //发出的DATA段的数据字节数, 包括重传
+    unsigned long bytesRcvd;        //收到的DATA段的数据字节数, 包括重复的段
+    unsigned long segsSent;         //发出的DATA段数, 包括重传
+    unsigned long segsRcvd;         //收到的DATA段数
+    unsigned long segsResent;       //重传的DATA段数
+    unsigned long bytesResent;      //重传的DATA段的数据字节数
+    unsigned long acksSent;         //发出的单独的DATAACK段数
+    unsigned long acksPiggybacked;  //捎带在DATA段中发出的新确认数
+    unsigned long paritySent;       //发出的校验段数
+    unsigned long parityRecovered;  //由对端的校验段恢复的DATA段数
+    unsigned long timeouts;         //发送方的超时次数
+    unsigned long dupAcks;          //重复的DATAACK数
+    unsigned int cwnd;              //拥塞窗口, 单位为段
+    unsigned int inFlight;          //已发送但未被确认的段数
+    unsigned int peerWin;           //对端在流0上通告的接收窗口, 单位为段
+    unsigned long rate;             //速率模式的发送速率, 单位为段/秒, 不是速率模式时为0
+    unsigned long peerCapacity;     //速率模式中对端报告的路径容量, 单位为段/秒, 没有时为0
+    int fec;                        //握手是否协商启用了前向纠错
+    unsigned int tclass;            //连接发出的段的流量类别(TC_*)
+    long srtt;                      //平滑的往返时间, 没有样本时为0
+    long minRtt;                    //最小的往返时间
+    long rto;                       //已发送的段最迟在这么久没有被确认后被重传, 包括stream_timer的轮询间隔
+    unsigned int recvBuffered;      //接收缓冲区中尚未被应用程序读出的字节数
+    unsigned int oooBytes;          //乱序缓存的字节数
+    unsigned int sendQueued;        //发送缓冲区中尚未被确认的段数, 包括还没有发出的段, 为0时所有数据都已被对端收到
+    long sendBlocked;               //非阻塞的发送因发送缓冲区满返回STCP_EAGAIN到确认腾出足够空间之间的总时间.
+                                    //阻塞模式的发送缓冲区没有上限, 它总是0
+    unsigned int streams;           //连接中的流数
+} stcp_stats_t;
+
+//延迟确认队列. 所有确认的延迟相同, 所以队列按截止时间有序. 只由处理段的线程访问
+typedef struct ackq {
+    stream_t* head;
+    stream_t* tail;
+} ackq_t;
+
+//这个函数设置到SIP进程的TCP连接, stcp_client_init()/stcp_server_init()调用它.
+void stream_setconn(int sip_conn);
+
+//这个函数把段标记为流量类别tclass并发送给SIP进程. 应用线程, 处理段的线程和定时器都会发送段, 一次只有一个段被写入到SIP进程的连接. 失败时返回-1.
+int stream_sendseg(int dest_nodeID, unsigned int tclass, seg_t* seg);
+
+//这个函数初始化流组和它的流0, 步调发送默认启用, 流量类别为TC_DEFAULT, lock和cond是所属TCB的bufMutex和stateCond, first_id是本端打开的第一个流ID: 客户端为1, 服务器为2.
+void stream_group_init(streamGroup_t* g, stream_t* main, pthread_mutex_t* lock, pthread_cond_t* cond, unsigned short first_id);
+
+//这个函数释放流组的所有流, 流0嵌入在TCB中, 只有它的缓冲区被释放. 流组不能在延迟确认队列中.
+//如果stream_timer线程仍在运行, 这个函数先让它退出并等待它, 调用者不能持有lock.
+void stream_group_free(streamGroup_t* g);
+
+//这个函数在连接断开时调用, 使流组的所有流不再established, 唤醒等待它们的线程. 调用者应持有lock.
+void stream_group_shutdown(streamGroup_t* g);
+
+//这个函数在客户端重新建立连接时调用, 它释放上一个连接留下的其他流. 只能由处理段的线程调用, 调用者应持有lock.
+void stream_group_reset(ackq_t* q, streamGroup_t* g);
+
+//这个函数把流组的所有流从延迟确认队列中删除. 只能由处理段的线程调用.
+void stream_group_ack_cancel(ackq_t* q, streamGroup_t* g);
+
+//这个函数把流组的所有流的接收缓冲区中不再有未读数据的块归还给块池, 在连接空闲时调用. 只能由处理段的线程调用.
+//返回仍有未读数据因而还占用着块的流数.
+int stream_group_trim(streamGroup_t* g);
+
+//这个函数把流组的传输统计填入stats. 计数器由各线程用relaxed原子操作更新, 这里不需要它们停下来, 其余字段在lock的保护下读取.
+//调用者不能持有lock.
+void stream_group_stats(streamGroup_t* g, stcp_stats_t* stats);
+
+//这个函数不经过握手打开一个新的流, 返回流ID. 如果连接不是established, 流ID已用完或流数已达到STREAM_MAX, 返回-1.
+int stream_open(streamGroup_t* g);
+
+//这个函数返回一个对端打开的新流的ID. 如果没有这样的流, nonblock为0时它等待, 否则返回STCP_EAGAIN. 连接断开时返回-1.
+int stream_accept(streamGroup_t* g, int nonblock);
+
+//这个函数关闭本端的一个流, 它不再接收数据, 发送缓冲区中的数据被确认后由处理段的线程释放. 流0不能被关闭. 成功时返回1, 否则返回-1.
+int stream_close(streamGroup_t* g, unsigned int id);
+
+//这个函数返回流组中ID为id且没有被关闭的流, 不存在时返回NULL. 由应用线程调用.
+stream_t* stream_find(streamGroup_t* g, unsigned int id);
+
+//这个函数为处理段的线程找到段所属的流, 并释放已完成的被关闭的流. 对端的DATA段可能打开一个新的流,
+//它需要打开的流使流数超过STREAM_MAX时段被当作已关闭的流的段.
+//启用前向纠错时, 段中报告的丢包率也在这里记下.
+//已被关闭的流的DATA段被直接确认并丢弃, 这时返回NULL.
+stream_t* stream_demux(ackq_t* q, streamGroup_t* g, seg_t* seg);
+
+//这个函数从接收缓冲区中读出一个完整的消息, 返回消息长度. *buf为NULL时消息被读入一个新分配的缓冲区, 它由调用者释放,
+//否则消息被读入长度为len的*buf, 消息更长时不读出任何数据并返回STCP_EMSGSIZE. 没有完整的消息时, nonblock为0时它等待,
+//否则返回STCP_EAGAIN. 连接在消息到达之前断开时返回-1. 用stream_recv()读过的消息边界被丢弃.
+int stream_recv_msg(stream_t* st, void** buf, unsigned int len, int nonblock);
+
+//这个函数从接收缓冲区中读出恰好len字节. 接收缓冲区中的数据不足时, nonblock为0时它等待, 否则返回STCP_EAGAIN.
+//成功时返回0, 连接在数据到达之前断开时返回-1.
+int stream_recv(stream_t* st, void* buf, unsigned int len, int nonblock);
+
+//这个函数与stream_recv()相同, 但读出的数据按顺序分散到iovcnt个用户缓冲区中, 直接从接收缓冲区拷贝, 没有中间缓冲区.
+int stream_recvv(stream_t* st, const struct iovec* iov, int iovcnt, int nonblock);
+
+//返回接收缓冲区的剩余空间, 单位为段, 它在rcv_win中被通告. 消息边界队列满时返回0.
+unsigned short stream_window(stream_t* st);
+
+//这个函数把数据分片为段放入发送缓冲区, 并在流的发送窗口和连接的拥塞窗口允许时发出段. 如果stream_timer线程没有在运行, 它启动这个线程.
+//nonblock非0时, 如果发送缓冲区非空且放入数据后将超过SEND_BUF_SEGS个段, 这个函数不放入任何数据并返回STCP_EAGAIN. 成功时返回1.
+//msg非0时数据是一个消息, 它的最后一个段带SEG_FLAG_EOM, 对端用stream_recv_msg()一次读出它.
+int stream_send(stream_t* st, const void* data, unsigned int length, int nonblock, int msg);
+
+//这个函数与stream_send()相同, 但数据是iovcnt个用户缓冲区按顺序的连接. 段直接从用户缓冲区聚集, 一个段可以跨越多个缓冲区.
+int stream_sendv(stream_t* st, const struct iovec* iov, int iovcnt, int nonblock, int msg);
+
+//这两个函数与stream_send()/stream_sendv()相同, 但总是放入全部数据. 调用者应持有lock, 处理段的线程用它发送在连接建立时才能发送的数据.
+void stream_push(stream_t* st, const void* data, unsigned int length, int msg);
+void stream_pushv(stream_t* st, const struct iovec* iov, int iovcnt, int msg);
+
+//这个函数处理带SEG_FLAG_RATE的DATAACK中的接收报告: 记下对端估计的路径容量, 把报告丢失的段标记为等待单独重传,
+//并据此调整发送速率. 一个段在上一次发出之后不到一个SRTT时不会被再次标记. 调用者随后用stream_ack()处理DATAACK中的确认,
+//它同时发出被标记的段.
+void stream_report(stream_t* st, seg_t* seg);
+
+//这个函数处理对端的累计确认ack_num和接收窗口rcv_win, 它们来自DATAACK或捎带在DATA中. 被确认的段从发送缓冲区中删除,
+//拥塞窗口随之增长, 没有被重传过的段给出往返时间的样本. 然后连接中所有流的未发送段在窗口和步调允许时被轮流发出. 返回被删除的段数.
+unsigned int stream_ack(stream_t* st, unsigned int ack_num, unsigned short rcv_win);
+
+//这个函数处理带SEG_FLAG_FEC的校验段. 如果它所在的组中恰好缺少一个段, 而组内其他段都还在缓存中, 这个段被恢复出来,
+//像收到的DATA段一样由stream_data()处理. 它同时由组中缺少的段数更新本端估计的丢包率. 校验段不捎带确认, 调用者不能把它交给stream_ack().
+//返回值与stream_data()相同. 只能由处理段的线程调用.
+int stream_parity(ackq_t* q, stream_t* st, seg_t* seg);
+
+//这个函数处理DATA段中的数据: 按序的数据进入接收缓冲区, 乱序的段被缓存, 然后根据情况立即或延迟确认. 带SEG_FLAG_EOM的段交付时
+//在消息边界队列中记下消息的结束位置, 队列没有空位时它像接收缓冲区满一样被丢弃. 它不处理段中捎带的确认.
+//有新数据可读时返回1, 否则返回0. 只能由处理段的线程调用.
+int stream_data(ackq_t* q, stream_t* st, seg_t* seg);
+
+//这个函数立即发送一个单独的DATAACK, 并把stream从延迟确认队列中删除. 只能由处理段的线程调用.
+void stream_ack_now(ackq_t* q, stream_t* st);
+
+//这个函数把stream从延迟确认队列中删除, 不发送确认. 只能由处理段的线程调用.
+void stream_ack_cancel(ackq_t* q, stream_t* st);
+
+//这个函数为截止时间已到且仍未被捎带的确认发送DATAACK. 返回下一个确认最多还能等待的毫秒数, 队列为空时返回-1.
+int ackq_flush(ackq_t* q);
+
+//这个函数在cond上等待, 直到接收缓冲区中至少有need字节, 连接不再established, 或超过deadline(now_nano的时钟, 负数表示不限).
+//调用者应持有lock.
+void stream_wait(stream_t* st, unsigned int need, long deadline);
+
+//这个函数声明应用程序正在等待接收缓冲区中有need字节可读, 使接收窗口不会因为块池的预算而小于它们, 窗口因此变大时立即通告.
+//stream_wait()和非阻塞的接收调用它, 下一次读出时声明被取消. 调用者应持有lock.
+void stream_want(stream_t* st, unsigned int need);
+
+//这个函数从接收缓冲区中读出最多len字节, 如果接收窗口因此重新打开, 它立即发送窗口更新. 返回读出的字节数. 只能由应用线程调用.
+unsigned int stream_read(stream_t* st, void* buf, unsigned int len);
+
+//这两个函数是stream_read()的零拷贝版本, 只能由接收缓冲区的消费者调用. stream_views()把接收缓冲区头部可读的数据作为只读视图存入
+//最多iovcnt个iov, 每个视图不跨越接收缓冲区的块, 返回视图数; stream_consume()释放头部的len字节, 如果接收窗口因此重新打开, 它立即发送窗口更新.
+int stream_views(stream_t* st, struct iovec* iov, int iovcnt);
+void stream_consume(stream_t* st, unsigned int len);
+
+//这个线程持续轮询连接中所有流的发送缓冲区以触发超时事件. 如果一个流的(当前时间 - 第一个已发送但未被确认段的发送时间) > DATA_TIMEOUT,
+//这个流所有已发送但未被确认段就回到未发送状态(回退N), 然后和新段一样在窗口和步调允许时被重新发送, 它们捎带最新的确认.
+//如果超时的段已经被重传过, 就认为发生了拥塞, 拥塞窗口减半. 速率模式下不回退N, 只有发送后超过max(DATA_TIMEOUT, 2 * SRTT)仍未被确认
+//也未被报告丢失的段被标记为重传, 其中有已重传过的段时速率降低. 在两次轮询之间, 它还在paceRelease时恢复因步调而暂停的发送.
+//当所有established的流的发送缓冲区都为空时, 这个线程将终止. 参数是流组.
+void* stream_timer(void* arg);
+
+#endif
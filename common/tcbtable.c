@@ -0,0 +1,180 @@
+//文件名: common/tcbtable.c
+//
+//描述: 这个文件实现STCP客户端和服务器共用的TCB表
+
+#include <stdlib.h>
+#include <string.h>
+#include "tcbtable.h"
+#include "helper.h"
+
+#define SLOT_EMPTY (-1)
+#define SLOT_DELETED (-2)
+//哈希表的初始槽数
+#define TCB_INIT_SLOTS 64
+
+// mix the three key words into a well spread 32-bit hash
+unsigned int tcbtable_hash(unsigned int remote_nodeID, unsigned int remote_port, unsigned int local_port) {
+    unsigned long h = remote_nodeID * 0x9E3779B97F4A7C15UL ^ ((unsigned long) remote_port << 32 | local_port);
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9UL;
+    h ^= h >> 32;
+    return (unsigned int) h;
+}
+
+static tcbslot_t *new_slots(unsigned int num) {
+    tcbslot_t *slots;
+    if (posix_memalign((void **) &slots, 64, num * sizeof(tcbslot_t)) != 0) return NULL;
+    for (unsigned int i = 0; i < num; ++i) slots[i].sock = SLOT_EMPTY;
+    return slots;
+}
+
+// linear probing, return the slot holding the key or the first reusable slot on its path
+static tcbslot_t *find_slot(tcbslot_t *slots, unsigned int mask, unsigned int remote_nodeID,
+                            unsigned int remote_port, unsigned int local_port) {
+    tcbslot_t *reuse = NULL;
+    for (unsigned int i = tcbtable_hash(remote_nodeID, remote_port, local_port) & mask;; i = (i + 1) & mask) {
+        tcbslot_t *slot = &slots[i];
+        if (slot->sock == SLOT_EMPTY) return reuse ? reuse : slot;
+        if (slot->sock == SLOT_DELETED) {
+            if (reuse == NULL) reuse = slot;
+        } else if (slot->local_port == local_port && slot->remote_port == remote_port &&
+                   slot->remote_nodeID == remote_nodeID) {
+            return slot;
+        }
+    }
+}
+
+// rebuild the hash with `num` slots, dropping the deleted ones, should be called with the write lock
+static void rehash(tcbtable_t *tab, unsigned int num) {
+    tcbslot_t *slots = new_slots(num);
+    for (unsigned int i = 0; i <= tab->slotMask; ++i) {
+        tcbslot_t *old = &tab->slots[i];
+        if (old->sock < 0) continue;
+        *find_slot(slots, num - 1, old->remote_nodeID, old->remote_port, old->local_port) = *old;
+    }
+    free(tab->slots);
+    tab->slots = slots;
+    tab->slotMask = num - 1;
+    tab->slotDeleted = 0;
+}
+
+tcbtable_t *tcbtable_create(unsigned int limit) {
+    tcbtable_t *tab = new(tcbtable_t);
+    bzero(tab, sizeof(tcbtable_t));
+    tab->limit = limit;
+    tab->freeIDs = new_n(int, TCB_CHUNK_SIZE);
+    tab->slots = new_slots(TCB_INIT_SLOTS);
+    tab->slotMask = TCB_INIT_SLOTS - 1;
+    pthread_mutex_init(&tab->idMutex, NULL);
+    pthread_rwlock_init(&tab->hashLock, NULL);
+    return tab;
+}
+
+void tcbtable_destroy(tcbtable_t *tab) {
+    for (int i = 0; i < TCB_MAX_CHUNKS && tab->chunks[i]; ++i) free(tab->chunks[i]);
+    free(tab->freeIDs);
+    free(tab->slots);
+    pthread_mutex_destroy(&tab->idMutex);
+    pthread_rwlock_destroy(&tab->hashLock);
+    free(tab);
+}
+
+void tcbtable_setlimit(tcbtable_t *tab, unsigned int limit) {
+    pthread_mutex_lock(&tab->idMutex);
+    tab->limit = min(limit, TCB_CHUNK_SIZE * TCB_MAX_CHUNKS);
+    pthread_mutex_unlock(&tab->idMutex);
+}
+
+void *tcbtable_newtcb(size_t size) {
+    void *tcb;
+    if (posix_memalign(&tcb, 64, size) != 0) return NULL;
+    bzero(tcb, size);
+    return tcb;
+}
+
+int tcbtable_alloc(tcbtable_t *tab, void *tcb) {
+    pthread_mutex_lock(&tab->idMutex);
+    if (tab->count >= tab->limit) {
+        pthread_mutex_unlock(&tab->idMutex);
+        return -1;
+    }
+    int sock;
+    if (tab->freeNum > 0) {
+        sock = tab->freeIDs[--tab->freeNum];
+    } else {
+        sock = tab->span;
+        if (sock % TCB_CHUNK_SIZE == 0) {
+            // grow the directory by one chunk and the recycle stack with it
+            void **chunk = new_n(void *, TCB_CHUNK_SIZE);
+            bzero(chunk, TCB_CHUNK_SIZE * sizeof(void *));
+            __atomic_store_n(&tab->chunks[sock / TCB_CHUNK_SIZE], chunk, __ATOMIC_RELEASE);
+            tab->freeIDs = (int *) realloc(tab->freeIDs, (sock + TCB_CHUNK_SIZE) * sizeof(int));
+        }
+        __atomic_store_n(&tab->span, sock + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&tab->chunks[sock / TCB_CHUNK_SIZE][sock % TCB_CHUNK_SIZE], tcb, __ATOMIC_RELEASE);
+    ++tab->count;
+    pthread_mutex_unlock(&tab->idMutex);
+    return sock;
+}
+
+void *tcbtable_release(tcbtable_t *tab, int sock) {
+    void *tcb = tcbtable_get(tab, sock);
+    if (tcb == NULL) return NULL;
+    pthread_mutex_lock(&tab->idMutex);
+    __atomic_store_n(&tab->chunks[sock / TCB_CHUNK_SIZE][sock % TCB_CHUNK_SIZE], NULL, __ATOMIC_RELEASE);
+    tab->freeIDs[tab->freeNum++] = sock;
+    --tab->count;
+    pthread_mutex_unlock(&tab->idMutex);
+    return tcb;
+}
+
+void *tcbtable_get(tcbtable_t *tab, int sock) {
+    if (sock < 0 || sock >= __atomic_load_n(&tab->span, __ATOMIC_ACQUIRE)) return NULL;
+    void **chunk = __atomic_load_n(&tab->chunks[sock / TCB_CHUNK_SIZE], __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&chunk[sock % TCB_CHUNK_SIZE], __ATOMIC_ACQUIRE);
+}
+
+int tcbtable_span(tcbtable_t *tab) {
+    return __atomic_load_n(&tab->span, __ATOMIC_ACQUIRE);
+}
+
+int tcbtable_bind(tcbtable_t *tab, unsigned int remote_nodeID, unsigned int remote_port,
+                  unsigned int local_port, int sock) {
+    pthread_rwlock_wrlock(&tab->hashLock);
+    // keep the load (live and deleted slots) under 3/4
+    if ((tab->slotUsed + tab->slotDeleted + 1) * 4 > (tab->slotMask + 1) * 3) {
+        unsigned int num = tab->slotMask + 1;
+        rehash(tab, (tab->slotUsed + 1) * 2 > num ? num * 2 : num);
+    }
+    tcbslot_t *slot = find_slot(tab->slots, tab->slotMask, remote_nodeID, remote_port, local_port);
+    if (slot->sock == SLOT_DELETED) --tab->slotDeleted;
+    if (slot->sock < 0) ++tab->slotUsed;
+    slot->remote_nodeID = remote_nodeID;
+    slot->remote_port = remote_port;
+    slot->local_port = local_port;
+    slot->sock = sock;
+    pthread_rwlock_unlock(&tab->hashLock);
+    return 1;
+}
+
+void tcbtable_unbind(tcbtable_t *tab, unsigned int remote_nodeID, unsigned int remote_port,
+                     unsigned int local_port) {
+    pthread_rwlock_wrlock(&tab->hashLock);
+    tcbslot_t *slot = find_slot(tab->slots, tab->slotMask, remote_nodeID, remote_port, local_port);
+    if (slot->sock >= 0) {
+        slot->sock = SLOT_DELETED;
+        --tab->slotUsed;
+        ++tab->slotDeleted;
+    }
+    pthread_rwlock_unlock(&tab->hashLock);
+}
+
+int tcbtable_lookup(tcbtable_t *tab, unsigned int remote_nodeID, unsigned int remote_port,
+                    unsigned int local_port) {
+    pthread_rwlock_rdlock(&tab->hashLock);
+    tcbslot_t *slot = find_slot(tab->slots, tab->slotMask, remote_nodeID, remote_port, local_port);
+    int sock = slot->sock >= 0 ? slot->sock : -1;
+    pthread_rwlock_unlock(&tab->hashLock);
+    return sock;
+}
@@ -0,0 +1,84 @@
+//文件名: common/tcbtable.h
+//
+//描述: 这个文件定义STCP客户端和服务器共用的TCB表.
+//TCB表由两部分组成: 按套接字ID索引的TCB目录, 以及以(远端节点ID, 远端端口号, 本地端口号)为键的开放寻址哈希表,
+//seghandler使用哈希表在O(1)时间内为进入的段找到套接字ID.
+//目录按TCB_CHUNK_SIZE个条目分块增长, 已分配的块从不移动, 所以按套接字ID访问TCB无需加锁.
+//套接字ID被关闭后会被回收, 表中的最大连接数可以在运行时修改.
+
+#ifndef TCBTABLE_H
+#define TCBTABLE_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+//TCB目录每块的条目数
+#define TCB_CHUNK_SIZE 1024
+//TCB目录的最大块数, 即最多支持TCB_CHUNK_SIZE * TCB_MAX_CHUNKS个套接字
+#define TCB_MAX_CHUNKS 1024
+//用作哈希键的通配值, 用于匹配任意远端节点或端口
+#define TCB_ANY 0xFFFFFFFFu
+
+//哈希表的槽, 16字节, 一个64字节的缓存行正好放下4个槽, 线性探测通常只访问一个缓存行
+typedef struct tcbslot {
+    unsigned int remote_nodeID;     //远端节点ID
+    unsigned int remote_port;       //远端端口号
+    unsigned int local_port;        //本地端口号
+    int sock;                       //套接字ID, 空槽为-1, 已删除的槽为-2
+} tcbslot_t;
+
+typedef struct tcbtable {
+    void **chunks[TCB_MAX_CHUNKS];  //TCB目录, chunks[sock / TCB_CHUNK_SIZE][sock % TCB_CHUNK_SIZE]
+    int span;                       //曾经分配过的最大套接字ID + 1
+    int *freeIDs;                   //被回收的套接字ID栈
+    int freeNum;                    //栈中套接字ID的数量
+    unsigned int count;             //当前使用中的套接字数
+    unsigned int limit;             //最大连接数
+    tcbslot_t *slots;               //哈希表, 槽数是2的幂
+    unsigned int slotMask;          //槽数 - 1
+    unsigned int slotUsed;          //使用中的槽数
+    unsigned int slotDeleted;       //已删除的槽数
+    pthread_mutex_t idMutex;        //保护套接字ID的分配与回收
+    pthread_rwlock_t hashLock;      //保护哈希表, 查找时持有读锁
+} tcbtable_t;
+
+//这个函数创建一个最多容纳limit个连接的空TCB表.
+tcbtable_t *tcbtable_create(unsigned int limit);
+
+//这个函数释放TCB表, 但不释放表中的TCB.
+void tcbtable_destroy(tcbtable_t *tab);
+
+//这个函数修改最大连接数. 已经存在的连接不受影响.
+void tcbtable_setlimit(tcbtable_t *tab, unsigned int limit);
+
+//这个函数分配64字节对齐并清零的TCB内存, 使TCB开头的热字段位于同一个缓存行中.
+void *tcbtable_newtcb(size_t size);
+
+//这个函数为tcb分配一个套接字ID, 优先使用被回收的ID. 如果连接数已达到上限, 返回-1.
+int tcbtable_alloc(tcbtable_t *tab, void *tcb);
+
+//这个函数回收套接字ID并返回它对应的TCB. 调用者应先用tcbtable_unbind()删除该套接字的所有键.
+void *tcbtable_release(tcbtable_t *tab, int sock);
+
+//这个函数返回套接字ID对应的TCB, 如果不存在, 返回NULL.
+void *tcbtable_get(tcbtable_t *tab, int sock);
+
+//返回曾经分配过的最大套接字ID + 1, 用于遍历表中的所有TCB.
+int tcbtable_span(tcbtable_t *tab);
+
+//这个函数将键(remote_nodeID, remote_port, local_port)映射到套接字ID sock, 已存在的映射被覆盖. 成功时返回1.
+int tcbtable_bind(tcbtable_t *tab, unsigned int remote_nodeID, unsigned int remote_port,
+                  unsigned int local_port, int sock);
+
+//这个函数删除键(remote_nodeID, remote_port, local_port)的映射, 键不存在时什么也不做.
+void tcbtable_unbind(tcbtable_t *tab, unsigned int remote_nodeID, unsigned int remote_port,
+                     unsigned int local_port);
+
+//这个函数查找键(remote_nodeID, remote_port, local_port)对应的套接字ID, 如果不存在, 返回-1.
+int tcbtable_lookup(tcbtable_t *tab, unsigned int remote_nodeID, unsigned int remote_port,
+                    unsigned int local_port);
+
+//这个函数返回键(remote_nodeID, remote_port, local_port)的32位哈希值, 哈希表和服务器的工作线程分配都使用它.
+unsigned int tcbtable_hash(unsigned int remote_nodeID, unsigned int remote_port, unsigned int local_port);
+
+#endif
@@ -0,0 +1,108 @@
+//文件名: common/tcq.c
+//
+//描述: 这个文件实现按流量类别调度的报文队列
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "tcq.h"
+#include "helper.h"
+
+// bytes a class may send in each DRR round, the control class never waits for its turn
+static const int tcWeight[TC_NUM] = {0, TC_WEIGHT_INTERACTIVE, TC_WEIGHT_DEFAULT, TC_WEIGHT_BULK};
+
+tcq_t *tcq_create(unsigned int limit) {
+    tcq_t *q = new(tcq_t);
+    memset(q, 0, sizeof(tcq_t));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    q->limit = limit;
+    // the first round starts at the interactive class, with its quantum like every later turn
+    q->drr = TC_INTERACTIVE;
+    q->deficit[TC_INTERACTIVE] = tcWeight[TC_INTERACTIVE] * TC_QUANTUM;
+    return q;
+}
+
+int tcq_put(tcq_t *q, int nextNode, sip_pkt_t *pkt) {
+    unsigned int c = pkt->header.tclass < TC_NUM ? pkt->header.tclass : TC_DEFAULT;
+    // most packets are ACKs, an item holds only the bytes of its packet
+    size_t len = sizeof(sip_hdr_t) + pkt->header.length;
+    tcqItem_t *it = malloc(offsetof(tcqItem_t, pkt) + len);
+    it->next = NULL;
+    it->nextNode = nextNode;
+    memcpy(&it->pkt, pkt, len);
+    it->pkt.header.tclass = (unsigned short) c;
+    pthread_mutex_lock(&q->lock);
+    if (q->closed || q->len[c] >= q->limit) {
+        ++q->dropped[c];
+        pthread_mutex_unlock(&q->lock);
+        free(it);
+        return -1;
+    }
+    if (q->tail[c]) q->tail[c]->next = it;
+    else q->head[c] = it;
+    q->tail[c] = it;
+    ++q->len[c];
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return 1;
+}
+
+static tcqItem_t *pop(tcq_t *q, int c) {
+    tcqItem_t *it = q->head[c];
+    q->head[c] = it->next;
+    if (q->head[c] == NULL) q->tail[c] = NULL;
+    --q->len[c];
+    ++q->sent[c];
+    return it;
+}
+
+// strict priority for the control class, deficit round robin over the others. should be called with the lock
+static tcqItem_t *pick(tcq_t *q) {
+    if (q->head[TC_CONTROL]) return pop(q, TC_CONTROL);
+    int backlogged = 0;
+    for (int c = TC_CONTROL + 1; c < TC_NUM; ++c) backlogged |= q->head[c] != NULL;
+    if (!backlogged) return NULL;
+    while (1) {
+        int c = q->drr;
+        tcqItem_t *it = q->head[c];
+        if (it && q->deficit[c] >= (int) (sizeof(sip_hdr_t) + it->pkt.header.length)) {
+            q->deficit[c] -= (int) (sizeof(sip_hdr_t) + it->pkt.header.length);
+            // an emptied class doesn't keep its credit for later
+            if (it->next == NULL) q->deficit[c] = 0;
+            return pop(q, c);
+        }
+        if (it == NULL) q->deficit[c] = 0;
+        // the next class starts its round with a new quantum
+        q->drr = c + 1 < TC_NUM ? c + 1 : TC_CONTROL + 1;
+        if (q->head[q->drr]) q->deficit[q->drr] += tcWeight[q->drr] * TC_QUANTUM;
+    }
+}
+
+tcqItem_t *tcq_get(tcq_t *q, int wait) {
+    pthread_mutex_lock(&q->lock);
+    tcqItem_t *it = NULL;
+    while (!q->closed && (it = pick(q)) == NULL && wait) pthread_cond_wait(&q->cond, &q->lock);
+    pthread_mutex_unlock(&q->lock);
+    return it;
+}
+
+void tcq_close(tcq_t *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void tcq_free(tcq_t *q) {
+    for (int c = 0; c < TC_NUM; ++c) {
+        while (q->head[c]) {
+            tcqItem_t *it = q->head[c];
+            q->head[c] = it->next;
+            free(it);
+        }
+    }
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->lock);
+    free(q);
+}
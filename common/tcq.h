@@ -0,0 +1,54 @@
+//文件名: common/tcq.h
+//
+//描述: 这个文件定义按流量类别调度的报文队列. SIP用一个队列保存交给SON的报文, SON为每个邻居用一个队列保存发往它的报文,
+//每个队列只有一个发送线程取出报文, 所以写入连接的总是一个线程.
+//每个类别(TC_*)有自己的FIFO: TC_CONTROL严格优先, 只要它不空就先发出它的报文; 其他类别按权重做差额轮转(DRR),
+//每轮可以发出权重乘以TC_QUANTUM字节. 所以批量传输占满链路时, 交互类别的报文最多等待当前一轮中其他类别的份额,
+//而不是排在整个批量队列后面. 每个类别最多排队limit个报文, 队列满时新报文被丢弃(drop-tail).
+
+#ifndef TCQ_H
+#define TCQ_H
+
+#include <pthread.h>
+#include "constants.h"
+#include "pkt.h"
+
+//队列中的一个报文
+typedef struct tcqItem {
+    struct tcqItem* next;
+    int nextNode;                   //下一跳的节点ID, SIP用它选择SON发送的邻居, SON中不使用
+    sip_pkt_t pkt;                  //报文, 只有首部和header.length字节的数据有效
+} tcqItem_t;
+
+typedef struct tcq {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;            //有新报文或队列被关闭时被广播
+    tcqItem_t* head[TC_NUM];        //每个类别的FIFO
+    tcqItem_t* tail[TC_NUM];
+    unsigned int len[TC_NUM];       //每个类别排队的报文数
+    unsigned int limit;             //每个类别最多排队的报文数
+    int deficit[TC_NUM];            //DRR中每个类别在这一轮剩余可以发出的字节数
+    int drr;                        //DRR当前服务的类别
+    int closed;                     //队列已被关闭, tcq_put()丢弃报文, tcq_get()返回NULL
+    unsigned long sent[TC_NUM];     //每个类别已被取出的报文数
+    unsigned long dropped[TC_NUM];  //每个类别因队列满被丢弃的报文数
+} tcq_t;
+
+//这个函数创建一个空队列, 每个类别最多排队limit个报文.
+tcq_t* tcq_create(unsigned int limit);
+
+//这个函数把报文pkt和它的下一跳nextNode的拷贝加入报文首部的tclass对应的队列, tclass不是合法的类别时使用TC_DEFAULT.
+//成功时返回1, 队列满或已被关闭时报文被丢弃, 返回-1.
+int tcq_put(tcq_t* q, int nextNode, sip_pkt_t* pkt);
+
+//这个函数按调度顺序取出下一个报文, 调用者用free()释放它. 队列为空时, wait非0则等待新报文, 否则返回NULL.
+//队列被关闭后返回NULL.
+tcqItem_t* tcq_get(tcq_t* q, int wait);
+
+//这个函数关闭队列并唤醒等待的tcq_get(), 发送线程由此知道连接已断开.
+void tcq_close(tcq_t* q);
+
+//这个函数释放队列和其中剩余的报文, 调用者保证没有其他线程再使用它.
+void tcq_free(tcq_t* q);
+
+#endif
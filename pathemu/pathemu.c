@@ -0,0 +1,231 @@
+//文件名: pathemu/pathemu.c
+//
+//描述: 这个文件实现路径模拟器, 它在测试中代替SIP进程和重叠网络. 它在端口SIP_PORT上等待两个STCP进程连接,
+//先连接的是节点1(服务器, 客户端用主机名localhost连接到它), 后连接的是节点2, 然后在两者之间转发段, 目的节点ID被忽略.
+//每个方向的路径由hops跳串联而成, 每一跳有相同的参数: 段以loss的概率丢失, 然后进入一个最多容纳queue个MAX_SEG_LEN字节的段的
+//尾部丢弃队列, 以rate KB/s的速率发出, 经过delay毫秒的传播延迟后到达下一跳. 所以路径的往返时间至少是2 * hops * delay毫秒,
+//瓶颈带宽是rate KB/s, 端到端丢包率约为1 - (1 - loss)^hops.
+//段按到达时间由每个方向的一个线程交给对端. 任何一端断开时, 模拟器报告每个方向转发和丢弃的段数, 然后退出.
+//可选的调度方式为fifo(默认)或tc. tc模式中第一跳像SIP和SON一样按段携带的流量类别排队(见common/tcq.h), 每个类别最多queue个段,
+//由每个方向的一个链路线程在链路空闲时取出下一个段, 其余各跳不变. 用于对比批量传输占满瓶颈时其他类别的连接的延迟.
+
+//输入: 跳数 每跳丢包率 每跳单向延迟(毫秒) 每跳速率(KB/s) 每跳队列长度(段) [fifo|tc]
+
+//输出: 每个方向转发和丢弃的段数
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "../common/constants.h"
+#include "../common/pkt.h"
+#include "../common/seg.h"
+#include "../common/tcq.h"
+
+//每个方向最多的跳数.
+#define MAX_HOPS 16
+
+//一个在路径上传输的段, 在arrival时到达对端.
+typedef struct flight {
+    long arrival;
+    struct flight *next;
+    seg_t seg;
+} flight_t;
+
+//一个方向的路径, 段从节点from发往另一个节点.
+typedef struct path {
+    int from;
+    long busyUntil[MAX_HOPS];   //每一跳发完已排队的段的时间
+    unsigned int seed;          //丢包用的随机数种子
+    flight_t *head;             //按到达时间排列的在途段
+    flight_t *tail;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned long forwarded;
+    unsigned long lost;         //按丢包率丢弃的段数
+    unsigned long overflow;     //因队列满而丢弃的段数
+    tcq_t *sched;               //tc模式中第一跳按流量类别调度的队列, fifo模式中为NULL
+} path_t;
+
+int hops;
+double loss;
+long delay;         //每跳的传播延迟, 单位为纳秒
+double rate;        //每跳的速率, 单位为字节/纳秒
+long queue;         //每跳队列的字节数
+int conns[3];       //节点1和节点2的连接, 下标为节点ID
+path_t paths[3];    //下标为发出段的节点ID
+
+// pass one segment through the hops, returns the time it reaches the other end or -1 if it is dropped.
+// a segment the scheduler of the first hop picked has already waited in its queue
+static long traverse(path_t *p, unsigned int len) {
+    long t = now_nano();
+    for (int h = 0; h < hops; ++h) {
+        if ((double) rand_r(&p->seed) / RAND_MAX < loss) {
+            ++p->lost;
+            return -1;
+        }
+        // what is still queued at the hop when the segment arrives
+        long backlog = p->busyUntil[h] > t ? (long) ((double) (p->busyUntil[h] - t) * rate) : 0;
+        if ((h > 0 || p->sched == NULL) && backlog + len > queue) {
+            ++p->overflow;
+            return -1;
+        }
+        long start = p->busyUntil[h] > t ? p->busyUntil[h] : t;
+        p->busyUntil[h] = start + (long) (len / rate);
+        // every hop has the same delay, so the segments stay in order
+        t = p->busyUntil[h] + delay;
+    }
+    return t;
+}
+
+// print the counters of both directions and exit when an end goes away
+static void finish(void) {
+    for (int n = 1; n <= 2; ++n) {
+        unsigned long overflow = paths[n].overflow;
+        if (paths[n].sched)
+            for (int c = 0; c < TC_NUM; ++c) overflow += paths[n].sched->dropped[c];
+        printf("[pathemu] node %d -> node %d: %lu forwarded, %lu lost, %lu dropped by full queues\n", n, 3 - n,
+               paths[n].forwarded, paths[n].lost, overflow);
+    }
+    exit(0);
+}
+
+// put a segment that survived the hops on its path
+static void fly(path_t *p, long arrival, sip_pkt_t *pkt) {
+    flight_t *f = (flight_t *) malloc(sizeof(flight_t));
+    f->arrival = arrival;
+    f->next = NULL;
+    memcpy(&f->seg, pkt->data, pkt->header.length);
+    pthread_mutex_lock(&p->lock);
+    if (p->tail) p->tail->next = f;
+    else p->head = f;
+    p->tail = f;
+    ++p->forwarded;
+    pthread_cond_signal(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// the first hop of a path in tc mode: the next segment is chosen only when the link is free,
+// so a segment of a higher class arriving meanwhile still goes before the queued ones
+void *link_sched(void *arg) {
+    path_t *p = (path_t *) arg;
+    tcqItem_t *it;
+    while (1) {
+        long wait = p->busyUntil[0] - now_nano();
+        if (wait > 0) {
+            struct timespec ts = {.tv_sec = wait / 1000000000, .tv_nsec = wait % 1000000000};
+            nanosleep(&ts, NULL);
+        }
+        if ((it = tcq_get(p->sched, 1)) == NULL) break;
+        long arrival = traverse(p, it->pkt.header.length);
+        if (arrival >= 0) fly(p, arrival, &it->pkt);
+        free(it);
+    }
+    return NULL;
+}
+
+// hand the segments of a path to the other end as they arrive
+void *deliver(void *arg) {
+    path_t *p = (path_t *) arg;
+    while (1) {
+        pthread_mutex_lock(&p->lock);
+        while (p->head == NULL) pthread_cond_wait(&p->cond, &p->lock);
+        flight_t *f = p->head;
+        long wait = f->arrival - now_nano();
+        if (wait > 0) {
+            struct timespec ts = {.tv_sec = f->arrival / 1000000000, .tv_nsec = f->arrival % 1000000000};
+            pthread_cond_timedwait(&p->cond, &p->lock, &ts);
+            pthread_mutex_unlock(&p->lock);
+            continue;
+        }
+        p->head = f->next;
+        if (p->head == NULL) p->tail = NULL;
+        pthread_mutex_unlock(&p->lock);
+        forwardsegToSTCP(conns[3 - p->from], p->from, &f->seg);
+        free(f);
+    }
+}
+
+// read the segments node from sends and put them on its path
+void *relay(void *arg) {
+    path_t *p = (path_t *) arg;
+    superseg_t *ss = (superseg_t *) malloc(sizeof(superseg_t));
+    sip_pkt_t *pkts = (sip_pkt_t *) malloc(SUPERSEG_SEGS * sizeof(sip_pkt_t));
+    int dst;
+    while (getsegToSend(conns[p->from], &dst, ss) > 0) {
+        int n = sip_packsegs(ss, p->from, 3 - p->from, pkts);
+        for (int i = 0; i < n; ++i) {
+            // a full class queue counts its own drops
+            if (p->sched) {
+                tcq_put(p->sched, 3 - p->from, &pkts[i]);
+                continue;
+            }
+            long arrival = traverse(p, pkts[i].header.length);
+            if (arrival >= 0) fly(p, arrival, &pkts[i]);
+        }
+    }
+    finish();
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 6) {
+        printf("usage: %s hops loss delay_ms rate_KBps queue_segs [fifo|tc]\n", argv[0]);
+        exit(1);
+    }
+    int tc = argc > 6 && strcmp(argv[6], "tc") == 0;
+    hops = atoi(argv[1]);
+    loss = atof(argv[2]);
+    delay = (long) (atof(argv[3]) * 1000000);
+    rate = atof(argv[4]) * 1024 / 1000000000;
+    queue = atol(argv[5]) * MAX_SEG_LEN;
+    if (hops < 1 || hops > MAX_HOPS || rate <= 0 || queue < MAX_SEG_LEN) {
+        printf("bad path parameters\n");
+        exit(1);
+    }
+    printf("[pathemu] %d hops, loss %.4f, delay %.1f ms, %.0f KB/s, queue %ld segments per hop, %s\n", hops, loss,
+           (double) delay / 1000000, atof(argv[4]), queue / MAX_SEG_LEN,
+           tc ? "first hop scheduled by traffic class" : "fifo");
+
+    int lsock = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(SIP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (lsock < 0 || bind(lsock, (struct sockaddr *) &addr, sizeof addr) < 0 || listen(lsock, 2) < 0) {
+        printf("[pathemu] can't listen on port %d\n", SIP_PORT);
+        exit(1);
+    }
+    for (int n = 1; n <= 2; ++n) {
+        conns[n] = accept(lsock, NULL, NULL);
+        if (conns[n] < 0) {
+            printf("[pathemu] accept error\n");
+            exit(1);
+        }
+        printf("[pathemu] node %d connected\n", n);
+    }
+    close(lsock);
+
+    pthread_t tid;
+    for (int n = 1; n <= 2; ++n) {
+        paths[n].from = n;
+        paths[n].seed = (unsigned int) time(NULL) + n;
+        pthread_mutex_init(&paths[n].lock, NULL);
+        pthread_cond_init(&paths[n].cond, NULL);
+        pthread_create(&tid, NULL, deliver, &paths[n]);
+        if (tc) {
+            paths[n].sched = tcq_create((unsigned int) (queue / MAX_SEG_LEN));
+            pthread_create(&tid, NULL, link_sched, &paths[n]);
+        }
+    }
+    pthread_create(&tid, NULL, relay, &paths[1]);
+    relay(&paths[2]);
+}
@@ -0,0 +1,47 @@
+#!/bin/bash
+# Sweeps the per-hop loss rate and the hop count of an emulated path and runs the bulk benchmark over it,
+# once in rate mode and once with the congestion window, printing one line per run.
+#
+# usage: pathemu/sweep.sh [MB]
+# LOSSES, HOPS, DELAY (one-way ms per hop), RATE (KB/s per hop) and QUEUE (segments per hop) override the path.
+# Run it from the repository root after make. The outputs of every run are kept in $OUT.
+
+MB=${1:-8}
+LOSSES=${LOSSES:-"0 0.001 0.01 0.03"}
+HOPS=${HOPS:-"1 2 4"}
+DELAY=${DELAY:-10}
+RATE=${RATE:-4096}
+QUEUE=${QUEUE:-64}
+OUT=${OUT:-/tmp/sweep}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+mkdir -p "$OUT"
+
+# run MB over the path once, $1 = hops, $2 = loss, $3 = rate|norate
+run() {
+    local log="$OUT/h$1-l$2-$3"
+    "$ROOT/pathemu/pathemu" "$1" "$2" "$DELAY" "$RATE" "$QUEUE" > "$log.path" &
+    local emu=$!
+    sleep 0.2
+    (cd "$ROOT/server" && ./app_bench_server bulk > "$log.server" 2>&1) &
+    local srv=$!
+    sleep 0.5
+    (cd "$ROOT/client" && timeout 600 ./app_bench_client localhost bulk "$MB" "$3" > "$log.client" 2>&1)
+    wait $srv
+    kill $emu 2> /dev/null
+    wait $emu 2> /dev/null
+    local soak bulk
+    soak=$(grep '^soak:' "$log.client")
+    bulk=$(grep '^bulk:' "$log.client")
+    printf "%-5s %-7s %-7s %8s KB/s  %s\n" "$1" "$2" "$3" "$(echo "$soak" | awk '{printf "%.1f", $2 / 1024 / $5}')" \
+        "$(echo "$bulk" | cut -d, -f2-4)"
+}
+
+echo "path: $DELAY ms, $RATE KB/s and $QUEUE segments per hop, $MB MB per run"
+printf "%-5s %-7s %-7s %13s  %s\n" hops loss mode goodput "srtt, min rtt, resent"
+for loss in $LOSSES; do
+    for hops in $HOPS; do
+        run "$hops" "$loss" rate
+        run "$hops" "$loss" norate
+    done
+done
@@ -0,0 +1,42 @@
+#!/bin/bash
+# Measures the round trip time of small requests while a bulk upload saturates the same emulated path,
+# with a FIFO bottleneck and with the bottleneck scheduled by traffic class, printing one line per run.
+#
+# usage: pathemu/tcbench.sh [requests]
+# HOPS, LOSS, DELAY (one-way ms per hop), RATE (KB/s per hop) and QUEUE (segments per hop) override the path.
+# Run it from the repository root after make. The outputs of every run are kept in $OUT.
+
+ROUNDS=${1:-200}
+HOPS=${HOPS:-1}
+LOSS=${LOSS:-0}
+DELAY=${DELAY:-5}
+RATE=${RATE:-1024}
+QUEUE=${QUEUE:-128}
+OUT=${OUT:-/tmp/tcbench}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+mkdir -p "$OUT"
+
+# $1 = fifo|tc, the scheduling of the bottleneck, $2 = class|noclass
+run() {
+    local log="$OUT/$1-$2"
+    "$ROOT/pathemu/pathemu" "$HOPS" "$LOSS" "$DELAY" "$RATE" "$QUEUE" "$1" > "$log.path" &
+    local emu=$!
+    sleep 0.2
+    (cd "$ROOT/server" && ./app_bench_server tclass "$ROUNDS" > "$log.server" 2>&1) &
+    local srv=$!
+    sleep 0.5
+    local extra=""
+    [ "$2" = noclass ] && extra=noclass
+    (cd "$ROOT/client" && timeout 600 ./app_bench_client localhost tclass "$ROUNDS" $extra > "$log.client" 2>&1)
+    wait $srv
+    kill $emu 2> /dev/null
+    wait $emu 2> /dev/null
+    printf "%-5s %-8s %s\n" "$1" "$2" "$(grep '^tclass:' "$log.client" | cut -d, -f3-)"
+}
+
+echo "path: $HOPS hops, loss $LOSS, $DELAY ms, $RATE KB/s and $QUEUE segments per hop, $ROUNDS requests per run"
+run fifo noclass
+run fifo class
+run tc noclass
+run tc class
@@ -0,0 +1,804 @@
+//文件名: server/app_bench_server.c
+
+//描述: 这是基准测试版本的服务器程序代码. 服务器首先连接到本地SIP进程. 然后它调用stcp_server_init()初始化STCP服务器.
+//它根据命令行参数选择测试模式:
+//  conns: 服务器调用stcp_server_setmaxconn()放开连接数上限, 在端口SERVERPORTBASE+i上创建n个套接字,
+//         由BENCH_THREADS个线程并发地接受来自客户端的连接并接收每个连接发送的序号. 所有连接建立后,
+//         服务器测量在n个连接的TCB表中为一个段查找所属连接(分用)的开销, 并与逐个比较TCB的线性查找相比较.
+//         然后报告所有接收缓冲区从块池中占用的内存, 以及连接空闲之后占用的内存.
+//         然后等待客户端断开每个连接, 并关闭套接字.
+//  fanin: 服务器在端口SERVERPORTBASE上创建一个监听套接字, 接受n个客户端的连接, 每个连接由一个线程并行地用stcp_server_recvv()
+//         把客户端的序号和FANIN_BYTES字节直接接收到两个缓冲区中, 然后报告所有上传完成的时间和总吞吐量.
+//  epoll: 与fanin相同, 但所有连接都使用非阻塞模式, 由主线程通过epoll等待套接字的eventfd来接受和接收.
+//  handler: 与fanin相同, 但服务器在监听套接字上用stcp_server_set_handler()注册回调, 数据由处理段的线程直接在接收缓冲区中检查,
+//         不为连接创建接收线程, 也不拷贝数据. 回调在客户端的序号到齐之前保留数据, 以演示部分释放.
+//  streams: 与fanin相同, 但服务器只接受一个连接, 用stcp_server_stream_accept()接受客户端在其中打开的n个流, 每个流由一个线程接收.
+//         所有上传完成后, 服务器在流0上回送一个字节.
+//  pingpong: 服务器在端口SERVERPORTBASE上接受一个连接, 把收到的n个PINGPONG_BYTES字节的请求用stcp_server_send()原样回送,
+//         然后报告服务器发出的DATA段, 单独的DATAACK和捎带在DATA中的确认的数量.
+//  msgpong: 与pingpong相同, 但请求是长度变化的消息, 服务器用stcp_server_recv_msg()把它读入MSGPONG_BYTES字节的缓冲区,
+//         再用stcp_server_send_msg()原样回送.
+//  oneshot: 服务器在启用了STCP_OPT_FASTOPEN的端口SERVERPORTBASE上依次接受n个连接, 把每个连接的一个ONESHOT_BYTES字节的请求原样回送,
+//         并统计有多少请求随SYN到达, 即stcp_server_accept()返回时已经可以读出. 客户端的oneshot和fastopen模式都使用它.
+//  soak: 服务器在端口SERVERPORTBASE上接受一个连接, 先接收8字节的上传长度, 然后以SOAK_CHUNK字节为单位接收数据, 并逐个64位字
+//         与客户端生成的序列比较, 每收到SOAK_REPORT字节报告一次吞吐量. 上传长度远超4GB, 用于验证序号回绕后的传输.
+//         结束时报告总吞吐量和数据是否完整, 并把结果(1为完整)用一个字节回送给客户端.
+//  fec: 与pingpong相同, 但监听套接字启用STCP_OPT_FEC, 请求是FEC_BYTES字节. 客户端请求时连接两个方向都使用前向纠错,
+//         服务器最后报告它发出的校验段数和由客户端的校验段恢复的段数.
+//  bulk: 与soak相同, 但监听套接字启用STCP_OPT_RATE, 客户端请求时使用速率模式, 并且不由seglost()注入丢包, 丢包和延迟由路径模拟器pathemu产生.
+//  tclass: 服务器在启用了STCP_OPT_RATE的端口SERVERPORTBASE上接受客户端的批量上传连接, 由一个线程接收并丢弃它的数据, 在端口SERVERPORTBASE+1上
+//         接受请求连接, 把n个PINGPONG_BYTES字节的请求原样回送. 两个连接都使用客户端在SYN中携带的流量类别, 服务器最后报告它们.
+//         与bulk相同, 丢包和延迟由路径模拟器pathemu产生.
+//可选的第三个参数是处理段的工作线程数, 它在stcp_server_init()之前通过stcp_server_setworkers()设置.
+//最后, 服务器通过调用stcp_server_close()关闭套接字, 并断开与本地SIP进程的连接.
+
+//输入: 测试模式 [连接数或往返次数 [工作线程数]]
+
+//输出: STCP服务器状态和测试结果
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include "../common/constants.h"
+#include "../common/seg.h"
+#include "../common/tcbtable.h"
+#include "stcp_server.h"
+
+//第i个连接使用服务器端口号SERVERPORTBASE+i.
+#define SERVERPORTBASE 1000
+//conns模式的默认连接数.
+#define DEFAULT_CONNS 10000
+//同时接受连接的线程数.
+#define BENCH_THREADS 64
+//fanin模式的默认客户端数和每个客户端上传的字节数.
+#define DEFAULT_FANIN 16
+#define FANIN_BYTES 65536
+//pingpong模式的默认往返次数和请求的字节数.
+#define DEFAULT_PINGPONG 1000
+#define PINGPONG_BYTES 64
+//msgpong模式中消息的最大长度.
+#define MSGPONG_BYTES 4096
+//oneshot模式的默认连接数和请求的字节数.
+#define DEFAULT_ONESHOT 200
+#define ONESHOT_BYTES 512
+//fec模式的默认往返次数和请求的字节数.
+#define DEFAULT_FEC_ROUNDS 200
+#define FEC_BYTES (8 * MAX_SEG_LEN)
+//tclass模式的默认请求数.
+#define DEFAULT_TCLASS_ROUNDS 200
+//soak模式每次接收的字节数, 是64位字的整数倍.
+#define SOAK_CHUNK (16 * MAX_SEG_LEN)
+//soak模式每接收这么多字节报告一次吞吐量.
+#define SOAK_REPORT (1UL << 30)
+//分用开销测试中查找的次数.
+#define DEMUX_ROUNDS 1000000
+
+//STCP服务器的TCB表, 只有分用开销测试直接使用它
+extern tcbtable_t *tcbTable;
+
+int conns;
+int *lsocks;    //监听套接字
+int *socks;     //stcp_server_accept()返回的连接套接字
+long *doneNano; //fanin模式中每个连接接收完数据的时间
+int *streamIds; //streams模式中stcp_server_stream_accept()返回的流ID
+int *handlerGot; //handler模式中每个套接字收到的字节数, 以套接字ID为下标
+int *handlerIdx; //handler模式中每个套接字的客户端序号
+int handlerClosed; //handler模式中收到FIN的连接数
+long handlerStart; //handler模式中第一次交付数据的时间
+pthread_mutex_t handlerMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t handlerCond = PTHREAD_COND_INITIALIZER;
+
+//这个函数连接到本地SIP进程的端口SIP_PORT. 如果TCP连接失败, 返回-1. 连接成功, 返回TCP套接字描述符, STCP将使用该描述符发送段.
+int connectToSIP(void) {
+    struct sockaddr_in servAddr;
+    bzero(&servAddr, sizeof servAddr);
+    servAddr.sin_family = AF_INET;
+    servAddr.sin_port = htons(SIP_PORT);
+    inet_pton(AF_INET, "127.0.0.1", &servAddr.sin_addr);
+    int sock_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock_fd == -1) {
+        printf("[SIP]<connectToSIP> tcp socket error\n");
+        return -1;
+    }
+    if (connect(sock_fd, (struct sockaddr *) &servAddr, sizeof servAddr) < 0) {
+        printf("[SIP]<connectToSIP> connection failed\n");
+        return -3;
+    }
+    return sock_fd;
+}
+
+//这个函数断开到本地SIP进程的TCP连接.
+void disconnectToSIP(int sip_conn) {
+    close(sip_conn);
+    printf("[SIP]<disconnectToSIP> connection to SON is closed\n");
+}
+
+// the transport statistics of a connection, all zero if it is gone
+stcp_stats_t sock_stats(int sock) {
+    stcp_stats_t s;
+    if (stcp_server_getstats(sock, &s) < 0) memset(&s, 0, sizeof s);
+    return s;
+}
+
+//这个函数在端口port上创建监听套接字, opt不为0时先把这个选项设置为val, 然后接受一个连接.
+//监听套接字存入*lsock, 返回连接套接字. 任何一步失败都退出程序.
+int serve_one(unsigned int port, int opt, int val, int *lsock) {
+    *lsock = stcp_server_sock(port);
+    if (*lsock < 0 || (opt && stcp_server_setopt(*lsock, opt, val) < 0) || stcp_server_listen(*lsock, 1) < 0) {
+        printf("can't create stcp server\n");
+        exit(1);
+    }
+    int sock = stcp_server_accept(*lsock);
+    if (sock < 0) {
+        printf("connection failed\n");
+        exit(1);
+    }
+    return sock;
+}
+
+//这个函数关闭n个客户端已经断开的连接和监听套接字.
+//在CLOSEWAIT状态中服务器仍要为重传的FIN回复FINACK, 等待它们超时后再关闭套接字.
+void finish_all(int *conn, int n, int lsock) {
+    sleep(CLOSEWAIT_TIMEOUT + 1);
+    for (int i = 0; i < n; ++i)
+        stcp_server_close(conn[i]);
+    stcp_server_close(lsock);
+}
+
+//这个函数等待客户端断开连接, 然后关闭连接和监听套接字.
+void finish(int sock, int lsock) {
+    //客户端的FIN把连接移出CONNECTED状态之后recv_some返回-1
+    char c;
+    while (stcp_server_recv_some(sock, &c, 1, 1, -1) > 0);
+    finish_all(&sock, 1, lsock);
+}
+
+// thread t accepts the connections t, t + BENCH_THREADS, ... in the order the client opens them,
+// then reads the index every connection sends
+void *conns_accept(void *arg) {
+    for (int i = (int) (long) arg; i < conns; i += BENCH_THREADS) {
+        socks[i] = stcp_server_accept(lsocks[i]);
+        if (socks[i] < 0) {
+            printf("connection %d failed\n", i);
+            exit(1);
+        }
+    }
+    for (int i = (int) (long) arg; i < conns; i += BENCH_THREADS) {
+        int n;
+        if (stcp_server_recv(socks[i], &n, sizeof(int)) < 0) {
+            printf("connection %d failed\n", i);
+            exit(1);
+        }
+        if (n != i) printf("connection %d received %d\n", i, n);
+    }
+    return NULL;
+}
+
+// recv_some fails once the FIN of the client has moved the connection out of CONNECTED
+void *conns_wait_fin(void *arg) {
+    for (int i = (int) (long) arg; i < conns; i += BENCH_THREADS) {
+        char c;
+        while (stcp_server_recv_some(socks[i], &c, 1, 1, -1) > 0);
+    }
+    return NULL;
+}
+
+// the per-segment demux cost with the hash against the linear scan the fixed TCB array used to do
+void bench_demux(void) {
+    unsigned int *nodes = (unsigned int *) malloc(conns * sizeof(unsigned int));
+    unsigned int *ports = (unsigned int *) malloc(conns * sizeof(unsigned int));
+    for (int i = 0; i < conns; ++i) {
+        server_tcb_t *tcb = tcbtable_get(tcbTable, socks[i]);
+        nodes[i] = tcb->client_nodeID;
+        ports[i] = tcb->client_portNum;
+    }
+    struct timespec t0, t1;
+    long found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int r = 0; r < DEMUX_ROUNDS; ++r) {
+        int i = (int) ((r * 2654435761u) % conns);
+        found += tcbtable_lookup(tcbTable, nodes[i], ports[i], SERVERPORTBASE + i) == socks[i];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double hash_ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / DEMUX_ROUNDS;
+
+    int rounds = DEMUX_ROUNDS / 100;
+    int span = tcbtable_span(tcbTable);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int r = 0; r < rounds; ++r) {
+        int i = (int) ((r * 2654435761u) % conns);
+        for (int j = 0; j < span; ++j) {
+            server_tcb_t *tcb = tcbtable_get(tcbTable, j);
+            if (tcb && tcb->client_nodeID == nodes[i] && tcb->client_portNum == ports[i] &&
+                tcb->server_portNum == SERVERPORTBASE + i) {
+                found += j == socks[i];
+                break;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double scan_ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / rounds;
+
+    printf("demux over %d connections: hash %.1f ns, linear scan %.1f ns per segment (%ld found)\n",
+           conns, hash_ns, scan_ns, found);
+    free(nodes);
+    free(ports);
+}
+
+// run one step of the benchmark on BENCH_THREADS threads
+void run_threads(void *(*step)(void *)) {
+    pthread_t tids[BENCH_THREADS];
+    for (long t = 0; t < BENCH_THREADS; ++t)
+        pthread_create(&tids[t], NULL, step, (void *) t);
+    for (int t = 0; t < BENCH_THREADS; ++t)
+        pthread_join(tids[t], NULL);
+}
+
+void bench_conns(void) {
+    lsocks = (int *) malloc(conns * sizeof(int));
+    socks = (int *) malloc(conns * sizeof(int));
+    //每个连接占用一个监听套接字和一个连接套接字
+    stcp_server_setmaxconn(2 * conns);
+    for (int i = 0; i < conns; ++i) {
+        lsocks[i] = stcp_server_sock(SERVERPORTBASE + i);
+        if (lsocks[i] < 0 || stcp_server_listen(lsocks[i], 1) < 0) {
+            printf("can't create stcp server %d\n", i);
+            exit(1);
+        }
+    }
+
+    run_threads(conns_accept);
+    printf("%d connections are accepted\n", conns);
+
+    bench_demux();
+
+    //接收缓冲区按块分配, 连接空闲RECV_IDLE_TRIM秒后它们剩下的块也被归还
+    printf("receive buffers of %d connections hold %lu bytes\n", conns, ringbuf_pool_used());
+    sleep(RECV_IDLE_TRIM + 1);
+    printf("receive buffers of %d idle connections hold %lu bytes\n", conns, ringbuf_pool_used());
+
+    run_threads(conns_wait_fin);
+    //在CLOSEWAIT状态中服务器仍要为重传的FIN回复FINACK, 等待它们超时后再关闭套接字
+    sleep(CLOSEWAIT_TIMEOUT + 1);
+    int failed = 0;
+    for (int i = 0; i < conns; ++i) {
+        failed += stcp_server_close(socks[i]) < 0;
+        stcp_server_close(lsocks[i]);
+    }
+    printf("%d connections are closed, %d are still open\n", conns - failed, failed);
+    free(socks);
+    free(lsocks);
+}
+
+// connection i receives the index and the upload of a client, then waits for its FIN
+void *fanin_recv(void *arg) {
+    int i = (int) (long) arg, n;
+    char *buf = (char *) malloc(FANIN_BYTES);
+    struct iovec iov[2] = {{.iov_base = &n, .iov_len = sizeof(int)}, {.iov_base = buf, .iov_len = FANIN_BYTES}};
+    if (stcp_server_recvv(socks[i], iov, 2) < 0) {
+        printf("connection %d failed\n", i);
+        exit(1);
+    }
+    doneNano[i] = now_nano();
+    for (int k = 0; k < FANIN_BYTES; ++k) {
+        if (buf[k] != (char) (k + n)) {
+            printf("connection %d: byte %d of client %d is corrupted\n", i, k, n);
+            break;
+        }
+    }
+    free(buf);
+    char c;
+    while (stcp_server_recv_some(socks[i], &c, 1, 1, -1) > 0);
+    return NULL;
+}
+
+void bench_fanin(void) {
+    socks = (int *) malloc(conns * sizeof(int));
+    doneNano = (long *) malloc(conns * sizeof(long));
+    stcp_server_setmaxconn(conns + 1);
+    int lsock = stcp_server_sock(SERVERPORTBASE);
+    if (lsock < 0 || stcp_server_listen(lsock, conns) < 0) {
+        printf("can't create stcp server\n");
+        exit(1);
+    }
+
+    //所有客户端的连接都由同一个监听套接字接受, 每个连接由一个线程接收
+    pthread_t *tids = (pthread_t *) malloc(conns * sizeof(pthread_t));
+    long start = 0, end = 0;
+    for (long i = 0; i < conns; ++i) {
+        socks[i] = stcp_server_accept(lsock);
+        if (socks[i] < 0) {
+            printf("connection %ld failed\n", i);
+            exit(1);
+        }
+        if (i == 0) start = now_nano();
+        pthread_create(&tids[i], NULL, fanin_recv, (void *) i);
+    }
+    for (int i = 0; i < conns; ++i) {
+        pthread_join(tids[i], NULL);
+        end = doneNano[i] > end ? doneNano[i] : end;
+    }
+    free(tids);
+    printf("%d clients uploaded %d bytes each in %.3f s, %.1f KB/s in total\n", conns, FANIN_BYTES,
+           (double) (end - start) / 1000000000, (double) conns * FANIN_BYTES / 1024 / ((double) (end - start) / 1000000000));
+
+    finish_all(socks, conns, lsock);
+    free(socks);
+    free(doneNano);
+}
+
+// the data handler of the handler mode, it checks the upload in place in the receive buffer of the connection
+unsigned int handler_data(int sockfd, const struct iovec *iov, int iovcnt, void *ctx) {
+    (void) ctx;
+    long zero = 0;
+    __atomic_compare_exchange_n(&handlerStart, &zero, now_nano(), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    unsigned int total = 0;
+    for (int v = 0; v < iovcnt; ++v) total += iov[v].iov_len;
+    // the index of the client stays in the buffer until all of it is there
+    if (handlerGot[sockfd] == 0 && total < sizeof(int)) return 0;
+    for (int v = 0; v < iovcnt; ++v) {
+        const char *p = (const char *) iov[v].iov_base;
+        for (size_t k = 0; k < iov[v].iov_len; ++k, ++handlerGot[sockfd]) {
+            int got = handlerGot[sockfd];
+            if (got < (int) sizeof(int)) {
+                ((char *) &handlerIdx[sockfd])[got] = p[k];
+            } else if (p[k] != (char) (got - sizeof(int) + handlerIdx[sockfd])) {
+                printf("socket %d: byte %d of client %d is corrupted\n", sockfd, (int) (got - sizeof(int)),
+                       handlerIdx[sockfd]);
+                exit(1);
+            }
+        }
+    }
+    if (handlerGot[sockfd] == sizeof(int) + FANIN_BYTES) doneNano[sockfd] = now_nano();
+    return total;
+}
+
+// the close handler of the handler mode
+void handler_close(int sockfd, void *ctx) {
+    (void) ctx;
+    if (handlerGot[sockfd] != sizeof(int) + FANIN_BYTES) {
+        printf("socket %d closed after %d bytes\n", sockfd, handlerGot[sockfd]);
+        exit(1);
+    }
+    pthread_mutex_lock(&handlerMutex);
+    ++handlerClosed;
+    pthread_cond_signal(&handlerCond);
+    pthread_mutex_unlock(&handlerMutex);
+}
+
+void bench_handler(void) {
+    //连接的套接字ID不超过conns
+    socks = (int *) malloc(conns * sizeof(int));
+    doneNano = (long *) calloc(conns + 1, sizeof(long));
+    handlerGot = (int *) calloc(conns + 1, sizeof(int));
+    handlerIdx = (int *) calloc(conns + 1, sizeof(int));
+    stcp_server_setmaxconn(conns + 1);
+    int lsock = stcp_server_sock(SERVERPORTBASE);
+    if (lsock < 0 || stcp_server_set_handler(lsock, handler_data, handler_close, NULL) < 0 ||
+        stcp_server_listen(lsock, conns) < 0) {
+        printf("can't create stcp server\n");
+        exit(1);
+    }
+
+    //接受连接只是为了之后关闭它们, 数据在连接进入接受队列时就已经开始交给回调
+    for (int i = 0; i < conns; ++i) {
+        socks[i] = stcp_server_accept(lsock);
+        if (socks[i] < 0) {
+            printf("connection %d failed\n", i);
+            exit(1);
+        }
+    }
+    pthread_mutex_lock(&handlerMutex);
+    while (handlerClosed < conns) pthread_cond_wait(&handlerCond, &handlerMutex);
+    pthread_mutex_unlock(&handlerMutex);
+    long start = handlerStart, end = 0;
+    for (int i = 0; i < conns; ++i) end = doneNano[socks[i]] > end ? doneNano[socks[i]] : end;
+    printf("%d clients uploaded %d bytes each in %.3f s, %.1f KB/s in total, no receiving threads, %d close callbacks\n",
+           conns, FANIN_BYTES, (double) (end - start) / 1000000000,
+           (double) conns * FANIN_BYTES / 1024 / ((double) (end - start) / 1000000000), handlerClosed);
+
+    finish_all(socks, conns, lsock);
+    free(socks);
+    free(doneNano);
+    free(handlerGot);
+    free(handlerIdx);
+}
+
+// read what connection i has buffered, returns 1 once the client has closed it
+int epoll_recv(int i, int *got, int *idx) {
+    char buf[MAX_SEG_LEN];
+    int n;
+    while ((n = stcp_server_recv_some(socks[i], buf, sizeof buf, 1, 0)) > 0) {
+        for (int k = 0; k < n; ++k, ++got[i]) {
+            // the index of the client comes first, then its upload
+            if (got[i] < (int) sizeof(int)) {
+                ((char *) &idx[i])[got[i]] = buf[k];
+            } else if (buf[k] != (char) (got[i] - sizeof(int) + idx[i])) {
+                printf("connection %d: byte %d of client %d is corrupted\n", i, (int) (got[i] - sizeof(int)), idx[i]);
+                exit(1);
+            }
+        }
+        if (got[i] == sizeof(int) + FANIN_BYTES) doneNano[i] = now_nano();
+    }
+    return n == -1;
+}
+
+void bench_epoll(void) {
+    //每个连接占用一个eventfd
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    socks = (int *) malloc(conns * sizeof(int));
+    doneNano = (long *) malloc(conns * sizeof(long));
+    int *got = (int *) calloc(conns, sizeof(int));
+    int *idx = (int *) calloc(conns, sizeof(int));
+    stcp_server_setmaxconn(conns + 1);
+    int lsock = stcp_server_sock(SERVERPORTBASE);
+    if (lsock < 0 || stcp_server_setopt(lsock, STCP_OPT_NONBLOCK, 1) < 0 || stcp_server_listen(lsock, conns) < 0) {
+        printf("can't create stcp server\n");
+        exit(1);
+    }
+    int ep = epoll_create1(0);
+    //epoll事件的数据是连接的序号, 监听套接字使用conns
+    struct epoll_event ev = {.events = EPOLLIN, .data.u32 = conns};
+    epoll_ctl(ep, EPOLL_CTL_ADD, stcp_server_eventfd(lsock), &ev);
+
+    int accepted = 0, closed = 0, wakeups = 0;
+    long start = 0, end = 0;
+    struct epoll_event evs[64];
+    while (closed < conns) {
+        int n = epoll_wait(ep, evs, 64, -1);
+        ++wakeups;
+        for (int e = 0; e < n; ++e) {
+            unsigned int i = evs[e].data.u32;
+            eventfd_t cnt;
+            if (i == (unsigned int) conns) {
+                eventfd_read(stcp_server_eventfd(lsock), &cnt);
+                int sock;
+                while (accepted < conns && (sock = stcp_server_accept(lsock)) >= 0) {
+                    if (accepted == 0) start = now_nano();
+                    socks[accepted] = sock;
+                    ev.data.u32 = accepted++;
+                    //新的eventfd立即可读, 下一轮epoll_wait会读出已经到达的数据
+                    epoll_ctl(ep, EPOLL_CTL_ADD, stcp_server_eventfd(sock), &ev);
+                }
+                continue;
+            }
+            eventfd_read(stcp_server_eventfd(socks[i]), &cnt);
+            if (epoll_recv(i, got, idx)) {
+                if (got[i] != sizeof(int) + FANIN_BYTES) {
+                    printf("connection %u closed after %d bytes\n", i, got[i]);
+                    exit(1);
+                }
+                epoll_ctl(ep, EPOLL_CTL_DEL, stcp_server_eventfd(socks[i]), NULL);
+                ++closed;
+            }
+        }
+    }
+    for (int i = 0; i < conns; ++i) end = doneNano[i] > end ? doneNano[i] : end;
+    printf("%d clients uploaded %d bytes each in %.3f s, %.1f KB/s in total, one thread, %d epoll wakeups\n",
+           conns, FANIN_BYTES, (double) (end - start) / 1000000000,
+           (double) conns * FANIN_BYTES / 1024 / ((double) (end - start) / 1000000000), wakeups);
+
+    finish_all(socks, conns, lsock);
+    close(ep);
+    free(socks);
+    free(doneNano);
+    free(got);
+    free(idx);
+}
+
+void *streams_recv(void *arg) {
+    int i = (int) (long) arg, n;
+    char *buf = (char *) malloc(FANIN_BYTES);
+    if (stcp_server_stream_recv(socks[0], streamIds[i], &n, sizeof(int)) < 0 ||
+        stcp_server_stream_recv(socks[0], streamIds[i], buf, FANIN_BYTES) < 0) {
+        printf("stream %d failed\n", i);
+        exit(1);
+    }
+    doneNano[i] = now_nano();
+    for (int k = 0; k < FANIN_BYTES; ++k) {
+        if (buf[k] != (char) (k + n)) {
+            printf("stream %d: byte %d of upload %d is corrupted\n", i, k, n);
+            break;
+        }
+    }
+    free(buf);
+    stcp_server_stream_close(socks[0], streamIds[i]);
+    return NULL;
+}
+
+void bench_streams(void) {
+    socks = (int *) malloc(sizeof(int));
+    streamIds = (int *) malloc(conns * sizeof(int));
+    doneNano = (long *) malloc(conns * sizeof(long));
+    int lsock = stcp_server_sock(SERVERPORTBASE);
+    if (lsock < 0 || stcp_server_listen(lsock, 1) < 0 || (socks[0] = stcp_server_accept(lsock)) < 0) {
+        printf("can't create stcp server\n");
+        exit(1);
+    }
+
+    //客户端的所有上传都在这一个连接的流上, 每个流由一个线程接收
+    pthread_t *tids = (pthread_t *) malloc(conns * sizeof(pthread_t));
+    long start = 0, end = 0;
+    for (long i = 0; i < conns; ++i) {
+        streamIds[i] = stcp_server_stream_accept(socks[0]);
+        if (streamIds[i] < 0) {
+            printf("stream %ld failed\n", i);
+            exit(1);
+        }
+        if (i == 0) start = now_nano();
+        pthread_create(&tids[i], NULL, streams_recv, (void *) i);
+    }
+    for (int i = 0; i < conns; ++i) {
+        pthread_join(tids[i], NULL);
+        end = doneNano[i] > end ? doneNano[i] : end;
+    }
+    free(tids);
+    char done = 1;
+    stcp_server_send(socks[0], &done, 1);
+    printf("%d streams uploaded %d bytes each in %.3f s, %.1f KB/s in total\n", conns, FANIN_BYTES,
+           (double) (end - start) / 1000000000, (double) conns * FANIN_BYTES / 1024 / ((double) (end - start) / 1000000000));
+
+    finish(socks[0], lsock);
+    free(socks);
+    free(streamIds);
+    free(doneNano);
+}
+
+void bench_pingpong(void) {
+    int lsock;
+    int sock = serve_one(SERVERPORTBASE, 0, 0, &lsock);
+    char buf[PINGPONG_BYTES];
+    for (int r = 0; r < conns; ++r) {
+        if (stcp_server_recv(sock, buf, PINGPONG_BYTES) < 0 || stcp_server_send(sock, buf, PINGPONG_BYTES) < 0) {
+            printf("round %d failed\n", r);
+            exit(1);
+        }
+    }
+    stcp_stats_t s = sock_stats(sock);
+    printf("%d requests are answered\n", conns);
+    printf("server sent %lu DATA, %lu DATAACK, %lu ACKs piggybacked on DATA\n",
+           s.segsSent, s.acksSent, s.acksPiggybacked);
+
+    finish(sock, lsock);
+}
+
+void bench_msgpong(void) {
+    int lsock;
+    int sock = serve_one(SERVERPORTBASE, 0, 0, &lsock);
+    char buf[MSGPONG_BYTES];
+    void *msg = buf;
+    for (int r = 0; r < conns; ++r) {
+        int len = stcp_server_recv_msg(sock, &msg, MSGPONG_BYTES);
+        if (len < 0 || stcp_server_send_msg(sock, buf, (unsigned int) len) < 0) {
+            printf("round %d failed\n", r);
+            exit(1);
+        }
+    }
+    stcp_stats_t s = sock_stats(sock);
+    printf("%d messages are answered\n", conns);
+    printf("server sent %lu DATA, %lu DATAACK, %lu ACKs piggybacked on DATA\n",
+           s.segsSent, s.acksSent, s.acksPiggybacked);
+
+    finish(sock, lsock);
+}
+
+void bench_oneshot(void) {
+    stcp_server_setmaxconn(conns + 1);
+    int lsock = stcp_server_sock(SERVERPORTBASE);
+    if (lsock < 0 || stcp_server_listen(lsock, ACCEPT_BACKLOG) < 0 ||
+        stcp_server_setopt(lsock, STCP_OPT_FASTOPEN, 1) < 0) {
+        printf("can't create stcp server\n");
+        exit(1);
+    }
+    socks = (int *) malloc(conns * sizeof(int));
+    char buf[ONESHOT_BYTES];
+    int early = 0;
+    for (int i = 0; i < conns; ++i) {
+        socks[i] = stcp_server_accept(lsock);
+        if (socks[i] < 0) {
+            printf("connection %d failed\n", i);
+            exit(1);
+        }
+        //不等待地读, 读到数据说明请求随SYN到达
+        int got = stcp_server_recv_some(socks[i], buf, ONESHOT_BYTES, 0, 0);
+        if (got > 0) ++early;
+        if (got < 0 || (got < ONESHOT_BYTES && stcp_server_recv(socks[i], buf + got, ONESHOT_BYTES - got) < 0) ||
+            stcp_server_send(socks[i], buf, ONESHOT_BYTES) < 0) {
+            printf("connection %d failed\n", i);
+            exit(1);
+        }
+    }
+    printf("%d requests are answered, %d of them arrived with the SYN\n", conns, early);
+
+    finish_all(socks, conns, lsock);
+    free(socks);
+}
+
+// the word the client put at byte offset off of the soak upload, a wrong, lost or repeated chunk breaks the sequence
+static uint64_t soak_word(uint64_t off) {
+    return off * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+void bench_soak(int rate) {
+    int lsock;
+    int sock = serve_one(SERVERPORTBASE, STCP_OPT_RATE, rate, &lsock);
+    uint64_t total;
+    if (stcp_server_recv(sock, &total, sizeof(uint64_t)) < 0) {
+        printf("connection failed\n");
+        exit(1);
+    }
+    printf("soak: receiving %lu bytes\n", (unsigned long) total);
+    uint64_t *buf = (uint64_t *) malloc(SOAK_CHUNK);
+    uint64_t got = 0, bad = 0, report = SOAK_REPORT, lastGot = 0;
+    long start = now_nano(), last = start;
+    while (got < total) {
+        unsigned int len = total - got < SOAK_CHUNK ? (unsigned int) (total - got) : SOAK_CHUNK;
+        if (stcp_server_recv(sock, buf, len) < 0) {
+            printf("connection lost after %lu bytes\n", (unsigned long) got);
+            exit(1);
+        }
+        for (unsigned int k = 0; k < len / sizeof(uint64_t); ++k)
+            if (buf[k] != soak_word(got + k * sizeof(uint64_t))) ++bad;
+        got += len;
+        if (got >= report || got == total) {
+            long cur_nano = now_nano();
+            printf("soak: %.2f GB received, %.1f MB/s in the last interval, %lu bad words so far\n",
+                   (double) got / (1UL << 30),
+                   (double) (got - lastGot) / (1 << 20) / ((double) (cur_nano - last) / 1000000000),
+                   (unsigned long) bad);
+            last = cur_nano, lastGot = got;
+            report += SOAK_REPORT;
+        }
+    }
+    double sec = (double) (now_nano() - start) / 1000000000;
+    printf("soak: %lu bytes in %.3f s, %.1f MB/s, data %s\n", (unsigned long) total, sec,
+           (double) total / (1 << 20) / sec, bad == 0 ? "intact" : "corrupted");
+    char ok = bad == 0;
+    if (stcp_server_send(sock, &ok, 1) < 0) printf("fail to send the result\n");
+    free(buf);
+
+    finish(sock, lsock);
+}
+
+void bench_fec(void) {
+    int lsock;
+    int sock = serve_one(SERVERPORTBASE, STCP_OPT_FEC, 1, &lsock);
+    char *buf = (char *) malloc(FEC_BYTES);
+    for (int r = 0; r < conns; ++r) {
+        if (stcp_server_recv(sock, buf, FEC_BYTES) < 0 || stcp_server_send(sock, buf, FEC_BYTES) < 0) {
+            printf("round %d failed\n", r);
+            exit(1);
+        }
+    }
+    free(buf);
+    stcp_stats_t s = sock_stats(sock);
+    printf("%d requests are answered, FEC is %s\n", conns, s.fec ? "on" : "off");
+    printf("server sent %lu DATA and %lu parity segments, %lu segments of the client were rebuilt from parity\n",
+           s.segsSent, s.paritySent, s.parityRecovered);
+
+    finish(sock, lsock);
+}
+
+// the bulk connection of the tclass mode, its data is only counted
+void *tclass_sink(void *arg) {
+    int sock = (int) (long) arg;
+    char *buf = (char *) malloc(SOAK_CHUNK);
+    unsigned long got = 0;
+    int n;
+    while ((n = stcp_server_recv_some(sock, buf, SOAK_CHUNK, 1, -1)) > 0) got += (unsigned long) n;
+    printf("tclass: the bulk upload brought %lu bytes\n", got);
+    free(buf);
+    return NULL;
+}
+
+void bench_tclass(void) {
+    int bulkLsock = stcp_server_sock(SERVERPORTBASE), rpcLsock = stcp_server_sock(SERVERPORTBASE + 1);
+    if (bulkLsock < 0 || rpcLsock < 0 || stcp_server_setopt(bulkLsock, STCP_OPT_RATE, 1) < 0 ||
+        stcp_server_listen(bulkLsock, 1) < 0 || stcp_server_listen(rpcLsock, 1) < 0) {
+        printf("can't create stcp server\n");
+        exit(1);
+    }
+    // the client opens the bulk connection first
+    int bulkSock = stcp_server_accept(bulkLsock), rpcSock = stcp_server_accept(rpcLsock);
+    if (bulkSock < 0 || rpcSock < 0) {
+        printf("connection failed\n");
+        exit(1);
+    }
+    pthread_t tid;
+    pthread_create(&tid, NULL, tclass_sink, (void *) (long) bulkSock);
+    char buf[PINGPONG_BYTES];
+    for (int r = 0; r < conns; ++r) {
+        if (stcp_server_recv(rpcSock, buf, PINGPONG_BYTES) < 0 || stcp_server_send(rpcSock, buf, PINGPONG_BYTES) < 0) {
+            printf("request %d failed\n", r);
+            exit(1);
+        }
+    }
+    printf("tclass: %d requests are answered, the bulk connection is in class %u, the request connection in class %u\n",
+           conns, sock_stats(bulkSock).tclass, sock_stats(rpcSock).tclass);
+
+    //客户端先断开批量连接, 接收线程结束时它已进入CLOSEWAIT, 与请求连接一起等待超时
+    pthread_join(tid, NULL);
+    finish(rpcSock, rpcLsock);
+    stcp_server_close(bulkSock);
+    stcp_server_close(bulkLsock);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("usage: %s conns|fanin|epoll|handler|streams|pingpong|msgpong|oneshot|soak|fec|bulk|tclass [connections|rounds [workers]]\n", argv[0]);
+        exit(1);
+    }
+    //用于丢包率的随机数种子
+    srand(time(NULL));
+
+    //连接到SIP进程并获得TCP套接字描述符
+    int sip_conn = connectToSIP();
+    if (sip_conn < 0) {
+        printf("can not connect to the local SIP process\n");
+        exit(1);
+    }
+
+    //初始化STCP服务器
+    if (argc > 3) stcp_server_setworkers(atoi(argv[3]));
+    stcp_server_init(sip_conn);
+
+    if (strcmp(argv[1], "conns") == 0) {
+        conns = argc > 2 ? atoi(argv[2]) : DEFAULT_CONNS;
+        bench_conns();
+    } else if (strcmp(argv[1], "fanin") == 0) {
+        conns = argc > 2 ? atoi(argv[2]) : DEFAULT_FANIN;
+        bench_fanin();
+    } else if (strcmp(argv[1], "epoll") == 0) {
+        conns = argc > 2 ? atoi(argv[2]) : DEFAULT_FANIN;
+        bench_epoll();
+    } else if (strcmp(argv[1], "handler") == 0) {
+        conns = argc > 2 ? atoi(argv[2]) : DEFAULT_FANIN;
+        bench_handler();
+    } else if (strcmp(argv[1], "streams") == 0) {
+        conns = argc > 2 ? atoi(argv[2]) : DEFAULT_FANIN;
+        bench_streams();
+    } else if (strcmp(argv[1], "pingpong") == 0) {
+        conns = argc > 2 ? atoi(argv[2]) : DEFAULT_PINGPONG;
+        bench_pingpong();
+    } else if (strcmp(argv[1], "msgpong") == 0) {
+        conns = argc > 2 ? atoi(argv[2]) : DEFAULT_PINGPONG;
+        bench_msgpong();
+    } else if (strcmp(argv[1], "oneshot") == 0) {
+        conns = argc > 2 ? atoi(argv[2]) : DEFAULT_ONESHOT;
+        bench_oneshot();
+    } else if (strcmp(argv[1], "soak") == 0) {
+        bench_soak(0);
+    } else if (strcmp(argv[1], "bulk") == 0) {
+        // the path emulator drops the segments
+        seg_setlossrate(0);
+        bench_soak(1);
+    } else if (strcmp(argv[1], "fec") == 0) {
+        conns = argc > 2 ? atoi(argv[2]) : DEFAULT_FEC_ROUNDS;
+        bench_fec();
+    } else if (strcmp(argv[1], "tclass") == 0) {
+        // the path emulator drops the segments
+        seg_setlossrate(0);
+        conns = argc > 2 ? atoi(argv[2]) : DEFAULT_TCLASS_ROUNDS;
+        bench_tclass();
+    } else {
+        printf("unknown mode %s\n", argv[1]);
+        exit(1);
+    }
+
+    //断开与SIP进程之间的连接
+    disconnectToSIP(sip_conn);
+}
@@ -1,7 +1,8 @@
 //文件名: server/app_simple_server.c
 
 //描述: 这是简单版本的服务器程序代码. 服务器首先连接到本地SIP进程. 然后它调用stcp_server_init()初始化STCP服务器. 
-//它通过两次调用stcp_server_sock()和stcp_server_accept()创建2个套接字并等待来自客户端的连接. 服务器然后接收来自两个连接的客户端发送的短字符串. 
+//它通过两次调用stcp_server_sock()和stcp_server_accept()创建2个监听套接字并接受来自客户端的连接, stcp_server_accept()返回每个连接的套接字.
+//服务器然后接收来自两个连接的客户端发送的短字符串. 
 //最后, 服务器通过调用stcp_server_close()关闭套接字, 并断开与本地SIP进程的连接.
 
 //输入: 无
@@ -72,7 +73,11 @@ int main(void) {
         exit(1);
     }
     //监听并接受来自STCP客户端的连接
-    stcp_server_accept(sockfd);
+    int connfd = stcp_server_accept(sockfd);
+    if (connfd < 0) {
+        printf("can't accept stcp connection\n");
+        exit(1);
+    }
 
     //在端口SERVERPORT2上创建另一个STCP服务器套接字
     int sockfd2 = stcp_server_sock(SERVERPORT2);
@@ -81,25 +86,33 @@ int main(void) {
         exit(1);
     }
     //监听并接受来自STCP客户端的连接
-    stcp_server_accept(sockfd2);
+    int connfd2 = stcp_server_accept(sockfd2);
+    if (connfd2 < 0) {
+        printf("can't accept stcp connection\n");
+        exit(1);
+    }
 
     char buf1[6];
     char buf2[7];
     int i;
     //接收来自第一个连接的字符串
     for (i = 0; i < 5; i++) {
-        stcp_server_recv(sockfd, buf1, 6);
+        stcp_server_recv(connfd, buf1, 6);
         printf("recv string: %s from connection 1\n", buf1);
     }
     //接收来自第二个连接的字符串
     for (i = 0; i < 5; i++) {
-        stcp_server_recv(sockfd2, buf2, 7);
+        stcp_server_recv(connfd2, buf2, 7);
         printf("recv string: %s from connection 2\n", buf2);
     }
 
     sleep(WAITTIME);
 
-    //关闭STCP服务器
+    //关闭STCP连接和服务器
+    if (stcp_server_close(connfd) < 0 || stcp_server_close(connfd2) < 0) {
+        printf("can't close stcp connection\n");
+        exit(1);
+    }
     if (stcp_server_close(sockfd) < 0) {
         printf("can't destroy stcp server\n");
         exit(1);
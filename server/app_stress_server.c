@@ -1,11 +1,13 @@
 //文件名: server/app_stress_server.c
 
 //描述: 这是压力测试版本的服务器程序代码. 服务器首先连接到本地SIP进程. 然后它调用stcp_server_init()初始化STCP服务器.
-//它通过调用stcp_server_sock()和stcp_server_accept()创建套接字并等待来自客户端的连接. 它然后接收文件长度. 
-//在这之后, 它创建一个缓冲区, 接收文件数据并将它保存到receivedtext.txt文件中.
+//它通过调用stcp_server_sock()创建监听套接字, 然后反复调用stcp_server_accept()接受来自客户端的连接, 每个连接由一个线程处理,
+//所以多个客户端可以同时上传文件. 每个线程先接收8字节的文件长度, 在receivedtext.txt的末尾为文件预留同样长度的区域, 然后用
+//stcp_server_recv_file()把文件数据边接收边写入这个区域, 所以文件可以大于4GB, 也可以大于内存, 写磁盘和接收也互相重叠.
+//文件接收完后, 线程打印连接的传输统计.
 //最后, 服务器通过调用stcp_server_close()关闭套接字, 并断开与本地SIP进程的连接.
 
-//输入: 无
+//输入: [客户端数 [direct]], 客户端数默认为1, direct表示以O_DIRECT写入文件
 
 //输出: STCP服务器状态
 
@@ -18,6 +20,9 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <fcntl.h>
 
 #include "../common/constants.h"
 #include "stcp_server.h"
@@ -28,6 +33,13 @@
 //在接收的文件数据被保存后, 服务器等待15秒, 然后关闭连接.
 #define WAITTIME 20
 
+//receivedtext.txt, 每个连接写入它在文件末尾预留的区域, 所以不同连接的文件数据不会交织
+int fileFd;
+off_t fileEnd;
+pthread_mutex_t fileMutex = PTHREAD_MUTEX_INITIALIZER;
+//stcp_server_recv_file()的标志
+int sinkFlags;
+
 //这个函数连接到本地SIP进程的端口SIP_PORT. 如果TCP连接失败, 返回-1. 连接成功, 返回TCP套接字描述符, STCP将使用该描述符发送段.
 int connectToSIP(void) {
     struct sockaddr_in servAddr;
@@ -53,7 +65,54 @@ void disconnectToSIP(int sip_conn) {
     printf("[SIP]<disconnectToSIP> connection to SON is closed\n");
 }
 
-int main(void) {
+//这个函数打印连接的传输统计.
+void print_stats(int sockfd) {
+	stcp_stats_t s;
+	if (stcp_server_getstats(sockfd, &s) < 0) return;
+	printf("stats: %lu bytes in %lu DATA sent, %lu bytes in %lu DATA received, %lu DATA (%lu bytes) resent, %lu DATAACK sent\n",
+	       s.bytesSent, s.segsSent, s.bytesRcvd, s.segsRcvd, s.segsResent, s.bytesResent, s.acksSent);
+	printf("stats: %lu timeouts, %lu duplicate ACKs, cwnd %u, %u in flight, peer window %u, srtt %.3f ms, min rtt %.3f ms, rto %.3f ms\n",
+	       s.timeouts, s.dupAcks, s.cwnd, s.inFlight, s.peerWin, (double) s.srtt / 1000000, (double) s.minRtt / 1000000,
+	       (double) s.rto / 1000000);
+	printf("stats: %u bytes unread, %u bytes out of order\n", s.recvBuffered, s.oooBytes);
+}
+
+//这个线程处理一个连接: 首先接收文件长度, 然后接收文件数据并保存, 等待一会儿后关闭连接.
+void *recvfile(void *arg) {
+	int connfd = (int) (long) arg;
+	uint64_t fileLen;
+	if (stcp_server_recv(connfd, &fileLen, sizeof(uint64_t)) < 0) {
+		printf("can't receive file length\n");
+		return NULL;
+	}
+	printf("file length: %lu\n", (unsigned long) fileLen);
+	//将接收到的文件数据直接保存到文件receivedtext.txt中
+	pthread_mutex_lock(&fileMutex);
+	off_t off = fileEnd;
+	fileEnd += (off_t) fileLen;
+	pthread_mutex_unlock(&fileMutex);
+	if (stcp_server_recv_file(connfd, fileFd, off, fileLen, sinkFlags) < 0)
+		printf("file is not received completely\n");
+	print_stats(connfd);
+
+	//等待一会儿
+	sleep(WAITTIME);
+
+	if(stcp_server_close(connfd)<0)
+		printf("can't close stcp connection\n");
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	int clients = argc > 1 ? atoi(argv[1]) : 1;
+	if (argc > 2 && strcmp(argv[2], "direct") == 0) sinkFlags = STCP_SINK_DIRECT;
+	//新的文件数据追加在已有内容之后
+	fileFd = open("receivedtext.txt", O_WRONLY | O_CREAT, 0644);
+	if (fileFd < 0) {
+		printf("can't open receivedtext.txt\n");
+		exit(1);
+	}
+	fileEnd = lseek(fileFd, 0, SEEK_END);
 	//用于丢包率的随机数种子
 	srand(time(NULL));
 
@@ -72,25 +131,20 @@ int main(void) {
 		printf("can't create stcp server\n");
 		exit(1);
 	}
-	//监听并接受来自STCP客户端的连接 
-	stcp_server_accept(sockfd);
-
-	//首先接收文件长度, 然后接收文件数据
-	int fileLen;
-	stcp_server_recv(sockfd,&fileLen,sizeof(int));
-    printf("file length: %d\n", fileLen);
-	char* buf = (char*) malloc(fileLen);
-	stcp_server_recv(sockfd,buf,fileLen);
-
-	//将接收到的文件数据保存到文件receivedtext.txt中
-	FILE* f;
-	f = fopen("receivedtext.txt","a");
-	fwrite(buf,fileLen,1,f);
-	fclose(f);
-	free(buf);
-
-	//等待一会儿
-	sleep(WAITTIME);
+	//监听并接受来自STCP客户端的连接, 每个连接由一个线程接收
+	pthread_t *tids = (pthread_t *) malloc(clients * sizeof(pthread_t));
+	for (long i = 0; i < clients; i++) {
+		long connfd = stcp_server_accept(sockfd);
+		if (connfd < 0) {
+			printf("can't accept stcp connection\n");
+			exit(1);
+		}
+		pthread_create(&tids[i], NULL, recvfile, (void *) connfd);
+	}
+	for (int i = 0; i < clients; i++)
+		pthread_join(tids[i], NULL);
+	free(tids);
+	close(fileFd);
 
 	//关闭STCP服务器 
 	if(stcp_server_close(sockfd)<0) {
@@ -7,15 +7,171 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <poll.h>
 #include <assert.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
 #include "stcp_server.h"
 #include "../topology/topology.h"
 #include "../common/helper.h"
+#include "../common/tcbtable.h"
 
 //声明tcbtable为全局变量
-server_tcb_t *TCB[MAX_TRANSPORT_CONNECTIONS];
-//声明到SIP进程的连接为全局变量
-int sip_conn;
+tcbtable_t *tcbTable;
+#define TCB(sock) ((server_tcb_t *) tcbtable_get(tcbTable, (sock)))
+//到SIP进程的连接
+static int sip_conn;
+static void *seghandler(void *arg);
+
+//seghandler交给工作线程的一个段
+typedef struct segItem {
+    int srcNodeID;                  //源节点ID
+    seg_t seg;                      //段
+} segItem_t;
+
+//段处理线程. 每个连接按(客户端节点ID, 客户端端口号, 服务器端口号)的哈希值固定属于一个工作线程, 同一连接的段按到达顺序处理,
+//连接的接收状态和下面的队列只由它所属的工作线程访问, 无需加锁. 没有工作线程时seghandler自己使用segWorkers[0]处理所有段.
+typedef struct segWorker {
+    pthread_t tid;
+    segItem_t *items;               //seghandler到工作线程的段队列, 长度为SEG_QUEUE_LEN
+    unsigned int head, tail;        //队列的读写位置, 由lock保护
+    int stop;                       //到SIP进程的连接已关闭, 处理完队列中的段后退出
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;        //队列由空变为非空或stop被设置时发出信号
+    pthread_cond_t notFull;         //队列由满变为不满时发出信号
+    //等待延迟确认的连接
+    ackq_t ackQueue;
+    //所属连接的链表, 下标为WORKER_*, 连接按加入的顺序排列, 所以CLOSEWAIT链表也按进入CLOSEWAIT的时间排序
+    server_tcb_t *listHead[WORKER_LISTS];
+    server_tcb_t *listTail[WORKER_LISTS];
+    //上一次归还空闲连接的块的时间
+    long lastTrimScan;
+    //被应用程序关闭的连接和被关闭的监听套接字留下的尚未被接受的连接. 工作线程可能正在处理它们的段, 它们也可能还在
+    //延迟确认队列和上面的链表中, 所以由工作线程释放. 由orphanMutex保护
+    server_tcb_t *orphanHead;
+    //被关闭的监听套接字. 任何工作线程都可能正在为它处理SYN, 所以每个工作线程各持有一个引用, 最后放开它的工作线程释放它.
+    //由orphanMutex保护
+    struct listenerRef *listenerOrphans;
+} segWorker_t;
+
+//被关闭的监听套接字在一个工作线程中的引用
+typedef struct listenerRef {
+    server_tcb_t *tcb;
+    struct listenerRef *next;
+} listenerRef_t;
+
+//stcp_server_recv_file()的暂存缓冲区队列. 接收线程填充缓冲区并交给写线程, 写线程按顺序把它们写入文件.
+typedef struct fileSink {
+    char *bufs[SINK_BUFS];          //SINK_ALIGN对齐的暂存缓冲区, 每个SINK_CHUNK字节
+    unsigned int lens[SINK_BUFS];   //交出的缓冲区中数据的长度
+    off_t offs[SINK_BUFS];          //交出的缓冲区中数据在文件中的偏移
+    unsigned int head, tail;        //写线程和接收线程的位置, 由lock保护
+    int fd;                         //写入的文件
+    int directFd;                   //以O_DIRECT打开的同一个文件, 没有时为-1
+    int done;                       //接收线程不再交出缓冲区
+    int error;                      //写文件失败
+    pthread_mutex_t lock;
+    pthread_cond_t cond;            //队列变化时被广播
+} fileSink_t;
+
+static segWorker_t *segWorkers;
+//工作线程数, 0表示seghandler自己处理所有段
+static unsigned int segWorkerNum;
+static pthread_mutex_t orphanMutex = PTHREAD_MUTEX_INITIALIZER;
+//计算快速打开cookie的密钥, 由stcp_server_init()随机生成
+static unsigned int cookieSecret;
+
+static void *segworker(void *arg);
+
+// the worker that owns the connection (node, client port, server port)
+static segWorker_t *seg_worker(unsigned int client_nodeID, unsigned int client_port, unsigned int server_port) {
+    if (segWorkerNum == 0) return &segWorkers[0];
+    return &segWorkers[tcbtable_hash(client_nodeID, client_port, server_port) % segWorkerNum];
+}
+
+// append a connection to one of the lists of the worker owning it, if it is not there yet
+static void worker_list_add(segWorker_t *w, int list, server_tcb_t *tcb) {
+    if (tcb->workerListed[list]) return;
+    tcb->workerListed[list] = 1;
+    tcb->workerNext[list] = NULL;
+    tcb->workerPrev[list] = w->listTail[list];
+    if (w->listTail[list]) w->listTail[list]->workerNext[list] = tcb;
+    else w->listHead[list] = tcb;
+    w->listTail[list] = tcb;
+}
+
+// remove a connection from one of the lists of the worker owning it, if it is there
+static void worker_list_del(segWorker_t *w, int list, server_tcb_t *tcb) {
+    if (!tcb->workerListed[list]) return;
+    tcb->workerListed[list] = 0;
+    server_tcb_t *prev = tcb->workerPrev[list], *next = tcb->workerNext[list];
+    if (prev) prev->workerNext[list] = next;
+    else w->listHead[list] = next;
+    if (next) next->workerPrev[list] = prev;
+    else w->listTail[list] = prev;
+}
+
+// hand a connection whose keys are unbound and whose socket ID is released to the worker owning it,
+// which frees it once it is done with the segments it may be handling
+static void worker_orphan(server_tcb_t *tcb) {
+    segWorker_t *w = seg_worker(tcb->client_nodeID, tcb->client_portNum, tcb->server_portNum);
+    pthread_mutex_lock(&orphanMutex);
+    tcb->acceptNext = w->orphanHead;
+    __atomic_store_n(&w->orphanHead, tcb, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&orphanMutex);
+}
+
+// hand a socket bound to (any node, any port, server port) whose key is unbound and whose socket ID is released
+// to every worker, any of them may be handling a SYN for it. the last one done with it frees it
+static void listener_orphan(server_tcb_t *tcb) {
+    unsigned int n = max(segWorkerNum, 1);
+    pthread_mutex_lock(&orphanMutex);
+    tcb->orphanRefs = n;
+    for (unsigned int i = 0; i < n; ++i) {
+        listenerRef_t *ref = new(listenerRef_t);
+        ref->tcb = tcb;
+        ref->next = segWorkers[i].listenerOrphans;
+        __atomic_store_n(&segWorkers[i].listenerOrphans, ref, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&orphanMutex);
+}
+
+// tell the application polling the eventfd of the tcb that something happened on it
+static void tcb_event(server_tcb_t *tcb) {
+    int fd = __atomic_load_n(&tcb->eventFd, __ATOMIC_ACQUIRE);
+    if (fd >= 0) eventfd_write(fd, 1);
+}
+
+// wake up the threads blocked on the tcb and the application polling its eventfd
+static void tcb_notify(server_tcb_t *tcb) {
+    pthread_mutex_lock(tcb->bufMutex);
+    pthread_cond_broadcast(tcb->stateCond);
+    tcb_event(tcb);
+    pthread_mutex_unlock(tcb->bufMutex);
+}
+
+// hand the data in the receive buffer of stream 0 to the data handler, what it releases leaves the buffer
+static void tcb_deliver(server_tcb_t *tcb) {
+    if (__atomic_load_n(&tcb->onData, __ATOMIC_ACQUIRE) == NULL) return;
+    pthread_mutex_lock(tcb->deliverMutex);
+    struct iovec iov[RINGBUF_VIEWS(RECEIVE_BUF_SIZE)];
+    int n = tcb->onData ? stream_views(&tcb->st, iov, RINGBUF_VIEWS(RECEIVE_BUF_SIZE)) : 0;
+    if (n > 0) {
+        unsigned int total = 0;
+        for (int i = 0; i < n; ++i) total += (unsigned int) iov[i].iov_len;
+        unsigned int released = tcb->onData(tcb->sockfd, iov, n, tcb->handlerCtx);
+        stream_consume(&tcb->st, min(released, total));
+    }
+    pthread_mutex_unlock(tcb->deliverMutex);
+}
+
+// call the close handler once, when the client sent its FIN or the connection went away
+static void tcb_closed(server_tcb_t *tcb) {
+    if (__atomic_load_n(&tcb->onData, __ATOMIC_ACQUIRE) == NULL) return;
+    if (__atomic_exchange_n(&tcb->closeNotified, 1, __ATOMIC_ACQ_REL)) return;
+    if (tcb->onClose) tcb->onClose(tcb->sockfd, tcb->handlerCtx);
+}
 
 /*********************************************************************/
 //
@@ -23,12 +179,26 @@ int sip_conn;
 //
 /*********************************************************************/
 
-// 这个函数初始化TCB表, 将所有条目标记为NULL. 它还针对TCP套接字描述符conn初始化一个STCP层的全局变量, 
-// 该变量作为sip_sendseg和sip_recvseg的输入参数. 最后, 这个函数启动seghandler线程来处理进入的STCP段.
+// 这个函数创建一个空的TCB表, 最大连接数为MAX_TRANSPORT_CONNECTIONS. 它还针对TCP套接字描述符conn初始化一个STCP层的全局变量, 
+// 该变量作为sip_sendseg和sip_recvseg的输入参数. 最后, 这个函数启动stcp_server_setworkers()设置的工作线程和seghandler线程来处理进入的STCP段.
 // 服务器只有一个seghandler.
 void stcp_server_init(int conn) {
     sip_conn = conn;
-    bzero(TCB, sizeof(TCB));
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0 || read(fd, &cookieSecret, sizeof(cookieSecret)) != sizeof(cookieSecret))
+        cookieSecret = (unsigned int) now_nano();
+    if (fd >= 0) close(fd);
+    stream_setconn(conn);
+    tcbTable = tcbtable_create(MAX_TRANSPORT_CONNECTIONS);
+    segWorkers = (segWorker_t *) calloc(max(segWorkerNum, 1), sizeof(segWorker_t));
+    for (unsigned int i = 0; i < segWorkerNum; ++i) {
+        segWorker_t *w = &segWorkers[i];
+        w->items = new_n(segItem_t, SEG_QUEUE_LEN);
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->notEmpty, NULL);
+        pthread_cond_init(&w->notFull, NULL);
+        pthread_create(&w->tid, NULL, segworker, w);
+    }
     pthread_t tid;
     pthread_attr_t attr;
     pthread_attr_init(&attr);
@@ -36,18 +206,15 @@ void stcp_server_init(int conn) {
     pthread_create(&tid, &attr, seghandler, NULL);
 }
 
-// 这个函数查找服务器TCB表以找到第一个NULL条目, 然后使用malloc()为该条目创建一个新的TCB条目.
-// 该TCB中的所有字段都被初始化, 例如, TCB state被设置为CLOSED, 服务器端口被设置为函数调用参数server_port. 
-// TCB表中条目的索引应作为服务器的新套接字ID被这个函数返回, 它用于标识服务器端的连接. 
-// 如果TCB表中没有条目可用, 这个函数返回-1.
-int stcp_server_sock(unsigned int server_port) {
-    int i_sock = 0;
-    for (; i_sock < MAX_TRANSPORT_CONNECTIONS && TCB[i_sock]; ++i_sock);
-    assert(i_sock <= MAX_TRANSPORT_CONNECTIONS);
-    if (i_sock == MAX_TRANSPORT_CONNECTIONS)return -1;
-
-    TCB[i_sock] = new(server_tcb_t);
-    server_tcb_t *entry = TCB[i_sock];
+// allocate and initialize a CLOSED tcb on server_port, returns its socket ID or -1 at the connection limit
+static int tcb_create(unsigned int server_port) {
+    server_tcb_t *entry = tcbtable_newtcb(sizeof(server_tcb_t));
+    int i_sock = tcbtable_alloc(tcbTable, entry);
+    if (i_sock < 0) {
+        free(entry);
+        return -1;
+    }
+    entry->sockfd = i_sock;
     // initialize server node ID & port
     entry->server_portNum = server_port;
     entry->server_nodeID = topology_getMyNodeID();
@@ -57,162 +224,884 @@ int stcp_server_sock(unsigned int server_port) {
     // stcp is not ready before stcp_server_accept
     entry->bufMutex = new(pthread_mutex_t);
     pthread_mutex_init(entry->bufMutex, NULL);
+    // accept sleeps on it until seghandler queues a connection
+    entry->stateCond = new(pthread_cond_t);
+    pthread_cond_init(entry->stateCond, NULL);
     entry->state = CLOSED;
-    entry->expect_seqNum = 0;
-    entry->recvBuf = (char *) malloc(RECEIVE_BUF_SIZE);
-    entry->usedBufLen = 0;
+    // the server opens the even streams, stream 0 is the connection itself
+    stream_group_init(&entry->sg, &entry->st, entry->bufMutex, entry->stateCond, 2);
+    // the SYNACK carries sequence number 0, data of the server starts after it
+    entry->st.next_seqNum = 1;
+    entry->st.localPort = server_port;
+    entry->backlog = 0;
+    entry->acceptNum = 0;
+    entry->acceptHead = entry->acceptTail = entry->acceptNext = NULL;
+    entry->nonblock = 0;
+    entry->eventFd = -1;
+    entry->tclass = -1;
+    entry->onData = NULL;
+    entry->onClose = NULL;
+    entry->handlerCtx = NULL;
+    entry->deliverMutex = new(pthread_mutex_t);
+    pthread_mutex_init(entry->deliverMutex, NULL);
+    entry->closeNotified = 0;
+    entry->idleRcvd = 0;
+    return i_sock;
+}
+
+// free a tcb whose keys are already unbound and whose socket ID is released
+static void tcb_free(server_tcb_t *tcb) {
+    stream_group_free(&tcb->sg);
+    pthread_mutex_destroy(tcb->bufMutex);
+    free(tcb->bufMutex);
+    pthread_cond_destroy(tcb->stateCond);
+    free(tcb->stateCond);
+    pthread_mutex_destroy(tcb->deliverMutex);
+    free(tcb->deliverMutex);
+    if (tcb->eventFd >= 0) close(tcb->eventFd);
+    free(tcb);
+}
+
+// 这个函数创建一个新的TCB条目, 并从TCB表中为它分配一个套接字ID, 被关闭的套接字ID会被优先回收使用.
+// 该TCB中的所有字段都被初始化, 例如, TCB state被设置为CLOSED, 服务器端口被设置为函数调用参数server_port. 
+// 分配的套接字ID被这个函数返回, 它用于标识服务器端的连接. 套接字以(任意节点, 任意端口, server_port)登记到TCB表的哈希表中.
+// 如果连接数已达到上限或者server_port已被占用, 这个函数返回-1.
+int stcp_server_sock(unsigned int server_port) {
+    if (tcbtable_lookup(tcbTable, TCB_ANY, TCB_ANY, server_port) >= 0) {
+        printf("[Server] port %u is in use\n", server_port);
+        return -1;
+    }
+    int i_sock = tcb_create(server_port);
+    if (i_sock >= 0) tcbtable_bind(tcbTable, TCB_ANY, TCB_ANY, server_port, i_sock);
     return i_sock;
 }
 
-// 这个函数使用sockfd获得TCB指针, 并将连接的state转换为LISTENING. 它然后启动定时器进入忙等待直到TCB状态转换为CONNECTED 
-// (当收到SYN时, seghandler会进行状态的转换). 该函数在一个无穷循环中等待TCB的state转换为CONNECTED,  
-// 当发生了转换时, 该函数返回1. 你可以使用不同的方法来实现这种阻塞等待.
+// 这个函数使用sockfd获得TCB指针, 并将套接字的state转换为LISTENING. 此后每个来自新客户端的SYN都会创建一个子连接,
+// 并被加入接受队列, 接受队列中最多有backlog个连接. 成功时返回1, 套接字不存在或不处于CLOSED状态时返回-1.
+int stcp_server_listen(int sockfd, unsigned int backlog) {
+    server_tcb_t *entry = TCB(sockfd);
+    if (entry == NULL) return -1;
+    pthread_mutex_lock(entry->bufMutex);
+    if (entry->state != CLOSED) {
+        pthread_mutex_unlock(entry->bufMutex);
+        return -1;
+    }
+    entry->backlog = backlog;
+    entry->state = LISTENING;
+    pthread_mutex_unlock(entry->bufMutex);
+    printf("[Server] listen on socket %d\n", sockfd);
+    return 1;
+}
+
+// 这个函数使用sockfd获得监听套接字的TCB指针, 必要时先调用stcp_server_listen(). 它然后阻塞在TCB的stateCond上直到接受队列非空
+// (seghandler为新的客户端创建连接后会广播stateCond), 取出队首的连接并返回它的套接字ID.
+// 如果到SIP进程的连接在此之前关闭, 返回-1. 非阻塞模式下接受队列为空时返回STCP_EAGAIN.
 int stcp_server_accept(int sockfd) {
-    server_tcb_t *entry = TCB[sockfd];
+    server_tcb_t *entry = TCB(sockfd);
     if (entry == NULL) {
         perror("[Server] accept: client socket invalid\n");
         return -2;
-    } else if (entry->state != CLOSED) {
-        perror("[Server] accept: connection is not closed\n");
+    }
+    if (entry->state == CLOSED) stcp_server_listen(sockfd, ACCEPT_BACKLOG);
+    pthread_mutex_lock(entry->bufMutex);
+    if (entry->state != LISTENING) {
+        pthread_mutex_unlock(entry->bufMutex);
+        perror("[Server] accept: socket is not listening\n");
         return -3;
     }
-    printf("[Server] listen on socket %d\n", sockfd);
-    entry->state = LISTENING;
-    while (entry->state == LISTENING) {
-        usleep(nstoms(ACCEPT_POLLING_INTERVAL));
+    if (entry->nonblock && entry->acceptHead == NULL) {
+        pthread_mutex_unlock(entry->bufMutex);
+        return STCP_EAGAIN;
+    }
+    while (entry->acceptHead == NULL && entry->state == LISTENING) {
+        pthread_cond_wait(entry->stateCond, entry->bufMutex);
     }
-    if (entry->state == CLOSED) {
+    server_tcb_t *child = entry->acceptHead;
+    if (child == NULL) {
         // son connection is closed;
+        pthread_mutex_unlock(entry->bufMutex);
         return -1;
     }
-    return 1;
+    entry->acceptHead = child->acceptNext;
+    if (entry->acceptHead == NULL) entry->acceptTail = NULL;
+    --entry->acceptNum;
+    child->acceptNext = NULL;
+    pthread_mutex_unlock(entry->bufMutex);
+    return child->sockfd;
 }
 
-// 接收来自STCP客户端的数据. 这个函数每隔RECVBUF_POLLING_INTERVAL时间
-// 就查询接收缓冲区, 直到等待的数据到达, 它然后存储数据并返回1. 如果这个函数失败, 则返回-1.
+// 接收来自STCP客户端的数据. 这个函数阻塞在TCB的stateCond上, seghandler每次向接收缓冲区追加数据时都会唤醒它,
+// 直到等待的数据到达, 它然后存储数据并返回0. 如果这个函数失败, 则返回-1.
+// 非阻塞模式下数据不足时不等待, 返回STCP_EAGAIN.
 int stcp_server_recv(int sockfd, void *buf, unsigned int length) {
-    server_tcb_t *tcb = TCB[sockfd];
+    server_tcb_t *tcb = TCB(sockfd);
     if (tcb == NULL || tcb->state != CONNECTED) {
         printf("[Server] missing socket or socket is not connected\n");
         return -1;
     }
     long int start_nano = now_nano();
-    while (tcb->usedBufLen < length) {
-        sleep(RECVBUF_POLLING_INTERVAL);
-        if (tcb->state != CONNECTED) return -1;
-    }
-    // data is ready
     pthread_mutex_lock(tcb->bufMutex);
-    memcpy(buf, tcb->recvBuf, length);
-    tcb->usedBufLen -= length;
-    memmove(tcb->recvBuf, tcb->recvBuf + length, tcb->usedBufLen);
+    if (!tcb->nonblock) stream_wait(&tcb->st, length, -1);
+    else stream_want(&tcb->st, length);
+    unsigned int state = tcb->state;
     pthread_mutex_unlock(tcb->bufMutex);
+    if (ringbuf_used(tcb->st.recvBuf) < length) {
+        // not there yet, or the connection is gone before the whole request arrived
+        return tcb->nonblock && state == CONNECTED ? STCP_EAGAIN : -1;
+    }
+    // data is ready, seghandler only appends so the bytes stay there without the lock
+    stream_read(&tcb->st, buf, length);
     printf("[Server] receive is done, costs %f s\n", (float) nstos(now_nano() - start_nano));
     return 0;
 }
 
-// 这个函数调用free()释放TCB条目. 它将该条目标记为NULL, 成功时(即位于正确的状态)返回1,
+// stcp_server_recv的部分读取版本. 这个函数等待直到接收缓冲区中至少有min_bytes字节(不超过length), 或等待了timeout纳秒,
+// 然后将缓冲区中已有的数据(最多length字节)拷贝到buf中. timeout为负数时一直等待, 为0时不等待.
+// 返回拷贝的字节数, 超时且没有数据时返回0. 如果套接字不存在, 或连接已不处于CONNECTED状态且缓冲区为空, 返回-1.
+// 非阻塞模式下从不等待, 没有数据时返回STCP_EAGAIN.
+int stcp_server_recv_some(int sockfd, void *buf, unsigned int length, unsigned int min_bytes, long timeout) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) {
+        printf("[Server] recv_some: missing socket\n");
+        return -1;
+    }
+    pthread_mutex_lock(tcb->bufMutex);
+    if (!tcb->nonblock) stream_wait(&tcb->st, min(min_bytes, length), timeout < 0 ? -1 : now_nano() + timeout);
+    unsigned int state = tcb->state;
+    pthread_mutex_unlock(tcb->bufMutex);
+    unsigned int got = stream_read(&tcb->st, buf, length);
+    if (got == 0 && state != CONNECTED) return -1;
+    if (got == 0 && tcb->nonblock) return STCP_EAGAIN;
+    return (int) got;
+}
+
+// 发送数据给STCP客户端. 数据被分片为段放入TCB的发送缓冲区, 根据滑动窗口的情况立即发出或等待, 每个DATA段都捎带当前的累计确认.
+// 成功时返回1, 否则返回-1. 非阻塞模式下发送缓冲区超过SEND_BUF_SEGS个段时返回STCP_EAGAIN.
+int stcp_server_send(int sockfd, void *data, unsigned int length) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) {
+        printf("[Server] send error: tcb missing or not connected\n");
+        return -1;
+    }
+    return stream_send(&tcb->st, data, length, tcb->nonblock, 0);
+}
+
+// stcp_server_send()的聚集版本, 段直接从iovcnt个缓冲区构造. 返回值与stcp_server_send()相同.
+int stcp_server_sendv(int sockfd, const struct iovec *iov, int iovcnt) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) {
+        printf("[Server] sendv error: tcb missing or not connected\n");
+        return -1;
+    }
+    return stream_sendv(&tcb->st, iov, iovcnt, tcb->nonblock, 0);
+}
+
+// stcp_server_recv()的分散版本, 数据到齐后直接从接收缓冲区分散到iovcnt个缓冲区中. 返回值与stcp_server_recv()相同.
+int stcp_server_recvv(int sockfd, const struct iovec *iov, int iovcnt) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) {
+        printf("[Server] missing socket or socket is not connected\n");
+        return -1;
+    }
+    return stream_recvv(&tcb->st, iov, iovcnt, tcb->nonblock);
+}
+
+// write len bytes at off, blocks that are aligned in memory, length and offset go through the direct descriptor
+static int sink_write(fileSink_t *s, const char *buf, unsigned int len, off_t off) {
+    while (len > 0) {
+        int direct = s->directFd >= 0 && off % SINK_ALIGN == 0 && len % SINK_ALIGN == 0;
+        ssize_t n = pwrite(direct ? s->directFd : s->fd, buf, len, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (unsigned int) n;
+        off += n;
+    }
+    return 0;
+}
+
+// the writer thread of stcp_server_recv_file, writes the handed over buffers in order until the receiver is done
+static void *sink_writer(void *arg) {
+    fileSink_t *s = (fileSink_t *) arg;
+    pthread_mutex_lock(&s->lock);
+    while (1) {
+        while (s->head == s->tail && !s->done) pthread_cond_wait(&s->cond, &s->lock);
+        if (s->head == s->tail) break;
+        unsigned int i = s->head % SINK_BUFS;
+        int error = s->error;
+        pthread_mutex_unlock(&s->lock);
+        // the receiver does not touch a buffer it has handed over until head passes it
+        if (!error && sink_write(s, s->bufs[i], s->lens[i], s->offs[i]) < 0) error = 1;
+        pthread_mutex_lock(&s->lock);
+        s->error = error;
+        ++s->head;
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+// 从连接接收length字节并由后台写线程写入fd从offset开始的位置, 接收网络数据和写磁盘重叠进行.
+// 全部数据被写入后返回0, 连接在数据到齐之前关闭或写文件失败时返回-1.
+int stcp_server_recv_file(int sockfd, int fd, off_t offset, uint64_t length, int flags) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) {
+        printf("[Server] missing socket or socket is not connected\n");
+        return -1;
+    }
+    long int start_nano = now_nano();
+    fileSink_t s;
+    memset(&s, 0, sizeof s);
+    s.fd = fd;
+    s.directFd = -1;
+    if (flags & STCP_SINK_DIRECT) {
+        // a second open file description, so that O_DIRECT does not change fd for the caller
+        char path[32];
+        snprintf(path, sizeof path, "/proc/self/fd/%d", fd);
+        s.directFd = open(path, O_WRONLY | O_DIRECT | O_CLOEXEC);
+    }
+    for (int i = 0; i < SINK_BUFS; ++i) {
+        if (posix_memalign((void **) &s.bufs[i], SINK_ALIGN, SINK_CHUNK) != 0) exit(1);
+    }
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.cond, NULL);
+    pthread_t tid;
+    pthread_create(&tid, NULL, sink_writer, &s);
+
+    uint64_t got = 0;
+    // the first block ends at a SINK_CHUNK boundary of the file, so that the blocks after it are aligned
+    unsigned int cap = SINK_CHUNK - (unsigned int) (offset % SINK_CHUNK);
+    while (got < length) {
+        pthread_mutex_lock(&s.lock);
+        while (s.tail - s.head == SINK_BUFS) pthread_cond_wait(&s.cond, &s.lock);
+        int error = s.error;
+        pthread_mutex_unlock(&s.lock);
+        if (error) break;
+        unsigned int i = s.tail % SINK_BUFS, fill = 0;
+        if (cap > length - got) cap = (unsigned int) (length - got);
+        while (fill < cap) {
+            // wake up for a part of the receive buffer at a time, the rest of the window stays open meanwhile
+            pthread_mutex_lock(tcb->bufMutex);
+            stream_wait(&tcb->st, min(cap - fill, RECEIVE_BUF_SIZE / 4), -1);
+            pthread_mutex_unlock(tcb->bufMutex);
+            unsigned int n = stream_read(&tcb->st, s.bufs[i] + fill, cap - fill);
+            // the connection is gone and nothing is left
+            if (n == 0) break;
+            fill += n;
+        }
+        if (fill > 0) {
+            pthread_mutex_lock(&s.lock);
+            s.lens[i] = fill;
+            s.offs[i] = offset + (off_t) got;
+            ++s.tail;
+            pthread_cond_broadcast(&s.cond);
+            pthread_mutex_unlock(&s.lock);
+        }
+        got += fill;
+        if (fill < cap) break;
+        cap = SINK_CHUNK;
+    }
+
+    pthread_mutex_lock(&s.lock);
+    s.done = 1;
+    pthread_cond_broadcast(&s.cond);
+    pthread_mutex_unlock(&s.lock);
+    pthread_join(tid, NULL);
+    for (int i = 0; i < SINK_BUFS; ++i) free(s.bufs[i]);
+    if (s.directFd >= 0) close(s.directFd);
+    pthread_mutex_destroy(&s.lock);
+    pthread_cond_destroy(&s.cond);
+    printf("[Server] %lu bytes are written to the file, costs %f s\n", (unsigned long) got,
+           (float) nstos(now_nano() - start_nano));
+    return got == length && !s.error ? 0 : -1;
+}
+
+// 把数据作为一个消息发送给STCP客户端, 最后一个段带SEG_FLAG_EOM. 返回值与stcp_server_send()相同, length为0或超过RECEIVE_BUF_SIZE时返回-1.
+int stcp_server_send_msg(int sockfd, void *data, unsigned int length) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED || length == 0 || length > RECEIVE_BUF_SIZE) {
+        printf("[Server] send_msg error: tcb missing, not connected or bad length\n");
+        return -1;
+    }
+    return stream_send(&tcb->st, data, length, tcb->nonblock, 1);
+}
+
+// 接收一个完整的消息, 返回消息长度. *buf为NULL时消息被读入新分配的缓冲区, 否则读入长度为length的*buf,
+// 消息更长时返回STCP_EMSGSIZE. 连接在消息到达前断开时返回-1, 非阻塞模式下没有完整的消息时返回STCP_EAGAIN.
+int stcp_server_recv_msg(int sockfd, void **buf, unsigned int length) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) {
+        printf("[Server] recv_msg: missing socket\n");
+        return -1;
+    }
+    return stream_recv_msg(&tcb->st, buf, length, tcb->nonblock);
+}
+
+// 这个函数在连接sockfd内不经过握手打开一个新的流, 返回流ID. 连接不处于CONNECTED状态或流ID已用完时返回-1.
+int stcp_server_stream_open(int sockfd) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) return -1;
+    return stream_open(&tcb->sg);
+}
+
+// 这个函数返回客户端在连接sockfd内打开的下一个新流的ID, 没有新流时它阻塞在stateCond上.
+// 非阻塞模式下没有新流时返回STCP_EAGAIN. 连接断开时返回-1.
+int stcp_server_stream_accept(int sockfd) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    return stream_accept(&tcb->sg, tcb->nonblock);
+}
+
+// 这个函数在连接sockfd的流stream_id上发送数据, 与stcp_server_send()相同. 流不存在时返回-1.
+int stcp_server_stream_send(int sockfd, int stream_id, void *data, unsigned int length) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL || tcb->state != CONNECTED) return -1;
+    stream_t *st = stream_find(&tcb->sg, stream_id);
+    if (st == NULL) return -1;
+    return stream_send(st, data, length, tcb->nonblock, 0);
+}
+
+// 这个函数从连接sockfd的流stream_id接收恰好length字节, 与stcp_server_recv()相同. 流不存在时返回-1.
+int stcp_server_stream_recv(int sockfd, int stream_id, void *buf, unsigned int length) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    stream_t *st = stream_find(&tcb->sg, stream_id);
+    if (st == NULL) return -1;
+    return stream_recv(st, buf, length, tcb->nonblock);
+}
+
+// 这个函数关闭连接sockfd的流stream_id. 成功时返回1, 流不存在或stream_id为0时返回-1.
+int stcp_server_stream_close(int sockfd, int stream_id) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    return stream_close(&tcb->sg, stream_id);
+}
+
+// 这个函数设置套接字选项opt的值为value. 成功时返回1, 套接字不存在或选项未知时返回-1.
+int stcp_server_setopt(int sockfd, int opt, int value) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    if (opt == STCP_OPT_CLASS && (value < 0 || value >= TC_NUM)) return -1;
+    // the segment threads and the timer read the options, every option is written under the lock
+    int ret = 1;
+    pthread_mutex_lock(tcb->bufMutex);
+    switch (opt) {
+        case STCP_OPT_DELAYACK:
+            tcb->st.delayAck = value != 0;
+            break;
+        case STCP_OPT_NONBLOCK:
+            tcb->nonblock = value != 0;
+            break;
+        case STCP_OPT_PACING:
+            tcb->sg.pacing = value != 0;
+            break;
+        case STCP_OPT_FASTOPEN:
+            tcb->fastOpen = value != 0;
+            break;
+        case STCP_OPT_FEC:
+            tcb->fec = value != 0;
+            break;
+        case STCP_OPT_RATE:
+            tcb->rate = value != 0;
+            break;
+        case STCP_OPT_CLASS:
+            tcb->tclass = value;
+            tcb->sg.tclass = (unsigned int) value;
+            break;
+        default:
+            ret = -1;
+    }
+    pthread_mutex_unlock(tcb->bufMutex);
+    return ret;
+}
+
+// 这个函数为套接字注册数据回调和关闭回调, 它们由处理段的线程调用. 注册时缓冲区中已有的数据立即交给on_data,
+// on_data为NULL时取消回调. 成功时返回1, 套接字不存在时返回-1.
+int stcp_server_set_handler(int sockfd, stcp_data_handler_t on_data, stcp_close_handler_t on_close, void *ctx) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    pthread_mutex_lock(tcb->deliverMutex);
+    tcb->onClose = on_close;
+    tcb->handlerCtx = ctx;
+    // the segment threads check onData without the lock, so it is published last
+    __atomic_store_n(&tcb->onData, on_data, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(tcb->deliverMutex);
+    // what arrived before the handler was set is not announced again
+    if (tcb->state == CONNECTED || tcb->state == CLOSEWAIT) tcb_deliver(tcb);
+    if (tcb->state == CLOSEWAIT) tcb_closed(tcb);
+    return 1;
+}
+
+// 这个函数调用free()释放TCB条目. 它从TCB表中删除该条目并回收套接字ID, 成功时(即位于正确的状态)返回1,
 // 失败时(即位于错误的状态)返回-1.
 int stcp_server_close(int sockfd) {
-    if (TCB[sockfd] == NULL) return 1;
-    if (TCB[sockfd] && (TCB[sockfd]->state == CLOSED || TCB[sockfd]->state == CLOSEWAIT)) {
-        pthread_mutex_destroy(TCB[sockfd]->bufMutex);
-        free(TCB[sockfd]->bufMutex);
-        free(TCB[sockfd]->recvBuf);
-        free(TCB[sockfd]);
-        TCB[sockfd] = NULL;
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return 1;
+    if (tcb->state == CLOSED || tcb->state == CLOSEWAIT) {
+        // a newer connection from the same client port may own the key by now
+        if (tcb->client_portNum != 0 &&
+            tcbtable_lookup(tcbTable, tcb->client_nodeID, tcb->client_portNum, tcb->server_portNum) == sockfd)
+            tcbtable_unbind(tcbTable, tcb->client_nodeID, tcb->client_portNum, tcb->server_portNum);
+        tcbtable_release(tcbTable, sockfd);
+        // the worker owning a connection may be reading it right now, so it frees it
+        if (tcb->client_portNum != 0) {
+            worker_orphan(tcb);
+        } else {
+            // a socket that never listened is still found by the SYNs for its port
+            if (tcbtable_lookup(tcbTable, TCB_ANY, TCB_ANY, tcb->server_portNum) == sockfd)
+                tcbtable_unbind(tcbTable, TCB_ANY, TCB_ANY, tcb->server_portNum);
+            listener_orphan(tcb);
+        }
+        return 1;
+    }
+    if (tcb->state == LISTENING) {
+        tcbtable_unbind(tcbTable, TCB_ANY, TCB_ANY, tcb->server_portNum);
+        // connections nobody has accepted go away with the listening socket, a worker still handling a SYN for it
+        // sees it CLOSED and gives its new connection up
+        pthread_mutex_lock(tcb->bufMutex);
+        server_tcb_t *child = tcb->acceptHead;
+        tcb->acceptHead = tcb->acceptTail = NULL;
+        tcb->state = CLOSED;
+        pthread_cond_broadcast(tcb->stateCond);
+        pthread_mutex_unlock(tcb->bufMutex);
+        while (child) {
+            server_tcb_t *next = child->acceptNext;
+            tcbtable_unbind(tcbTable, child->client_nodeID, child->client_portNum, child->server_portNum);
+            tcbtable_release(tcbTable, child->sockfd);
+            // it may sit in the delayed ACK queue, so the worker owning it frees it
+            worker_orphan(child);
+            child = next;
+        }
+        tcbtable_release(tcbTable, sockfd);
+        listener_orphan(tcb);
         return 1;
     }
     return -1;
 }
 
+// 这个函数返回套接字的eventfd, 第一次调用时创建它. 新创建的eventfd立即可读, 以免错过在它创建之前发生的事件. 失败时返回-1.
+int stcp_server_eventfd(int sockfd) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    pthread_mutex_lock(tcb->bufMutex);
+    if (tcb->eventFd < 0) {
+        int fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+        __atomic_store_n(&tcb->eventFd, fd, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(tcb->bufMutex);
+    return tcb->eventFd;
+}
+
+// 这个函数把连接的传输统计填入stats. 成功时返回1, 套接字不存在时返回-1.
+int stcp_server_getstats(int sockfd, stcp_stats_t *stats) {
+    server_tcb_t *tcb = TCB(sockfd);
+    if (tcb == NULL) return -1;
+    stream_group_stats(&tcb->sg, stats);
+    return 1;
+}
+
+// 这个函数修改服务器的最大连接数. 已经存在的连接不受影响.
+void stcp_server_setmaxconn(unsigned int max_conn) {
+    tcbtable_setlimit(tcbTable, max_conn);
+}
+
+// 这个函数设置所有接收缓冲区共用的内存预算, 它限制通告的接收窗口.
+void stcp_server_setrecvmem(unsigned long bytes) {
+    ringbuf_pool_budget(bytes);
+}
+
+// 这个函数设置处理进入的段的工作线程数, 必须在stcp_server_init()之前调用. 0表示由seghandler自己处理所有段.
+void stcp_server_setworkers(unsigned int workers) {
+    segWorkerNum = workers;
+}
+
 // 这是由stcp_server_init()启动的线程. 它处理所有来自客户端的进入数据. seghandler被设计为一个调用sip_recvseg()的无穷循环, 
-// 如果sip_recvseg()失败, 则说明到SIP进程的连接已关闭, 线程将终止. 根据STCP段到达时连接所处的状态, 可以采取不同的动作.
-// 请查看服务端FSM以了解更多细节.
+// 如果sip_recvseg()失败, 则说明到SIP进程的连接已关闭, 线程将终止. 段所属的连接先以(源节点ID, 源端口号, 目的端口号)在TCB表的哈希表中查找,
+// 找不到时再以(任意节点, 任意端口, 目的端口号)查找监听的套接字. 监听套接字只处理SYN, 它为每个新的客户端创建一个子连接.
+// 根据STCP段到达时连接所处的状态, 可以采取不同的动作. 请查看服务端FSM以了解更多细节.
+// 设置了工作线程时, seghandler只接收段, 并按段所属连接的哈希值把它放入一个工作线程的队列, 查找连接和状态机都由工作线程完成.
+// 处理段的线程同时负责发送到期的延迟确认: 在等待下一个段时, 它最多等待到延迟确认队列中第一个确认的截止时间.
+// 它还负责将超时的CLOSEWAIT连接转换到CLOSED, 只有存在CLOSEWAIT连接时才扫描TCB表, 且每秒最多扫描一次.
+// 它是库的内部线程, 不对应用程序导出.
 
-static inline int get_sip_sock(unsigned int dst_port) {
-    int j = 0;
-    for (; j < MAX_TRANSPORT_CONNECTIONS; ++j) {
-        if (TCB[j] && TCB[j]->server_portNum == dst_port)
-            break;
+// find the connection of a segment, a socket bound to the exact peer wins over the listening one
+static inline int get_sip_sock(int srcNodeID, seg_t *seg) {
+    unsigned int src_port = seg->header.src_port, dst_port = seg->header.dst_port;
+    int sock = tcbtable_lookup(tcbTable, srcNodeID, src_port, dst_port);
+    // a SYN from the port of a finished connection opens a new one on the listening socket
+    if (sock >= 0 && seg->header.type == SYN) {
+        server_tcb_t *tcb = TCB(sock);
+        if (tcb && tcb->state != CONNECTED) {
+            tcbtable_unbind(tcbTable, srcNodeID, src_port, dst_port);
+            sock = -1;
+        }
     }
-    if (j == MAX_TRANSPORT_CONNECTIONS)return -1;
-    return j;
+    if (sock < 0) sock = tcbtable_lookup(tcbTable, TCB_ANY, TCB_ANY, dst_port);
+    return sock;
 }
 
-void *seghandler(void *arg) {
-    int srcNodeID;
-    seg_t rcv_seg;
-    bzero(&rcv_seg, sizeof(seg_t));
-    while (1) {
-//        usleep(1);
-        int ret = sip_recvseg(sip_conn, &srcNodeID, &rcv_seg);
-        if (ret < 0)break;
-        if (ret > 0)continue;
-        int sock = get_sip_sock(rcv_seg.header.dst_port);
-        if (sock < 0)continue;
-        server_tcb_t *tcb = TCB[sock];
-        if (tcb->state == CLOSED)continue;
-        switch (rcv_seg.header.type) {
-            case SYN: {
-                assert(tcb->state == LISTENING || tcb->state == CONNECTED);
-                // SYN is received ready to send SYNACK
-                tcb->client_portNum = rcv_seg.header.src_port;
-                tcb->client_nodeID = srcNodeID;
-                tcb->expect_seqNum = rcv_seg.header.seq_num + 1;
-                seg_t *synack = create_seg(tcb->server_portNum, tcb->client_portNum, SYNACK,
-                                           0, tcb->expect_seqNum, 0, 0, NULL);
-                if (sip_sendseg(sip_conn, (int) tcb->client_nodeID, synack) < 0) exit(1);
-                printf("[Server] SYNACK is sent\n");
-                tcb->state = CONNECTED;
-                tcb->usedBufLen = 0;
-                free(synack);
-                break;
+// create the connection of a new client on a listening socket, NULL if the accept queue is full
+static server_tcb_t *syn_child(server_tcb_t *listener, int srcNodeID, unsigned int src_port) {
+    // the slot in the accept queue is taken right away, the SYNs of other clients may be handled by other workers
+    pthread_mutex_lock(listener->bufMutex);
+    if (listener->state != LISTENING) {
+        pthread_mutex_unlock(listener->bufMutex);
+        return NULL;
+    }
+    if (listener->acceptNum >= listener->backlog) {
+        pthread_mutex_unlock(listener->bufMutex);
+        printf("[Server] accept queue of port %u is full, SYN is dropped\n", listener->server_portNum);
+        return NULL;
+    }
+    ++listener->acceptNum;
+    pthread_mutex_unlock(listener->bufMutex);
+    int sock = tcb_create(listener->server_portNum);
+    pthread_mutex_lock(listener->bufMutex);
+    if (sock < 0) {
+        --listener->acceptNum;
+        pthread_mutex_unlock(listener->bufMutex);
+        return NULL;
+    }
+    server_tcb_t *child = TCB(sock);
+    child->client_nodeID = srcNodeID;
+    child->client_portNum = src_port;
+    child->st.remoteNodeID = srcNodeID;
+    child->st.remotePort = src_port;
+    child->st.established = 1;
+    // the options of the listening socket are set under its lock
+    child->st.delayAck = listener->st.delayAck;
+    child->nonblock = listener->nonblock;
+    child->fastOpen = listener->fastOpen;
+    child->fec = listener->fec;
+    child->rate = listener->rate;
+    child->tclass = listener->tclass;
+    child->sg.pacing = listener->sg.pacing;
+    pthread_mutex_unlock(listener->bufMutex);
+    child->onClose = listener->onClose;
+    child->handlerCtx = listener->handlerCtx;
+    child->onData = __atomic_load_n(&listener->onData, __ATOMIC_ACQUIRE);
+    child->state = CONNECTED;
+    tcbtable_bind(tcbTable, child->client_nodeID, child->client_portNum, child->server_portNum, sock);
+    return child;
+}
+
+// the fast open cookie of a client node, a keyed hash that only the nodes which got a SYNACK from us know
+static unsigned int fastopen_cookie(int nodeID) {
+    unsigned int h = (unsigned int) nodeID ^ cookieSecret;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h ^ cookieSecret;
+}
+
+// hand a new connection to stcp_server_accept in the slot syn_child took for it. returns 1 if it is queued,
+// 0 if the listening socket was closed meanwhile, the connection is then given to its worker to free
+static int accept_enqueue(server_tcb_t *listener, server_tcb_t *child) {
+    pthread_mutex_lock(listener->bufMutex);
+    if (listener->state != LISTENING) {
+        pthread_mutex_unlock(listener->bufMutex);
+        tcbtable_unbind(tcbTable, child->client_nodeID, child->client_portNum, child->server_portNum);
+        tcbtable_release(tcbTable, child->sockfd);
+        worker_orphan(child);
+        return 0;
+    }
+    if (listener->acceptTail) listener->acceptTail->acceptNext = child;
+    else listener->acceptHead = child;
+    listener->acceptTail = child;
+    pthread_cond_broadcast(listener->stateCond);
+    tcb_event(listener);
+    pthread_mutex_unlock(listener->bufMutex);
+    return 1;
+}
+
+// free the connections closed by the application or left in the accept queue of closed listening sockets,
+// and let go of the closed listening sockets, the worker holds none of them between segments
+static void orphan_reap(segWorker_t *w) {
+    if (__atomic_load_n(&w->orphanHead, __ATOMIC_ACQUIRE) == NULL &&
+        __atomic_load_n(&w->listenerOrphans, __ATOMIC_ACQUIRE) == NULL)
+        return;
+    pthread_mutex_lock(&orphanMutex);
+    server_tcb_t *tcb = w->orphanHead;
+    w->orphanHead = NULL;
+    listenerRef_t *ref = w->listenerOrphans;
+    w->listenerOrphans = NULL;
+    // the listening sockets the other workers are done with too
+    listenerRef_t *last = NULL;
+    while (ref) {
+        listenerRef_t *next = ref->next;
+        if (--ref->tcb->orphanRefs == 0) {
+            ref->next = last;
+            last = ref;
+        } else {
+            free(ref);
+        }
+        ref = next;
+    }
+    pthread_mutex_unlock(&orphanMutex);
+    while (last) {
+        listenerRef_t *next = last->next;
+        tcb_free(last->tcb);
+        free(last);
+        last = next;
+    }
+    while (tcb) {
+        server_tcb_t *next = tcb->acceptNext;
+        stream_group_ack_cancel(&w->ackQueue, &tcb->sg);
+        for (int l = 0; l < WORKER_LISTS; ++l) worker_list_del(w, l, tcb);
+        tcb_free(tcb);
+        tcb = next;
+    }
+}
+
+// move the expired CLOSEWAIT connections of the worker to CLOSED, they are listed in the order they expire
+static void closewait_expire(segWorker_t *w) {
+    long int cur_nano = now_nano();
+    server_tcb_t *tcb;
+    while ((tcb = w->listHead[WORKER_CLOSEWAIT]) &&
+           timeout_nano(cur_nano, tcb->t_close_wait, stons(CLOSEWAIT_TIMEOUT))) {
+        worker_list_del(w, WORKER_CLOSEWAIT, tcb);
+        tcb->state = CLOSED;
+        tcb_notify(tcb);
+    }
+}
+
+// give the chunks of the receive buffers of the idle connections of the worker back to the pool,
+// walking the connections that received data at most once every RECV_IDLE_TRIM seconds
+static void idle_trim(segWorker_t *w) {
+    long int cur_nano = now_nano();
+    if (w->listHead[WORKER_TRIM] == NULL || !timeout_nano(cur_nano, w->lastTrimScan, stons(RECV_IDLE_TRIM))) return;
+    w->lastTrimScan = cur_nano;
+    server_tcb_t *tcb = w->listHead[WORKER_TRIM];
+    while (tcb) {
+        server_tcb_t *next = tcb->workerNext[WORKER_TRIM];
+        if (tcb->state != CONNECTED && tcb->state != CLOSEWAIT) {
+            worker_list_del(w, WORKER_TRIM, tcb);
+        } else if (tcb->st.dataRcvd != tcb->idleRcvd) {
+            // data came in since the last scan, the connection is not idle
+            tcb->idleRcvd = tcb->st.dataRcvd;
+        } else if (!stream_group_trim(&tcb->sg)) {
+            // everything is read and given back, the next data lists it again
+            worker_list_del(w, WORKER_TRIM, tcb);
+        }
+        tcb = next;
+    }
+}
+
+// the timed work of a worker, returns how many milliseconds it may wait for the next segment, -1 for no limit
+static int worker_tick(segWorker_t *w) {
+    orphan_reap(w);
+    closewait_expire(w);
+    idle_trim(w);
+    // no longer than the first delayed ACK, the next CLOSEWAIT expiry check or the next trim may wait
+    int wait_ms = ackq_flush(&w->ackQueue);
+    if ((w->listHead[WORKER_CLOSEWAIT] || w->listHead[WORKER_TRIM]) && (wait_ms < 0 || wait_ms > 1000)) wait_ms = 1000;
+    return wait_ms;
+}
+
+// run the FSM of the connection a segment belongs to
+static void seg_process(segWorker_t *w, int srcNodeID, seg_t *seg) {
+    int sock = get_sip_sock(srcNodeID, seg);
+    if (sock < 0) return;
+    server_tcb_t *tcb = TCB(sock);
+    if (tcb == NULL || tcb->state == CLOSED) return;
+    // a listening socket only takes SYNs, anything else belongs to a connection that is gone
+    if (tcb->state == LISTENING && seg->header.type != SYN) return;
+    switch (seg->header.type) {
+        case SYN: {
+            server_tcb_t *listener = NULL;
+            if (tcb->state == LISTENING) {
+                // a new client gets its own connection, found by the exact key from now on
+                listener = tcb;
+                tcb = syn_child(listener, srcNodeID, seg->header.src_port);
+                if (tcb == NULL) break;
             }
-            case FIN: {
-                assert(tcb->state == CONNECTED || tcb->state == CLOSEWAIT);
-                seg_t *finack = create_seg(tcb->server_portNum, tcb->client_portNum, FINACK,
-                                           0, tcb->expect_seqNum, 0, 0, NULL);
-                if (sip_sendseg(sip_conn, (int) tcb->client_nodeID, finack) < 0) exit(1);
-                printf("[Server] FINACK for port %u is sent\n", tcb->client_portNum);
-                if (tcb->state == CONNECTED) {
-                    tcb->state = CLOSEWAIT;
-                    tcb->t_close_wait = now_nano();
+            assert(tcb->state == CONNECTED);
+            unsigned int cookie = fastopen_cookie(srcNodeID);
+            int cookie_ok = (seg->header.flags & SEG_FLAG_FASTOPEN) && seg->header.ack_num == cookie;
+            unsigned int fo_len = 0;
+            if (listener) {
+                // SYN is received ready to send SYNACK, a retransmitted SYN gets it again with the same ack
+                tcb->st.expect_seqNum = seg->header.seq_num + 1;
+                tcb->sg.fec = tcb->fec && (seg->header.flags & SEG_FLAG_FEC);
+                tcb->sg.rateMode = tcb->rate && (seg->header.flags & SEG_FLAG_RATE);
+                // the reply goes the way the request came unless the listening socket chose a class
+                tcb->sg.tclass = tcb->tclass >= 0 ? (unsigned int) tcb->tclass : SEG_CLASS(seg->header.flags);
+                // the first data of a client holding a valid cookie is ready before accept returns
+                if (tcb->fastOpen && cookie_ok && seg->header.length > 0) {
+                    fo_len = ringbuf_write(tcb->st.recvBuf, seg->data, seg->header.length);
+                    tcb->st.expect_seqNum += fo_len;
+                    __atomic_fetch_add(&tcb->st.dataRcvd, 1, __ATOMIC_RELAXED);
+                    __atomic_fetch_add(&tcb->st.bytesRcvd, fo_len, __ATOMIC_RELAXED);
                 }
-                free(finack);
-                break;
             }
-            case DATA: {
-                assert(tcb->state == CONNECTED);
-                if (tcb->expect_seqNum == rcv_seg.header.seq_num) {
-                    if (tcb->usedBufLen + rcv_seg.header.length > RECEIVE_BUF_SIZE) continue;
-                    tcb->expect_seqNum += rcv_seg.header.length;
-                    pthread_mutex_lock(tcb->bufMutex);
-                    memcpy(tcb->recvBuf + tcb->usedBufLen, rcv_seg.data, rcv_seg.header.length);
-                    tcb->usedBufLen += rcv_seg.header.length;
-                    pthread_mutex_unlock(tcb->bufMutex);
-                }
-                seg_t *data_ack = create_seg(tcb->server_portNum, tcb->client_portNum, DATAACK,
-                                             0, tcb->expect_seqNum, 0, 0, NULL);
-                if (sip_sendseg(sip_conn, (int) tcb->client_nodeID, data_ack) < 0)exit(1);
+            tcb->st.advWin = stream_window(&tcb->st);
+            // a client asking for a cookie or holding a stale one gets a new cookie as the data of the SYNACK
+            int give_cookie = tcb->fastOpen && (seg->header.flags & (SEG_FLAG_COOKIE | SEG_FLAG_FASTOPEN)) && !cookie_ok;
+            seg_t *synack = create_seg(tcb->server_portNum, tcb->client_portNum, SYNACK,
+                                       0, tcb->st.expect_seqNum, tcb->st.advWin,
+                                       give_cookie ? sizeof(cookie) : 0, give_cookie ? (char *) &cookie : NULL);
+            if (give_cookie) synack->header.flags = SEG_FLAG_COOKIE;
+            if (tcb->sg.fec) synack->header.flags |= SEG_FLAG_FEC;
+            if (tcb->sg.rateMode) synack->header.flags |= SEG_FLAG_RATE;
+            if (stream_sendseg((int) tcb->client_nodeID, tcb->sg.tclass, synack) < 0) exit(1);
+            tcb->st.ackSentNum = tcb->st.expect_seqNum;
+            if (fo_len > 0) printf("[Server] SYNACK is sent, %u bytes of fast open data accepted\n", fo_len);
+            else printf("[Server] SYNACK is sent\n");
+            if (listener && !accept_enqueue(listener, tcb)) {
+                free(synack);
                 break;
             }
-            default:
-                assert(0);
+            if (fo_len > 0) {
+                worker_list_add(w, WORKER_TRIM, tcb);
+                tcb_deliver(tcb);
+            }
+            free(synack);
+            break;
+        }
+        case FIN: {
+            assert(tcb->state == CONNECTED || tcb->state == CLOSEWAIT);
+            // the FINACK acknowledges everything, the delayed one is not needed anymore
+            stream_group_ack_cancel(&w->ackQueue, &tcb->sg);
+            seg_t *finack = create_seg(tcb->server_portNum, tcb->client_portNum, FINACK,
+                                       0, tcb->st.expect_seqNum, 0, 0, NULL);
+            if (stream_sendseg((int) tcb->client_nodeID, tcb->sg.tclass, finack) < 0) exit(1);
+            printf("[Server] FINACK for port %u is sent, %lu DATA received, %lu DATA sent, %lu DATAACK sent, "
+                   "%lu ACKs piggybacked, %lu bytes were delivered from the reassembly queue, "
+                   "%lu segments were rebuilt from parity\n",
+                   tcb->client_portNum, tcb->st.dataRcvd, tcb->st.dataSent, tcb->st.ackSent,
+                   tcb->st.ackPiggybacked, tcb->st.oooSavedBytes, tcb->st.fecRecovered);
+            if (tcb->state == CONNECTED) {
+                tcb->t_close_wait = now_nano();
+                worker_list_add(w, WORKER_CLOSEWAIT, tcb);
+                // data the client has not acknowledged is given up, the timer stops
+                pthread_mutex_lock(tcb->bufMutex);
+                stream_group_shutdown(&tcb->sg);
+                tcb->state = CLOSEWAIT;
+                pthread_mutex_unlock(tcb->bufMutex);
+                tcb_notify(tcb);
+                tcb_closed(tcb);
+            }
+            free(finack);
+            break;
+        }
+        case DATA: {
+            // a retransmission may still come in after the FIN
+            if (tcb->state != CONNECTED) break;
+            stream_t *st = stream_demux(&w->ackQueue, &tcb->sg, seg);
+            if (st == NULL) break;
+            // every DATA of the client carries its cumulative ACK and window as well,
+            // but a parity carries the bounds of its block there
+            int parity = (seg->header.flags & SEG_FLAG_FEC) != 0;
+            unsigned int popped = parity ? 0 : stream_ack(st, seg->header.ack_num, seg->header.rcv_win);
+            int fresh = parity ? stream_parity(&w->ackQueue, st, seg) : stream_data(&w->ackQueue, st, seg);
+            worker_list_add(w, WORKER_TRIM, tcb);
+            // the handler takes the new data right here, before the readers parked in stcp_server_recv wake up
+            if (fresh && st == &tcb->st) tcb_deliver(tcb);
+            // the lock only orders the wakeup
+            if (fresh || popped) tcb_notify(tcb);
+            break;
+        }
+        case DATAACK: {
+            if (tcb->state != CONNECTED) break;
+            stream_t *st = stream_demux(&w->ackQueue, &tcb->sg, seg);
+            // the segments a receive report names lost go out again with the ones the ACK lets go
+            if (st && (seg->header.flags & SEG_FLAG_RATE)) stream_report(st, seg);
+            // room in the send buffer for a non-blocking sender
+            if (st && stream_ack(st, seg->header.ack_num, seg->header.rcv_win)) tcb_event(tcb);
+            break;
+        }
+        default:
+            assert(0);
+    }
+}
+
+// hand a segment to the worker owning its connection, waits while the queue of the worker is full
+static void worker_push(int srcNodeID, seg_t *seg) {
+    segWorker_t *w = seg_worker(srcNodeID, seg->header.src_port, seg->header.dst_port);
+    pthread_mutex_lock(&w->lock);
+    while (w->tail - w->head == SEG_QUEUE_LEN) pthread_cond_wait(&w->notFull, &w->lock);
+    segItem_t *item = &w->items[w->tail % SEG_QUEUE_LEN];
+    item->srcNodeID = srcNodeID;
+    memcpy(&item->seg, seg, sizeof(stcp_hdr_t) + seg->header.length);
+    if (w->tail++ == w->head) pthread_cond_signal(&w->notEmpty);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// a worker thread: handle the segments seghandler queued and the timed work of the connections it owns
+static void *segworker(void *arg) {
+    segWorker_t *w = (segWorker_t *) arg;
+    while (1) {
+        int wait_ms = worker_tick(w);
+        pthread_mutex_lock(&w->lock);
+        if (w->head == w->tail && !w->stop) {
+            if (wait_ms < 0) {
+                pthread_cond_wait(&w->notEmpty, &w->lock);
+            } else {
+                struct timespec ts = nano_timespec(now_nano() + wait_ms * 1000000L);
+                pthread_cond_timedwait(&w->notEmpty, &w->lock, &ts);
+            }
+        }
+        if (w->head == w->tail) {
+            int stop = w->stop;
+            pthread_mutex_unlock(&w->lock);
+            if (stop) break;
+            continue;
         }
-        // should check the first connect waiting in the waiting que to see if it's expired
-        long int cur_nano = now_nano();
-        for (int i = 0; i < MAX_TRANSPORT_CONNECTIONS; ++i) {
-            if (TCB[i] && TCB[i]->state == CLOSEWAIT &&
-                timeout_nano(cur_nano, TCB[i]->t_close_wait, stons(CLOSEWAIT_TIMEOUT))) {
-                TCB[i]->state = CLOSED;
+        // seghandler only writes behind tail, the item stays put while it is processed without the lock
+        segItem_t *item = &w->items[w->head % SEG_QUEUE_LEN];
+        pthread_mutex_unlock(&w->lock);
+        seg_process(w, item->srcNodeID, &item->seg);
+        pthread_mutex_lock(&w->lock);
+        if (w->tail - w->head++ == SEG_QUEUE_LEN) pthread_cond_signal(&w->notFull);
+        pthread_mutex_unlock(&w->lock);
+    }
+    return NULL;
+}
+
+static void *seghandler(void *arg) {
+    int srcNodeID;
+    seg_t rcv_seg;
+    bzero(&rcv_seg, sizeof(seg_t));
+    segWorker_t *self = &segWorkers[0];
+    while (1) {
+        if (segWorkerNum == 0) {
+            // no workers, the timed work is done here between segments
+            int wait_ms = worker_tick(self);
+            if (wait_ms >= 0) {
+                struct pollfd pfd = {.fd = sip_conn, .events = POLLIN};
+                if (poll(&pfd, 1, wait_ms) == 0) continue;
             }
         }
+        int ret = sip_recvseg(sip_conn, &srcNodeID, &rcv_seg);
+        if (ret < 0)break;
+        if (ret > 0)continue;
+        if (segWorkerNum == 0) seg_process(self, srcNodeID, &rcv_seg);
+        else worker_push(srcNodeID, &rcv_seg);
+    }
+
+    // let the workers finish what is queued before the connections go away
+    for (unsigned int i = 0; i < segWorkerNum; ++i) {
+        pthread_mutex_lock(&segWorkers[i].lock);
+        segWorkers[i].stop = 1;
+        pthread_cond_signal(&segWorkers[i].notEmpty);
+        pthread_mutex_unlock(&segWorkers[i].lock);
     }
+    for (unsigned int i = 0; i < segWorkerNum; ++i) pthread_join(segWorkers[i].tid, NULL);
 
-    // son is closed, should clear TCB
-    for (int i = 0; i < MAX_TRANSPORT_CONNECTIONS; ++i) {
-        if (TCB[i]) TCB[i]->state = CLOSED;
+    // son is closed, should clear TCB and wake up everyone waiting for a transition
+    for (int i = 0; i < tcbtable_span(tcbTable); ++i) {
+        server_tcb_t *tcb = TCB(i);
+        if (tcb == NULL) continue;
+        pthread_mutex_lock(tcb->bufMutex);
+        int connected = tcb->state == CONNECTED;
+        stream_group_shutdown(&tcb->sg);
+        tcb->state = CLOSED;
+        pthread_mutex_unlock(tcb->bufMutex);
+        tcb_notify(tcb);
+        // a listening socket only hands its handler down
+        if (connected) tcb_closed(tcb);
     }
 
     return 0;
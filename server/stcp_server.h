@@ -6,8 +6,11 @@
 #define STCPSERVER_H
 
 #include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
 #include "../common/seg.h"
 #include "../common/constants.h"
+#include "../common/stream.h"
 
 //FSM中使用的服务器状态
 #define	CLOSED 1
@@ -15,6 +18,27 @@
 #define	CONNECTED 3
 #define	CLOSEWAIT 4
 
+//stcp_server_setopt()支持的套接字选项
+#define STCP_OPT_DELAYACK 1         //是否启用延迟确认, 默认启用
+#define STCP_OPT_NONBLOCK 2         //是否使用非阻塞模式, 默认不使用
+#define STCP_OPT_FASTOPEN 3         //监听套接字是否接受SYN中携带的数据(快速打开), 默认不接受
+#define STCP_OPT_PACING 4           //是否步调发送, 默认启用
+#define STCP_OPT_FEC 5              //监听套接字是否同意客户端启用前向纠错的请求, 默认不同意
+#define STCP_OPT_RATE 6             //监听套接字是否同意客户端使用速率模式的请求, 默认不同意
+#define STCP_OPT_CLASS 7            //连接的流量类别(TC_*), 默认使用客户端的类别
+
+//stcp_server_recv_file()的标志
+#define STCP_SINK_DIRECT 1          //对齐的块以O_DIRECT写入, 绕过页缓存
+
+//stcp_server_set_handler()注册的回调. 数据回调收到接收缓冲区中尚未被释放的全部数据(按接收缓冲区的块分为多段),
+//返回它处理完可以释放的字节数. 没有释放的数据留在缓冲区中, 在新数据到达时连同新数据一起再次交给回调.
+typedef unsigned int (*stcp_data_handler_t)(int sockfd, const struct iovec* iov, int iovcnt, void* ctx);
+//连接收到FIN或被关闭时调用一次的回调.
+typedef void (*stcp_close_handler_t)(int sockfd, void* ctx);
+
+//工作线程为它的连接维护的链表: 处于CLOSEWAIT状态的连接, 以及最近收到过数据, 接收缓冲区可能占用着块的连接
+enum { WORKER_CLOSEWAIT, WORKER_TRIM, WORKER_LISTS };
+
 //服务器传输控制块. 一个STCP连接的服务器端使用这个数据结构记录连接信息.
 typedef struct server_tcb {
     unsigned int server_nodeID;     //服务器节点ID, 类似IP地址, 当前未使用
@@ -23,10 +47,32 @@ typedef struct server_tcb {
     unsigned int client_portNum;    //客户端端口号
     unsigned int state;         	//服务器状态
     long int t_close_wait;
-    unsigned int expect_seqNum;     //服务器期待的数据序号
-    char* recvBuf;                  //指向接收缓冲区的指针
-    unsigned int  usedBufLen;       //接收缓冲区中已接收数据的大小
-    pthread_mutex_t* bufMutex;      //指向一个互斥量的指针, 该互斥量用于对接收缓冲区的访问
+    pthread_mutex_t* bufMutex;      //指向一个互斥量的指针, 它保护发送缓冲区, 也用于在stateCond上等待
+    pthread_cond_t* stateCond;      //state变化或有新数据进入接收缓冲区时被广播的条件变量, 与bufMutex配合使用
+    stream_t st;                    //双向的数据传输状态, 从客户端到服务器的数据进入它的接收缓冲区, stcp_server_send()的数据进入它的发送缓冲区
+    streamGroup_t sg;               //连接内多路复用的流, st是其中的流0
+    int sockfd;                     //这个TCB的套接字ID
+    unsigned int backlog;           //监听套接字的接受队列长度上限
+    unsigned int acceptNum;         //接受队列中等待stcp_server_accept()的连接数, 包括正在为SYN创建的子连接
+    struct server_tcb* acceptHead;  //监听套接字的接受队列头, 由监听套接字的bufMutex保护
+    struct server_tcb* acceptTail;  //监听套接字的接受队列尾
+    struct server_tcb* acceptNext;  //子连接在接受队列中的后继
+    unsigned int orphanRefs;        //被关闭的监听套接字还在等待放开它的工作线程数, 由orphanMutex保护
+    int nonblock;                   //是否使用非阻塞模式
+    int eventFd;                    //stcp_server_eventfd()创建的eventfd, 没有时为-1
+    int fastOpen;                   //是否接受快速打开, 子连接从监听套接字继承, 重传的SYN据此再次得到cookie
+    int fec;                        //是否同意启用前向纠错, 子连接从监听套接字继承, 协商的结果在sg.fec中
+    int rate;                       //是否同意使用速率模式, 子连接从监听套接字继承, 协商的结果在sg.rateMode中
+    int tclass;                     //STCP_OPT_CLASS设置的流量类别, 子连接从监听套接字继承, -1表示使用客户端SYN中的类别, 结果在sg.tclass中
+    stcp_data_handler_t onData;     //数据回调, 没有时为NULL, 子连接从监听套接字继承
+    stcp_close_handler_t onClose;   //关闭回调
+    void* handlerCtx;               //传给回调的参数
+    pthread_mutex_t* deliverMutex;  //保证同一时间只有一个线程调用数据回调
+    int closeNotified;              //关闭回调是否已经被调用
+    unsigned long idleRcvd;         //上一次检查连接是否空闲时它收到的DATA段数
+    struct server_tcb* workerPrev[WORKER_LISTS];    //在所属工作线程的链表(WORKER_*)中的前驱, 只由该工作线程访问
+    struct server_tcb* workerNext[WORKER_LISTS];    //在所属工作线程的链表中的后继
+    int workerListed[WORKER_LISTS];                 //是否在所属工作线程的链表中
 } server_tcb_t;
 
 //
@@ -42,8 +88,8 @@ typedef struct server_tcb {
 
 void stcp_server_init(int conn);
 
-// 这个函数初始化TCB表, 将所有条目标记为NULL. 它还针对重叠网络TCP套接字描述符conn初始化一个STCP层的全局变量,
-// 该变量作为sip_sendseg和sip_recvseg的输入参数. 最后, 这个函数启动seghandler线程来处理进入的STCP段.
+// 这个函数创建一个空的TCB表, 最大连接数为MAX_TRANSPORT_CONNECTIONS. 它还针对重叠网络TCP套接字描述符conn初始化一个STCP层的全局变量,
+// 该变量作为sip_sendseg和sip_recvseg的输入参数. 最后, 这个函数启动stcp_server_setworkers()设置的工作线程和seghandler线程来处理进入的STCP段.
 // 服务器只有一个seghandler.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -51,47 +97,234 @@ void stcp_server_init(int conn);
 
 int stcp_server_sock(unsigned int server_port);
 
-// 这个函数查找服务器TCB表以找到第一个NULL条目, 然后使用malloc()为该条目创建一个新的TCB条目.
+// 这个函数创建一个新的TCB条目, 并从TCB表中为它分配一个套接字ID, 被关闭的套接字ID会被优先回收使用.
 // 该TCB中的所有字段都被初始化, 例如, TCB state被设置为CLOSED, 服务器端口被设置为函数调用参数server_port.
-// TCB表中条目的索引应作为服务器的新套接字ID被这个函数返回, 它用于标识服务器的连接.
-// 如果TCB表中没有条目可用, 这个函数返回-1.
+// 分配的套接字ID被这个函数返回, 它用于标识服务器的连接. 套接字以(任意节点, 任意端口, server_port)登记到TCB表的哈希表中.
+// 如果连接数已达到上限或者server_port已被占用, 这个函数返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_listen(int sockfd, unsigned int backlog);
+
+// 这个函数使用sockfd获得TCB指针, 并将套接字的state转换为LISTENING. 此后每个来自新的(客户端节点ID, 客户端端口号)的SYN
+// 都会使seghandler创建一个子TCB, 为它分配新的套接字ID, 将它的state设置为CONNECTED并回复SYNACK, 然后将它加入监听套接字的接受队列.
+// 接受队列中已有backlog个连接时, 新的SYN被丢弃, 客户端会重传SYN. 成功时返回1, 套接字不存在或不处于CLOSED状态时返回-1.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
 
 int stcp_server_accept(int sockfd);
 
-// 这个函数使用sockfd获得TCB指针, 并将连接的state转换为LISTENING. 它然后启动定时器进入忙等待直到TCB状态转换为CONNECTED
-// (当收到SYN时, seghandler会进行状态的转换). 该函数在一个无穷循环中等待TCB的state转换为CONNECTED,
-// 当发生了转换时, 该函数返回1. 你可以使用不同的方法来实现这种阻塞等待.
+// 这个函数使用sockfd获得监听套接字的TCB指针, 如果套接字处于CLOSED状态, 先以ACCEPT_BACKLOG为接受队列长度调用stcp_server_listen().
+// 它然后阻塞在TCB的stateCond上直到接受队列非空(seghandler加入新连接时会广播stateCond), 取出队首的连接并返回它的套接字ID.
+// 监听套接字保持LISTENING状态, 可以继续接受其他客户端的连接. 返回的套接字用于stcp_server_recv()等函数, 使用完后需要用stcp_server_close()关闭.
+// 如果到SIP进程的连接在此之前关闭, 返回-1. 非阻塞模式下接受队列为空时立即返回STCP_EAGAIN, 新连接入队时监听套接字的eventfd变为可读.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
 
 int stcp_server_recv(int sockfd, void* buf, unsigned int length);
 
-// 接收来自STCP客户端的数据. 请回忆STCP使用的是单向传输, 数据从客户端发送到服务器端.
-// 信号/控制信息(如SYN, SYNACK等)则是双向传递. 这个函数每隔RECVBUF_POLLING_INTERVAL时间
-// 就查询接收缓冲区, 直到等待的数据到达, 它然后存储数据并返回1. 如果这个函数失败, 则返回-1.
+// 接收来自STCP客户端的数据. STCP连接是双向的, 服务器也可以用stcp_server_send()向客户端发送数据. 这个函数阻塞在TCB的stateCond上, seghandler每次向接收缓冲区
+// 追加数据时都会唤醒它, 直到等待的数据到达, 它然后存储数据并返回0. 如果这个函数失败, 则返回-1.
 //
 // 注意: stcp_server_recv在返回数据给应用程序之前, 它阻塞等待用户请求的字节数(即length)到达服务器.
+// 接收缓冲区是单消费者的, 同一个套接字上同一时间只能有一个线程调用stcp_server_recv/stcp_server_recv_some.
+// 非阻塞模式下, 如果缓冲区中的数据不足length字节而连接仍处于CONNECTED状态, 这个函数不读取任何数据并返回STCP_EAGAIN.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_recv_some(int sockfd, void* buf, unsigned int length, unsigned int min_bytes, long timeout);
+
+// stcp_server_recv的部分读取版本. 这个函数等待直到接收缓冲区中至少有min_bytes字节(不超过length), 或等待了timeout纳秒,
+// 然后将缓冲区中已有的数据(最多length字节)拷贝到buf中. timeout为负数时一直等待, 为0时不等待.
+// 返回拷贝的字节数, 超时且没有数据时返回0. 如果套接字不存在, 或连接已不处于CONNECTED状态且缓冲区为空, 返回-1.
+// 非阻塞模式下这个函数从不等待, 没有数据时返回STCP_EAGAIN.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_sendv(int sockfd, const struct iovec* iov, int iovcnt);
+int stcp_server_recvv(int sockfd, const struct iovec* iov, int iovcnt);
+
+// stcp_server_send()和stcp_server_recv()的分散/聚集版本. 数据是iovcnt个缓冲区按顺序的连接, 例如一个协议首部和它的负载:
+// stcp_server_sendv()直接从这些缓冲区构造段, 一个段可以跨越多个缓冲区, 所以应用程序不需要先把它们拼接到一个临时缓冲区中;
+// stcp_server_recvv()等待直到所有缓冲区的总长度的数据到达, 然后把它们直接从接收缓冲区依次分散到各个缓冲区中.
+// 返回值与stcp_server_send()和stcp_server_recv()相同.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_recv_file(int sockfd, int fd, off_t offset, uint64_t length, int flags);
+
+// 这个函数从连接接收length字节并把它们写入文件描述符fd从offset开始的位置, 长度可以超过4GB和内存. 数据从接收缓冲区被拷贝到
+// SINK_BUFS个SINK_CHUNK字节的暂存缓冲区中, 由一个后台写线程用pwrite()写入磁盘, 所以写磁盘和接收网络数据重叠进行,
+// 总时间接近两者中较慢的一个而不是两者之和. 除第一块外, 每块都结束在文件的SINK_CHUNK对齐的位置.
+// flags中有STCP_SINK_DIRECT时, 文件偏移和长度都对齐的块通过另一个以O_DIRECT打开的描述符写入; 文件系统不支持O_DIRECT时
+// 退回到普通写入. fd不能以O_APPEND打开. 这个函数总是阻塞, 它不能用于注册了stcp_server_set_handler()回调的套接字.
+// 全部数据被写入后返回0. 连接在数据到齐之前关闭或写文件失败时返回-1, 已经到达的数据仍然被写入.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_send_msg(int sockfd, void* data, unsigned int length);
+
+// 把数据作为一个消息发送给STCP客户端. 这个函数与stcp_server_send()相同, 但消息的最后一个段带SEG_FLAG_EOM标志,
+// 对端用stcp_client_recv_msg()一次读出整个消息, 不需要先发送消息长度. length必须在1到RECEIVE_BUF_SIZE之间, 否则返回-1.
+// 消息和stcp_server_send()发送的数据在同一个字节流中按序到达, 所以同一个连接上应只使用其中一种.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_recv_msg(int sockfd, void** buf, unsigned int length);
+
+// 从STCP客户端接收一个用stcp_client_send_msg()发送的完整消息, 返回消息长度. 这个函数阻塞直到整个消息到达接收缓冲区.
+// *buf不为NULL时, 消息被拷贝到长度为length的*buf中, 消息长于length时不读出任何数据并返回STCP_EMSGSIZE.
+// *buf为NULL时, 这个函数分配一个恰好容纳消息的缓冲区并存入*buf, 它由调用者用free()释放, length被忽略.
+// 连接在消息到达之前断开时返回-1. 非阻塞模式下没有完整的消息时返回STCP_EAGAIN.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_send(int sockfd, void* data, unsigned int length);
+
+// 发送数据给STCP客户端. 这个函数与stcp_client_send()相同: 数据被分片为段放入TCB的发送缓冲区, 根据滑动窗口的情况立即发出或等待,
+// 超时未被确认的段由stream_timer线程重传. 每个DATA段都捎带服务器当前的累计确认, 所以对请求的回复同时确认了请求.
+// 连接必须处于CONNECTED状态, 客户端断开连接时发送缓冲区中尚未被确认的数据被丢弃. 成功时返回1, 否则返回-1.
+// 非阻塞模式下发送缓冲区超过SEND_BUF_SEGS个段时返回STCP_EAGAIN, 段被确认时套接字的eventfd变为可读.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_stream_open(int sockfd);
+
+// 在连接内打开一个新的流. 流0是连接本身, stcp_server_send()/stcp_server_recv()使用它. 其他流不需要握手: 这个函数只在本地分配一个
+// 偶数流ID, 流的第一个DATA段就在客户端打开它. 每个流有独立的序号空间, 按序交付, 接收窗口(STREAM_BUF_SIZE)和重传,
+// 所以一个流的丢包不会阻塞其他流. 连接的所有流共享一个拥塞窗口和一个重传定时器线程.
+// 返回流ID. 连接不处于CONNECTED状态, 流ID已用完或连接中的流数已达到STREAM_MAX时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_stream_accept(int sockfd);
+
+// 返回客户端在连接内打开的下一个流的ID. 流按客户端打开的顺序被返回. 没有新流时这个函数阻塞在TCB的stateCond上,
+// 非阻塞模式下返回STCP_EAGAIN. 连接断开时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_stream_send(int sockfd, int stream_id, void* data, unsigned int length);
+int stcp_server_stream_recv(int sockfd, int stream_id, void* buf, unsigned int length);
+
+// 在流stream_id上发送或接收数据, 与stcp_server_send()和stcp_server_recv()相同. 流不存在或已被关闭时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_stream_close(int sockfd, int stream_id);
+
+// 关闭一个流. 关闭后这个流不再接收数据, 对端在这个流上继续发送的数据被直接确认并丢弃. 发送缓冲区中的数据仍被发送,
+// 全部被确认后流被释放. 流ID在一个连接内不会被重用. 成功时返回1, 流不存在或stream_id为0时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_setopt(int sockfd, int opt, int value);
+
+// 这个函数设置套接字选项opt的值为value. 当前支持的选项有:
+// STCP_OPT_DELAYACK: 非0时启用延迟确认. 按序到达的DATA段在收到第二个满长度段或DELAYED_ACK_TIMEOUT超时后才被确认,
+//                    乱序段, 重复段, 填补空洞的段和窗口更新总是立即被确认.
+// STCP_OPT_NONBLOCK: 非0时使用非阻塞模式, stcp_server_accept(), stcp_server_recv()和stcp_server_recv_some()
+//                    在操作无法立即完成时返回STCP_EAGAIN.
+// STCP_OPT_FASTOPEN: 非0时监听套接字接受快速打开. 请求cookie的SYN得到携带cookie的SYNACK, cookie是以服务器启动时随机生成的
+//                    密钥对客户端节点ID计算的散列值. 携带有效cookie的SYN中的数据(最多MAX_SEG_LEN字节)在连接被加入接受队列之前
+//                    进入它的接收缓冲区, 所以stcp_server_accept()返回后立即可以读出, SYNACK同时确认了这些数据. cookie无效时数据被丢弃,
+//                    SYNACK携带新的cookie, 客户端在连接建立后重传数据. 只有收到过SYNACK的节点才知道cookie, 所以伪造源节点的SYN
+//                    不能让服务器把数据交给应用程序.
+// STCP_OPT_PACING: 非0时启用步调发送(默认启用). 段不再在窗口打开时一次全部发出, 而是以cwnd/SRTT的速率离开, 空闲的连接
+//                    最多可以立即发出PACING_BURST个段, 其余的由stream_timer线程按时发出. 超时重传的段也同样步调发送.
+//                    这避免了窗口大小的突发填满SIP和SON的套接字缓冲区, 成为所有连接的排队延迟.
+// STCP_OPT_FEC: 非0时监听套接字同意客户端在SYN中提出的启用前向纠错的请求. 启用后两个方向上每组新发出的DATA段之后都跟一个
+//                    校验段, 它是组内各段数据的异或, 接收方在一组中只丢失一个段时用它恢复这个段, 而不必等待超时重传.
+//                    每组的段数在1到FEC_MAX_K之间, 由接收方在确认中报告的丢包率决定, 使一组中丢失的段数的期望值不超过
+//                    FEC_LOSS_TARGET%. 校验段不受拥塞窗口限制, 丢包很少时开销约为1/FEC_MAX_K. 适用于丢包率较高的重叠网络路径.
+// STCP_OPT_RATE: 非0时监听套接字同意客户端在SYN中提出的使用速率模式的请求. 速率模式用于带宽时延积大的路径上的批量传输:
+//                    段不受拥塞窗口限制, 以测量的速率步调发出, 在途段数最多RATE_WINDOW个. 接收方在每个DATAACK中报告空洞,
+//                    空洞存在时每DELAYED_ACK_TIMEOUT重复报告, 发送方只重传报告丢失的段, 不再回退N. 发送方每RATE_PROBE_SEGS个段
+//                    发出一个包对, 接收方由它估计路径容量. 速率从RATE_INIT段/秒开始每个SRTT翻倍, 然后逼近路径容量.
+//                    没有排队延迟时的随机丢包不降低速率, 伴随排队延迟的丢包使速率降低1/8.
+// STCP_OPT_CLASS: 连接的流量类别, TC_CONTROL到TC_BULK之一. 它发出的段在SIP和SON中进入这个类别的队列: TC_CONTROL严格优先,
+//                    其他类别按权重分享每个下一跳的链路, 所以批量传输不会让同一路径上的交互请求排在它的整个队列后面.
+//                    接受的连接默认使用客户端在SYN中携带的类别, 在监听套接字上设置后它此后接受的连接都使用这个类别,
+//                    在连接上设置时立即生效.
+// 在监听套接字上设置的选项被它此后接受的连接继承.
+// 成功时返回1, 套接字不存在, 选项未知或流量类别不合法时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_set_handler(int sockfd, stcp_data_handler_t on_data, stcp_close_handler_t on_close, void* ctx);
+
+// 这个函数为套接字注册回调, 接收数据不再需要一个线程阻塞在stcp_server_recv()上. 数据进入流0的接收缓冲区后, 处理该段的线程
+// (seghandler或工作线程)直接调用on_data, 把缓冲区中的数据原地交给它, 回调释放的字节从缓冲区中移除并重新打开接收窗口.
+// 连接收到FIN时on_close被调用一次(可以为NULL). 回调在段处理线程中运行, 所以它不能阻塞, 不能关闭这个套接字, 也不能再调用
+// stcp_server_recv()等函数读取同一个套接字; 发送数据是允许的. 只有流0的数据以这种方式交付.
+// 在监听套接字上注册的回调被它此后接受的连接继承, 所以从第一个段(包括快速打开的数据)开始就不会遗漏数据. 注册时缓冲区中已有的数据
+// 立即交给on_data. on_data为NULL时取消回调, 此后数据重新留在缓冲区中供stcp_server_recv()读取.
+// 成功时返回1, 套接字不存在时返回-1.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
 
 int stcp_server_close(int sockfd);
 
-// 这个函数调用free()释放TCB条目. 它将该条目标记为NULL, 成功时(即位于正确的状态)返回1,
-// 失败时(即位于错误的状态)返回-1.
+// 这个函数调用free()释放TCB条目. 它从TCB表中删除该条目并回收套接字ID, 成功时(即位于正确的状态)返回1,
+// 失败时(即位于错误的状态)返回-1. 关闭监听套接字时, 接受队列中尚未被接受的连接也一并被释放. 套接字的eventfd也被关闭.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_eventfd(int sockfd);
+
+// 这个函数返回套接字的eventfd, 第一次调用时创建它, 它由stcp_server_close()关闭. 监听套接字的接受队列加入新连接,
+// 数据进入接收缓冲区, 发送缓冲区中的段被确认, 或连接收到FIN及被关闭时, eventfd的计数器增加, 从而变为可读. 应用程序可以把它加入自己的epoll/poll/select中,
+// 读出计数器后重试非阻塞调用, 从而由一个线程驱动大量连接. 新创建的eventfd立即可读, 以免错过在它创建之前发生的事件. 失败时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcp_server_getstats(int sockfd, stcp_stats_t* stats);
+
+// 这个函数把连接的传输统计填入stats, 与stcp_client_getstats()相同. 监听套接字没有数据传输, 它的统计都为0.
+// 成功时返回1, 套接字不存在时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+void stcp_server_setmaxconn(unsigned int max_conn);
+
+// 这个函数修改服务器的最大连接数(默认为MAX_TRANSPORT_CONNECTIONS). 已经存在的连接不受影响.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+void stcp_server_setrecvmem(unsigned long bytes);
+
+// 这个函数设置所有接收缓冲区共用的内存预算(默认为RECV_POOL_BUDGET字节). 接收缓冲区不在创建套接字时分配, 而是在数据到达时
+// 按RECV_CHUNK字节的块从共享的块池中分配, 应用程序读出数据后块被归还, 连接空闲RECV_IDLE_TRIM秒后它剩下的块也被归还, 所以监听套接字
+// 和空闲连接不占用接收缓冲区. 占用的块接近预算时, 每个连接通告的接收窗口缩小到它已分配的块中的空闲空间加上预算的剩余部分.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
 
-void* seghandler(void* arg);
+void stcp_server_setworkers(unsigned int workers);
 
-// 这是由stcp_server_init()启动的线程. 它处理所有来自客户端的进入数据. seghandler被设计为一个调用sip_recvseg()的无穷循环,
-// 如果sip_recvseg()失败, 则说明重叠网络连接已关闭, 线程将终止. 根据STCP段到达时连接所处的状态, 可以采取不同的动作.
-// 请查看服务端FSM以了解更多细节.
+// 这个函数设置处理进入的段的工作线程数(默认为0), 必须在stcp_server_init()之前调用. 每个连接按(客户端节点ID, 客户端端口号, 服务器端口号)
+// 的哈希值固定属于一个工作线程, 所以同一连接的段仍按到达顺序处理, 不同连接的段在多个核上并行处理.
+// 为0时seghandler自己处理所有段.
 //
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //
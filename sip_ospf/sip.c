@@ -20,6 +20,7 @@
 #include "../common/constants.h"
 #include "../common/pkt.h"
 #include "../common/seg.h"
+#include "../common/tcq.h"
 #include "../topology/topology.h"
 #include "sip.h"
 #include "routingtable.h"
@@ -32,6 +33,7 @@
 /**************************************************************/
 int son_conn;            //到重叠网络的连接
 int stcp_conn;            //到STCP的连接
+tcq_t *sonQueue;            //交给SON进程的报文, 按流量类别排队, 由sonsender线程发送
 
 routingtable_t *routingtable;        //路由表
 pthread_mutex_t *routingtable_mutex;    //路由表互斥量
@@ -93,8 +95,8 @@ void *pkthandler(void *arg) {
                 if (nextHop < 0) {
                     printf("[Sip]<pkthandler:SIP> no route to %d\n", sipPkt.header.dst_nodeID);
                 } else {
-                    if (son_sendpkt(nextHop, &sipPkt, son_conn) < 0) {
-                        printf("[Sip]<pkthandler:SIP> send to next hop error\n");
+                    if (tcq_put(sonQueue, nextHop, &sipPkt) < 0) {
+                        printf("[Sip]<pkthandler:SIP> queue to %d is full, packet dropped\n", nextHop);
                     }
                 }
             }
@@ -114,7 +116,7 @@ void *pkthandler(void *arg) {
                     dstNode++;
                     pktRouteupdate->entry[i].nodeID = dstNode;
                     if (dstNode < UPDATE_HOP_CEIL)
-                        son_sendpkt(BROADCAST_NODEID, &sipPkt, son_conn);
+                        tcq_put(sonQueue, BROADCAST_NODEID, &sipPkt);
                     else
                         routingtable_print(routingtable);
                 }
@@ -127,6 +129,27 @@ void *pkthandler(void *arg) {
     pthread_exit(NULL);
 }
 
+//这个线程按流量类别的调度顺序从sonQueue中取出报文交给SON进程, 它是唯一写son_conn的线程.
+//连续发往同一个下一跳的报文用一次son_sendpkts()发送.
+void *sonsender(void *arg) {
+    static sip_pkt_t pkts[SUPERSEG_SEGS];
+    tcqItem_t *it = tcq_get(sonQueue, 1);
+    while (it != NULL) {
+        int nextNode = it->nextNode, n = 0;
+        // take what is already waiting for the same next hop, the first packet for another one starts the next write
+        do {
+            memcpy(&pkts[n++], &it->pkt, sizeof(sip_hdr_t) + it->pkt.header.length);
+            free(it);
+            it = tcq_get(sonQueue, 0);
+        } while (it != NULL && it->nextNode == nextNode && n < SUPERSEG_SEGS);
+        if (son_sendpkts(nextNode, pkts, n, son_conn) < 0) {
+            printf("[Sip]<sonsender> send to SON error\n");
+        }
+        if (it == NULL) it = tcq_get(sonQueue, 1);
+    }
+    return 0;
+}
+
 //这个函数终止SIP进程, 当SIP进程收到信号SIGINT时会调用这个函数. 
 //它关闭所有连接, 释放所有动态分配的内存.
 void sip_stop(int type) {
@@ -141,7 +164,8 @@ void sip_stop(int type) {
 
 //这个函数打开端口SIP_PORT并等待来自本地STCP进程的TCP连接.
 //在连接建立后, 这个函数从STCP进程处持续接收包含段及其目的节点ID的sendseg_arg_t. 
-//接收的段被封装进数据报(一个段在一个数据报中), 然后使用son_sendpkt发送该报文到下一跳. 下一跳节点ID提取自路由表.
+//接收的段被封装进数据报(一个段在一个数据报中), 超级段先被切分为多个段. 这些报文按段携带的流量类别进入sonQueue, 由sonsender线程发送到下一跳,
+//下一跳节点ID提取自路由表.
 //当本地STCP进程断开连接时, 这个函数等待下一个STCP进程的连接.
 void waitSTCP(void) {
     //你需要编写这里的代码.
@@ -166,9 +190,10 @@ void waitSTCP(void) {
     }
 
     printf("[Sip]<waitSTCP> connected to SIP\n");
-    seg_t seg;
+    // a super-segment of STCP becomes up to SUPERSEG_SEGS packets
+    static superseg_t seg;
+    static sip_pkt_t sipPkts[SUPERSEG_SEGS];
     int dstNodeID;
-    sip_pkt_t sipPkt;
     while (1) {
         if (getsegToSend(stcp_conn, &dstNodeID, &seg) < 0) {
             printf("[Sip]<waitSTCP> error get packet from STCP\n");
@@ -178,22 +203,23 @@ void waitSTCP(void) {
                 printf("[Sip]<waitSTCP> connected to SIP\n");
             continue;
         }
-        printf("[Sip]<waitSTCP> sip get a seg from stcp | type: %s, dstNode: %d\n",
-               seg_type_str(seg.header.type), dstNodeID);
-        sipPkt.header.src_nodeID = topology_getMyNodeID();
-        sipPkt.header.dst_nodeID = dstNodeID;
-        sipPkt.header.type = SIP;
-        sipPkt.header.length = sizeof(stcp_hdr_t) + seg.header.length;
-        memcpy(sipPkt.data, &seg, sipPkt.header.length);
+        printf("[Sip]<waitSTCP> sip get a seg from stcp | type: %s, length: %u, dstNode: %d\n",
+               seg_type_str(seg.header.type), seg.header.length, dstNodeID);
         assert(dstNodeID >= 0);
+        int pktNum = sip_packsegs(&seg, topology_getMyNodeID(), dstNodeID, sipPkts);
+        // one route lookup and one write to SON for all the packets
         LOCK_ROUTE;
         int nextNode = routingtable_getnextnode(routingtable, dstNodeID);
         UNLOCK_ROUTE;
         if (nextNode < 0) {
             printf("[Sip]<waitSTCP> next hop for %d doesn't exist\n", dstNodeID);
         } else {
-            printf("[Sip]<waitSTCP> routing to: %d\n", nextNode);
-            son_sendpkt(nextNode, &sipPkt, son_conn);
+            printf("[Sip]<waitSTCP> routing %d packets to: %d\n", pktNum, nextNode);
+            for (int i = 0; i < pktNum; ++i) {
+                if (tcq_put(sonQueue, nextNode, &sipPkts[i]) < 0) {
+                    printf("[Sip]<waitSTCP> queue of class %u is full, packet dropped\n", sipPkts[i].header.tclass);
+                }
+            }
         }
     }
 }
@@ -220,6 +246,11 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
+    //启动线程按流量类别把报文交给SON进程
+    sonQueue = tcq_create(TC_QUEUE_PKTS);
+    pthread_t son_sender_thread;
+    pthread_create(&son_sender_thread, NULL, sonsender, (void *) 0);
+
     //启动线程处理来自SON进程的进入报文
     pthread_t pkt_handler_thread;
     pthread_create(&pkt_handler_thread, NULL, pkthandler, (void *) 0);
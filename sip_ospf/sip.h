@@ -14,13 +14,17 @@ int connectToSON(void);
 //就根据路由表转发报文给下一跳.如果报文是路由更新报文,就更新距离矢量表和路由表. 
 void* pkthandler(void* arg); 
 
+//这个线程按流量类别的调度顺序从sonQueue中取出报文交给SON进程, 它是唯一写son_conn的线程.
+//连续发往同一个下一跳的报文用一次son_sendpkts()发送.
+void* sonsender(void* arg);
 //这个函数终止SIP进程, 当SIP进程收到信号SIGINT时会调用这个函数. 
 //它关闭所有连接, 释放所有动态分配的内存.
 void sip_stop(int type);
 
 //这个函数打开端口SIP_PORT并等待来自本地STCP进程的TCP连接.
 //在连接建立后, 这个函数从STCP进程处持续接收包含段及其目的节点ID的sendseg_arg_t. 
-//接收的段被封装进数据报(一个段在一个数据报中), 然后使用son_sendpkt发送该报文到下一跳. 下一跳节点ID提取自路由表.
+//接收的段被封装进数据报(一个段在一个数据报中), 超级段先被切分为多个段. 这些报文按段携带的流量类别进入sonQueue, 由sonsender线程发送到下一跳,
+//下一跳节点ID提取自路由表.
 //当本地STCP进程断开连接时, 这个函数等待下一个STCP进程的连接.
 void waitSTCP(void);
 #endif
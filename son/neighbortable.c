@@ -18,6 +18,7 @@ nbr_entry_t *create_entry(int nodeID, in_addr_t nodeIP, int conn) {
     entry->conn = conn;
     entry->nodeID = nodeID;
     entry->nodeIP = nodeIP;
+    entry->queue = NULL;
     entry->next = entry->prev = NULL;
     return entry;
 }
@@ -7,6 +7,7 @@
 
 #include <arpa/inet.h>
 #include <pthread.h>
+#include "../common/tcq.h"
 
 #define wait_nt(nt) pthread_mutex_lock(&nt->mtx)
 #define leave_nt(nt) pthread_mutex_unlock(&nt->mtx)
@@ -20,6 +21,7 @@ typedef struct neighborentry {
     int nodeID;            //邻居的节点ID
     in_addr_t nodeIP;     //邻居的IP地址
     int conn;                //针对这个邻居的TCP连接套接字描述符
+    tcq_t *queue;            //发往这个邻居的报文, 按流量类别排队, 由这个邻居的nbr_sender线程发送. 发送线程启动前为NULL
     struct neighborentry *next;
     struct neighborentry *prev;
 } nbr_entry_t;
@@ -2,7 +2,8 @@
 //
 //描述: 这个文件实现SON进程
 //SON进程首先连接到所有邻居, 然后启动listen_to_neighbor线程, 每个该线程持续接收来自一个邻居的进入报文, 并将该报文转发给SIP进程.
-//然后SON进程等待来自SIP进程的连接. 在与SIP进程建立连接之后, SON进程持续接收来自SIP进程的sendpkt_arg_t结构, 并将接收到的报文发送到重叠网络中.
+//然后SON进程等待来自SIP进程的连接. 在与SIP进程建立连接之后, SON进程持续接收来自SIP进程的sendpkt_arg_t结构, 并将接收到的报文按流量类别
+//加入下一跳的队列, 每个邻居的nbr_sender线程把它的队列中的报文发送到重叠网络中.
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -17,6 +18,8 @@
 #include <signal.h>
 #include <sys/utsname.h>
 #include <assert.h>
+#include <poll.h>
+#include <netinet/tcp.h>
 
 #include "../common/constants.h"
 #include "../common/pkt.h"
@@ -120,6 +123,47 @@ int connectNbrs(void) {
     return 1;
 }
 
+//nbr_sender线程的参数. 邻居断开后它的条目被释放, 所以线程使用自己的拷贝
+typedef struct nbrSender {
+    tcq_t *queue;
+    int conn;
+    int nodeID;
+} nbrSender_t;
+
+//每个nbr_sender线程按流量类别的调度顺序从一个邻居的队列中取出报文, 发送给这个邻居, 它是唯一写这个邻居的连接的线程.
+//连接的内核发送缓冲区中只保留少量尚未发出的数据, 其余报文留在队列中, 所以后到的高优先级报文可以排在它们前面.
+//邻居断开后它的队列被关闭, 线程释放队列后终止.
+void *nbr_sender(void *arg) {
+    nbrSender_t *sender = arg;
+    struct pollfd pfd = {.fd = sender->conn, .events = POLLOUT};
+    while (1) {
+        // the next packet is chosen only once the socket has room, a broken connection returns at once
+        if (sender->conn >= 0) poll(&pfd, 1, -1);
+        tcqItem_t *it = tcq_get(sender->queue, 1);
+        if (it == NULL) break;
+        if (sendpkt(&it->pkt, sender->conn) < 0) {
+            printf("[Son]<nbr_sender> neighbor offline: Node %d\n", sender->nodeID);
+        }
+        free(it);
+    }
+    tcq_free(sender->queue);
+    free(sender);
+    return 0;
+}
+
+// give the neighbor its queue and the thread sending it
+static void start_sender(nbr_entry_t *nbr) {
+    int lowat = SON_NOTSENT_LOWAT;
+    if (nbr->conn >= 0) setsockopt(nbr->conn, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof lowat);
+    nbrSender_t *sender = malloc(sizeof(nbrSender_t));
+    sender->queue = nbr->queue = tcq_create(TC_QUEUE_PKTS);
+    sender->conn = nbr->conn;
+    sender->nodeID = nbr->nodeID;
+    pthread_t tid;
+    pthread_create(&tid, NULL, nbr_sender, sender);
+    pthread_detach(tid);
+}
+
 //每个listen_to_neighbor线程持续接收来自一个邻居的报文. 它将接收到的报文转发给SIP进程.
 //所有的listen_to_neighbor线程都是在到邻居的TCP连接全部建立之后启动的.
 void *listen_to_neighbor(void *arg) {
@@ -134,6 +178,7 @@ void *listen_to_neighbor(void *arg) {
             makeNodeFailSipPkt(&sipPkt, nbr->nodeID);
             forwardpktToSIP(&sipPkt, sip_conn);
             wait_nt(nt);
+            tcq_close(nbr->queue);
             removeEntry(nt, nbr);
             leave_nt(nt);
             break;
@@ -150,7 +195,7 @@ void *listen_to_neighbor(void *arg) {
 }
 
 //这个函数打开TCP端口SON_PORT, 等待来自本地SIP进程的进入连接.
-//在本地SIP进程连接之后, 这个函数持续接收来自SIP进程的sendpkt_arg_t结构, 并将报文发送到重叠网络中的下一跳.
+//在本地SIP进程连接之后, 这个函数持续接收来自SIP进程的sendpkt_arg_t结构, 并将报文按它的流量类别加入下一跳的队列.
 //如果下一跳的节点ID为BROADCAST_NODEID, 报文应发送到所有邻居节点.
 void waitSIP(void) {
     //你需要编写这里的代码.
@@ -188,9 +233,7 @@ void waitSIP(void) {
                 makeNodeFailSipPkt(&sipPkt, topology_getMyNodeID());
                 wait_nt(nt);
                 iterate_nbr(nt, nbr) {
-                    if (sendpkt(&sipPkt, nbr->conn) < 0) {
-                        printf("[Son]<waitSIP> neighbor offline: Node %d\n", nbr->nodeID);
-                    }
+                    tcq_put(nbr->queue, nbr->nodeID, &sipPkt);
                 }
                 leave_nt(nt);
                 needSendFail = 0;
@@ -203,23 +246,23 @@ void waitSIP(void) {
             sleep(5);
             continue;
         }
+        // the queue of a neighbor goes away with its entry, it is used with the table locked
         if (nextNode == BROADCAST_NODEID) {
             wait_nt(nt);
             iterate_nbr(nt, nbr) {
-                if (sendpkt(&sipPkt, nbr->conn) < 0) {
-                    printf("[Son]<waitSIP> neighbor offline: Node %d\n", nbr->nodeID);
-                }
+                tcq_put(nbr->queue, nbr->nodeID, &sipPkt);
             }
             leave_nt(nt);
         } else {
             wait_nt(nt);
             nbr_entry_t *nbr = get_nbrEntry_byID(nt, nextNode);
-            leave_nt(nt);
             if (!nbr) {
                 printf("[Son]<waitSIP> neighbour not found, nodeID: %d\n", nextNode);
-            } else if (sendpkt(&sipPkt, nbr->conn) < 0) {
-                printf("[Son]<waitSIP> neighbor offline: Node %d\n", nbr->nodeID);
+            } else if (tcq_put(nbr->queue, nextNode, &sipPkt) < 0) {
+                printf("[Son]<waitSIP> queue of class %u to Node %d is full, packet dropped\n",
+                       sipPkt.header.tclass, nextNode);
             }
+            leave_nt(nt);
         }
     }// end of while(1)
 }
@@ -269,6 +312,11 @@ int main(void) {
     //此时, 所有与邻居之间的连接都建立好了
     printf("[Son] son connection is ready\n");
 
+    //为每个邻居创建按流量类别调度的队列和发送线程
+    iterate_nbr(nt, nbr) {
+        start_sender(nbr);
+    }
+
     //创建线程监听所有邻居
     iterate_nbr(nt, nbr) {
         pthread_t nbr_listen_thread;
@@ -17,7 +17,7 @@ void* waitNbrs(void *arg);
 int connectNbrs(void);
 
 //这个函数打开TCP端口SON_PORT, 等待来自本地SIP进程的进入连接.
-//在本地SIP进程连接之后, 这个函数持续接收来自SIP进程的sendpkt_arg_t结构, 并将报文发送到重叠网络中的下一跳.
+//在本地SIP进程连接之后, 这个函数持续接收来自SIP进程的sendpkt_arg_t结构, 并将报文按它的流量类别加入下一跳的队列.
 //如果下一跳的节点ID为BROADCAST_NODEID, 报文应发送到所有邻居节点.
 void waitSIP(void);
 
@@ -25,6 +25,11 @@ void waitSIP(void);
 //所有的listen_to_neighbor线程都是在到邻居的TCP连接全部建立之后启动的.
 void* listen_to_neighbor(void* arg);
 
+//每个nbr_sender线程按流量类别的调度顺序从一个邻居的队列中取出报文, 发送给这个邻居, 它是唯一写这个邻居的连接的线程.
+//连接的内核发送缓冲区中只保留少量尚未发出的数据, 其余报文留在队列中, 所以后到的高优先级报文可以排在它们前面.
+//邻居断开后它的队列被关闭, 线程释放队列后终止.
+void* nbr_sender(void* arg);
+
 //这个函数停止重叠网络, 当接收到信号SIGINT时, 该函数被调用.
 //它关闭所有的连接, 释放所有动态分配的内存.
 void son_stop(int type);
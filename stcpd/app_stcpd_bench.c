@@ -0,0 +1,135 @@
+//文件名: stcpd/app_stcpd_bench.c
+//
+//描述: 这是通过STCP守护进程收发数据的测试程序, 它不链接STCP库, 也不连接SIP进程.
+//echo模式在服务器端口上监听, 每个被接受的连接由一个线程把收到的数据原样发回, 直到客户端断开连接.
+//ping模式启动procs个进程, 每个进程通过守护进程建立一个连接, 发送rounds个PING_LEN字节的请求并等待它的回显, 然后关闭连接.
+//所有进程共享本地守护进程的一个SIP连接. 每个进程打印往返时间, 最后打印成功的进程数.
+
+//输入: [-p 守护进程的Unix套接字路径] echo 服务器端口
+//      [-p 守护进程的Unix套接字路径] ping 服务器主机名 服务器端口 [进程数] [轮数]
+
+//输出: 往返时间和结果
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "../common/seg.h"
+#include "../topology/topology.h"
+#include "stcpd.h"
+
+//每个请求的字节数
+#define PING_LEN 64
+#define DEFAULT_PROCS 8
+#define DEFAULT_ROUNDS 20
+
+// send the data of an accepted connection back until the client disconnects
+void *echo(void *arg) {
+    int fd = (int) (long) arg;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof buf)) > 0) {
+        if (write(fd, buf, (size_t) n) != n) break;
+    }
+    close(fd);
+    return NULL;
+}
+
+static int run_echo(unsigned int port) {
+    int lfd = stcpd_listen(port);
+    if (lfd < 0) {
+        printf("echo: can't listen on port %u\n", port);
+        return 1;
+    }
+    printf("echo: listening on port %u\n", port);
+    int fd;
+    unsigned long conns = 0;
+    while ((fd = stcpd_accept(lfd)) >= 0) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, echo, (void *) (long) fd);
+        pthread_detach(tid);
+        printf("echo: connection %lu\n", ++conns);
+    }
+    printf("echo: the daemon closed the listening socket\n");
+    return 0;
+}
+
+// one application: connect, send rounds requests one at a time and check their echoes, returns 0 on success
+static int ping(int id, int nodeID, unsigned int port, int rounds) {
+    long begin = now_nano();
+    int fd = stcpd_connect(0, nodeID, port);
+    if (fd < 0) {
+        printf("ping %d: connection failed\n", id);
+        return 1;
+    }
+    long connected = now_nano();
+    char req[PING_LEN], rsp[PING_LEN];
+    long total = 0, worst = 0;
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < PING_LEN; ++i) req[i] = (char) (id * 31 + r + i);
+        long sent = now_nano();
+        if (write(fd, req, PING_LEN) != PING_LEN) {
+            printf("ping %d: write failed in round %d\n", id, r);
+            close(fd);
+            return 1;
+        }
+        size_t got = 0;
+        while (got < PING_LEN) {
+            ssize_t n = read(fd, rsp + got, PING_LEN - got);
+            if (n <= 0) {
+                printf("ping %d: connection lost in round %d\n", id, r);
+                close(fd);
+                return 1;
+            }
+            got += (size_t) n;
+        }
+        long rtt = now_nano() - sent;
+        total += rtt;
+        if (rtt > worst) worst = rtt;
+        if (memcmp(req, rsp, PING_LEN) != 0) {
+            printf("ping %d: echo mismatch in round %d\n", id, r);
+            close(fd);
+            return 1;
+        }
+    }
+    close(fd);
+    printf("ping %d: connected in %.1f ms, %d rounds, avg rtt %.1f ms, max rtt %.1f ms\n", id,
+           (double) (connected - begin) / 1000000, rounds, (double) total / rounds / 1000000, (double) worst / 1000000);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 2 && strcmp(argv[1], "-p") == 0) {
+        stcpd_setpath(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc > 2 && strcmp(argv[1], "echo") == 0) return run_echo((unsigned int) atoi(argv[2]));
+    if (argc < 4 || strcmp(argv[1], "ping") != 0) {
+        printf("usage: %s [-p path] echo port\n", argv[0]);
+        printf("       %s [-p path] ping server port [procs] [rounds]\n", argv[0]);
+        return 1;
+    }
+    int nodeID = topology_getNodeIDfromname(argv[2], NULL);
+    if (nodeID < 0) {
+        printf("ping: unknown host %s\n", argv[2]);
+        return 1;
+    }
+    unsigned int port = (unsigned int) atoi(argv[3]);
+    int procs = argc > 4 ? atoi(argv[4]) : DEFAULT_PROCS;
+    int rounds = argc > 5 ? atoi(argv[5]) : DEFAULT_ROUNDS;
+    long begin = now_nano();
+    // separate processes, as separate applications would be
+    for (int i = 0; i < procs; ++i) {
+        if (fork() == 0) exit(ping(i, nodeID, port, rounds));
+    }
+    int ok = 0, status;
+    while (wait(&status) > 0) {
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) ++ok;
+    }
+    printf("ping: %d of %d applications done in %.1f ms\n", ok, procs, (double) (now_nano() - begin) / 1000000);
+    return ok == procs ? 0 : 1;
+}
@@ -0,0 +1,490 @@
+//文件名: stcpd/stcpd.c
+//
+//描述: 这个文件实现STCP守护进程. 守护进程连接到本地SIP进程, 并在同一个进程中初始化客户端和服务器的STCP库, 所以节点上所有的TCB,
+//定时器和重传都在这里, SIP进程只看到一个STCP连接. 两个库的seghandler各自从一个socketpair读取段, 一个分发线程从SIP读出段,
+//SYN和FIN交给服务器库, SYNACK和FINACK交给客户端库, DATA和DATAACK按目的端口是否是本地连接的客户端端口分发. 两个库发出的段
+//都直接写入到SIP的连接.
+//本地应用程序通过Unix套接字(默认为STCPD_PATH)使用守护进程, 请求格式见stcpd.h. 一个epoll线程以非阻塞模式驱动所有的STCP套接字:
+//每个连接有一个应用程序的Unix流套接字和STCP套接字的eventfd, 任何一个就绪时, 数据在两者之间被搬运, 直到两个方向都无法继续.
+//所以应用程序增加时, 守护进程不增加线程, 到SIP的连接也只有一个.
+
+//输入: [Unix套接字路径]
+
+//输出: 守护进程和STCP状态
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#include "../common/constants.h"
+#include "../common/seg.h"
+#include "../client/stcp_client.h"
+#include "../server/stcp_server.h"
+#include "stcpd.h"
+
+//描述符不小于它的连接被拒绝
+#define STCPD_MAX_FDS 4096
+//守护进程为所有应用程序持有连接, 每个库的最大连接数
+#define STCPD_MAX_CONN 1024
+//每个方向上在应用程序和STCP套接字之间一次搬运的字节数, 不超过SEND_BUF_SEGS个段, 所以非阻塞发送总能在发送缓冲区被确认后完成
+#define RELAY_BUF (16 * MAX_SEG_LEN)
+
+//端口的用途, 分发线程据此把DATA和DATAACK交给客户端库
+#define PORT_FREE 0
+#define PORT_CLIENT 1
+#define PORT_LISTEN 2
+
+//中继的状态
+#define R_REQUEST 0         //等待应用程序的请求
+#define R_CONNECTING 1      //客户端连接正在建立
+#define R_CLIENT 2          //客户端连接, 在应用程序和STCP套接字之间搬运数据
+#define R_SERVER 3          //服务器接受的连接, 同上
+#define R_LISTEN 4          //监听套接字, 被接受的连接传给应用程序
+#define R_DISCONNECTING 5   //应用程序已关闭且数据已被确认, 客户端连接正在断开
+
+//一个应用程序的请求和它的STCP套接字
+typedef struct relay {
+    int kind;
+    int app;                    //到应用程序的Unix流套接字, 没有时为-1
+    int sock;                   //STCP套接字, 没有时为-1
+    int efd;                    //STCP套接字的eventfd, 没有时为-1
+    unsigned int port;          //登记在portUse中的端口
+    int nodeID;                 //R_CONNECTING: 服务器节点ID
+    unsigned int serverPort;    //R_CONNECTING: 服务器端口
+    int appEof;                 //应用程序不再写入数据, 或它的套接字已关闭
+    int peerEof;                //STCP连接已断开, 接收缓冲区已读空
+    char out[RELAY_BUF];        //从STCP套接字读出, 还没有写给应用程序的数据
+    unsigned int outLen;
+    unsigned int outOff;
+    char in[RELAY_BUF];         //从应用程序读出, 还没有放入发送缓冲区的数据
+    unsigned int inLen;
+    long closeAt;               //应用程序一侧已关闭, 等待关闭STCP套接字时: 关闭的时间
+    struct relay *next;         //等待关闭STCP套接字的中继按closeAt排列的链表
+} relay_t;
+
+static int sip;
+static int epfd;
+static int unixFd;
+static int cliPair[2];          //[1]是客户端库的"SIP连接", 分发线程写入[0]
+static int srvPair[2];          //同上, 用于服务器库
+static relay_t *relays[STCPD_MAX_FDS];              //按app和efd描述符索引
+static unsigned char portUse[STCPD_MAX_PORT];       //分发线程和epoll线程都访问, 用原子操作
+static unsigned int nextEphemeral = STCPD_EPHEMERAL_BASE;
+static relay_t *lingerHead;
+
+//这个函数用于连接到本地SIP进程的端口SIP_PORT. 如果TCP连接失败, 返回-1. 连接成功, 返回TCP描述符, STCP将使用该描述符发送段.
+int connectToSIP(void) {
+    struct sockaddr_in servAddr;
+    memset(&servAddr, 0, sizeof servAddr);
+    servAddr.sin_family = AF_INET;
+    servAddr.sin_port = htons(SIP_PORT);
+    inet_pton(AF_INET, "127.0.0.1", &servAddr.sin_addr);
+    int sock_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock_fd == -1) {
+        printf("[STCPD]<connectToSIP> tcp socket error\n");
+        return -1;
+    }
+    if (connect(sock_fd, (struct sockaddr *) &servAddr, sizeof servAddr) < 0) {
+        printf("[STCPD]<connectToSIP> connection failed\n");
+        close(sock_fd);
+        return -1;
+    }
+    return sock_fd;
+}
+
+// hand every segment from SIP to the library that owns its connection
+void *demux(void *arg) {
+    superseg_t *seg = (superseg_t *) malloc(sizeof(superseg_t));
+    int src;
+    while (getsegToSend(sip, &src, seg) > 0) {
+        int to = srvPair[0];
+        unsigned int port = seg->header.dst_port;
+        switch (seg->header.type) {
+            case SYNACK:
+            case FINACK:
+                to = cliPair[0];
+                break;
+            case DATA:
+            case DATAACK:
+                if (port < STCPD_MAX_PORT && __atomic_load_n(&portUse[port], __ATOMIC_ACQUIRE) == PORT_CLIENT)
+                    to = cliPair[0];
+                break;
+            default:
+                break;
+        }
+        // SIP splits super-segments, so what it forwards is a plain segment
+        forwardsegToSTCP(to, src, (seg_t *) seg);
+    }
+    printf("[STCPD] connection to SIP is closed\n");
+    exit(1);
+}
+
+// add a descriptor of r to the epoll set
+static int watch(int fd, unsigned int events, relay_t *r) {
+    if (fd < 0 || fd >= STCPD_MAX_FDS) return -1;
+    struct epoll_event ev = {.events = events, .data.fd = fd};
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) return -1;
+    relays[fd] = r;
+    return 0;
+}
+
+static void unwatch(int fd) {
+    if (fd < 0) return;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    relays[fd] = NULL;
+}
+
+static void reply(relay_t *r, int ret) {
+    send(r->app, &ret, sizeof ret, MSG_NOSIGNAL);
+}
+
+static void port_set(unsigned int port, unsigned char use) {
+    __atomic_store_n(&portUse[port], use, __ATOMIC_RELEASE);
+}
+
+// a client port nobody uses, 0 if there is none
+static unsigned int ephemeral(void) {
+    for (unsigned int i = 0; i < STCPD_MAX_PORT - STCPD_EPHEMERAL_BASE; ++i) {
+        unsigned int port = nextEphemeral++;
+        if (nextEphemeral == STCPD_MAX_PORT) nextEphemeral = STCPD_EPHEMERAL_BASE;
+        if (portUse[port] == PORT_FREE) return port;
+    }
+    return 0;
+}
+
+// the application side goes away, the STCP socket is closed by the caller
+static void relay_detach(relay_t *r) {
+    if (r->app >= 0) {
+        unwatch(r->app);
+        close(r->app);
+        r->app = -1;
+    }
+    // the library closes the eventfd with the socket
+    unwatch(r->efd);
+    r->efd = -1;
+}
+
+static int sock_close(relay_t *r) {
+    if (r->sock < 0) return 1;
+    int ret = r->kind == R_CLIENT || r->kind == R_CONNECTING || r->kind == R_DISCONNECTING ?
+              stcp_client_close(r->sock) : stcp_server_close(r->sock);
+    if (ret < 0) return -1;
+    r->sock = -1;
+    if (r->port) port_set(r->port, PORT_FREE);
+    return 1;
+}
+
+// close the STCP socket of r after delay seconds, or retry then if it can't be closed now
+static void linger(relay_t *r, int delay) {
+    relay_detach(r);
+    r->closeAt = now_nano() + (long) delay * 1000000000;
+    relay_t **p = &lingerHead;
+    while (*p && (*p)->closeAt <= r->closeAt) p = &(*p)->next;
+    r->next = *p;
+    *p = r;
+}
+
+// close the sockets whose time has come, returns the milliseconds epoll_wait may sleep
+static int linger_expire(void) {
+    long cur_nano = now_nano();
+    while (lingerHead && lingerHead->closeAt <= cur_nano) {
+        relay_t *r = lingerHead;
+        lingerHead = r->next;
+        if (sock_close(r) < 0) linger(r, 1);
+        else free(r);
+    }
+    return lingerHead ? (int) ((lingerHead->closeAt - cur_nano) / 1000000 + 1) : -1;
+}
+
+// a socket still in a handshake is closed a second later
+static void relay_free(relay_t *r) {
+    relay_detach(r);
+    if (sock_close(r) < 0) linger(r, 1);
+    else free(r);
+}
+
+static int relay_recv(relay_t *r) {
+    return r->kind == R_CLIENT ? stcp_client_recv_some(r->sock, r->out, RELAY_BUF, 1, 0)
+                               : stcp_server_recv_some(r->sock, r->out, RELAY_BUF, 1, 0);
+}
+
+static int relay_send(relay_t *r) {
+    return r->kind == R_CLIENT ? stcp_client_send(r->sock, r->in, r->inLen)
+                               : stcp_server_send(r->sock, r->in, r->inLen);
+}
+
+static void disconnect_step(relay_t *r) {
+    if (stcp_client_disconnect(r->sock) == STCP_EAGAIN) return;
+    relay_free(r);
+}
+
+// move data both ways until neither the application nor the STCP socket can take more, then see if the connection is done
+static void pump(relay_t *r) {
+    int moved = 1;
+    while (moved) {
+        moved = 0;
+        // STCP -> application
+        if (r->outOff == r->outLen && !r->peerEof) {
+            int n = relay_recv(r);
+            if (n > 0) {
+                r->outOff = 0;
+                r->outLen = (unsigned int) n;
+            } else if (n != STCP_EAGAIN) {
+                // the connection is gone and everything it received is written, so the application reads EOF
+                r->peerEof = 1;
+                if (!r->appEof) shutdown(r->app, SHUT_WR);
+            }
+        }
+        if (r->outOff < r->outLen) {
+            ssize_t w = r->appEof ? -1 : send(r->app, r->out + r->outOff, r->outLen - r->outOff, MSG_NOSIGNAL);
+            if (w > 0) {
+                r->outOff += (unsigned int) w;
+                moved = 1;
+            } else if (r->appEof || errno != EAGAIN) {
+                // nobody reads it anymore
+                r->appEof = 1;
+                r->outOff = r->outLen;
+                moved = 1;
+            }
+        }
+        // application -> STCP
+        if (r->inLen == 0 && !r->appEof) {
+            ssize_t n = recv(r->app, r->in, RELAY_BUF, 0);
+            if (n > 0) r->inLen = (unsigned int) n;
+            else if (n == 0 || errno != EAGAIN) r->appEof = 1;
+        }
+        if (r->inLen > 0) {
+            // a connection that is gone takes the data with it
+            if (r->peerEof || relay_send(r) != STCP_EAGAIN) {
+                r->inLen = 0;
+                moved = 1;
+            }
+        }
+    }
+    if (!r->appEof || r->inLen > 0) return;
+    if (r->kind == R_CLIENT && !r->peerEof) {
+        // disconnecting drops what is not acknowledged yet, so it waits for the last ACK
+        stcp_stats_t s;
+        if (stcp_client_getstats(r->sock, &s) < 0 || s.sendQueued > 0) return;
+        r->kind = R_DISCONNECTING;
+        disconnect_step(r);
+    } else if (r->peerEof) {
+        // the server keeps the connection in CLOSEWAIT for a while so that the FIN of the client can be answered again
+        linger(r, r->kind == R_SERVER ? CLOSEWAIT_TIMEOUT + 1 : 0);
+    }
+}
+
+static void connect_step(relay_t *r) {
+    int ret = stcp_client_connect(r->sock, r->nodeID, r->serverPort);
+    if (ret == STCP_EAGAIN) return;
+    reply(r, ret == 1 ? 1 : -1);
+    if (ret != 1) {
+        relay_free(r);
+        return;
+    }
+    r->kind = R_CLIENT;
+    pump(r);
+}
+
+// pass the connections the listening socket accepted to the application
+static void accept_step(relay_t *lr) {
+    int child;
+    while ((child = stcp_server_accept(lr->sock)) >= 0) {
+        relay_t *r = (relay_t *) calloc(1, sizeof(relay_t));
+        r->kind = R_SERVER;
+        r->sock = child;
+        r->app = r->efd = -1;
+        int sv[2];
+        // only the end of the daemon is non-blocking, the application gets an ordinary descriptor
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == 0) {
+            fcntl(sv[0], F_SETFL, O_NONBLOCK);
+            char byte = 0;
+            char ctrl[CMSG_SPACE(sizeof(int))];
+            struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+            struct msghdr msg;
+            memset(&msg, 0, sizeof msg);
+            memset(ctrl, 0, sizeof ctrl);
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = ctrl;
+            msg.msg_controllen = sizeof ctrl;
+            struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+            cm->cmsg_level = SOL_SOCKET;
+            cm->cmsg_type = SCM_RIGHTS;
+            cm->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(cm), &sv[1], sizeof(int));
+            // an application that does not take it leaves the connection without a reader
+            if (sendmsg(lr->app, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) r->appEof = 1;
+            close(sv[1]);
+            r->app = sv[0];
+        } else r->appEof = 1;
+        r->efd = stcp_server_eventfd(child);
+        if ((r->app >= 0 && watch(r->app, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, r) < 0) ||
+            watch(r->efd, EPOLLIN, r) < 0) {
+            // without its eventfd the connection is only closed, once the client disconnects
+            printf("[STCPD] too many connections, dropping socket %d\n", child);
+            linger(r, 1);
+            continue;
+        }
+        pump(r);
+    }
+}
+
+static int request_connect(relay_t *r, stcpd_req_t *req) {
+    unsigned int port = req->clientPort ? req->clientPort : ephemeral();
+    if (port == 0 || port >= STCPD_MAX_PORT || portUse[port] != PORT_FREE) return -1;
+    r->sock = stcp_client_sock(port);
+    if (r->sock < 0) return -1;
+    // DATA for the port goes to the client library from the SYNACK on
+    r->kind = R_CONNECTING;
+    r->port = port;
+    port_set(port, PORT_CLIENT);
+    r->nodeID = req->nodeID;
+    r->serverPort = req->serverPort;
+    stcp_client_setopt(r->sock, STCP_OPT_NONBLOCK, 1);
+    r->efd = stcp_client_eventfd(r->sock);
+    if (watch(r->efd, EPOLLIN, r) < 0) return -1;
+    connect_step(r);
+    return 1;
+}
+
+static int request_listen(relay_t *r, stcpd_req_t *req) {
+    unsigned int port = req->serverPort;
+    if (port == 0 || port >= STCPD_MAX_PORT || portUse[port] != PORT_FREE) return -1;
+    r->sock = stcp_server_sock(port);
+    if (r->sock < 0) return -1;
+    r->kind = R_LISTEN;
+    r->port = port;
+    port_set(port, PORT_LISTEN);
+    stcp_server_setopt(r->sock, STCP_OPT_NONBLOCK, 1);
+    if (stcp_server_listen(r->sock, ACCEPT_BACKLOG) < 0) return -1;
+    r->efd = stcp_server_eventfd(r->sock);
+    if (watch(r->efd, EPOLLIN, r) < 0) return -1;
+    reply(r, 1);
+    accept_step(r);
+    return 1;
+}
+
+static void handle_request(relay_t *r) {
+    stcpd_req_t req;
+    ssize_t n = recv(r->app, &req, sizeof req, 0);
+    if (n < 0 && errno == EAGAIN) return;
+    int ret = -1;
+    if (n == sizeof req) {
+        if (req.op == STCPD_CONNECT) ret = request_connect(r, &req);
+        else if (req.op == STCPD_LISTEN) ret = request_listen(r, &req);
+    }
+    if (ret < 0) {
+        reply(r, -1);
+        relay_free(r);
+    }
+}
+
+static void handle_event(int fd) {
+    relay_t *r = relays[fd];
+    if (r == NULL) return;
+    if (fd == r->efd) {
+        uint64_t count;
+        if (read(fd, &count, sizeof count) < 0 && errno != EAGAIN) return;
+    }
+    switch (r->kind) {
+        case R_REQUEST:
+            handle_request(r);
+            break;
+        case R_CONNECTING:
+            // calling connect again before the eventfd fires only returns STCP_EAGAIN
+            if (fd == r->efd) connect_step(r);
+            break;
+        case R_CLIENT:
+        case R_SERVER:
+            pump(r);
+            break;
+        case R_DISCONNECTING:
+            if (fd == r->efd) disconnect_step(r);
+            break;
+        case R_LISTEN:
+            if (fd == r->efd) accept_step(r);
+            else {
+                // the application never writes to the listening descriptor, so it is readable only when closed
+                char byte;
+                ssize_t n = recv(r->app, &byte, 1, 0);
+                if (n == 0 || (n < 0 && errno != EAGAIN)) relay_free(r);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// take the new connections of local applications, each first sends a request
+static void handle_accept(void) {
+    int fd;
+    while ((fd = accept4(unixFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        relay_t *r = (relay_t *) calloc(1, sizeof(relay_t));
+        r->kind = R_REQUEST;
+        r->app = fd;
+        r->sock = r->efd = -1;
+        if (watch(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, r) < 0) {
+            close(fd);
+            free(r);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : STCPD_PATH;
+    signal(SIGPIPE, SIG_IGN);
+
+    sip = connectToSIP();
+    if (sip < 0) {
+        printf("[STCPD] fail to connect to the local SIP process\n");
+        exit(1);
+    }
+    // each library reads its own socketpair, both write to SIP directly
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, cliPair) < 0 || socketpair(AF_UNIX, SOCK_STREAM, 0, srvPair) < 0) {
+        printf("[STCPD] socketpair error\n");
+        exit(1);
+    }
+    stcp_client_init(cliPair[1]);
+    stcp_server_init(srvPair[1]);
+    stcp_client_setmaxconn(STCPD_MAX_CONN);
+    stcp_server_setmaxconn(STCPD_MAX_CONN);
+    stream_setconn(sip);
+
+    unixFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof addr.sun_path - 1);
+    unlink(path);
+    if (unixFd < 0 || bind(unixFd, (struct sockaddr *) &addr, sizeof addr) < 0 || listen(unixFd, SOMAXCONN) < 0) {
+        printf("[STCPD] can't listen on %s\n", path);
+        exit(1);
+    }
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = unixFd};
+    epoll_ctl(epfd, EPOLL_CTL_ADD, unixFd, &ev);
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, demux, NULL);
+    printf("[STCPD] serving applications on %s\n", path);
+
+    struct epoll_event events[64];
+    while (1) {
+        int n = epoll_wait(epfd, events, 64, linger_expire());
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd == unixFd) handle_accept();
+            else handle_event(events[i].data.fd);
+        }
+    }
+}
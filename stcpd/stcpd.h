@@ -0,0 +1,72 @@
+//
+// 文件名: stcpd.h
+//
+// 描述: 这个文件包含STCP守护进程的请求格式和本地应用程序使用的接口定义. 守护进程stcpd是节点上唯一连接到SIP进程的STCP进程,
+// 它同时运行客户端和服务器的STCP库, 拥有所有的TCB, 定时器和重传. 应用程序不再链接STCP库, 而是通过Unix套接字STCPD_PATH连接到守护进程:
+// 每个STCP连接对应一个Unix流套接字, 应用程序写入它的数据由守护进程发给对端, 对端发来的数据由守护进程写入它.
+// 所以节点上的多个应用程序可以同时使用网络, 而SIP进程始终只有一个STCP连接.
+
+#ifndef STCPD_H
+#define STCPD_H
+
+//守护进程默认监听的Unix套接字路径
+#define STCPD_PATH "/tmp/stcpd.sock"
+
+//请求类型
+#define STCPD_CONNECT 1     //建立到服务器的连接, 此后Unix套接字就是这个连接
+#define STCPD_LISTEN 2      //在服务器端口上监听, 此后每个被接受的连接以一个Unix套接字描述符的形式经这个Unix套接字传给应用程序
+
+//守护进程为没有指定客户端端口的连接分配的端口从这里开始
+#define STCPD_EPHEMERAL_BASE 30000
+//客户端端口和服务器端口必须小于它
+#define STCPD_MAX_PORT 65536
+
+//应用程序连接到守护进程后发送的请求, 守护进程回复一个int: 成功时为1, 否则为-1.
+typedef struct stcpd_req {
+	int op;                     //STCPD_CONNECT或STCPD_LISTEN
+	unsigned int clientPort;    //STCPD_CONNECT: 客户端端口, 0表示由守护进程分配
+	int nodeID;                 //STCPD_CONNECT: 服务器的节点ID
+	unsigned int serverPort;    //服务器端口
+} stcpd_req_t;
+
+//
+//  用于本地应用程序的STCP守护进程API.
+//  ===================================
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+void stcpd_setpath(const char* path);
+
+// 这个函数修改以下函数连接的守护进程的Unix套接字路径, 默认为STCPD_PATH. 同一台主机上运行多个守护进程时使用.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcpd_connect(unsigned int client_port, int nodeID, unsigned int server_port);
+
+// 这个函数请求守护进程从客户端端口client_port(为0时由守护进程分配)连接到节点nodeID的服务器端口server_port, 并等待连接建立.
+// 成功时返回一个Unix流套接字描述符, 应用程序像使用TCP套接字一样用read()/write()在它上面收发数据. 关闭它时, 守护进程在已写入的数据
+// 全部被服务器确认后断开STCP连接; 服务器已发出但还没有被读出的数据被丢弃. 连接失败或守护进程不可用时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcpd_listen(unsigned int server_port);
+
+// 这个函数请求守护进程在服务器端口server_port上监听. 成功时返回一个监听描述符, 用它调用stcpd_accept()接受连接, 关闭它时守护进程
+// 关闭监听套接字. 端口已被占用或守护进程不可用时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+int stcpd_accept(int listen_fd);
+
+// 这个函数等待守护进程接受的下一个连接, 返回它的Unix流套接字描述符. 守护进程一接受连接就把它传给应用程序, 所以尚未被stcpd_accept()
+// 取出的连接已经在接收数据. 客户端断开连接后, 读这个描述符返回0. 服务器不能主动断开连接, 应用程序关闭描述符后,
+// 守护进程丢弃客户端此后发来的数据直到客户端断开连接. 监听描述符被守护进程关闭时返回-1.
+//
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+
+#endif
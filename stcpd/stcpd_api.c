@@ -0,0 +1,70 @@
+//文件名: stcpd/stcpd_api.c
+//
+//描述: 这个文件实现本地应用程序使用的STCP守护进程API. 每个请求使用一个新的到守护进程的Unix流套接字, 请求成功后它就是STCP连接
+//或监听描述符本身, 所以应用程序可以把它直接交给poll/epoll.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "stcpd.h"
+
+static const char *stcpdPath = STCPD_PATH;
+
+void stcpd_setpath(const char *path) {
+    stcpdPath = path;
+}
+
+// send one request on a new connection to the daemon, returns the connection or -1 if the daemon refused it
+static int stcpd_request(stcpd_req_t *req) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, stcpdPath, sizeof addr.sun_path - 1);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+        printf("[STCPD]<stcpd_request> can't connect to %s\n", stcpdPath);
+        close(fd);
+        return -1;
+    }
+    int ret;
+    // the daemon replies once the connection is made or the port is bound
+    if (send(fd, req, sizeof(stcpd_req_t), MSG_NOSIGNAL) != sizeof(stcpd_req_t) ||
+        recv(fd, &ret, sizeof ret, MSG_WAITALL) != sizeof ret || ret < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int stcpd_connect(unsigned int client_port, int nodeID, unsigned int server_port) {
+    stcpd_req_t req = {.op = STCPD_CONNECT, .clientPort = client_port, .nodeID = nodeID, .serverPort = server_port};
+    return stcpd_request(&req);
+}
+
+int stcpd_listen(unsigned int server_port) {
+    stcpd_req_t req = {.op = STCPD_LISTEN, .serverPort = server_port};
+    return stcpd_request(&req);
+}
+
+int stcpd_accept(int listen_fd) {
+    char byte;
+    char ctrl[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof ctrl;
+    // every accepted connection comes as one byte carrying its descriptor
+    if (recvmsg(listen_fd, &msg, MSG_CMSG_CLOEXEC) <= 0) return -1;
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (cm == NULL || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) return -1;
+    int fd;
+    memcpy(&fd, CMSG_DATA(cm), sizeof fd);
+    return fd;
+}